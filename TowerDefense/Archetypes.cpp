@@ -0,0 +1,241 @@
+#include "Archetypes.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+bool ParseMonsterArchetype(std::istream& line, MonsterArchetypes& monsters)
+{
+	std::string name;
+	float speed = -1.0f;
+	int64_t health = -1;
+	int64_t damage = -1;
+
+	line >> name;
+	std::string key;
+	while (line >> key)
+	{
+		if (key == "speed")
+		{
+			line >> speed;
+		}
+		else if (key == "health")
+		{
+			line >> health;
+		}
+		else if (key == "damage")
+		{
+			line >> damage;
+		}
+		else
+		{
+			std::cerr << "Unknown monster key '" << key << "'" << std::endl;
+			return false;
+		}
+	}
+
+	if (line.fail() && !line.eof())
+	{
+		return false;
+	}
+	if (name.empty() || speed < 0.0f || health <= 0 || damage < 0)
+	{
+		std::cerr << "Monster '" << name << "' needs speed, health and damage" << std::endl;
+		return false;
+	}
+
+	monsters.name.push_back(name);
+	monsters.speed.push_back(speed);
+	monsters.max_health.push_back(Health({ (uint32_t)health }));
+	monsters.damage.push_back(Damage({ (uint32_t)damage }));
+	return true;
+}
+
+bool ParseTowerArchetype(std::istream& line, TowerArchetypes& towers)
+{
+	std::string name;
+	float range = -1.0f;
+	float rate = -1.0f;
+	int64_t damage = -1;
+	std::string projectile;
+	float splash = 0.0f;
+	int64_t jumps = 0;
+	float hop = 0.0f;
+	OnHitEffect effect = { STATUS_NONE, 0.0f, 0.0f };
+
+	line >> name;
+	std::string key;
+	while (line >> key)
+	{
+		if (key == "range")
+		{
+			line >> range;
+		}
+		else if (key == "rate")
+		{
+			line >> rate;
+		}
+		else if (key == "damage")
+		{
+			line >> damage;
+		}
+		else if (key == "projectile")
+		{
+			line >> projectile;
+		}
+		else if (key == "splash")
+		{
+			line >> splash;
+		}
+		else if (key == "jumps")
+		{
+			line >> jumps;
+		}
+		else if (key == "hop")
+		{
+			line >> hop;
+		}
+		else if (key == "effect")
+		{
+			std::string type;
+			line >> type >> effect.magnitude >> effect.duration;
+			if (type == "slow")
+			{
+				effect.type = STATUS_SLOW;
+			}
+			else if (type == "burn")
+			{
+				effect.type = STATUS_BURN;
+			}
+			else if (type == "poison")
+			{
+				effect.type = STATUS_POISON;
+			}
+			else
+			{
+				std::cerr << "Unknown effect '" << type << "'" << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown tower key '" << key << "'" << std::endl;
+			return false;
+		}
+	}
+
+	if (line.fail() && !line.eof())
+	{
+		return false;
+	}
+	if (name.empty() || range < 0.0f || rate <= 0.0f || damage < 0)
+	{
+		std::cerr << "Tower '" << name << "' needs range, rate and damage" << std::endl;
+		return false;
+	}
+	if (splash < 0.0f || jumps < 0 || hop < 0.0f || (effect.type != STATUS_NONE && (effect.magnitude < 0.0f || effect.duration <= 0.0f)))
+	{
+		std::cerr << "Tower '" << name << "' has a negative splash, jumps, hop or effect" << std::endl;
+		return false;
+	}
+
+	ProjectileType type;
+	if (projectile == "homing")
+	{
+		type = PROJECTILE_HOMING;
+	}
+	else if (projectile == "piercing")
+	{
+		type = PROJECTILE_PIERCING;
+	}
+	else if (projectile == "chain" && jumps > 0)
+	{
+		type = PROJECTILE_CHAIN;
+	}
+	else
+	{
+		std::cerr << "Tower '" << name << "' needs projectile homing, piercing or chain (with jumps)" << std::endl;
+		return false;
+	}
+
+	towers.name.push_back(name);
+	towers.range.push_back(AttackRange({ range }));
+	towers.attack_rate.push_back(AttackRate({ rate }));
+	towers.damage.push_back(Damage({ (uint32_t)damage }));
+	towers.projectile.push_back(type);
+	towers.splash.push_back(SplashRadius({ splash }));
+	towers.chain.push_back(Chain({ (uint32_t)jumps, hop }));
+	towers.effect.push_back(effect);
+	return true;
+}
+
+bool LoadArchetypes(const std::string& path, Archetypes& archetypes)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+
+	archetypes = Archetypes();
+
+	std::string text;
+	uint32_t line_number = 0;
+	while (std::getline(file, text))
+	{
+		++line_number;
+		const size_t comment = text.find('#');
+		if (comment != std::string::npos)
+		{
+			text.erase(comment);
+		}
+
+		std::istringstream line(text);
+		std::string kind;
+		if (!(line >> kind))
+		{
+			continue;
+		}
+
+		bool ok = false;
+		if (kind == "monster")
+		{
+			ok = ParseMonsterArchetype(line, archetypes.monsters);
+		}
+		else if (kind == "tower")
+		{
+			ok = ParseTowerArchetype(line, archetypes.towers);
+		}
+		else
+		{
+			std::cerr << "Unknown archetype kind '" << kind << "'" << std::endl;
+		}
+
+		if (!ok)
+		{
+			std::cerr << path << ":" << line_number << ": invalid archetype" << std::endl;
+			return false;
+		}
+	}
+
+	if (archetypes.monsters.name.empty() || archetypes.towers.name.empty())
+	{
+		std::cerr << path << ": needs at least one monster and one tower" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t FindArchetype(const std::vector<std::string>& names, const std::string& name)
+{
+	for (uint32_t i = 0; i < names.size(); ++i)
+	{
+		if (names[i] == name)
+		{
+			return i;
+		}
+	}
+	return INVALID_ARCHETYPE;
+}
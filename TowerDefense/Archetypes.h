@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Components.h"
+
+#include <vector>
+#include <string>
+#include <istream>
+
+//
+// Archetype tables, the data driven stats of every kind of Monster and Tower.
+//
+// Tables are loaded once at startup from a text file and stored as one contiguous
+// array per stat, indexed by archetype id. Entities only carry their small archetype id,
+// so stats shared by every Monster or Tower of a kind are stored once, not per entity.
+//
+// File format, one archetype per line, '#' starts a comment:
+//   monster <name> speed <pixels/s> health <hp> damage <player damage>
+//   tower <name> range <pixels> rate <seconds> damage <hp> projectile <homing|piercing|chain>
+//         [splash <pixels>] [jumps <count> hop <pixels>] [effect <slow|burn|poison> <magnitude> <seconds>]
+// Ids are assigned in file order starting at 0.
+//
+
+const uint32_t INVALID_ARCHETYPE = 0xFFFFFFFF;
+
+struct MonsterArchetypes
+{
+	std::vector<std::string> name;
+	std::vector<float> speed;				// Pixels per second.
+	std::vector<Health> max_health;
+	std::vector<Damage> damage;				// Dealt to the player on reaching the last Waypoint.
+};
+
+struct TowerArchetypes
+{
+	std::vector<std::string> name;
+	std::vector<AttackRange> range;
+	std::vector<AttackRate> attack_rate;
+	std::vector<Damage> damage;
+	std::vector<ProjectileType> projectile;
+	std::vector<SplashRadius> splash;
+	std::vector<Chain> chain;
+	std::vector<OnHitEffect> effect;
+};
+
+struct Archetypes
+{
+	MonsterArchetypes monsters;
+	TowerArchetypes towers;
+};
+
+// Returns false (after printing why to std::cerr) if the file is missing, malformed,
+// or does not define at least one Monster and one Tower.
+bool LoadArchetypes(const std::string& path, Archetypes& archetypes);
+
+// Parse the rest of a single "monster" or "tower" line (everything after the kind) and append it.
+bool ParseMonsterArchetype(std::istream& line, MonsterArchetypes& monsters);
+bool ParseTowerArchetype(std::istream& line, TowerArchetypes& towers);
+
+// Index of the archetype called name, or INVALID_ARCHETYPE.
+uint32_t FindArchetype(const std::vector<std::string>& names, const std::string& name);
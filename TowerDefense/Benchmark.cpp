@@ -0,0 +1,270 @@
+#include "Benchmark.h"
+#include "Combat.h"
+#include "SpatialGrid.h"
+#include "TowerMesh.h"
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iostream>
+
+const uint32_t BENCHMARK_MONSTERS = 4000;
+const uint32_t BENCHMARK_TOWERS = 2000;
+const uint32_t BENCHMARK_FRAMES = 900;
+const uint32_t BENCHMARK_REPETITIONS = 11;
+const float BENCHMARK_DELTA_TIME = 1.0f / 60.0f;
+const float BENCHMARK_WIDTH = 1600.0f;
+const float BENCHMARK_HEIGHT = 900.0f;
+
+// Seconds between attacks of every Tower archetype while comparing the generic and specialized
+// systems, short enough that firing and Bullets, not counting down reloads, take the time.
+const float BENCHMARK_ATTACK_RATE = 0.1f;
+
+// A Tower is placed every this many frames while measuring change tracking.
+const uint32_t BENCHMARK_PLACEMENT_INTERVAL = 60;
+
+struct BenchmarkResult
+{
+	double seconds;
+	uint64_t damage_events;
+	uint64_t splash_queries;
+};
+
+static double Median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+static BenchmarkResult RunGeneric(const Archetypes& archetypes, const std::vector<Monster>& monsters, const SpatialGrid& spatial_grid,
+								  std::vector<Tower> towers)
+{
+	std::vector<Bullet> bullets;
+	std::vector<LightningArc> arcs;
+	HitQueue hits;
+	BenchmarkResult result = { 0.0, 0, 0 };
+
+	const auto start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		ClearHits(hits);
+		arcs.clear();
+
+		for (uint32_t i = 0; i < towers.size(); ++i)
+		{
+			UpdateTower(towers[i], BENCHMARK_DELTA_TIME, archetypes.towers, monsters, spatial_grid, bullets, hits, arcs);
+		}
+		for (uint32_t i = 0; i < bullets.size(); ++i)
+		{
+			if (!UpdateBullet(bullets[i], BENCHMARK_DELTA_TIME, archetypes.towers, monsters, spatial_grid, hits))
+			{
+				bullets[i] = bullets.back();
+				bullets.pop_back();
+				--i;
+			}
+		}
+
+		result.damage_events += hits.damage.size();
+		result.splash_queries += hits.splash_queries.size();
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return result;
+}
+
+static BenchmarkResult RunSpecialized(const Archetypes& archetypes, const std::vector<Monster>& monsters, const SpatialGrid& spatial_grid,
+									  const std::vector<Tower>& towers)
+{
+	KernelRegistry registry;
+	BuildKernelRegistry(archetypes.towers, registry);
+
+	std::vector<TowerBlock> blocks;
+	InitTowerBlocks(archetypes.towers, blocks);
+	for (uint32_t i = 0; i < towers.size(); ++i)
+	{
+		AddTower(blocks[towers[i].archetype], towers[i].position);
+	}
+
+	std::vector<LightningArc> arcs;
+	HitQueue hits;
+	BenchmarkResult result = { 0.0, 0, 0 };
+
+	const auto start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		ClearHits(hits);
+		arcs.clear();
+
+		UpdateTowerBlocks(registry, blocks, archetypes.towers, BENCHMARK_DELTA_TIME, monsters, spatial_grid, hits, arcs);
+		UpdateBulletBlocks(registry, blocks, archetypes.towers, BENCHMARK_DELTA_TIME, monsters, spatial_grid, hits);
+
+		result.damage_events += hits.damage.size();
+		result.splash_queries += hits.splash_queries.size();
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return result;
+}
+
+// Tower meshes rebuilt every frame vs rewritten only for changed Towers, with a Tower placed now and then.
+// The bookkeeping alone (marking and consuming changes with nothing to do for them) is timed separately.
+static void RunChangeTracking(const Archetypes& archetypes, const std::vector<Tower>& towers, ResultsReporter& report)
+{
+	std::vector<TowerBlock> blocks;
+	InitTowerBlocks(archetypes.towers, blocks);
+	for (uint32_t i = 0; i < towers.size(); ++i)
+	{
+		AddTower(blocks[towers[i].archetype], towers[i].position);
+	}
+
+	std::vector<TowerMesh> meshes(blocks.size());
+	for (uint32_t i = 0; i < meshes.size(); ++i)
+	{
+		InitTowerMesh(meshes[i], BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+	}
+
+	// Identical copies so all three runs place the same Towers.
+	std::vector<TowerBlock> full_blocks = blocks;
+	std::vector<TowerBlock> tracked_blocks = blocks;
+	std::vector<TowerBlock> bookkeeping_blocks = blocks;
+	uint64_t consumed = 0;
+
+	const auto full_start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		if (frame % BENCHMARK_PLACEMENT_INTERVAL == 0)
+		{
+			AddTower(full_blocks[frame % full_blocks.size()], towers[frame % towers.size()].position);
+		}
+		for (uint32_t b = 0; b < full_blocks.size(); ++b)
+		{
+			RebuildTowerMesh(meshes[b], full_blocks[b], archetypes.towers);
+		}
+	}
+	const double full = std::chrono::duration<double>(std::chrono::steady_clock::now() - full_start).count();
+
+	const auto tracked_start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		if (frame % BENCHMARK_PLACEMENT_INTERVAL == 0)
+		{
+			AddTower(tracked_blocks[frame % tracked_blocks.size()], towers[frame % towers.size()].position);
+		}
+		for (uint32_t b = 0; b < tracked_blocks.size(); ++b)
+		{
+			UpdateTowerMesh(meshes[b], tracked_blocks[b], archetypes.towers);
+		}
+	}
+	const double tracked = std::chrono::duration<double>(std::chrono::steady_clock::now() - tracked_start).count();
+
+	const auto bookkeeping_start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		if (frame % BENCHMARK_PLACEMENT_INTERVAL == 0)
+		{
+			AddTower(bookkeeping_blocks[frame % bookkeeping_blocks.size()], towers[frame % towers.size()].position);
+		}
+		for (uint32_t b = 0; b < bookkeeping_blocks.size(); ++b)
+		{
+			ConsumeChanges(bookkeeping_blocks[b].changes, CONSUMER_RENDER, [&](uint32_t) { ++consumed; });
+		}
+	}
+	const double bookkeeping = std::chrono::duration<double>(std::chrono::steady_clock::now() - bookkeeping_start).count();
+
+	std::cout << "Tower mesh rebuilt:  " << full * 1000.0 / BENCHMARK_FRAMES << " ms/frame" << std::endl;
+	std::cout << "Tower mesh tracked:  " << tracked * 1000.0 / BENCHMARK_FRAMES << " ms/frame" << std::endl;
+	std::cout << "Change bookkeeping:  " << bookkeeping * 1000.0 / BENCHMARK_FRAMES << " ms/frame, "
+			  << 100.0 * bookkeeping / (full - tracked + bookkeeping) << "% of the time saved, "
+			  << consumed << " changes" << std::endl;
+
+	AddResult(report, "mesh_rebuilt_ms", full * 1000.0 / BENCHMARK_FRAMES);
+	AddResult(report, "mesh_tracked_ms", tracked * 1000.0 / BENCHMARK_FRAMES);
+	AddResult(report, "change_bookkeeping_ms", bookkeeping * 1000.0 / BENCHMARK_FRAMES);
+}
+
+int RunBenchmark(const Archetypes& archetypes, ResultsReporter& report)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> x(0.0f, BENCHMARK_WIDTH);
+	std::uniform_real_distribution<float> y(0.0f, BENCHMARK_HEIGHT);
+
+	// Monsters stand still and take no damage so every frame does the same amount of work.
+	std::vector<Monster> monsters;
+	for (uint32_t i = 0; i < BENCHMARK_MONSTERS; ++i)
+	{
+		const uint32_t archetype = i % (uint32_t)archetypes.monsters.name.size();
+		monsters.emplace_back(Monster({ i,											// Id
+										archetypes.monsters.max_health[archetype],	// Health
+										x(random), y(random),						// Position
+										0.0f, 0.0f,									// Velocity
+										0,											// Waypoint Index
+										archetype,									// Archetype
+										0xFFFFFFFF, 0, 0,							// Route
+										1.0f }));									// Speed Multiplier
+	}
+
+	std::vector<Tower> towers;
+	for (uint32_t i = 0; i < BENCHMARK_TOWERS; ++i)
+	{
+		towers.emplace_back(Tower({ x(random), y(random),								// Position
+									0.0f,												// Timer
+									i % (uint32_t)archetypes.towers.name.size() }));	// Archetype
+	}
+
+	SpatialGrid spatial_grid;
+	InitSpatialGrid(spatial_grid, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, MONSTER_SIZE);
+	BuildSpatialGrid(spatial_grid, monsters);
+
+	std::cout << "Benchmark: " << BENCHMARK_MONSTERS << " Monsters, " << BENCHMARK_TOWERS << " Towers, "
+			  << BENCHMARK_FRAMES << " frames, median of " << BENCHMARK_REPETITIONS << std::endl;
+
+	// Every Tower fires every few frames, so the comparison is of the firing and Bullet loops.
+	Archetypes firing = archetypes;
+	for (AttackRate& rate : firing.towers.attack_rate)
+	{
+		rate.value = BENCHMARK_ATTACK_RATE;
+	}
+
+	// Alternating, so anything else slowing the machine down hits both about equally.
+	std::vector<double> generic_seconds;
+	std::vector<double> specialized_seconds;
+	std::vector<double> speedups;
+	BenchmarkResult generic;
+	BenchmarkResult specialized;
+	bool agree = true;
+	for (uint32_t i = 0; i < BENCHMARK_REPETITIONS; ++i)
+	{
+		generic = RunGeneric(firing, monsters, spatial_grid, towers);
+		specialized = RunSpecialized(firing, monsters, spatial_grid, towers);
+		generic_seconds.push_back(generic.seconds);
+		specialized_seconds.push_back(specialized.seconds);
+		speedups.push_back(generic.seconds / specialized.seconds);
+		agree = agree && generic.damage_events == specialized.damage_events && generic.splash_queries == specialized.splash_queries;
+	}
+	const double generic_median = Median(generic_seconds);
+	const double specialized_median = Median(specialized_seconds);
+	const double speedup = generic_median / specialized_median;
+
+	std::cout << "Generic:     " << generic_median * 1000.0 / BENCHMARK_FRAMES << " ms/frame, "
+			  << generic.damage_events << " hits, " << generic.splash_queries << " splashes" << std::endl;
+	std::cout << "Specialized: " << specialized_median * 1000.0 / BENCHMARK_FRAMES << " ms/frame, "
+			  << specialized.damage_events << " hits, " << specialized.splash_queries << " splashes" << std::endl;
+	std::cout << "Speedup:     " << speedup << "x of the medians, single runs " << *std::min_element(speedups.begin(), speedups.end()) << "x to "
+			  << *std::max_element(speedups.begin(), speedups.end()) << "x" << std::endl;
+
+	AddResult(report, "generic_ms", generic_median * 1000.0 / BENCHMARK_FRAMES);
+	AddResult(report, "specialized_ms", specialized_median * 1000.0 / BENCHMARK_FRAMES);
+	AddResult(report, "speedup", speedup);
+	AddResult(report, "hits", (double)specialized.damage_events);
+
+	RunChangeTracking(archetypes, towers, report);
+
+	if (!agree)
+	{
+		std::cerr << "Benchmark: generic and specialized systems disagree" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
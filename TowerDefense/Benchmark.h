@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Archetypes.h"
+#include "Results.h"
+
+//
+// Headless benchmark of the Tower and Bullet systems (run with --benchmark).
+//
+// Builds a fixed scene (same seed every run) of stationary Monsters and Towers of every
+// archetype, then steps it for a fixed number of frames twice: once with the generic
+// UpdateTower()/UpdateBullet() loop over flat vectors and once with the per archetype
+// kernels from the KernelRegistry. Both runs start from identical state, so they must
+// queue the same number of hits, which is checked before the timings are printed.
+// Every archetype's attack rate is shortened so Towers spend the frames firing and tracking
+// Bullets rather than reloading, and the pair is repeated, alternating, with the medians
+// compared, since a single run is well within the noise of a busy machine.
+//
+// Then times keeping the Tower meshes up to date by rebuilding them every frame against
+// rewriting only the Towers their ChangeTrackers report, and the cost of that tracking alone.
+//
+
+// Adds its timings to report. Returns 0 on success, 1 if the two versions disagree.
+int RunBenchmark(const Archetypes& archetypes, ResultsReporter& report);
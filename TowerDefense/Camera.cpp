@@ -0,0 +1,99 @@
+#include "Camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Keeps the view inside the world on an axis, or centered on it if the view is larger.
+static float ClampAxis(float center, float half_view, float world)
+{
+	if (half_view * 2.0f >= world)
+	{
+		return world / 2.0f;
+	}
+	return std::max(half_view, std::min(center, world - half_view));
+}
+
+static void ApplyCamera(Camera& camera)
+{
+	const sf::Vector2f size = camera.window_size * camera.zoom;
+	camera.center.x = ClampAxis(camera.center.x, size.x / 2.0f, camera.world_size.x);
+	camera.center.y = ClampAxis(camera.center.y, size.y / 2.0f, camera.world_size.y);
+	camera.view.setSize(size);
+	camera.view.setCenter(camera.center);
+}
+
+void InitCamera(Camera& camera, float window_width, float window_height, float world_width, float world_height)
+{
+	camera.window_size = sf::Vector2f(window_width, window_height);
+	camera.world_size = sf::Vector2f(world_width, world_height);
+	camera.center = camera.window_size * 0.5f;
+	camera.zoom = 1.0f;
+	camera.max_zoom = std::max(1.0f, std::max(world_width / window_width, world_height / window_height));
+	camera.dragging = false;
+	camera.drag_from = sf::Vector2i(0, 0);
+	ApplyCamera(camera);
+}
+
+bool HandleCameraEvent(Camera& camera, const sf::Event& event)
+{
+	if (event.type == sf::Event::MouseWheelScrolled && event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel)
+	{
+		// The world position under the cursor stays under it.
+		const sf::Vector2i pixel(event.mouseWheelScroll.x, event.mouseWheelScroll.y);
+		const sf::Vector2f anchor = CameraToWorld(camera, pixel);
+		const float zoom = camera.zoom * powf(CAMERA_ZOOM_STEP, -event.mouseWheelScroll.delta);
+		camera.zoom = std::max(CAMERA_MIN_ZOOM, std::min(zoom, camera.max_zoom));
+		camera.center = anchor - (sf::Vector2f(pixel) - camera.window_size * 0.5f) * camera.zoom;
+		ApplyCamera(camera);
+		return true;
+	}
+	if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Middle)
+	{
+		camera.dragging = true;
+		camera.drag_from = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+		return true;
+	}
+	if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Middle)
+	{
+		camera.dragging = false;
+		return true;
+	}
+	if (event.type == sf::Event::MouseMoved && camera.dragging)
+	{
+		const sf::Vector2i to(event.mouseMove.x, event.mouseMove.y);
+		camera.center = camera.center + sf::Vector2f(camera.drag_from - to) * camera.zoom;
+		camera.drag_from = to;
+		ApplyCamera(camera);
+		return true;
+	}
+	return false;
+}
+
+bool UpdateCamera(Camera& camera, float seconds)
+{
+	sf::Vector2f direction(0.0f, 0.0f);
+	direction.x -= sf::Keyboard::isKeyPressed(sf::Keyboard::Left) ? 1.0f : 0.0f;
+	direction.x += sf::Keyboard::isKeyPressed(sf::Keyboard::Right) ? 1.0f : 0.0f;
+	direction.y -= sf::Keyboard::isKeyPressed(sf::Keyboard::Up) ? 1.0f : 0.0f;
+	direction.y += sf::Keyboard::isKeyPressed(sf::Keyboard::Down) ? 1.0f : 0.0f;
+	if (direction.x == 0.0f && direction.y == 0.0f)
+	{
+		return false;
+	}
+
+	// Pans at the same speed across the window whatever the zoom.
+	camera.center = camera.center + direction * (CAMERA_PAN_SPEED * camera.zoom * seconds);
+	ApplyCamera(camera);
+	return true;
+}
+
+sf::Vector2f CameraToWorld(const Camera& camera, sf::Vector2i pixel)
+{
+	return camera.center + (sf::Vector2f(pixel) - camera.window_size * 0.5f) * camera.zoom;
+}
+
+sf::FloatRect CameraBounds(const Camera& camera)
+{
+	const sf::Vector2f size = camera.window_size * camera.zoom;
+	return sf::FloatRect(camera.center.x - size.x / 2.0f, camera.center.y - size.y / 2.0f, size.x, size.y);
+}
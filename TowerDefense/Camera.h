@@ -0,0 +1,50 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+//
+// Camera the world is drawn through, so worlds larger than the window can be played.
+//
+// The arrow keys or dragging with the middle mouse button pan it, the mouse wheel zooms it
+// about the cursor. It never leaves the world: zooming out stops once the whole world fits,
+// and while the view is smaller than the world its edges stay inside it. A world the size of
+// the window starts out showing exactly what the window always did.
+//
+// The world is drawn culled against CameraBounds(), see the Draw functions in main.cpp.
+//
+
+// World pixels per window pixel, zoomed all the way in.
+const float CAMERA_MIN_ZOOM = 0.25f;
+
+// Zoom factor per mouse wheel notch.
+const float CAMERA_ZOOM_STEP = 1.25f;
+
+// Window pixels per second with an arrow key held.
+const float CAMERA_PAN_SPEED = 1000.0f;
+
+struct Camera
+{
+	sf::View view;
+	sf::Vector2f window_size;		// Pixels.
+	sf::Vector2f world_size;
+	sf::Vector2f center;			// World position at the middle of the window.
+	float zoom;						// World pixels per window pixel.
+	float max_zoom;					// The whole world fits.
+	bool dragging;
+	sf::Vector2i drag_from;			// Window pixel the drag was last seen at.
+};
+
+// Starts at 1:1 over the top left of the world.
+void InitCamera(Camera& camera, float window_width, float window_height, float world_width, float world_height);
+
+// Zooms on the mouse wheel and pans on middle mouse drags. Returns true if the event was one of those.
+bool HandleCameraEvent(Camera& camera, const sf::Event& event);
+
+// Pans by the arrow keys held, for a frame of seconds. Returns true if any was held.
+bool UpdateCamera(Camera& camera, float seconds);
+
+// World position under a window pixel.
+sf::Vector2f CameraToWorld(const Camera& camera, sf::Vector2i pixel);
+
+// Rectangle of the world in view.
+sf::FloatRect CameraBounds(const Camera& camera);
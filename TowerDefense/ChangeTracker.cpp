@@ -0,0 +1,39 @@
+#include "ChangeTracker.h"
+
+void InitChangeTracker(ChangeTracker& tracker)
+{
+	tracker.count = 0;
+	for (uint32_t c = 0; c < CONSUMER_COUNT; ++c)
+	{
+		tracker.dirty[c].clear();
+	}
+}
+
+void ResizeChangeTracker(ChangeTracker& tracker, uint32_t count)
+{
+	const uint32_t old_count = tracker.count;
+	tracker.count = count;
+	for (uint32_t c = 0; c < CONSUMER_COUNT; ++c)
+	{
+		tracker.dirty[c].resize((count + 63) / 64, 0);
+
+		// Clear bits past the end so a later grow doesn't resurrect them.
+		if (count & 63)
+		{
+			tracker.dirty[c].back() &= (1ull << (count & 63)) - 1;
+		}
+	}
+
+	for (uint32_t i = old_count; i < count; ++i)
+	{
+		MarkChanged(tracker, i);
+	}
+}
+
+void MarkAllChanged(ChangeTracker& tracker)
+{
+	for (uint32_t i = 0; i < tracker.count; ++i)
+	{
+		MarkChanged(tracker, i);
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//
+// Component change tracking with dirty bitsets.
+//
+// Most entities don't change most frames (Towers never move once placed), yet anything
+// derived from them (vertex buffers, snapshot deltas) would be rebuilt for every entity
+// every frame. A ChangeTracker covers one component of one entity vector and keeps a bitset
+// per consumer with one bit per entity. Writers mark an index once and it becomes dirty for
+// every consumer, each consumer then visits and clears only its own dirty bits, so consumers
+// running at different rates never miss a change or steal one from each other.
+//
+// Visiting a consumer's changes costs one 64 bit word per 64 entities plus the dirty entries,
+// clean words are skipped without looking at their bits.
+//
+
+// Everything that consumes changes, one bitset each.
+enum ChangeConsumer : uint32_t
+{
+	CONSUMER_RENDER = 0,		// Cached vertex buffers.
+	CONSUMER_NETWORK = 1,		// Replay deltas.
+	CONSUMER_SPECTATORS = 2,	// Spectator server deltas.
+	CONSUMER_COUNT = 3,
+};
+
+struct ChangeTracker
+{
+	uint32_t count;										// Number of tracked entities.
+	std::vector<uint64_t> dirty[CONSUMER_COUNT];		// One bit per entity.
+};
+
+void InitChangeTracker(ChangeTracker& tracker);
+
+// Entities added by growing are dirty for every consumer, bits of entities removed by shrinking are dropped.
+void ResizeChangeTracker(ChangeTracker& tracker, uint32_t count);
+
+inline void MarkChanged(ChangeTracker& tracker, uint32_t index)
+{
+	const uint64_t bit = 1ull << (index & 63);
+	for (uint32_t c = 0; c < CONSUMER_COUNT; ++c)
+	{
+		tracker.dirty[c][index >> 6] |= bit;
+	}
+}
+
+void MarkAllChanged(ChangeTracker& tracker);
+
+inline uint32_t LowestSetBit(uint64_t word)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctzll(word);
+#endif
+}
+
+// Calls fn(index) for every entity changed since consumer last looked, then clears them for consumer only.
+template <typename Function>
+void ConsumeChanges(ChangeTracker& tracker, ChangeConsumer consumer, Function fn)
+{
+	std::vector<uint64_t>& words = tracker.dirty[consumer];
+	for (uint32_t w = 0; w < words.size(); ++w)
+	{
+		uint64_t word = words[w];
+		words[w] = 0;
+		while (word != 0)
+		{
+			fn((w << 6) + LowestSetBit(word));
+			word &= word - 1;
+		}
+	}
+}
@@ -0,0 +1,481 @@
+#include "Combat.h"
+
+#include <algorithm>
+#include <cmath>
+
+static float Distance(Position pos1, Position pos2)
+{
+	return sqrtf((pos2.x - pos1.x) * (pos2.x - pos1.x) + (pos2.y - pos1.y) * (pos2.y - pos1.y));
+}
+
+static Velocity Normalize(float x, float y)
+{
+	const float magnitude = sqrtf(x * x + y * y);
+	return Velocity({ x / magnitude, y / magnitude });
+}
+
+//
+// Generic versions.
+//
+
+void ClearHits(HitQueue& hits)
+{
+	hits.damage.clear();
+	hits.effects.clear();
+	hits.splash_queries.clear();
+	hits.splash_damage.clear();
+	hits.splash_effects.clear();
+}
+
+void QueueHit(HitQueue& hits, uint32_t monster_index, Damage damage, const OnHitEffect& effect)
+{
+	hits.damage.emplace_back(DamageEvent({ monster_index, damage }));
+	if (effect.type != STATUS_NONE)
+	{
+		hits.effects.emplace_back(EffectEvent({ monster_index, effect }));
+	}
+}
+
+uint32_t FireChainLightning(const Tower& tower, const TowerArchetypes& archetypes, const std::vector<Monster>& monsters,
+							const SpatialGrid& spatial_grid, HitQueue& hits, std::vector<LightningArc>& arcs)
+{
+	// Reused between attacks so a chain never allocates, one per thread.
+	static thread_local KnnResult nearest;
+	uint32_t hit[KNN_MAX_RESULTS];
+	uint32_t hit_count = 0;
+
+	const Chain chain = archetypes.chain[tower.archetype];
+	const Damage damage = archetypes.damage[tower.archetype];
+	const OnHitEffect effect = archetypes.effect[tower.archetype];
+
+	Position from = tower.position;
+	float range = archetypes.range[tower.archetype].value;
+	const uint32_t max_hits = std::min(chain.jumps + 1, KNN_MAX_RESULTS);
+	while (hit_count < max_hits)
+	{
+		QueryNearest(spatial_grid, from, range, 1, hit, hit_count, nearest);
+		if (nearest.count == 0)
+		{
+			break;
+		}
+
+		const uint32_t monster = nearest.monster[0];
+		const Position to = monsters[monster].position;
+
+		QueueHit(hits, monster, damage, effect);
+		arcs.emplace_back(LightningArc({ from, to, LIGHTNING_ARC_TIME }));
+		hit[hit_count++] = monster;
+
+		from = to;
+		range = chain.hop_range;
+	}
+
+	return hit_count;
+}
+
+void UpdateTower(Tower& tower, float DeltaTime, const TowerArchetypes& archetypes, const std::vector<Monster>& monsters,
+				 const SpatialGrid& spatial_grid, std::vector<Bullet>& bullets, HitQueue& hits, std::vector<LightningArc>& arcs)
+{
+	const ProjectileType projectile = archetypes.projectile[tower.archetype];
+	const float range = archetypes.range[tower.archetype].value;
+	const float attack_rate = archetypes.attack_rate[tower.archetype].value;
+
+	tower.timer.value += DeltaTime;
+
+	// Check if enough time has passed for us to fire again, reloading Towers don't look for targets.
+	if (tower.timer.value < attack_rate)
+	{
+		return;
+	}
+
+	if (projectile == PROJECTILE_CHAIN)
+	{
+		// Only reset the timer if something was in range to hit.
+		if (FireChainLightning(tower, archetypes, monsters, spatial_grid, hits, arcs) > 0)
+		{
+			tower.timer.value = 0.0f;
+		}
+		return;
+	}
+
+	const float range_squared = range * range;
+	for (uint32_t i = 0; i < monsters.size(); ++i)
+	{
+		// Check if Monster is in range of Tower.
+		const float xdir = monsters[i].position.x - tower.position.x;
+		const float ydir = monsters[i].position.y - tower.position.y;
+		if (xdir * xdir + ydir * ydir <= range_squared)
+		{
+			if (projectile == PROJECTILE_PIERCING)
+			{
+				// Fire straight at where the Monster is now, the Bullet flies on past it until it leaves range.
+				const Velocity dir = Normalize(xdir, ydir);
+				bullets.emplace_back(Bullet({ tower.position.x, tower.position.y,						// Position
+											  dir.x * PIERCING_BULLET_SPEED, dir.y * PIERCING_BULLET_SPEED,	// Velocity
+											  i,														// Target Index
+											  tower.archetype,											// Archetype
+											  range / PIERCING_BULLET_SPEED,							// Lifetime
+											  PROJECTILE_PIERCING }));									// Type
+			}
+			else
+			{
+				// Don't worry about bullet velocity, as UpdateBullet() will handle that.
+				bullets.emplace_back(Bullet({ tower.position.x, tower.position.y,	// Position
+											  0.0f, 0.0f,							// Velocity
+											  i,									// Target Index
+											  tower.archetype,						// Archetype
+											  0.0f,									// Lifetime
+											  PROJECTILE_HOMING }));				// Type
+			}
+
+			// Reset timer to 0.0f as we just fired.
+			tower.timer.value = 0.0f;
+
+			return;
+		}
+	}
+}
+
+// Returns false once a piercing Bullet has flown its full range.
+// Only the cells along this frame's movement are searched, and each Monster is only hit
+// on the frame the Bullet passes it (see QuerySegment()).
+static bool UpdatePiercingBullet(Bullet& bullet, float DeltaTime, const TowerArchetypes& archetypes, const SpatialGrid& spatial_grid, HitQueue& hits)
+{
+	// Reused every frame to avoid reallocating, one per thread so Simulations can be stepped in parallel.
+	static thread_local std::vector<uint32_t> passed;
+
+	const Position from = bullet.position;
+	bullet.position.x += bullet.velocity.x * DeltaTime;
+	bullet.position.y += bullet.velocity.y * DeltaTime;
+	bullet.lifetime.value -= DeltaTime;
+
+	passed.clear();
+	QuerySegment(spatial_grid, from, bullet.position, MONSTER_SIZE / 2.0f + BULLET_RADIUS, passed);
+	const Damage damage = archetypes.damage[bullet.archetype];
+	const OnHitEffect& effect = archetypes.effect[bullet.archetype];
+	for (uint32_t i = 0; i < passed.size(); ++i)
+	{
+		QueueHit(hits, passed[i], damage, effect);
+	}
+
+	return bullet.lifetime.value > 0.0f;
+}
+
+// Damage is not applied here, hits are queued so ApplyDamage() can process them in one batch.
+// Splash Bullets queue a radius query instead, resolved against the SpatialGrid once every Bullet has moved.
+bool UpdateBullet(Bullet& bullet, float DeltaTime, const TowerArchetypes& archetypes, const std::vector<Monster>& monsters,
+				  const SpatialGrid& spatial_grid, HitQueue& hits)
+{
+	if (bullet.type == PROJECTILE_PIERCING)
+	{
+		return UpdatePiercingBullet(bullet, DeltaTime, archetypes, spatial_grid, hits);
+	}
+
+	// No more monsters left, destroy bullet.
+	if (monsters.size() == 0)
+	{
+		return false;
+	}
+
+	// If we were targetting the last Monster in monsters and they died, target the new last Monster.
+	if (bullet.target_index >= monsters.size() && monsters.size() != 0)
+	{
+		bullet.target_index = (uint32_t)monsters.size() - 1;
+	}
+
+	// Get direction vectors to targeted Monster.
+	const float xdir = monsters[bullet.target_index].position.x - bullet.position.x;
+	const float ydir = monsters[bullet.target_index].position.y - bullet.position.y;
+
+	const Velocity normalized_dir = Normalize(xdir, ydir);
+
+	bullet.position.x += (normalized_dir.x * BULLET_SPEED * DeltaTime);
+	bullet.position.y += (normalized_dir.y * BULLET_SPEED * DeltaTime);
+
+	// Have we hit a monster?
+	if (Distance(bullet.position, monsters[bullet.target_index].position) <= BULLET_RADIUS)
+	{
+		const float splash = archetypes.splash[bullet.archetype].value;
+		if (splash > 0.0f)
+		{
+			// Damage every monster around the impact.
+			hits.splash_queries.emplace_back(RadiusQuery({ bullet.position, splash }));
+			hits.splash_damage.push_back(archetypes.damage[bullet.archetype]);
+			hits.splash_effects.push_back(archetypes.effect[bullet.archetype]);
+		}
+		else
+		{
+			// Damage monster.
+			QueueHit(hits, bullet.target_index, archetypes.damage[bullet.archetype], archetypes.effect[bullet.archetype]);
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+//
+// Specialized kernels, one instantiation per TowerTraits.
+// Traits are compile time constants, so every 'if (Traits::...)' below is folded away.
+//
+
+template <typename Traits>
+static void UpdateTowerBlock(TowerBlock& block, const TowerArchetypes& archetypes, float DeltaTime, const std::vector<Monster>& monsters,
+							 const SpatialGrid& spatial_grid, HitQueue& hits, std::vector<LightningArc>& arcs)
+{
+	const uint32_t archetype = block.archetype;
+	const float range = archetypes.range[archetype].value;
+	const float range_squared = range * range;
+	const float attack_rate = archetypes.attack_rate[archetype].value;
+	const uint32_t monster_count = (uint32_t)monsters.size();
+
+	std::vector<Tower>& towers = block.towers;
+	for (uint32_t t = 0; t < towers.size(); ++t)
+	{
+		Tower& tower = towers[t];
+		tower.timer.value += DeltaTime;
+
+		// Reloading Towers can't fire whatever is in range, so don't look.
+		if (tower.timer.value < attack_rate)
+		{
+			continue;
+		}
+
+		if (Traits::projectile == PROJECTILE_CHAIN)
+		{
+			if (FireChainLightning(tower, archetypes, monsters, spatial_grid, hits, arcs) > 0)
+			{
+				tower.timer.value = 0.0f;
+			}
+			continue;
+		}
+
+		// Same target as UpdateTower(), the first Monster in range.
+		for (uint32_t i = 0; i < monster_count; ++i)
+		{
+			const float xdir = monsters[i].position.x - tower.position.x;
+			const float ydir = monsters[i].position.y - tower.position.y;
+			const float distance_squared = xdir * xdir + ydir * ydir;
+			if (distance_squared > range_squared)
+			{
+				continue;
+			}
+
+			if (Traits::projectile == PROJECTILE_PIERCING)
+			{
+				const float inv_distance = 1.0f / sqrtf(distance_squared);
+				block.bullets.emplace_back(Bullet({ tower.position.x, tower.position.y,								// Position
+													xdir * inv_distance * Traits::bullet_speed,							// Velocity
+													ydir * inv_distance * Traits::bullet_speed,
+													i,																	// Target Index
+													archetype,															// Archetype
+													range / Traits::bullet_speed,										// Lifetime
+													PROJECTILE_PIERCING }));											// Type
+			}
+			else
+			{
+				block.bullets.emplace_back(Bullet({ tower.position.x, tower.position.y,	// Position
+													0.0f, 0.0f,							// Velocity
+													i,									// Target Index
+													archetype,							// Archetype
+													0.0f,								// Lifetime
+													PROJECTILE_HOMING }));				// Type
+			}
+
+			tower.timer.value = 0.0f;
+			break;
+		}
+	}
+}
+
+template <typename Traits>
+static void UpdateBulletBlock(TowerBlock& block, const TowerArchetypes& archetypes, float DeltaTime, const std::vector<Monster>& monsters,
+							  const SpatialGrid& spatial_grid, HitQueue& hits)
+{
+	// Reused every frame to avoid reallocating, one per thread so Simulations can be stepped in parallel.
+	static thread_local std::vector<uint32_t> passed;
+
+	const Damage damage = archetypes.damage[block.archetype];
+	const OnHitEffect effect = archetypes.effect[block.archetype];
+	const float splash = archetypes.splash[block.archetype].value;
+	const uint32_t monster_count = (uint32_t)monsters.size();
+
+	std::vector<Bullet>& bullets = block.bullets;
+	for (uint32_t i = 0; i < bullets.size(); ++i)
+	{
+		Bullet& bullet = bullets[i];
+		bool alive = true;
+
+		if (Traits::projectile == PROJECTILE_PIERCING)
+		{
+			const Position from = bullet.position;
+			bullet.position.x += bullet.velocity.x * DeltaTime;
+			bullet.position.y += bullet.velocity.y * DeltaTime;
+			bullet.lifetime.value -= DeltaTime;
+
+			passed.clear();
+			QuerySegment(spatial_grid, from, bullet.position, MONSTER_SIZE / 2.0f + BULLET_RADIUS, passed);
+			for (uint32_t p = 0; p < passed.size(); ++p)
+			{
+				hits.damage.emplace_back(DamageEvent({ passed[p], damage }));
+				if (Traits::effect)
+				{
+					hits.effects.emplace_back(EffectEvent({ passed[p], effect }));
+				}
+			}
+
+			alive = bullet.lifetime.value > 0.0f;
+		}
+		else if (monster_count == 0)
+		{
+			alive = false;
+		}
+		else
+		{
+			bullet.target_index = std::min(bullet.target_index, monster_count - 1);
+			const Position target = monsters[bullet.target_index].position;
+
+			const Velocity dir = Normalize(target.x - bullet.position.x, target.y - bullet.position.y);
+			bullet.position.x += dir.x * Traits::bullet_speed * DeltaTime;
+			bullet.position.y += dir.y * Traits::bullet_speed * DeltaTime;
+
+			if (Distance(bullet.position, target) <= BULLET_RADIUS)
+			{
+				if (Traits::splash)
+				{
+					hits.splash_queries.emplace_back(RadiusQuery({ bullet.position, splash }));
+					hits.splash_damage.push_back(damage);
+					hits.splash_effects.push_back(effect);
+				}
+				else
+				{
+					hits.damage.emplace_back(DamageEvent({ bullet.target_index, damage }));
+					if (Traits::effect)
+					{
+						hits.effects.emplace_back(EffectEvent({ bullet.target_index, effect }));
+					}
+				}
+				alive = false;
+			}
+		}
+
+		if (!alive)
+		{
+			bullets[i] = bullets.back();
+			bullets.pop_back();
+			--i;
+		}
+	}
+}
+
+template <ProjectileType Projectile, bool Splash>
+static void SelectKernels(bool effect, TowerKernel& tower, BulletKernel& bullet)
+{
+	if (effect)
+	{
+		tower = &UpdateTowerBlock<TowerTraits<Projectile, Splash, true>>;
+		bullet = &UpdateBulletBlock<TowerTraits<Projectile, Splash, true>>;
+	}
+	else
+	{
+		tower = &UpdateTowerBlock<TowerTraits<Projectile, Splash, false>>;
+		bullet = &UpdateBulletBlock<TowerTraits<Projectile, Splash, false>>;
+	}
+}
+
+void BuildKernelRegistry(const TowerArchetypes& archetypes, KernelRegistry& registry)
+{
+	const uint32_t count = (uint32_t)archetypes.name.size();
+	registry.tower.resize(count);
+	registry.bullet.resize(count);
+
+	for (uint32_t a = 0; a < count; ++a)
+	{
+		const bool splash = archetypes.splash[a].value > 0.0f;
+		const bool effect = archetypes.effect[a].type != STATUS_NONE;
+		switch (archetypes.projectile[a])
+		{
+		case PROJECTILE_HOMING:
+			if (splash)
+			{
+				SelectKernels<PROJECTILE_HOMING, true>(effect, registry.tower[a], registry.bullet[a]);
+			}
+			else
+			{
+				SelectKernels<PROJECTILE_HOMING, false>(effect, registry.tower[a], registry.bullet[a]);
+			}
+			break;
+		case PROJECTILE_PIERCING:
+			// Piercing Bullets never splash, they already hit everything they pass through.
+			SelectKernels<PROJECTILE_PIERCING, false>(effect, registry.tower[a], registry.bullet[a]);
+			break;
+		case PROJECTILE_CHAIN:
+			// Chain lightning fires no Bullets, the bullet kernel only ever sees an empty block.
+			SelectKernels<PROJECTILE_CHAIN, false>(effect, registry.tower[a], registry.bullet[a]);
+			break;
+		}
+	}
+}
+
+void InitTowerBlocks(const TowerArchetypes& archetypes, std::vector<TowerBlock>& blocks)
+{
+	blocks.resize(archetypes.name.size());
+	for (uint32_t a = 0; a < blocks.size(); ++a)
+	{
+		blocks[a].archetype = a;
+		blocks[a].towers.clear();
+		blocks[a].bullets.clear();
+		InitChangeTracker(blocks[a].changes);
+	}
+}
+
+void AddTower(TowerBlock& block, Position position)
+{
+	block.towers.emplace_back(Tower({ position,				// Position
+									  0.0f,					// Timer
+									  block.archetype }));	// Archetype
+	ResizeChangeTracker(block.changes, (uint32_t)block.towers.size());
+}
+
+void UpdateTowerBlocks(const KernelRegistry& registry, std::vector<TowerBlock>& blocks, const TowerArchetypes& archetypes, float DeltaTime,
+					   const std::vector<Monster>& monsters, const SpatialGrid& spatial_grid, HitQueue& hits, std::vector<LightningArc>& arcs)
+{
+	for (uint32_t b = 0; b < blocks.size(); ++b)
+	{
+		registry.tower[blocks[b].archetype](blocks[b], archetypes, DeltaTime, monsters, spatial_grid, hits, arcs);
+	}
+}
+
+void UpdateBulletBlocks(const KernelRegistry& registry, std::vector<TowerBlock>& blocks, const TowerArchetypes& archetypes, float DeltaTime,
+						const std::vector<Monster>& monsters, const SpatialGrid& spatial_grid, HitQueue& hits)
+{
+	for (uint32_t b = 0; b < blocks.size(); ++b)
+	{
+		if (!blocks[b].bullets.empty())
+		{
+			registry.bullet[blocks[b].archetype](blocks[b], archetypes, DeltaTime, monsters, spatial_grid, hits);
+		}
+	}
+}
+
+void ResolveSplash(const SpatialGrid& spatial_grid, HitQueue& hits)
+{
+	hits.splash_hits.clear();
+	QueryRadiusBatch(spatial_grid, hits.splash_queries, hits.splash_hits);
+	for (uint32_t i = 0; i < hits.splash_hits.size(); ++i)
+	{
+		const uint32_t query = hits.splash_hits[i].query;
+		QueueHit(hits, hits.splash_hits[i].monster, hits.splash_damage[query], hits.splash_effects[query]);
+	}
+}
+
+void ApplyDamage(const std::vector<DamageEvent>& damage_events, View<Monster, Health> monster_health)
+{
+	for (uint32_t i = 0; i < damage_events.size(); ++i)
+	{
+		Health& health = monster_health.get<Health>(damage_events[i].monster_index);
+		const uint32_t damage = damage_events[i].damage.value;
+		health.value = health.value > damage ? health.value - damage : 0;
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Components.h"
+#include "SpatialGrid.h"
+#include "Archetypes.h"
+#include "View.h"
+#include "ChangeTracker.h"
+
+#include <vector>
+
+//
+// Towers, Bullets and damage.
+//
+// Towers (and the Bullets they fire) are stored in one TowerBlock per Tower archetype.
+// Everything that differs between archetypes in a way that would branch per entity
+// (what kind of projectile is fired, whether it splashes, whether it applies an effect)
+// is lifted into a TowerTraits type, and each block is updated by a kernel instantiated
+// for its archetype's traits. The KernelRegistry picks the kernels once when archetypes
+// are loaded, so a frame dispatches once per block and the inner loops never branch on type.
+//
+// Stats that are plain numbers (range, rate, damage) stay in the archetype tables and are
+// loaded once per block before the loop.
+//
+// UpdateTower() and UpdateBullet() are the generic, branch per entity versions, kept as
+// the reference the kernels are checked and benchmarked against (see Benchmark.h). They do
+// the same work in the same order (including skipping the target scan while reloading), so
+// the only difference measured is the per entity table lookups and type branches.
+//
+
+// Sizes are in pixels, also used for drawing.
+const float MONSTER_SIZE = 32.0f;
+const float BULLET_RADIUS = 8.0f;
+
+// Speed is pixels per second.
+constexpr float BULLET_SPEED = 150.0f;
+constexpr float PIERCING_BULLET_SPEED = 400.0f;
+
+// Seconds a LightningArc stays on screen.
+const float LIGHTNING_ARC_TIME = 0.15f;
+
+// Every hit queued while updating Towers and Bullets, applied in one batch once everything has moved.
+struct HitQueue
+{
+	std::vector<DamageEvent> damage;
+	std::vector<EffectEvent> effects;
+	std::vector<RadiusQuery> splash_queries;
+	std::vector<Damage> splash_damage;			// Parallel to splash_queries.
+	std::vector<OnHitEffect> splash_effects;	// Parallel to splash_queries.
+	std::vector<RadiusHit> splash_hits;
+};
+
+// Every Tower of one archetype and every Bullet they have fired.
+struct TowerBlock
+{
+	uint32_t archetype;				// Index into TowerArchetypes.
+	std::vector<Tower> towers;
+	std::vector<Bullet> bullets;
+	ChangeTracker changes;			// Tower Positions, only written when a Tower is placed.
+};
+
+// Compile time description of an archetype's behaviour, the template argument of the kernels.
+template <ProjectileType Projectile, bool Splash, bool Effect>
+struct TowerTraits
+{
+	static constexpr ProjectileType projectile = Projectile;
+	static constexpr bool splash = Splash;		// Homing Bullets damage everything within the archetype's SplashRadius.
+	static constexpr bool effect = Effect;		// Hits queue the archetype's OnHitEffect.
+	static constexpr float bullet_speed = Projectile == PROJECTILE_PIERCING ? PIERCING_BULLET_SPEED : BULLET_SPEED;
+};
+
+typedef void (*TowerKernel)(TowerBlock& block, const TowerArchetypes& archetypes, float DeltaTime, const std::vector<Monster>& monsters,
+							const SpatialGrid& spatial_grid, HitQueue& hits, std::vector<LightningArc>& arcs);
+typedef void (*BulletKernel)(TowerBlock& block, const TowerArchetypes& archetypes, float DeltaTime, const std::vector<Monster>& monsters,
+							 const SpatialGrid& spatial_grid, HitQueue& hits);
+
+// Kernels for each Tower archetype, indexed by archetype.
+struct KernelRegistry
+{
+	std::vector<TowerKernel> tower;
+	std::vector<BulletKernel> bullet;
+};
+
+void BuildKernelRegistry(const TowerArchetypes& archetypes, KernelRegistry& registry);
+
+// One empty block per archetype, so blocks[archetype] is where that archetype's Towers go.
+void InitTowerBlocks(const TowerArchetypes& archetypes, std::vector<TowerBlock>& blocks);
+
+// Places a Tower in its archetype's block, marking it changed.
+void AddTower(TowerBlock& block, Position position);
+
+// Update every block with its archetype's kernels.
+void UpdateTowerBlocks(const KernelRegistry& registry, std::vector<TowerBlock>& blocks, const TowerArchetypes& archetypes, float DeltaTime,
+					   const std::vector<Monster>& monsters, const SpatialGrid& spatial_grid, HitQueue& hits, std::vector<LightningArc>& arcs);
+void UpdateBulletBlocks(const KernelRegistry& registry, std::vector<TowerBlock>& blocks, const TowerArchetypes& archetypes, float DeltaTime,
+						const std::vector<Monster>& monsters, const SpatialGrid& spatial_grid, HitQueue& hits);
+
+void ClearHits(HitQueue& hits);
+
+void QueueHit(HitQueue& hits, uint32_t monster_index, Damage damage, const OnHitEffect& effect);
+
+// Chain lightning hits instantly, no Bullet is fired.
+// The first target is the nearest Monster in range, each jump after that is the nearest Monster
+// not yet hit within hop_range of the previous target. Returns the number of Monsters hit.
+uint32_t FireChainLightning(const Tower& tower, const TowerArchetypes& archetypes, const std::vector<Monster>& monsters,
+							const SpatialGrid& spatial_grid, HitQueue& hits, std::vector<LightningArc>& arcs);
+
+// Generic versions, look up the archetype and branch on its projectile for every entity.
+void UpdateTower(Tower& tower, float DeltaTime, const TowerArchetypes& archetypes, const std::vector<Monster>& monsters,
+				 const SpatialGrid& spatial_grid, std::vector<Bullet>& bullets, HitQueue& hits, std::vector<LightningArc>& arcs);
+
+// Returns false if Bullet hit a Monster, ran out of lifetime, or there are no Monsters left.
+bool UpdateBullet(Bullet& bullet, float DeltaTime, const TowerArchetypes& archetypes, const std::vector<Monster>& monsters,
+				  const SpatialGrid& spatial_grid, HitQueue& hits);
+
+// Resolves every splash impact queued this frame in one batch against the SpatialGrid.
+void ResolveSplash(const SpatialGrid& spatial_grid, HitQueue& hits);
+
+// Health is unsigned, so clamp at 0 rather than wrapping around when damage exceeds it.
+void ApplyDamage(const std::vector<DamageEvent>& damage_events, View<Monster, Health> monster_health);
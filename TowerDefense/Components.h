@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+
+//
+// Base Components.
+//
+
+// Alignment values assume x64.
+// 4 byte aligned, 4 byte size.
+struct Health
+{
+	uint32_t value;
+};
+
+// 4 byte aligned, 8 byte size.
+struct Position
+{
+	float x;
+	float y;
+};
+
+// 4 byte aligned, 8 byte size.
+struct Velocity
+{
+	float x;
+	float y;
+};
+
+// 4 byte aligned, 4 byte size.
+struct Damage
+{
+	uint32_t value;
+};
+
+// 4 byte aligned, 4 byte size.
+struct AttackRange
+{
+	float value;
+};
+
+// 4 byte aligned, 4 byte size.
+// The number of seconds between each shot.
+struct AttackRate
+{
+	float value;
+};
+
+// 4 byte aligned, 4 byte size.
+struct Timer
+{
+	float value;
+};
+
+// 4 byte aligned, 4 byte size.
+// Radius in pixels damaged on impact, 0 means only the target is damaged.
+struct SplashRadius
+{
+	float value;
+};
+
+// 4 byte aligned, 8 byte size.
+// Chain lightning, the attack jumps to the nearest Monster not yet hit within hop_range
+// of the last one, up to jumps times. Only used by PROJECTILE_CHAIN Towers.
+struct Chain
+{
+	uint32_t jumps;
+	float hop_range;
+};
+
+// 4 byte size.
+// How a Tower's Bullets travel.
+enum ProjectileType : uint32_t
+{
+	PROJECTILE_HOMING = 0,		// Follows target_index until it hits.
+	PROJECTILE_PIERCING = 1,	// Flies straight along its Velocity and damages every Monster it passes through.
+	PROJECTILE_CHAIN = 2,		// No Bullet, chain lightning hits instantly, see Chain.
+};
+
+// 4 byte aligned, 4 byte size.
+// Scales a Monster's speed, 1 is full speed. Lowered while the Monster is slowed.
+struct SpeedMultiplier
+{
+	float value;
+};
+
+// 4 byte size.
+enum StatusEffectType : uint32_t
+{
+	STATUS_SLOW = 0,		// Magnitude is the fraction of speed taken away.
+	STATUS_BURN = 1,		// Magnitude is damage per second, reapplying refreshes it.
+	STATUS_POISON = 2,		// Magnitude is damage per second, reapplying stacks it.
+	STATUS_EFFECT_COUNT = 3,
+	STATUS_NONE = 0xFFFFFFFF,
+};
+
+// 4 byte aligned, 12 byte size.
+// Status effect applied to every Monster a Tower's attack damages.
+struct OnHitEffect
+{
+	StatusEffectType type;
+	float magnitude;
+	float duration;			// Seconds.
+};
+
+//
+// Entity types (comprised of base components).
+//
+
+// 4 byte aligned, 44 byte size.
+// Status effects are not stored here, only the few Monsters affected have entries in StatusEffects.
+// Stats shared by every Monster of a kind (speed, max health, damage) live in MonsterArchetypes.
+struct Monster
+{
+	uint32_t id;				// Stable across removals of other Monsters, see EntityIds.
+	Health health;
+	Position position;
+	Velocity velocity;			// Crowd separation push, zero unless separation is enabled.
+	uint32_t waypoint_index;	// Index into waypoints vector, this is the currently targeted waypoint.
+	uint32_t archetype;			// Index into MonsterArchetypes.
+	uint32_t route_leg;			// Index into PathCache legs, only used in grid map mode.
+	uint16_t route_step;		// Current point along route_leg.
+	uint16_t route_epoch;		// PathCache epoch route_leg was taken from, stale legs force a replan.
+	SpeedMultiplier speed;
+};
+
+// 4 byte aligned, 8 byte size.
+struct Waypoint
+{
+	Position position;
+};
+
+// 4 byte aligned, 16 byte size.
+// Range, rate, damage and what the Tower fires live in TowerArchetypes.
+struct Tower
+{
+	Position position;
+	Timer timer;
+	uint32_t archetype;			// Index into TowerArchetypes.
+};
+
+// 4 byte aligned, 32 byte size.
+// Damage, splash and on hit effect are those of the Tower archetype that fired it.
+struct Bullet
+{
+	Position position;
+	Velocity velocity;			// Only used by piercing Bullets, homing Bullets steer towards their target every frame.
+	uint32_t target_index;		// Index into monsters vector, this is the current target.
+								// This enables the bullets to track their target and home in.
+	uint32_t archetype;			// Index into TowerArchetypes of the Tower that fired it.
+	Timer lifetime;				// Seconds until a piercing Bullet expires.
+	ProjectileType type;		// Copied from the archetype so Bullets can be updated without looking it up.
+};
+
+// 4 byte aligned, 20 byte size.
+// A single jump of a chain lightning attack, only drawn until timer runs out.
+struct LightningArc
+{
+	Position from;
+	Position to;
+	Timer timer;
+};
+
+//
+// Events (produced and consumed within a single frame).
+//
+
+// 4 byte aligned, 8 byte size.
+struct DamageEvent
+{
+	uint32_t monster_index;		// Index into monsters vector.
+	Damage damage;
+};
+
+// 4 byte aligned, 16 byte size.
+struct EffectEvent
+{
+	uint32_t monster_index;		// Index into monsters vector.
+	OnHitEffect effect;
+};
+
@@ -0,0 +1,185 @@
+#include "Compression.h"
+
+#include <cstring>
+
+const uint32_t LZ_HASH_BITS = 14;
+const uint32_t LZ_NO_POSITION = 0xFFFFFFFF;
+
+// Misses skip ahead faster the longer it's been since the last match, so incompressible data passes quickly.
+const uint32_t LZ_SKIP_SHIFT = 6;
+
+static uint32_t Load32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void PutLength(std::vector<uint8_t>& out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+	{
+		out.push_back(255);
+	}
+	out.push_back((uint8_t)length);
+}
+
+static void PutSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_count, uint32_t offset, size_t match_length)
+{
+	const size_t match_code = match_length - LZ_MIN_MATCH;
+	out.push_back((uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15)));
+	if (literal_count >= 15)
+	{
+		PutLength(out, literal_count - 15);
+	}
+	out.insert(out.end(), literals, literals + literal_count);
+
+	out.push_back((uint8_t)offset);
+	out.push_back((uint8_t)(offset >> 8));
+	if (match_code >= 15)
+	{
+		PutLength(out, match_code - 15);
+	}
+}
+
+size_t CompressBlock(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	static thread_local uint32_t table[1 << LZ_HASH_BITS];
+	memset(table, 0xFF, sizeof(table));
+
+	const size_t start = out.size();
+	size_t anchor = 0;
+	size_t misses = 0;
+	for (size_t i = 0; i + LZ_MIN_MATCH <= size;)
+	{
+		const uint32_t sequence = Load32(data + i);
+		uint32_t& slot = table[HashSequence(sequence)];
+		const uint32_t candidate = slot;
+		slot = (uint32_t)i;
+
+		if (candidate == LZ_NO_POSITION || i - candidate > LZ_MAX_OFFSET || Load32(data + candidate) != sequence)
+		{
+			i += 1 + (misses++ >> LZ_SKIP_SHIFT);
+			continue;
+		}
+
+		size_t length = LZ_MIN_MATCH;
+		while (i + length < size && data[candidate + length] == data[i + length])
+		{
+			++length;
+		}
+		PutSequence(out, data + anchor, i - anchor, (uint32_t)(i - candidate), length);
+		i += length;
+		anchor = i;
+		misses = 0;
+	}
+
+	// Trailing literals, a token with no match after it.
+	const size_t literal_count = size - anchor;
+	out.push_back((uint8_t)((literal_count < 15 ? literal_count : 15) << 4));
+	if (literal_count >= 15)
+	{
+		PutLength(out, literal_count - 15);
+	}
+	out.insert(out.end(), data + anchor, data + size);
+
+	return out.size() - start;
+}
+
+static bool GetLength(const uint8_t*& p, const uint8_t* end, size_t& length)
+{
+	for (;;)
+	{
+		if (p == end)
+		{
+			return false;
+		}
+		const uint8_t byte = *p++;
+		length += byte;
+		if (byte != 255)
+		{
+			return true;
+		}
+	}
+}
+
+bool DecompressBlock(const uint8_t* data, size_t data_size, uint8_t* out, size_t size)
+{
+	const uint8_t* p = data;
+	const uint8_t* end = data + data_size;
+	size_t written = 0;
+	while (p < end)
+	{
+		const uint8_t token = *p++;
+		size_t literal_count = token >> 4;
+		if (literal_count == 15 && !GetLength(p, end, literal_count))
+		{
+			return false;
+		}
+		if (literal_count > (size_t)(end - p) || literal_count > size - written)
+		{
+			return false;
+		}
+		memcpy(out + written, p, literal_count);
+		p += literal_count;
+		written += literal_count;
+
+		if (p == end)
+		{
+			break;
+		}
+
+		if (end - p < 2)
+		{
+			return false;
+		}
+		const size_t offset = p[0] | (p[1] << 8);
+		p += 2;
+		size_t length = (token & 15) + LZ_MIN_MATCH;
+		if ((token & 15) == 15 && !GetLength(p, end, length))
+		{
+			return false;
+		}
+		if (offset == 0 || offset > written || length > size - written)
+		{
+			return false;
+		}
+
+		// Byte by byte, a match may overlap what it is copying (e.g. offset 1 repeats one byte).
+		const uint8_t* match = out + written - offset;
+		for (size_t i = 0; i < length; ++i)
+		{
+			out[written + i] = match[i];
+		}
+		written += length;
+	}
+
+	return written == size;
+}
+
+void ShuffleBytes(const uint8_t* values, size_t count, uint8_t* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		out[i] = values[i * 4];
+		out[count + i] = values[i * 4 + 1];
+		out[count * 2 + i] = values[i * 4 + 2];
+		out[count * 3 + i] = values[i * 4 + 3];
+	}
+}
+
+void UnshuffleBytes(const uint8_t* shuffled, size_t count, uint8_t* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		out[i * 4] = shuffled[i];
+		out[i * 4 + 1] = shuffled[count + i];
+		out[i * 4 + 2] = shuffled[count * 2 + i];
+		out[i * 4 + 3] = shuffled[count * 3 + i];
+	}
+}
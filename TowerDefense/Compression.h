@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Small, fast block compression for telemetry and other bulk numeric data.
+//
+// CompressBlock is a byte oriented LZ77 in the style of LZ4: a sequence is a token byte
+// (literal count in the high 4 bits, match length - LZ_MIN_MATCH in the low 4 bits, 15
+// meaning more length bytes follow), the literals, a 2 byte little endian offset back into
+// what was already decoded and the rest of the match length. The last sequence of a block
+// has literals only. Matches are found through a single hash table of 4 byte sequences, no
+// chains, so it compresses at hundreds of MB/s and decompresses faster still.
+//
+// LZ finds little to repeat in raw floats, so arrays of 4 byte values are shuffled first:
+// ShuffleBytes stores the first byte of every value, then every second byte and so on.
+// Sign, exponent and high bytes of nearby values are mostly equal and end up in long runs.
+//
+
+const uint32_t LZ_MIN_MATCH = 4;
+const uint32_t LZ_MAX_OFFSET = 0xFFFF;
+
+// Appends the compressed block to out, returns its size.
+size_t CompressBlock(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+// Returns false unless data decompresses to exactly size bytes.
+bool DecompressBlock(const uint8_t* data, size_t data_size, uint8_t* out, size_t size);
+
+// count values of 4 bytes each.
+void ShuffleBytes(const uint8_t* values, size_t count, uint8_t* out);
+void UnshuffleBytes(const uint8_t* shuffled, size_t count, uint8_t* out);
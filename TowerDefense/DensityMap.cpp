@@ -0,0 +1,87 @@
+#include "DensityMap.h"
+
+#include <algorithm>
+
+// Area UseDensityMap() thresholds are per, in window pixels.
+const float DENSITY_AREA = 100.0f * 100.0f;
+
+// Empty cells are transparent, the rest run from dark red through yellow to white.
+static void WriteHeat(uint8_t* pixel, uint32_t count)
+{
+	if (count == 0)
+	{
+		pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+		return;
+	}
+	const float heat = std::min(1.0f, (float)count / DENSITY_SATURATED_COUNT);
+	pixel[0] = (uint8_t)(255.0f * std::min(1.0f, 0.5f + heat));
+	pixel[1] = (uint8_t)(255.0f * heat);
+	pixel[2] = (uint8_t)(255.0f * std::max(0.0f, heat * 2.0f - 1.0f));
+	pixel[3] = (uint8_t)(128.0f + 127.0f * heat);
+}
+
+void InitDensityMap(DensityMap& map)
+{
+	map.texture_width = 0;
+	map.texture_height = 0;
+	map.pixels.clear();
+	map.quad.setPrimitiveType(sf::Quads);
+	map.quad.resize(4);
+}
+
+bool UseDensityMap(const SpatialGrid& grid, const sf::FloatRect& bounds, float window_area, float threshold)
+{
+	if (threshold <= 0.0f)
+	{
+		return false;
+	}
+	const uint32_t in_view = CountRect(grid, Position({ bounds.left, bounds.top }), Position({ bounds.left + bounds.width, bounds.top + bounds.height }));
+	return in_view > threshold * window_area / DENSITY_AREA;
+}
+
+bool DrawDensityMap(DensityMap& map, const SpatialGrid& grid, const sf::FloatRect& bounds, sf::RenderTarget& target)
+{
+	const uint32_t min_x = SpatialCellX(grid, bounds.left);
+	const uint32_t max_x = SpatialCellX(grid, bounds.left + bounds.width);
+	const uint32_t min_y = SpatialCellY(grid, bounds.top);
+	const uint32_t max_y = SpatialCellY(grid, bounds.top + bounds.height);
+	const uint32_t width = max_x - min_x + 1;
+	const uint32_t height = max_y - min_y + 1;
+
+	if (width > map.texture_width || height > map.texture_height)
+	{
+		const uint32_t texture_width = std::max(width, map.texture_width);
+		const uint32_t texture_height = std::max(height, map.texture_height);
+		if (!map.texture.create(texture_width, texture_height))
+		{
+			return false;
+		}
+		map.texture_width = texture_width;
+		map.texture_height = texture_height;
+	}
+
+	// Each cell's count is the difference of its and the next cell's start.
+	map.pixels.resize(width * height * 4);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint32_t row = (min_y + y) * grid.width + min_x;
+		uint8_t* pixel = &map.pixels[y * width * 4];
+		for (uint32_t x = 0; x < width; ++x, pixel += 4)
+		{
+			WriteHeat(pixel, grid.cell_start[row + x + 1] - grid.cell_start[row + x]);
+		}
+	}
+	map.texture.update(map.pixels.data(), width, height, 0, 0);
+
+	// One quad over the cells in view, textured with the part of the texture just written.
+	const float left = min_x * grid.cell_size;
+	const float top = min_y * grid.cell_size;
+	const float right = (max_x + 1) * grid.cell_size;
+	const float bottom = (max_y + 1) * grid.cell_size;
+	map.quad[0] = sf::Vertex(sf::Vector2f(left, top), sf::Color::White, sf::Vector2f(0.0f, 0.0f));
+	map.quad[1] = sf::Vertex(sf::Vector2f(right, top), sf::Color::White, sf::Vector2f((float)width, 0.0f));
+	map.quad[2] = sf::Vertex(sf::Vector2f(right, bottom), sf::Color::White, sf::Vector2f((float)width, (float)height));
+	map.quad[3] = sf::Vertex(sf::Vector2f(left, bottom), sf::Color::White, sf::Vector2f(0.0f, (float)height));
+	target.draw(map.quad, &map.texture);
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "SpatialGrid.h"
+
+#include <vector>
+
+//
+// Level of detail for crowds too dense to draw one by one. Zoomed out over enough Monsters,
+// they are drawn as a heat map of how many are in each spatial grid cell, one texel per cell,
+// without health bars.
+//
+// The counts are the spatial grid's: BuildSpatialGrid() counts every cell's Monsters for its
+// counting sort, and cell_start keeps them as offsets. Drawing the map writes one texel per
+// cell in view and never looks at a Monster. Choosing it is as cheap: the Monsters in view are
+// counted a row of cells at a time (CountRect()) and compared against a density on screen.
+//
+
+// Monsters in view per 100x100 window pixels above which the map is drawn, unless told otherwise.
+const float DENSITY_DEFAULT_THRESHOLD = 40.0f;
+
+// Monsters in a cell at which its color is hottest.
+const uint32_t DENSITY_SATURATED_COUNT = 16;
+
+struct DensityMap
+{
+	sf::Texture texture;			// Grows to fit the most cells seen in view at once.
+	uint32_t texture_width;
+	uint32_t texture_height;
+	std::vector<uint8_t> pixels;	// RGBA, the cells in view.
+	sf::VertexArray quad;
+};
+
+void InitDensityMap(DensityMap& map);
+
+// True if threshold is above 0 and the Monsters in bounds, seen through a window of window_area
+// pixels, are denser than it.
+bool UseDensityMap(const SpatialGrid& grid, const sf::FloatRect& bounds, float window_area, float threshold);
+
+// Draws the cells in bounds. Returns false if they don't fit in a texture, draw the Monsters instead.
+bool DrawDensityMap(DensityMap& map, const SpatialGrid& grid, const sf::FloatRect& bounds, sf::RenderTarget& target);
@@ -0,0 +1,21 @@
+#include "EntityIds.h"
+
+uint32_t CreateId(EntityIds& ids, uint32_t index)
+{
+	if (!ids.free_ids.empty())
+	{
+		const uint32_t id = ids.free_ids.back();
+		ids.free_ids.pop_back();
+		ids.index_of[id] = index;
+		return id;
+	}
+
+	ids.index_of.push_back(index);
+	return (uint32_t)ids.index_of.size() - 1;
+}
+
+void DestroyId(EntityIds& ids, uint32_t id)
+{
+	ids.index_of[id] = INVALID_INDEX;
+	ids.free_ids.push_back(id);
+}
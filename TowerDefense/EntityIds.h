@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//
+// Stable Monster ids.
+//
+// Monsters are removed by swapping the last Monster into the hole, so a Monster's index
+// into the monsters vector changes over its lifetime. Anything that has to refer to a
+// Monster across frames (e.g. sparse components) uses its id instead and looks the
+// current index up here. Ids of dead Monsters are recycled so index_of stays as small
+// as the largest number of Monsters alive at once.
+//
+
+const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+struct EntityIds
+{
+	std::vector<uint32_t> index_of;		// Id -> index into monsters vector, INVALID_INDEX if free.
+	std::vector<uint32_t> free_ids;
+};
+
+uint32_t CreateId(EntityIds& ids, uint32_t index);
+void DestroyId(EntityIds& ids, uint32_t id);
+
+inline void MoveId(EntityIds& ids, uint32_t id, uint32_t index)
+{
+	ids.index_of[id] = index;
+}
+
+inline uint32_t IndexOf(const EntityIds& ids, uint32_t id)
+{
+	return ids.index_of[id];
+}
@@ -0,0 +1,100 @@
+#include "FastForward.h"
+
+#include <cmath>
+#include <limits>
+
+void InitFastForward(FastForward& fast_forward, uint32_t speed)
+{
+	fast_forward.speed = speed;
+	fast_forward.owed = 0.0;
+	fast_forward.frame_start = FastForwardClock::now();
+	fast_forward.frame_ticks = 0;
+	fast_forward.frames = 0;
+	fast_forward.ticks = 0;
+	fast_forward.dropped = 0;
+}
+
+void CycleFastForward(FastForward& fast_forward)
+{
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < FAST_FORWARD_SPEED_COUNT; ++i)
+	{
+		if (FAST_FORWARD_SPEEDS[i] == fast_forward.speed)
+		{
+			next = (i + 1) % FAST_FORWARD_SPEED_COUNT;
+		}
+	}
+	fast_forward.speed = FAST_FORWARD_SPEEDS[next];
+	fast_forward.owed = 0.0;
+}
+
+uint32_t BeginFastForwardFrame(FastForward& fast_forward, float frame_seconds)
+{
+	fast_forward.frame_start = FastForwardClock::now();
+	fast_forward.frame_ticks = 0;
+	if (fast_forward.speed == 1)
+	{
+		return 1;
+	}
+
+	++fast_forward.frames;
+	if (fast_forward.speed == FAST_FORWARD_UNBOUNDED)
+	{
+		return std::numeric_limits<uint32_t>::max();
+	}
+	fast_forward.owed += (double)frame_seconds * fast_forward.speed;
+	return (uint32_t)floor(fast_forward.owed / FAST_FORWARD_TICK_SECONDS);
+}
+
+float FastForwardTickSeconds(const FastForward& fast_forward, float frame_seconds)
+{
+	return fast_forward.speed == 1 ? frame_seconds : FAST_FORWARD_TICK_SECONDS;
+}
+
+bool FastForwardTick(FastForward& fast_forward)
+{
+	++fast_forward.frame_ticks;
+	if (fast_forward.speed == 1)
+	{
+		return true;
+	}
+
+	++fast_forward.ticks;
+	if (fast_forward.speed != FAST_FORWARD_UNBOUNDED)
+	{
+		fast_forward.owed -= FAST_FORWARD_TICK_SECONDS;
+	}
+	const float stepping = std::chrono::duration<float>(FastForwardClock::now() - fast_forward.frame_start).count();
+	if (stepping < FAST_FORWARD_STEP_SECONDS)
+	{
+		return true;
+	}
+
+	// Out of time, whatever more is owed than the next tick would take is dropped.
+	if (fast_forward.owed > FAST_FORWARD_TICK_SECONDS)
+	{
+		const double dropped = floor(fast_forward.owed / FAST_FORWARD_TICK_SECONDS);
+		fast_forward.dropped += (uint64_t)dropped;
+		fast_forward.owed -= dropped * FAST_FORWARD_TICK_SECONDS;
+	}
+	return false;
+}
+
+const char* FastForwardName(uint32_t speed)
+{
+	switch (speed)
+	{
+	case 1:
+		return "1x";
+	case 2:
+		return "2x";
+	case 4:
+		return "4x";
+	case 16:
+		return "16x";
+	case FAST_FORWARD_UNBOUNDED:
+		return "max";
+	default:
+		return "?";
+	}
+}
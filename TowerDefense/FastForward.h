@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+//
+// Fast forward for the game window: the simulation runs at a multiple of real time while the
+// screen keeps showing one frame per displayed frame.
+//
+// At 1x the game is stepped once per frame by however long the frame took, as it always was.
+// Faster, it's stepped in fixed ticks, as many as the speed owes for the time the frame took,
+// and drawn once after the last of them; the ticks in between are never drawn, they couldn't
+// have been shown. Unbounded steps ticks for a frame's worth of time, then draws, so the tick
+// rate it reaches is the simulation's throughput on this machine with a window open.
+//
+// Stepping a frame stops once it has taken FAST_FORWARD_STEP_SECONDS, whatever the speed, so
+// events are still read every frame or so. Time owed past that is dropped: the game falls
+// behind the speed asked for instead of trying to catch up, which would only make the next
+// frame later still.
+//
+
+// Times real time, unbounded steps for as long as each frame allows.
+const uint32_t FAST_FORWARD_UNBOUNDED = 0;
+const uint32_t FAST_FORWARD_SPEED_COUNT = 5;
+const uint32_t FAST_FORWARD_SPEEDS[FAST_FORWARD_SPEED_COUNT] = { 1, 2, 4, 16, FAST_FORWARD_UNBOUNDED };
+
+// Seconds simulated per tick when fast forwarding (60 ticks per second).
+const float FAST_FORWARD_TICK_SECONDS = 1.0f / 60.0f;
+
+// Longest a frame steps the simulation for when fast forwarding.
+const float FAST_FORWARD_STEP_SECONDS = 1.0f / 60.0f;
+
+typedef std::chrono::steady_clock FastForwardClock;
+
+struct FastForward
+{
+	uint32_t speed;							// One of FAST_FORWARD_SPEEDS.
+	double owed;							// Simulated seconds due but not stepped yet.
+	FastForwardClock::time_point frame_start;
+	uint32_t frame_ticks;					// Stepped this frame.
+
+	uint64_t frames;						// Fast forwarded so far.
+	uint64_t ticks;							// Stepped while fast forwarding.
+	uint64_t dropped;						// Owed but dropped because a frame ran out of time.
+};
+
+void InitFastForward(FastForward& fast_forward, uint32_t speed);
+
+// Moves to the next speed, from unbounded back to 1x.
+void CycleFastForward(FastForward& fast_forward);
+
+// Starts stepping a frame that came frame_seconds after the last one. Returns the most ticks to step,
+// call FastForwardTick after each.
+uint32_t BeginFastForwardFrame(FastForward& fast_forward, float frame_seconds);
+
+// Seconds each tick of the frame simulates.
+float FastForwardTickSeconds(const FastForward& fast_forward, float frame_seconds);
+
+// Call after every tick stepped. Returns false once the frame should stop stepping and draw.
+bool FastForwardTick(FastForward& fast_forward);
+
+// "4x", "max", ...
+const char* FastForwardName(uint32_t speed);
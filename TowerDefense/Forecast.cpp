@@ -0,0 +1,84 @@
+#include "Forecast.h"
+
+#include <algorithm>
+#include <atomic>
+
+void InitForecaster(Forecaster& forecaster, uint32_t thread_count)
+{
+	InitThreadPool(forecaster.pool, thread_count);
+	forecaster.forks.resize(ThreadCount(forecaster.pool));
+}
+
+void ShutdownForecaster(Forecaster& forecaster)
+{
+	ShutdownThreadPool(forecaster.pool);
+	forecaster.forks.clear();
+}
+
+void FindPlacementCandidates(const Simulation& sim, uint32_t archetype, uint32_t spacing, std::vector<PlacementCandidate>& candidates)
+{
+	const NavGrid& grid = sim.grid_map.grid;
+	for (uint32_t y = spacing / 2; y < grid.height; y += spacing)
+	{
+		for (uint32_t x = spacing / 2; x < grid.width; x += spacing)
+		{
+			const uint32_t cell = y * grid.width + x;
+			bool open = grid.blocked[cell] == 0;
+			for (uint32_t w = 0; open && w < sim.waypoints.size(); ++w)
+			{
+				open = CellAt(grid, sim.waypoints[w].position) != cell;
+			}
+			if (open)
+			{
+				candidates.push_back(PlacementCandidate({ archetype, CellCenter(grid, cell) }));
+			}
+		}
+	}
+}
+
+void ForecastPlacements(Forecaster& forecaster, const Simulation& sim, const Archetypes& archetypes, const KernelRegistry& kernels,
+						const std::vector<PlacementCandidate>& candidates, uint32_t ticks, float DeltaTime, std::vector<PlacementForecast>& results)
+{
+	results.resize(candidates.size());
+
+	// Workers pull candidates until there are none left, so a slow forecast doesn't hold up the others.
+	std::atomic<uint32_t> next(0);
+	for (uint32_t w = 0; w < forecaster.forks.size(); ++w)
+	{
+		Simulation& fork = forecaster.forks[w];
+		SubmitJob(forecaster.pool, [&]()
+		{
+			for (uint32_t c = next++; c < candidates.size(); c = next++)
+			{
+				ForkSimulation(sim, fork);
+				PlaceTower(fork, candidates[c].archetype, candidates[c].position);
+				for (uint32_t tick = 0; tick < ticks && fork.player_health > 0; ++tick)
+				{
+					StepSimulation(fork, archetypes, kernels, DeltaTime);
+				}
+
+				PlacementForecast& result = results[c];
+				result.candidate = candidates[c];
+				result.player_health = fork.player_health;
+				result.monsters_left = (uint32_t)fork.monsters.size();
+				result.monster_health_left = 0;
+				for (uint32_t i = 0; i < fork.monsters.size(); ++i)
+				{
+					result.monster_health_left += fork.monsters[i].health.value;
+				}
+			}
+		});
+	}
+	WaitForJobs(forecaster.pool);
+
+	std::stable_sort(results.begin(), results.end(), BetterForecast);
+}
+
+bool BetterForecast(const PlacementForecast& a, const PlacementForecast& b)
+{
+	if (a.player_health != b.player_health)
+	{
+		return a.player_health > b.player_health;
+	}
+	return a.monster_health_left < b.monster_health_left;
+}
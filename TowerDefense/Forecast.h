@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Simulation.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+//
+// What-if forecasts for Tower placement.
+//
+// Every candidate placement is tried on its own fork of the current Simulation (see
+// ForkSimulation()), which is run forward a fixed number of ticks and scored by what is left
+// at the end. Forks share nothing but the read only archetypes and kernels, so they run in
+// parallel on a ThreadPool. Each worker owns one fork and reuses it for every candidate it
+// takes, so memory stays at one copy of the state per thread however many candidates there are.
+//
+
+struct PlacementCandidate
+{
+	uint32_t archetype;				// Index into TowerArchetypes.
+	Position position;
+};
+
+struct PlacementForecast
+{
+	PlacementCandidate candidate;
+	uint32_t player_health;			// At the end of the forecast.
+	uint32_t monsters_left;
+	uint64_t monster_health_left;	// Total Health of every Monster still alive.
+};
+
+struct Forecaster
+{
+	ThreadPool pool;
+	std::vector<Simulation> forks;	// One per worker.
+};
+
+// thread_count 0 uses one thread per hardware thread.
+void InitForecaster(Forecaster& forecaster, uint32_t thread_count);
+void ShutdownForecaster(Forecaster& forecaster);
+
+// Appends the centre of every open cell spacing cells apart, skipping cells with a Waypoint.
+void FindPlacementCandidates(const Simulation& sim, uint32_t archetype, uint32_t spacing, std::vector<PlacementCandidate>& candidates);
+
+// Forks sim once per candidate, places the candidate's Tower and steps the fork ticks times
+// (or until the player dies). results are sorted best first.
+void ForecastPlacements(Forecaster& forecaster, const Simulation& sim, const Archetypes& archetypes, const KernelRegistry& kernels,
+						const std::vector<PlacementCandidate>& candidates, uint32_t ticks, float DeltaTime, std::vector<PlacementForecast>& results);
+
+// More player health left is better, then less Monster health left.
+bool BetterForecast(const PlacementForecast& a, const PlacementForecast& b);
@@ -0,0 +1,108 @@
+#include "FramePacing.h"
+
+#include <SFML/System.hpp>
+
+#include <cmath>
+
+// Weight of each new sleep in the running estimate of how long sleeps take.
+const double PACING_ESTIMATE_WEIGHT = 0.05;
+
+static double Seconds(PacingClock::duration duration)
+{
+	return std::chrono::duration<double>(duration).count();
+}
+
+// Sleeps while there is clearly time for another sleep, then spins until deadline.
+static void WaitUntil(FramePacer& pacer, PacingClock::time_point deadline)
+{
+	PacingClock::time_point now = PacingClock::now();
+	while (Seconds(deadline - now) > pacer.sleep_mean + 2.0 * sqrt(pacer.sleep_variance))
+	{
+		// sf::sleep raises the timer resolution on Windows while it sleeps.
+		sf::sleep(sf::seconds(PACING_SLEEP_SECONDS));
+		const PacingClock::time_point woke = PacingClock::now();
+		const double slept = Seconds(woke - now);
+		pacer.sleep_total += slept;
+
+		const double difference = slept - pacer.sleep_mean;
+		pacer.sleep_mean += PACING_ESTIMATE_WEIGHT * difference;
+		pacer.sleep_variance = (1.0 - PACING_ESTIMATE_WEIGHT) * (pacer.sleep_variance + PACING_ESTIMATE_WEIGHT * difference * difference);
+		now = woke;
+	}
+
+	const PacingClock::time_point spin_start = now;
+	while (now < deadline)
+	{
+		now = PacingClock::now();
+	}
+	pacer.spin_total += Seconds(now - spin_start);
+}
+
+static void MeasureError(FramePacer& pacer, PacingClock::time_point started, PacingClock::time_point target)
+{
+	const double error = fabs(Seconds(started - target));
+	++pacer.frames;
+	pacer.on_time += error <= PACING_ON_TIME_SECONDS ? 1 : 0;
+	pacer.error_total += error;
+	pacer.error_max = error > pacer.error_max ? error : pacer.error_max;
+}
+
+void InitFramePacer(FramePacer& pacer, PacingMode mode, float fps)
+{
+	pacer.mode = mode;
+	pacer.period = 1.0 / (fps > 0.0f ? fps : PACING_DEFAULT_FPS);
+	pacer.started = false;
+	// Until sleeps have been seen, assume the worst of a default Windows timer.
+	pacer.sleep_mean = 0.002;
+	pacer.sleep_variance = 0.0;
+	pacer.frames = 0;
+	pacer.on_time = 0;
+	pacer.error_total = 0.0;
+	pacer.error_max = 0.0;
+	pacer.sleep_total = 0.0;
+	pacer.spin_total = 0.0;
+}
+
+void PaceFrame(FramePacer& pacer)
+{
+	if (pacer.mode == PACING_UNCAPPED)
+	{
+		return;
+	}
+	const std::chrono::duration<double> period(pacer.period);
+	if (!pacer.started)
+	{
+		pacer.started = true;
+		pacer.next = PacingClock::now() + std::chrono::duration_cast<PacingClock::duration>(period);
+		return;
+	}
+
+	if (pacer.mode == PACING_VSYNC)
+	{
+		// display() already waited, only measure.
+		const PacingClock::time_point now = PacingClock::now();
+		MeasureError(pacer, now, pacer.next);
+		pacer.next = now + std::chrono::duration_cast<PacingClock::duration>(period);
+		return;
+	}
+
+	const PacingClock::time_point target = pacer.next;
+	if (PacingClock::now() < target)
+	{
+		WaitUntil(pacer, target);
+	}
+	const PacingClock::time_point now = PacingClock::now();
+	MeasureError(pacer, now, target);
+
+	// Late by more than a frame, restart the schedule instead of rushing to catch up.
+	pacer.next = target + std::chrono::duration_cast<PacingClock::duration>(period);
+	if (pacer.next < now)
+	{
+		pacer.next = now + std::chrono::duration_cast<PacingClock::duration>(period);
+	}
+}
+
+void RestartFramePacing(FramePacer& pacer)
+{
+	pacer.started = false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+//
+// Frame pacing for the game window, so it doesn't spin a core drawing frames nobody sees.
+//
+// PACING_CAP starts frames on a fixed schedule. Sleeping alone is too coarse to hit it
+// (the OS wakes a sleeping thread up to a timer tick late) and spinning alone burns the CPU the
+// cap is meant to save, so waits are hybrid: sleep in short steps while more time is left than a
+// short sleep has been seen to take, then spin the rest. How long a sleep really takes is
+// learned as the game runs (a running mean plus twice its deviation), so the spin stays as short
+// as the machine allows. A frame that ends late starts the next one right away, and the
+// schedule restarts from it rather than rushing frames to catch up.
+//
+// PACING_VSYNC lets the driver block in display() instead, and PACING_UNCAPPED never waits.
+//
+// Pacing error is how far each frame started from when it was meant to: its scheduled time
+// when capped, one frame period after the last frame with vsync.
+//
+
+const float PACING_DEFAULT_FPS = 60.0f;
+
+// Length of each sleep step.
+const float PACING_SLEEP_SECONDS = 0.001f;
+
+// A frame that started within this of its time counts as on time.
+const float PACING_ON_TIME_SECONDS = 0.0001f;
+
+enum PacingMode : uint32_t
+{
+	PACING_UNCAPPED = 0,
+	PACING_VSYNC = 1,
+	PACING_CAP = 2,
+};
+
+typedef std::chrono::steady_clock PacingClock;
+
+struct FramePacer
+{
+	PacingMode mode;
+	double period;						// Seconds per frame.
+	PacingClock::time_point next;		// When the next frame should start.
+	bool started;
+
+	// What a PACING_SLEEP_SECONDS sleep has been taking.
+	double sleep_mean;
+	double sleep_variance;
+
+	uint64_t frames;					// Paced so far.
+	uint64_t on_time;
+	double error_total;					// Seconds.
+	double error_max;
+	double sleep_total;					// Seconds spent waiting asleep,
+	double spin_total;					// and spinning.
+};
+
+// fps is ignored when uncapped, with vsync it's the refresh rate errors are measured against.
+void InitFramePacer(FramePacer& pacer, PacingMode mode, float fps);
+
+// Call at the top of every frame, waits until it's time for it to start.
+void PaceFrame(FramePacer& pacer);
+
+// Starts a new schedule from the next frame, e.g. after the game waited for input while idle,
+// so the wait isn't measured as a late frame.
+void RestartFramePacing(FramePacer& pacer);
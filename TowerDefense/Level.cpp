@@ -0,0 +1,364 @@
+#include "Level.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// Relative paths in a level file are relative to the directory the level file is in.
+static std::string ResolveLevelPath(const std::string& level_path, const std::string& path)
+{
+	const bool absolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+	const size_t separator = level_path.find_last_of("/\\");
+	if (absolute || separator == std::string::npos)
+	{
+		return path;
+	}
+	return level_path.substr(0, separator + 1) + path;
+}
+
+static bool ParseLevelLine(const std::string& kind, std::istringstream& line, const std::string& level_path, LevelData& level)
+{
+	if (kind == "world")
+	{
+		line >> level.world_width >> level.world_height;
+		if (line.fail() || level.world_width <= 0.0f || level.world_height <= 0.0f)
+		{
+			return false;
+		}
+		level.grid_width = (uint32_t)ceilf(level.world_width / level.cell_size);
+		level.grid_height = (uint32_t)ceilf(level.world_height / level.cell_size);
+		level.blocked.assign(level.grid_width * level.grid_height, 0);
+		return true;
+	}
+	if (kind == "archetypes")
+	{
+		std::string path;
+		line >> path;
+		Archetypes included;
+		if (line.fail() || !LoadArchetypes(ResolveLevelPath(level_path, path), included))
+		{
+			return false;
+		}
+
+		MonsterArchetypes& monsters = level.archetypes.monsters;
+		monsters.name.insert(monsters.name.end(), included.monsters.name.begin(), included.monsters.name.end());
+		monsters.speed.insert(monsters.speed.end(), included.monsters.speed.begin(), included.monsters.speed.end());
+		monsters.max_health.insert(monsters.max_health.end(), included.monsters.max_health.begin(), included.monsters.max_health.end());
+		monsters.damage.insert(monsters.damage.end(), included.monsters.damage.begin(), included.monsters.damage.end());
+
+		TowerArchetypes& towers = level.archetypes.towers;
+		towers.name.insert(towers.name.end(), included.towers.name.begin(), included.towers.name.end());
+		towers.range.insert(towers.range.end(), included.towers.range.begin(), included.towers.range.end());
+		towers.attack_rate.insert(towers.attack_rate.end(), included.towers.attack_rate.begin(), included.towers.attack_rate.end());
+		towers.damage.insert(towers.damage.end(), included.towers.damage.begin(), included.towers.damage.end());
+		towers.projectile.insert(towers.projectile.end(), included.towers.projectile.begin(), included.towers.projectile.end());
+		towers.splash.insert(towers.splash.end(), included.towers.splash.begin(), included.towers.splash.end());
+		towers.chain.insert(towers.chain.end(), included.towers.chain.begin(), included.towers.chain.end());
+		towers.effect.insert(towers.effect.end(), included.towers.effect.begin(), included.towers.effect.end());
+		return true;
+	}
+	if (kind == "monster")
+	{
+		return ParseMonsterArchetype(line, level.archetypes.monsters);
+	}
+	if (kind == "tower")
+	{
+		return ParseTowerArchetype(line, level.archetypes.towers);
+	}
+	if (kind == "waypoint")
+	{
+		Waypoint waypoint;
+		line >> waypoint.position.x >> waypoint.position.y;
+		level.waypoints.push_back(waypoint);
+		return !line.fail();
+	}
+	if (kind == "place")
+	{
+		std::string name;
+		LevelTower tower;
+		line >> name >> tower.position.x >> tower.position.y;
+		tower.archetype = FindArchetype(level.archetypes.towers.name, name);
+		if (tower.archetype == INVALID_ARCHETYPE)
+		{
+			std::cerr << "Unknown tower archetype '" << name << "'" << std::endl;
+			return false;
+		}
+		level.towers.push_back(tower);
+		return !line.fail();
+	}
+	if (kind == "block")
+	{
+		uint32_t x0, y0, x1, y1;
+		line >> x0 >> y0 >> x1 >> y1;
+		if (line.fail() || x0 > x1 || y0 > y1 || x1 >= level.grid_width || y1 >= level.grid_height)
+		{
+			std::cerr << "Block outside the " << level.grid_width << "x" << level.grid_height << " grid" << std::endl;
+			return false;
+		}
+		for (uint32_t y = y0; y <= y1; ++y)
+		{
+			std::fill(level.blocked.begin() + y * level.grid_width + x0, level.blocked.begin() + y * level.grid_width + x1 + 1, 1);
+		}
+		return true;
+	}
+	if (kind == "wave")
+	{
+		std::string name;
+		Wave wave;
+		int64_t count = 0;
+		line >> wave.start_time >> name >> count >> wave.interval;
+		if (line.fail())
+		{
+			return false;
+		}
+		wave.archetype = FindArchetype(level.archetypes.monsters.name, name);
+		if (wave.archetype == INVALID_ARCHETYPE)
+		{
+			std::cerr << "Unknown monster archetype '" << name << "'" << std::endl;
+			return false;
+		}
+		// Read signed so a negative count is rejected rather than wrapping around.
+		if (count <= 0 || count > UINT32_MAX || !(wave.interval > 0.0f))
+		{
+			std::cerr << "Wave of '" << name << "' needs a count and interval above 0" << std::endl;
+			return false;
+		}
+		wave.count = (uint32_t)count;
+		level.waves.push_back(wave);
+		return true;
+	}
+
+	std::cerr << "Unknown level item '" << kind << "'" << std::endl;
+	return false;
+}
+
+bool LoadLevelText(const std::string& path, float default_width, float default_height, float cell_size, LevelData& level)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+
+	level = LevelData();
+	level.world_width = default_width;
+	level.world_height = default_height;
+	level.cell_size = cell_size;
+	level.grid_width = (uint32_t)ceilf(default_width / cell_size);
+	level.grid_height = (uint32_t)ceilf(default_height / cell_size);
+	level.blocked.assign(level.grid_width * level.grid_height, 0);
+
+	std::string text;
+	uint32_t line_number = 0;
+	while (std::getline(file, text))
+	{
+		++line_number;
+		const size_t comment = text.find('#');
+		if (comment != std::string::npos)
+		{
+			text.erase(comment);
+		}
+
+		std::istringstream line(text);
+		std::string kind;
+		if (!(line >> kind))
+		{
+			continue;
+		}
+
+		if (!ParseLevelLine(kind, line, path, level))
+		{
+			std::cerr << path << ":" << line_number << ": invalid level line" << std::endl;
+			return false;
+		}
+	}
+
+	if (level.waypoints.empty() || level.archetypes.monsters.name.empty() || level.archetypes.towers.name.empty())
+	{
+		std::cerr << path << ": needs at least one waypoint, monster and tower" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static uint64_t AlignSection(uint64_t offset)
+{
+	return (offset + 7) & ~7ull;
+}
+
+bool WriteLevel(const std::string& path, const LevelData& level)
+{
+	const MonsterArchetypes& monsters = level.archetypes.monsters;
+	const TowerArchetypes& towers = level.archetypes.towers;
+
+	std::vector<LevelMonsterArchetype> monster_archetypes(monsters.name.size());
+	for (uint32_t i = 0; i < monster_archetypes.size(); ++i)
+	{
+		LevelMonsterArchetype& archetype = monster_archetypes[i];
+		memset(&archetype, 0, sizeof(archetype));
+		memcpy(archetype.name, monsters.name[i].c_str(), std::min<size_t>(monsters.name[i].size(), LEVEL_NAME_SIZE - 1));
+		archetype.speed = monsters.speed[i];
+		archetype.max_health = monsters.max_health[i];
+		archetype.damage = monsters.damage[i];
+	}
+
+	std::vector<LevelTowerArchetype> tower_archetypes(towers.name.size());
+	for (uint32_t i = 0; i < tower_archetypes.size(); ++i)
+	{
+		LevelTowerArchetype& archetype = tower_archetypes[i];
+		memset(&archetype, 0, sizeof(archetype));
+		memcpy(archetype.name, towers.name[i].c_str(), std::min<size_t>(towers.name[i].size(), LEVEL_NAME_SIZE - 1));
+		archetype.range = towers.range[i];
+		archetype.attack_rate = towers.attack_rate[i];
+		archetype.damage = towers.damage[i];
+		archetype.projectile = towers.projectile[i];
+		archetype.splash = towers.splash[i];
+		archetype.chain = towers.chain[i];
+		archetype.effect = towers.effect[i];
+	}
+
+	// Section contents in LevelSectionId order.
+	const void* data[LEVEL_SECTION_COUNT] = { level.waypoints.data(), level.towers.data(), level.blocked.data(),
+											  monster_archetypes.data(), tower_archetypes.data(), level.waves.data() };
+	const uint32_t count[LEVEL_SECTION_COUNT] = { (uint32_t)level.waypoints.size(), (uint32_t)level.towers.size(), (uint32_t)level.blocked.size(),
+												  (uint32_t)monster_archetypes.size(), (uint32_t)tower_archetypes.size(), (uint32_t)level.waves.size() };
+	const uint32_t stride[LEVEL_SECTION_COUNT] = { sizeof(Waypoint), sizeof(LevelTower), sizeof(uint8_t),
+												   sizeof(LevelMonsterArchetype), sizeof(LevelTowerArchetype), sizeof(Wave) };
+
+	LevelHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LEVEL_MAGIC;
+	header.version = LEVEL_VERSION;
+	header.world_width = level.world_width;
+	header.world_height = level.world_height;
+	header.cell_size = level.cell_size;
+	header.grid_width = level.grid_width;
+	header.grid_height = level.grid_height;
+
+	uint64_t offset = sizeof(LevelHeader);
+	for (uint32_t s = 0; s < LEVEL_SECTION_COUNT; ++s)
+	{
+		offset = AlignSection(offset);
+		header.sections[s].offset = offset;
+		header.sections[s].count = count[s];
+		header.sections[s].stride = stride[s];
+		offset += (uint64_t)count[s] * stride[s];
+	}
+	header.file_size = offset;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cerr << "Could not create " << path << std::endl;
+		return false;
+	}
+
+	const char padding[8] = {};
+	file.write((const char*)&header, sizeof(header));
+	uint64_t written = sizeof(header);
+	for (uint32_t s = 0; s < LEVEL_SECTION_COUNT; ++s)
+	{
+		file.write(padding, header.sections[s].offset - written);
+		file.write((const char*)data[s], (std::streamsize)count[s] * stride[s]);
+		written = header.sections[s].offset + (uint64_t)count[s] * stride[s];
+	}
+
+	return (bool)file;
+}
+
+bool OpenLevel(const std::string& path, MappedFile& mapped, LevelView& view)
+{
+	if (!OpenMappedFile(path, mapped))
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+
+	const uint32_t stride[LEVEL_SECTION_COUNT] = { sizeof(Waypoint), sizeof(LevelTower), sizeof(uint8_t),
+												   sizeof(LevelMonsterArchetype), sizeof(LevelTowerArchetype), sizeof(Wave) };
+
+	const LevelHeader* header = (const LevelHeader*)mapped.data;
+	bool valid = mapped.size >= sizeof(LevelHeader) && header->magic == LEVEL_MAGIC && header->version == LEVEL_VERSION &&
+				 header->file_size == mapped.size && header->cell_size > 0.0f;
+	for (uint32_t s = 0; valid && s < LEVEL_SECTION_COUNT; ++s)
+	{
+		const LevelSection& section = header->sections[s];
+		valid = section.stride == stride[s] && section.offset % 8 == 0 && section.offset >= sizeof(LevelHeader) &&
+				section.offset <= mapped.size && (uint64_t)section.count * section.stride <= mapped.size - section.offset;
+	}
+	valid = valid && header->sections[LEVEL_BLOCKED].count == (uint64_t)header->grid_width * header->grid_height &&
+			header->sections[LEVEL_WAYPOINTS].count > 0 && header->sections[LEVEL_MONSTER_ARCHETYPES].count > 0 &&
+			header->sections[LEVEL_TOWER_ARCHETYPES].count > 0;
+	if (!valid)
+	{
+		std::cerr << path << ": not a version " << LEVEL_VERSION << " level" << std::endl;
+		CloseMappedFile(mapped);
+		return false;
+	}
+
+	view.header = header;
+	view.waypoints = (const Waypoint*)(mapped.data + header->sections[LEVEL_WAYPOINTS].offset);
+	view.towers = (const LevelTower*)(mapped.data + header->sections[LEVEL_TOWERS].offset);
+	view.blocked = mapped.data + header->sections[LEVEL_BLOCKED].offset;
+	view.monster_archetypes = (const LevelMonsterArchetype*)(mapped.data + header->sections[LEVEL_MONSTER_ARCHETYPES].offset);
+	view.tower_archetypes = (const LevelTowerArchetype*)(mapped.data + header->sections[LEVEL_TOWER_ARCHETYPES].offset);
+	view.waves = (const Wave*)(mapped.data + header->sections[LEVEL_WAVES].offset);
+
+	// Archetype indices and enums are used unchecked once the level is running.
+	const uint32_t monster_archetype_count = LevelCount(view, LEVEL_MONSTER_ARCHETYPES);
+	const uint32_t tower_archetype_count = LevelCount(view, LEVEL_TOWER_ARCHETYPES);
+	for (uint32_t i = 0; valid && i < tower_archetype_count; ++i)
+	{
+		const LevelTowerArchetype& archetype = view.tower_archetypes[i];
+		valid = archetype.projectile <= PROJECTILE_CHAIN && archetype.attack_rate.value > 0.0f &&
+				(archetype.effect.type < STATUS_EFFECT_COUNT || archetype.effect.type == STATUS_NONE);
+	}
+	for (uint32_t i = 0; valid && i < LevelCount(view, LEVEL_TOWERS); ++i)
+	{
+		valid = view.towers[i].archetype < tower_archetype_count;
+	}
+	for (uint32_t i = 0; valid && i < LevelCount(view, LEVEL_WAVES); ++i)
+	{
+		valid = view.waves[i].archetype < monster_archetype_count && view.waves[i].count > 0 && view.waves[i].interval > 0.0f;
+	}
+	if (!valid)
+	{
+		std::cerr << path << ": has an invalid archetype or wave, or refers to an archetype it doesn't define" << std::endl;
+		CloseMappedFile(mapped);
+		return false;
+	}
+
+	return true;
+}
+
+void ReadLevelArchetypes(const LevelView& view, Archetypes& archetypes)
+{
+	archetypes = Archetypes();
+
+	for (uint32_t i = 0; i < LevelCount(view, LEVEL_MONSTER_ARCHETYPES); ++i)
+	{
+		const LevelMonsterArchetype& archetype = view.monster_archetypes[i];
+		archetypes.monsters.name.push_back(std::string(archetype.name, strnlen(archetype.name, LEVEL_NAME_SIZE)));
+		archetypes.monsters.speed.push_back(archetype.speed);
+		archetypes.monsters.max_health.push_back(archetype.max_health);
+		archetypes.monsters.damage.push_back(archetype.damage);
+	}
+
+	for (uint32_t i = 0; i < LevelCount(view, LEVEL_TOWER_ARCHETYPES); ++i)
+	{
+		const LevelTowerArchetype& archetype = view.tower_archetypes[i];
+		archetypes.towers.name.push_back(std::string(archetype.name, strnlen(archetype.name, LEVEL_NAME_SIZE)));
+		archetypes.towers.range.push_back(archetype.range);
+		archetypes.towers.attack_rate.push_back(archetype.attack_rate);
+		archetypes.towers.damage.push_back(archetype.damage);
+		archetypes.towers.projectile.push_back(archetype.projectile);
+		archetypes.towers.splash.push_back(archetype.splash);
+		archetypes.towers.chain.push_back(archetype.chain);
+		archetypes.towers.effect.push_back(archetype.effect);
+	}
+}
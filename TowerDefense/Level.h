@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Components.h"
+#include "Archetypes.h"
+#include "Waves.h"
+#include "MappedFile.h"
+
+#include <vector>
+#include <string>
+
+//
+// Levels: waypoints, pre-placed Towers, blocked grid cells, archetype tables and the wave schedule.
+//
+// Levels are written by hand in a text format and converted (--convert-level) into a
+// versioned binary format which the game memory maps and uses in place. The binary file is
+// a LevelHeader followed by one section per kind of data. Every section is an array of
+// fixed size records, 8 byte aligned, with the same layout as the structs below, so opening
+// a level is validating the header and pointing a LevelView at the sections. No part of it
+// is parsed, large grids and Tower lists are used (or bulk copied) straight from the mapping.
+//
+// Text format, one item per line, '#' starts a comment:
+//   world <width> <height>                          World size in pixels, defaults to the window size. Must come before any block.
+//   archetypes <path>                               Include archetype definitions from another file, relative to this one.
+//   monster ... / tower ...                         Archetype definitions, as in archetypes.txt.
+//   waypoint <x> <y>                                In order, Monsters spawn on the first.
+//   place <tower archetype> <x> <y>                 Tower placed when the level starts.
+//   block <x0> <y0> <x1> <y1>                       Blocks the inclusive rectangle of grid cells.
+//   wave <start seconds> <monster archetype> <count> <interval seconds>   Count and interval above 0.
+//
+
+const uint32_t LEVEL_MAGIC = 0x564C4454;		// "TDLV"
+const uint32_t LEVEL_VERSION = 1;
+
+// Longest archetype name stored in a level, including the terminating 0.
+const uint32_t LEVEL_NAME_SIZE = 32;
+
+enum LevelSectionId : uint32_t
+{
+	LEVEL_WAYPOINTS = 0,			// Waypoint
+	LEVEL_TOWERS = 1,				// LevelTower
+	LEVEL_BLOCKED = 2,				// uint8_t per grid cell, non zero is blocked.
+	LEVEL_MONSTER_ARCHETYPES = 3,	// LevelMonsterArchetype
+	LEVEL_TOWER_ARCHETYPES = 4,		// LevelTowerArchetype
+	LEVEL_WAVES = 5,				// Wave
+	LEVEL_SECTION_COUNT = 6,
+};
+
+// 8 byte aligned, 16 byte size.
+struct LevelSection
+{
+	uint64_t offset;		// From the start of the file, multiple of 8.
+	uint32_t count;
+	uint32_t stride;		// Size of one record, checked against the struct it is read as.
+};
+
+// 8 byte aligned, 136 byte size.
+struct LevelHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;
+	float world_width;		// Pixels.
+	float world_height;
+	float cell_size;		// Pixels, the blocked section covers grid_width * grid_height cells of this size.
+	uint32_t grid_width;
+	uint32_t grid_height;
+	uint32_t reserved;
+	LevelSection sections[LEVEL_SECTION_COUNT];
+};
+
+// 4 byte aligned, 12 byte size.
+struct LevelTower
+{
+	Position position;
+	uint32_t archetype;		// Index into the level's Tower archetypes.
+};
+
+// 4 byte aligned, 44 byte size.
+struct LevelMonsterArchetype
+{
+	char name[LEVEL_NAME_SIZE];
+	float speed;
+	Health max_health;
+	Damage damage;
+};
+
+// 4 byte aligned, 72 byte size.
+struct LevelTowerArchetype
+{
+	char name[LEVEL_NAME_SIZE];
+	AttackRange range;
+	AttackRate attack_rate;
+	Damage damage;
+	ProjectileType projectile;
+	SplashRadius splash;
+	Chain chain;
+	OnHitEffect effect;
+};
+
+// A level in memory, as parsed from text.
+struct LevelData
+{
+	float world_width;
+	float world_height;
+	float cell_size;
+	uint32_t grid_width;
+	uint32_t grid_height;
+	Archetypes archetypes;
+	std::vector<Waypoint> waypoints;
+	std::vector<LevelTower> towers;
+	std::vector<uint8_t> blocked;
+	std::vector<Wave> waves;
+};
+
+// A binary level used in place, every pointer points into the mapped file.
+struct LevelView
+{
+	const LevelHeader* header;
+	const Waypoint* waypoints;
+	const LevelTower* towers;
+	const uint8_t* blocked;
+	const LevelMonsterArchetype* monster_archetypes;
+	const LevelTowerArchetype* tower_archetypes;
+	const Wave* waves;
+};
+
+// Returns false (after printing why to std::cerr) if the text is malformed or refers to unknown archetypes.
+bool LoadLevelText(const std::string& path, float default_width, float default_height, float cell_size, LevelData& level);
+
+bool WriteLevel(const std::string& path, const LevelData& level);
+
+// Checks the header and every section fits the file, then points view at the sections.
+// The mapping must stay open for as long as view is used.
+bool OpenLevel(const std::string& path, MappedFile& mapped, LevelView& view);
+
+inline uint32_t LevelCount(const LevelView& view, LevelSectionId section)
+{
+	return view.header->sections[section].count;
+}
+
+// Copies the level's archetypes into the tables the game uses, the only part of a level that is converted.
+void ReadLevelArchetypes(const LevelView& view, Archetypes& archetypes);
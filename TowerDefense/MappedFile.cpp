@@ -0,0 +1,119 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool OpenMappedFile(const std::string& path, MappedFile& mapped)
+{
+	mapped.data = nullptr;
+	mapped.size = 0;
+	mapped.mapping = nullptr;
+	mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mapped.file == INVALID_HANDLE_VALUE)
+	{
+		mapped.file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapped.file, &size) || size.QuadPart == 0)
+	{
+		CloseMappedFile(mapped);
+		return false;
+	}
+	mapped.size = (size_t)size.QuadPart;
+
+	mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapped.mapping)
+	{
+		CloseMappedFile(mapped);
+		return false;
+	}
+
+	mapped.data = (const uint8_t*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped.data)
+	{
+		CloseMappedFile(mapped);
+		return false;
+	}
+
+	return true;
+}
+
+void CloseMappedFile(MappedFile& mapped)
+{
+	if (mapped.data)
+	{
+		UnmapViewOfFile(mapped.data);
+	}
+	if (mapped.mapping)
+	{
+		CloseHandle(mapped.mapping);
+	}
+	if (mapped.file)
+	{
+		CloseHandle(mapped.file);
+	}
+	mapped.data = nullptr;
+	mapped.size = 0;
+	mapped.mapping = nullptr;
+	mapped.file = nullptr;
+}
+
+#else
+
+bool OpenMappedFile(const std::string& path, MappedFile& mapped)
+{
+	mapped.data = nullptr;
+	mapped.size = 0;
+	mapped.file = open(path.c_str(), O_RDONLY);
+	if (mapped.file < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(mapped.file, &status) != 0 || status.st_size == 0)
+	{
+		CloseMappedFile(mapped);
+		return false;
+	}
+	mapped.size = (size_t)status.st_size;
+
+	void* data = mmap(nullptr, mapped.size, PROT_READ, MAP_PRIVATE, mapped.file, 0);
+	if (data == MAP_FAILED)
+	{
+		CloseMappedFile(mapped);
+		return false;
+	}
+	mapped.data = (const uint8_t*)data;
+
+	return true;
+}
+
+void CloseMappedFile(MappedFile& mapped)
+{
+	if (mapped.data)
+	{
+		munmap((void*)mapped.data, mapped.size);
+	}
+	if (mapped.file >= 0)
+	{
+		close(mapped.file);
+	}
+	mapped.data = nullptr;
+	mapped.size = 0;
+	mapped.file = -1;
+}
+
+#endif
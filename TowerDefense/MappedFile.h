@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Read only memory mapped files.
+//
+// The file's pages are mapped straight into the address space, nothing is read up front
+// and nothing is copied, so binary formats laid out for it (see Level.h) can be used in place.
+//
+
+struct MappedFile
+{
+	const uint8_t* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;			// HANDLE
+	void* mapping;		// HANDLE
+#else
+	int file;
+#endif
+};
+
+// Returns false if the file can't be opened or is empty.
+bool OpenMappedFile(const std::string& path, MappedFile& mapped);
+void CloseMappedFile(MappedFile& mapped);
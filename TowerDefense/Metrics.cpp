@@ -0,0 +1,348 @@
+#include "Metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+// How often the server thread looks at running while nobody is scraping.
+const int METRICS_POLL_MILLISECONDS = 100;
+
+// A scraper gets this long to send its request and take the response.
+const int METRICS_IO_MILLISECONDS = 1000;
+
+// Longest request read, the request line is all that is looked at.
+const uint32_t METRICS_REQUEST_SIZE = 4096;
+
+struct MetricInfo
+{
+	const char* name;
+	const char* type;
+	const char* help;
+};
+
+static const MetricInfo METRIC_INFO[METRIC_COUNT] = {
+	{ "tower_defense_ticks_total", "counter", "Simulation ticks stepped." },
+	{ "tower_defense_monsters_killed_total", "counter", "Monsters that died or reached the last Waypoint." },
+	{ "tower_defense_monsters", "gauge", "Live Monsters." },
+	{ "tower_defense_towers", "gauge", "Placed Towers." },
+	{ "tower_defense_bullets", "gauge", "Bullets in flight." },
+	{ "tower_defense_lightning_arcs", "gauge", "Lightning arcs being drawn." },
+	{ "tower_defense_player_health", "gauge", "Player health left." },
+};
+
+//
+// Allocation counting. Replaces the global operator new and delete, so it counts every
+// allocation the game's own code makes, including the standard library's.
+//
+
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> deallocation_count(0);
+
+static void Deallocate(void* memory)
+{
+	if (memory)
+	{
+		deallocation_count.fetch_add(1, std::memory_order_relaxed);
+		free(memory);
+	}
+}
+
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	void* memory = malloc(size > 0 ? size : 1);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	Deallocate(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	Deallocate(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	Deallocate(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	Deallocate(memory);
+}
+
+uint64_t AllocationCount()
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t DeallocationCount()
+{
+	return deallocation_count.load(std::memory_order_relaxed);
+}
+
+//
+// Registry, updated on the simulation thread.
+//
+
+void InitMetrics(MetricsRegistry& registry)
+{
+	for (uint32_t i = 0; i < METRIC_COUNT; ++i)
+	{
+		registry.values[i].store(0, std::memory_order_relaxed);
+	}
+	for (uint32_t i = 0; i < SYSTEM_COUNT; ++i)
+	{
+		registry.system_nanoseconds[i].store(0, std::memory_order_relaxed);
+	}
+	for (uint32_t i = 0; i <= METRICS_FRAME_BUCKETS; ++i)
+	{
+		registry.frame_buckets[i].store(0, std::memory_order_relaxed);
+	}
+	registry.frame_nanoseconds.store(0, std::memory_order_relaxed);
+}
+
+void RecordSimulationMetrics(MetricsRegistry& registry, const Simulation& sim)
+{
+	registry.values[METRIC_TICKS].fetch_add(1, std::memory_order_relaxed);
+	registry.values[METRIC_MONSTERS_KILLED].store(sim.monsters_killed, std::memory_order_relaxed);
+	registry.values[METRIC_MONSTERS].store(sim.monsters.size(), std::memory_order_relaxed);
+	registry.values[METRIC_TOWERS].store(TowerCount(sim), std::memory_order_relaxed);
+	registry.values[METRIC_BULLETS].store(BulletCount(sim), std::memory_order_relaxed);
+	registry.values[METRIC_LIGHTNING_ARCS].store(sim.lightning_arcs.size(), std::memory_order_relaxed);
+	registry.values[METRIC_PLAYER_HEALTH].store(sim.player_health, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < SYSTEM_COUNT; ++i)
+	{
+		registry.system_nanoseconds[i].fetch_add((uint64_t)(sim.system_seconds[i] * 1e9f), std::memory_order_relaxed);
+	}
+}
+
+void ObserveFrame(MetricsRegistry& registry, float seconds)
+{
+	uint32_t bucket = 0;
+	while (bucket < METRICS_FRAME_BUCKETS && seconds > METRICS_FRAME_BOUNDS[bucket])
+	{
+		++bucket;
+	}
+	registry.frame_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	registry.frame_nanoseconds.fetch_add((uint64_t)(seconds * 1e9f), std::memory_order_relaxed);
+}
+
+//
+// Rendering, on the server thread.
+//
+
+static void AppendHeader(std::string& out, const char* name, const char* type, const char* help)
+{
+	out += "# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += "\n# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+static void AppendValue(std::string& out, const char* name, const char* labels, uint64_t value)
+{
+	char line[160];
+	snprintf(line, sizeof(line), "%s%s %llu\n", name, labels, (unsigned long long)value);
+	out += line;
+}
+
+static void AppendSeconds(std::string& out, const char* name, const char* labels, uint64_t nanoseconds)
+{
+	char line[160];
+	snprintf(line, sizeof(line), "%s%s %.9f\n", name, labels, nanoseconds / 1e9);
+	out += line;
+}
+
+void RenderMetrics(const MetricsRegistry& registry, std::string& out)
+{
+	for (uint32_t i = 0; i < METRIC_COUNT; ++i)
+	{
+		AppendHeader(out, METRIC_INFO[i].name, METRIC_INFO[i].type, METRIC_INFO[i].help);
+		AppendValue(out, METRIC_INFO[i].name, "", registry.values[i].load(std::memory_order_relaxed));
+	}
+
+	const char* const allocations = "tower_defense_allocations_total";
+	AppendHeader(out, allocations, "counter", "Calls to operator new.");
+	AppendValue(out, allocations, "", AllocationCount());
+	const char* const deallocations = "tower_defense_deallocations_total";
+	AppendHeader(out, deallocations, "counter", "Calls to operator delete with memory to free.");
+	AppendValue(out, deallocations, "", DeallocationCount());
+
+	const char* const systems = "tower_defense_system_seconds_total";
+	AppendHeader(out, systems, "counter", "Time spent in each simulation system.");
+	for (uint32_t i = 0; i < SYSTEM_COUNT; ++i)
+	{
+		char labels[64];
+		snprintf(labels, sizeof(labels), "{system=\"%s\"}", SystemName((SimulationSystem)i));
+		AppendSeconds(out, systems, labels, registry.system_nanoseconds[i].load(std::memory_order_relaxed));
+	}
+
+	// Buckets are cumulative in the exposition format.
+	AppendHeader(out, "tower_defense_frame_seconds", "histogram", "Time per frame, per tick when headless.");
+	uint64_t frames = 0;
+	for (uint32_t i = 0; i <= METRICS_FRAME_BUCKETS; ++i)
+	{
+		frames += registry.frame_buckets[i].load(std::memory_order_relaxed);
+		char labels[64];
+		if (i < METRICS_FRAME_BUCKETS)
+		{
+			snprintf(labels, sizeof(labels), "{le=\"%g\"}", METRICS_FRAME_BOUNDS[i]);
+		}
+		else
+		{
+			snprintf(labels, sizeof(labels), "{le=\"+Inf\"}");
+		}
+		AppendValue(out, "tower_defense_frame_seconds_bucket", labels, frames);
+	}
+	AppendSeconds(out, "tower_defense_frame_seconds_sum", "", registry.frame_nanoseconds.load(std::memory_order_relaxed));
+	AppendValue(out, "tower_defense_frame_seconds_count", "", frames);
+}
+
+//
+// Server thread.
+//
+
+static bool SendAll(SocketHandle socket, const char* data, size_t size)
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(METRICS_IO_MILLISECONDS);
+	while (size > 0)
+	{
+		const int sent = SendSocket(socket, data, size);
+		if (sent < 0 && WouldBlock() && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (sent <= 0)
+		{
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+// Reads the request line and answers it, anything but GET /metrics is not found.
+static void ServeRequest(MetricsServer& server, SocketHandle connection)
+{
+	char request[METRICS_REQUEST_SIZE];
+	size_t size = 0;
+	while (size < sizeof(request) && memchr(request, '\n', size) == nullptr)
+	{
+		if (!WaitReadable(connection, METRICS_IO_MILLISECONDS))
+		{
+			return;
+		}
+		const int received = ReceiveSocket(connection, request + size, sizeof(request) - size);
+		if (received <= 0 && !(received < 0 && WouldBlock()))
+		{
+			return;
+		}
+		size += received > 0 ? received : 0;
+	}
+
+	const char* const path = "GET /metrics";
+	const size_t path_size = strlen(path);
+	const bool found = size > path_size && memcmp(request, path, path_size) == 0 && (request[path_size] == ' ' || request[path_size] == '?');
+
+	server.page.clear();
+	if (found)
+	{
+		RenderMetrics(*server.registry, server.page);
+	}
+	else
+	{
+		server.page = "Not found, metrics are at /metrics\n";
+	}
+
+	char header[192];
+	const int header_size = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+															 "Content-Length: %u\r\nConnection: close\r\n\r\n",
+									 found ? "200 OK" : "404 Not Found", (uint32_t)server.page.size());
+	if (SendAll(connection, header, header_size) && SendAll(connection, server.page.data(), server.page.size()))
+	{
+		server.scrapes.fetch_add(found ? 1 : 0, std::memory_order_relaxed);
+	}
+}
+
+static void ServerLoop(MetricsServer& server)
+{
+	while (server.running.load(std::memory_order_acquire))
+	{
+		if (!WaitReadable(server.listener, METRICS_POLL_MILLISECONDS))
+		{
+			continue;
+		}
+		const SocketHandle connection = AcceptSocket(server.listener);
+		if (connection == NO_SOCKET)
+		{
+			continue;
+		}
+		// Accepted sockets don't inherit non blocking everywhere, make it the same on every platform.
+		if (SetNonBlocking(connection))
+		{
+			ServeRequest(server, connection);
+		}
+		CloseSocket(connection);
+	}
+}
+
+bool OpenMetricsServer(uint16_t port, const MetricsRegistry& registry, MetricsServer& server)
+{
+	server.listener = NO_SOCKET;
+	if (!StartSockets())
+	{
+		std::cerr << "Could not start sockets" << std::endl;
+		return false;
+	}
+	server.listener = ListenLoopback(port);
+	if (server.listener == NO_SOCKET || !SetNonBlocking(server.listener))
+	{
+		std::cerr << "Could not listen on port " << port << std::endl;
+		CloseMetricsServer(server);
+		return false;
+	}
+
+	server.registry = &registry;
+	server.scrapes.store(0, std::memory_order_relaxed);
+	server.running.store(true, std::memory_order_release);
+	server.thread = std::thread(ServerLoop, std::ref(server));
+	return true;
+}
+
+void CloseMetricsServer(MetricsServer& server)
+{
+	server.running.store(false, std::memory_order_release);
+	if (server.thread.joinable())
+	{
+		server.thread.join();
+	}
+	if (server.listener != NO_SOCKET)
+	{
+		CloseSocket(server.listener);
+		server.listener = NO_SOCKET;
+	}
+	StopSockets();
+}
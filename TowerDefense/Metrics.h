@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Simulation.h"
+#include "Sockets.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+//
+// Operational metrics in the Prometheus text exposition format, served over HTTP on the
+// loopback interface for a local metrics agent to scrape (GET /metrics).
+//
+// The registry is a fixed set of atomic counters and gauges. The simulation thread updates
+// them with relaxed atomic operations and never takes a lock; a scrape renders whatever
+// values are there at the time, on the server's own thread, so a slow or stuck scraper never
+// delays a frame. Values rendered by one scrape may be a tick apart from each other.
+//
+// Allocations (and frees) are counted by the game's global operator new (and delete), in every
+// mode and whether or not metrics are served, by a relaxed atomic increment.
+//
+
+const uint16_t METRICS_DEFAULT_PORT = 9464;
+
+// Upper bounds in seconds of the frame time histogram buckets, +Inf is implied.
+const uint32_t METRICS_FRAME_BUCKETS = 8;
+const float METRICS_FRAME_BOUNDS[METRICS_FRAME_BUCKETS] = { 0.002f, 0.004f, 0.008f, 0.0167f, 0.0333f, 0.05f, 0.1f, 0.25f };
+
+enum MetricId : uint32_t
+{
+	// Counters.
+	METRIC_TICKS = 0,
+	METRIC_MONSTERS_KILLED = 1,
+	// Gauges.
+	METRIC_MONSTERS = 2,
+	METRIC_TOWERS = 3,
+	METRIC_BULLETS = 4,
+	METRIC_LIGHTNING_ARCS = 5,
+	METRIC_PLAYER_HEALTH = 6,
+	METRIC_COUNT = 7,
+};
+
+struct MetricsRegistry
+{
+	std::atomic<uint64_t> values[METRIC_COUNT];
+	std::atomic<uint64_t> system_nanoseconds[SYSTEM_COUNT];				// Total time spent in each system.
+	std::atomic<uint64_t> frame_buckets[METRICS_FRAME_BUCKETS + 1];		// Frames by time, not cumulative, the last is +Inf.
+	std::atomic<uint64_t> frame_nanoseconds;
+};
+
+void InitMetrics(MetricsRegistry& registry);
+
+// Call after every tick.
+void RecordSimulationMetrics(MetricsRegistry& registry, const Simulation& sim);
+
+// Call once per frame with how long it took.
+void ObserveFrame(MetricsRegistry& registry, float seconds);
+
+// Appends every metric to out in the text exposition format.
+void RenderMetrics(const MetricsRegistry& registry, std::string& out);
+
+// Calls to operator new (and new[]) so far.
+uint64_t AllocationCount();
+
+// Calls to operator delete (and delete[]) with memory to free so far.
+uint64_t DeallocationCount();
+
+struct MetricsServer
+{
+	SocketHandle listener;
+	const MetricsRegistry* registry;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<uint64_t> scrapes;
+	std::string page;			// Server thread only, reused every scrape.
+};
+
+// Listens on 127.0.0.1:port and starts serving registry, which must outlive the server.
+bool OpenMetricsServer(uint16_t port, const MetricsRegistry& registry, MetricsServer& server);
+
+// Waits for the server thread to finish the request it is serving, if any.
+void CloseMetricsServer(MetricsServer& server);
@@ -0,0 +1,802 @@
+#include "Pathfinding.h"
+
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+const float DIAGONAL_COST = 1.41421356f;
+const float INFINITE_COST = 1e30f;
+
+//
+// Helpers.
+//
+
+static uint32_t ClusterOfCell(const NavGrid& grid, const NavHierarchy& hierarchy, uint32_t cell)
+{
+	const uint32_t cx = (cell % grid.width) / NAV_CLUSTER_SIZE;
+	const uint32_t cy = (cell / grid.width) / NAV_CLUSTER_SIZE;
+	return cy * hierarchy.clusters_x + cx;
+}
+
+static bool IsOpen(const NavGrid& grid, uint32_t x, uint32_t y)
+{
+	return grid.blocked[y * grid.width + x] == 0;
+}
+
+// Cell bounds of a cluster, max is exclusive.
+struct ClusterRect
+{
+	uint32_t min_x;
+	uint32_t min_y;
+	uint32_t max_x;
+	uint32_t max_y;
+};
+
+static ClusterRect GetClusterRect(const NavGrid& grid, const NavHierarchy& hierarchy, uint32_t cluster)
+{
+	ClusterRect rect;
+	rect.min_x = (cluster % hierarchy.clusters_x) * NAV_CLUSTER_SIZE;
+	rect.min_y = (cluster / hierarchy.clusters_x) * NAV_CLUSTER_SIZE;
+	rect.max_x = std::min(rect.min_x + NAV_CLUSTER_SIZE, grid.width);
+	rect.max_y = std::min(rect.min_y + NAV_CLUSTER_SIZE, grid.height);
+	return rect;
+}
+
+// Scratch space for searches confined to one cluster, reused so searches do not allocate.
+struct LocalSearch
+{
+	ClusterRect rect;
+	float dist[NAV_CLUSTER_SIZE * NAV_CLUSTER_SIZE];
+	uint16_t parent[NAV_CLUSTER_SIZE * NAV_CLUSTER_SIZE];
+};
+
+static uint32_t LocalIndex(const ClusterRect& rect, uint32_t x, uint32_t y)
+{
+	return (y - rect.min_y) * NAV_CLUSTER_SIZE + (x - rect.min_x);
+}
+
+// Dijkstra over the full resolution cells of one cluster, 8-connected without corner cutting.
+// The source cell is always treated as open so Monsters standing on a freshly blocked cell can leave it.
+// Stops early once target_cell is settled (pass INVALID_CELL to flood the whole cluster).
+static void SearchCluster(const NavGrid& grid, LocalSearch& search, uint32_t source_cell, uint32_t target_cell)
+{
+	const ClusterRect& rect = search.rect;
+	std::fill(search.dist, search.dist + NAV_CLUSTER_SIZE * NAV_CLUSTER_SIZE, INFINITE_COST);
+
+	typedef std::pair<float, uint32_t> QueueEntry;	// Cost, cell.
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> open;
+
+	const uint32_t sx = source_cell % grid.width;
+	const uint32_t sy = source_cell / grid.width;
+	search.dist[LocalIndex(rect, sx, sy)] = 0.0f;
+	search.parent[LocalIndex(rect, sx, sy)] = (uint16_t)LocalIndex(rect, sx, sy);
+	open.push(QueueEntry(0.0f, source_cell));
+
+	static const int dx[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int dy[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	while (!open.empty())
+	{
+		const QueueEntry top = open.top();
+		open.pop();
+
+		const uint32_t x = top.second % grid.width;
+		const uint32_t y = top.second / grid.width;
+		const uint32_t local = LocalIndex(rect, x, y);
+		if (top.first > search.dist[local])
+		{
+			continue;
+		}
+		if (top.second == target_cell)
+		{
+			return;
+		}
+
+		for (uint32_t d = 0; d < 8; ++d)
+		{
+			const int nx = (int)x + dx[d];
+			const int ny = (int)y + dy[d];
+			if (nx < (int)rect.min_x || ny < (int)rect.min_y || nx >= (int)rect.max_x || ny >= (int)rect.max_y)
+			{
+				continue;
+			}
+			if (!IsOpen(grid, nx, ny))
+			{
+				continue;
+			}
+
+			float step = 1.0f;
+			if (dx[d] != 0 && dy[d] != 0)
+			{
+				// Don't cut corners of blocked cells.
+				if (!IsOpen(grid, nx, y) || !IsOpen(grid, x, ny))
+				{
+					continue;
+				}
+				step = DIAGONAL_COST;
+			}
+
+			const uint32_t neighbour_local = LocalIndex(rect, nx, ny);
+			const float cost = top.first + step;
+			if (cost < search.dist[neighbour_local])
+			{
+				search.dist[neighbour_local] = cost;
+				search.parent[neighbour_local] = (uint16_t)local;
+				open.push(QueueEntry(cost, ny * grid.width + nx));
+			}
+		}
+	}
+}
+
+static LocalSearch& GetLocalSearch(const NavGrid& grid, const NavHierarchy& hierarchy, uint32_t cluster)
+{
+	// One per thread so Simulations can be stepped in parallel.
+	static thread_local LocalSearch search;
+	search.rect = GetClusterRect(grid, hierarchy, cluster);
+	return search;
+}
+
+static float LocalDistance(const NavGrid& grid, const LocalSearch& search, uint32_t cell)
+{
+	return search.dist[LocalIndex(search.rect, cell % grid.width, cell / grid.width)];
+}
+
+//
+// Building the abstract graph.
+//
+
+static void AddTransition(NavHierarchy& hierarchy, uint32_t cell_a, uint32_t cell_b)
+{
+	hierarchy.nodes[cell_a].inter.push_back(cell_b);
+	hierarchy.nodes[cell_b].inter.push_back(cell_a);
+}
+
+// Finds the open runs along the border between two clusters and places entrances on them.
+// (ax, ay) is the first border cell of the first cluster and (dir_x, dir_y) the direction along the border.
+static void ScanBorder(const NavGrid& grid, NavHierarchy& hierarchy, uint32_t ax, uint32_t ay, uint32_t dir_x, uint32_t dir_y, uint32_t length)
+{
+	const uint32_t bx = ax + (1 - dir_x);
+	const uint32_t by = ay + (1 - dir_y);
+
+	uint32_t run_start = 0;
+	uint32_t run_length = 0;
+	for (uint32_t i = 0; i <= length; ++i)
+	{
+		const bool open = (i < length) && IsOpen(grid, ax + i * dir_x, ay + i * dir_y) && IsOpen(grid, bx + i * dir_x, by + i * dir_y);
+		if (open)
+		{
+			if (run_length == 0)
+			{
+				run_start = i;
+			}
+			++run_length;
+			continue;
+		}
+
+		if (run_length > 0)
+		{
+			const uint32_t first = run_start;
+			const uint32_t last = run_start + run_length - 1;
+			if (run_length < NAV_MAX_ENTRANCE_WIDTH)
+			{
+				const uint32_t middle = (first + last) / 2;
+				AddTransition(hierarchy, (ay + middle * dir_y) * grid.width + ax + middle * dir_x, (by + middle * dir_y) * grid.width + bx + middle * dir_x);
+			}
+			else
+			{
+				AddTransition(hierarchy, (ay + first * dir_y) * grid.width + ax + first * dir_x, (by + first * dir_y) * grid.width + bx + first * dir_x);
+				AddTransition(hierarchy, (ay + last * dir_y) * grid.width + ax + last * dir_x, (by + last * dir_y) * grid.width + bx + last * dir_x);
+			}
+			run_length = 0;
+		}
+	}
+}
+
+// Border shared with the cluster to the right (+x).
+static void ScanRightBorder(const NavGrid& grid, NavHierarchy& hierarchy, uint32_t cluster)
+{
+	if ((cluster % hierarchy.clusters_x) + 1 >= hierarchy.clusters_x)
+	{
+		return;
+	}
+	const ClusterRect rect = GetClusterRect(grid, hierarchy, cluster);
+	ScanBorder(grid, hierarchy, rect.max_x - 1, rect.min_y, 0, 1, rect.max_y - rect.min_y);
+}
+
+// Border shared with the cluster below (+y).
+static void ScanBottomBorder(const NavGrid& grid, NavHierarchy& hierarchy, uint32_t cluster)
+{
+	if ((cluster / hierarchy.clusters_x) + 1 >= hierarchy.clusters_y)
+	{
+		return;
+	}
+	const ClusterRect rect = GetClusterRect(grid, hierarchy, cluster);
+	ScanBorder(grid, hierarchy, rect.min_x, rect.max_y - 1, 1, 0, rect.max_x - rect.min_x);
+}
+
+// Gathers the node cells on the edges of a cluster, dropping nodes that lost all their transitions,
+// then precomputes the intra cluster edges between every pair of them.
+static void BuildClusterEdges(const NavGrid& grid, NavHierarchy& hierarchy, uint32_t cluster)
+{
+	const ClusterRect rect = GetClusterRect(grid, hierarchy, cluster);
+	std::vector<uint32_t>& cluster_nodes = hierarchy.cluster_nodes[cluster];
+	cluster_nodes.clear();
+
+	for (uint32_t y = rect.min_y; y < rect.max_y; ++y)
+	{
+		for (uint32_t x = rect.min_x; x < rect.max_x; ++x)
+		{
+			// Only border cells can hold nodes.
+			if (y != rect.min_y && y != rect.max_y - 1 && x != rect.min_x && x != rect.max_x - 1)
+			{
+				continue;
+			}
+
+			const uint32_t cell = y * grid.width + x;
+			auto it = hierarchy.nodes.find(cell);
+			if (it == hierarchy.nodes.end())
+			{
+				continue;
+			}
+			if (it->second.inter.empty())
+			{
+				hierarchy.nodes.erase(it);
+				continue;
+			}
+			cluster_nodes.push_back(cell);
+		}
+	}
+
+	LocalSearch& search = GetLocalSearch(grid, hierarchy, cluster);
+	for (uint32_t i = 0; i < cluster_nodes.size(); ++i)
+	{
+		AbstractNode& node = hierarchy.nodes[cluster_nodes[i]];
+		node.intra.clear();
+
+		SearchCluster(grid, search, cluster_nodes[i], INVALID_CELL);
+		for (uint32_t j = 0; j < cluster_nodes.size(); ++j)
+		{
+			const float cost = LocalDistance(grid, search, cluster_nodes[j]);
+			if (i != j && cost < INFINITE_COST)
+			{
+				node.intra.push_back(AbstractEdge({ cluster_nodes[j], cost }));
+			}
+		}
+	}
+
+	++hierarchy.cluster_version[cluster];
+}
+
+void InitNavGrid(NavGrid& grid, NavHierarchy& hierarchy, float world_width, float world_height, float cell_size)
+{
+	grid.cell_size = cell_size;
+	grid.width = (uint32_t)ceilf(world_width / cell_size);
+	grid.height = (uint32_t)ceilf(world_height / cell_size);
+	grid.blocked.assign(grid.width * grid.height, 0);
+
+	hierarchy.version = 0;
+	BuildNavHierarchy(grid, hierarchy);
+}
+
+void BuildNavHierarchy(const NavGrid& grid, NavHierarchy& hierarchy)
+{
+	hierarchy.clusters_x = (grid.width + NAV_CLUSTER_SIZE - 1) / NAV_CLUSTER_SIZE;
+	hierarchy.clusters_y = (grid.height + NAV_CLUSTER_SIZE - 1) / NAV_CLUSTER_SIZE;
+	const uint32_t cluster_count = hierarchy.clusters_x * hierarchy.clusters_y;
+	hierarchy.nodes.clear();
+	hierarchy.cluster_nodes.assign(cluster_count, std::vector<uint32_t>());
+	hierarchy.cluster_version.assign(cluster_count, 0);
+
+	// Fields from before can't be repaired across a whole rebuild. 0 is reserved for fields that have never been built.
+	++hierarchy.version;
+	hierarchy.changes.clear();
+	hierarchy.changes_from = hierarchy.version;
+
+	for (uint32_t cluster = 0; cluster < cluster_count; ++cluster)
+	{
+		ScanRightBorder(grid, hierarchy, cluster);
+		ScanBottomBorder(grid, hierarchy, cluster);
+	}
+	for (uint32_t cluster = 0; cluster < cluster_count; ++cluster)
+	{
+		BuildClusterEdges(grid, hierarchy, cluster);
+	}
+}
+
+uint32_t CellAt(const NavGrid& grid, Position position)
+{
+	int x = (int)(position.x / grid.cell_size);
+	int y = (int)(position.y / grid.cell_size);
+	x = std::max(0, std::min(x, (int)grid.width - 1));
+	y = std::max(0, std::min(y, (int)grid.height - 1));
+	return y * grid.width + x;
+}
+
+Position CellCenter(const NavGrid& grid, uint32_t cell)
+{
+	return Position({ ((cell % grid.width) + 0.5f) * grid.cell_size, ((cell / grid.width) + 0.5f) * grid.cell_size });
+}
+
+// Re-derives the entrances of a cluster after one of its cells changed.
+// Only this cluster and its 4 neighbours are touched, the rest of the abstract graph is left alone.
+static void RebuildCluster(const NavGrid& grid, NavHierarchy& hierarchy, uint32_t cluster)
+{
+	// Remove every transition into or out of this cluster.
+	for (uint32_t i = 0; i < hierarchy.cluster_nodes[cluster].size(); ++i)
+	{
+		AbstractNode& node = hierarchy.nodes[hierarchy.cluster_nodes[cluster][i]];
+		for (uint32_t j = 0; j < node.inter.size(); ++j)
+		{
+			std::vector<uint32_t>& other = hierarchy.nodes[node.inter[j]].inter;
+			other.erase(std::remove(other.begin(), other.end(), hierarchy.cluster_nodes[cluster][i]), other.end());
+		}
+		node.inter.clear();
+	}
+
+	const uint32_t cx = cluster % hierarchy.clusters_x;
+	const uint32_t cy = cluster / hierarchy.clusters_x;
+
+	uint32_t affected[5];
+	uint32_t affected_count = 0;
+	affected[affected_count++] = cluster;
+
+	ScanRightBorder(grid, hierarchy, cluster);
+	ScanBottomBorder(grid, hierarchy, cluster);
+	if (cx + 1 < hierarchy.clusters_x)
+	{
+		affected[affected_count++] = cluster + 1;
+	}
+	if (cy + 1 < hierarchy.clusters_y)
+	{
+		affected[affected_count++] = cluster + hierarchy.clusters_x;
+	}
+	if (cx > 0)
+	{
+		ScanRightBorder(grid, hierarchy, cluster - 1);
+		affected[affected_count++] = cluster - 1;
+	}
+	if (cy > 0)
+	{
+		ScanBottomBorder(grid, hierarchy, cluster - hierarchy.clusters_x);
+		affected[affected_count++] = cluster - hierarchy.clusters_x;
+	}
+
+	for (uint32_t i = 0; i < affected_count; ++i)
+	{
+		BuildClusterEdges(grid, hierarchy, affected[i]);
+	}
+
+	// Log what changed so fields can repair just these clusters.
+	++hierarchy.version;
+	for (uint32_t i = 0; i < affected_count; ++i)
+	{
+		hierarchy.changes.push_back(NavChange({ hierarchy.version, affected[i] }));
+	}
+	if (hierarchy.changes.size() > NAV_MAX_LOGGED_CHANGES)
+	{
+		hierarchy.changes.erase(hierarchy.changes.begin(), hierarchy.changes.begin() + hierarchy.changes.size() / 2);
+		hierarchy.changes_from = hierarchy.changes.front().version;
+	}
+}
+
+void AddBlocker(NavGrid& grid, NavHierarchy& hierarchy, Position position)
+{
+	const uint32_t cell = CellAt(grid, position);
+	if (grid.blocked[cell] == 255)
+	{
+		return;
+	}
+
+	++grid.blocked[cell];
+	if (grid.blocked[cell] == 1)
+	{
+		RebuildCluster(grid, hierarchy, ClusterOfCell(grid, hierarchy, cell));
+	}
+}
+
+void RemoveBlocker(NavGrid& grid, NavHierarchy& hierarchy, Position position)
+{
+	const uint32_t cell = CellAt(grid, position);
+	if (grid.blocked[cell] == 0)
+	{
+		return;
+	}
+
+	--grid.blocked[cell];
+	if (grid.blocked[cell] == 0)
+	{
+		RebuildCluster(grid, hierarchy, ClusterOfCell(grid, hierarchy, cell));
+	}
+}
+
+//
+// Queries.
+//
+
+typedef std::pair<float, uint32_t> FieldQueueEntry;	// Cost, node cell.
+typedef std::priority_queue<FieldQueueEntry, std::vector<FieldQueueEntry>, std::greater<FieldQueueEntry>> FieldQueue;
+
+// Calls fn(neighbour cell, edge cost) for every intra and inter cluster edge of node.
+template <typename Function>
+static void ForEachNeighbour(const AbstractNode& node, Function fn)
+{
+	for (uint32_t i = 0; i < node.intra.size(); ++i)
+	{
+		fn(node.intra[i].to_cell, node.intra[i].cost);
+	}
+	for (uint32_t i = 0; i < node.inter.size(); ++i)
+	{
+		fn(node.inter[i], 1.0f);
+	}
+}
+
+// Settles every node reachable from the nodes in open, lowering any entry a cheaper path is found for.
+// Entries not in open must already be real path costs, so this both builds and repairs fields.
+static void RelaxField(const NavHierarchy& hierarchy, AbstractField& field, FieldQueue& open)
+{
+	while (!open.empty())
+	{
+		const FieldQueueEntry top = open.top();
+		open.pop();
+		if (top.first > field.entries[top.second].cost)
+		{
+			continue;
+		}
+
+		ForEachNeighbour(hierarchy.nodes.at(top.second), [&](uint32_t neighbour, float edge_cost)
+		{
+			const float cost = top.first + edge_cost;
+			auto it = field.entries.find(neighbour);
+			if (it == field.entries.end() || cost < it->second.cost)
+			{
+				field.entries[neighbour] = FieldEntry({ cost, top.second });
+				open.push(FieldQueueEntry(cost, neighbour));
+			}
+		});
+	}
+}
+
+// Dijkstra over the abstract graph outwards from the goal, so every node learns its cost to the goal
+// and which cell to head for next. Edges are symmetric so searching from the goal is equivalent.
+static void BuildField(const NavGrid& grid, const NavHierarchy& hierarchy, AbstractField& field, uint32_t goal_cell)
+{
+	field.version = hierarchy.version;
+	field.entries.clear();
+	field.first_hop.clear();
+
+	FieldQueue open;
+
+	// Seed with the nodes that can reach the goal inside the goal's own cluster.
+	const uint32_t goal_cluster = ClusterOfCell(grid, hierarchy, goal_cell);
+	LocalSearch& search = GetLocalSearch(grid, hierarchy, goal_cluster);
+	SearchCluster(grid, search, goal_cell, INVALID_CELL);
+	const std::vector<uint32_t>& goal_nodes = hierarchy.cluster_nodes[goal_cluster];
+	for (uint32_t i = 0; i < goal_nodes.size(); ++i)
+	{
+		const float cost = LocalDistance(grid, search, goal_nodes[i]);
+		if (cost < INFINITE_COST)
+		{
+			field.entries[goal_nodes[i]] = FieldEntry({ cost, goal_cell });
+			open.push(FieldQueueEntry(cost, goal_nodes[i]));
+		}
+	}
+
+	RelaxField(hierarchy, field, open);
+}
+
+// Brings a field up to date with the clusters rebuilt since it was last built or repaired.
+// Entries in those clusters, and every entry whose path to the goal ran through one of them,
+// are dropped and searched again from the valid entries around them. The rest of the field is
+// only touched if a rebuilt cluster opened a cheaper path through it.
+static void RepairField(const NavGrid& grid, const NavHierarchy& hierarchy, AbstractField& field, uint32_t goal_cell)
+{
+	// Reused between repairs, one per thread so Simulations can be stepped in parallel.
+	static thread_local std::vector<uint32_t> clusters;
+	static thread_local std::vector<uint32_t> invalid;
+
+	clusters.clear();
+	auto change = std::upper_bound(hierarchy.changes.begin(), hierarchy.changes.end(), field.version,
+								   [](uint32_t version, const NavChange& logged) { return version < logged.version; });
+	for (; change != hierarchy.changes.end(); ++change)
+	{
+		clusters.push_back(change->cluster);
+	}
+	std::sort(clusters.begin(), clusters.end());
+	clusters.erase(std::unique(clusters.begin(), clusters.end()), clusters.end());
+
+	field.version = hierarchy.version;
+	field.first_hop.clear();	// Start cells connect through node costs which may have changed.
+
+	// Drop every entry in a rebuilt cluster, nodes only sit on cluster borders.
+	invalid.clear();
+	for (uint32_t c = 0; c < clusters.size(); ++c)
+	{
+		const ClusterRect rect = GetClusterRect(grid, hierarchy, clusters[c]);
+		for (uint32_t y = rect.min_y; y < rect.max_y; ++y)
+		{
+			for (uint32_t x = rect.min_x; x < rect.max_x; ++x)
+			{
+				if (y != rect.min_y && y != rect.max_y - 1 && x != rect.min_x && x != rect.max_x - 1)
+				{
+					continue;
+				}
+				const uint32_t cell = y * grid.width + x;
+				if (field.entries.erase(cell) > 0)
+				{
+					invalid.push_back(cell);
+				}
+			}
+		}
+	}
+
+	// Then every entry whose next hop was dropped, walking the tree away from the goal. Edges that
+	// changed all have both ends in rebuilt clusters, so the dropped nodes' remaining edges are enough.
+	for (uint32_t i = 0; i < invalid.size(); ++i)
+	{
+		const uint32_t cell = invalid[i];
+		auto node = hierarchy.nodes.find(cell);
+		if (node == hierarchy.nodes.end())
+		{
+			continue;
+		}
+		ForEachNeighbour(node->second, [&](uint32_t neighbour, float)
+		{
+			auto entry = field.entries.find(neighbour);
+			if (entry != field.entries.end() && entry->second.next == cell)
+			{
+				field.entries.erase(entry);
+				invalid.push_back(neighbour);
+			}
+		});
+	}
+
+	// Reseed the dropped nodes still in the graph, and every node of the rebuilt clusters (new ones included),
+	// from their valid neighbours or straight from the goal inside its own cluster.
+	const uint32_t goal_cluster = ClusterOfCell(grid, hierarchy, goal_cell);
+	LocalSearch& search = GetLocalSearch(grid, hierarchy, goal_cluster);
+	SearchCluster(grid, search, goal_cell, INVALID_CELL);
+
+	FieldQueue open;
+	auto reseed = [&](uint32_t cell)
+	{
+		auto node = hierarchy.nodes.find(cell);
+		if (node == hierarchy.nodes.end())
+		{
+			return;
+		}
+
+		FieldEntry best = { INFINITE_COST, INVALID_CELL };
+		if (ClusterOfCell(grid, hierarchy, cell) == goal_cluster)
+		{
+			best = FieldEntry({ LocalDistance(grid, search, cell), goal_cell });
+		}
+		ForEachNeighbour(node->second, [&](uint32_t neighbour, float edge_cost)
+		{
+			auto entry = field.entries.find(neighbour);
+			if (entry != field.entries.end() && entry->second.cost + edge_cost < best.cost)
+			{
+				best = FieldEntry({ entry->second.cost + edge_cost, neighbour });
+			}
+		});
+
+		auto entry = field.entries.find(cell);
+		if (best.cost < INFINITE_COST && (entry == field.entries.end() || best.cost < entry->second.cost))
+		{
+			field.entries[cell] = best;
+			open.push(FieldQueueEntry(best.cost, cell));
+		}
+	};
+	for (uint32_t i = 0; i < invalid.size(); ++i)
+	{
+		reseed(invalid[i]);
+	}
+	for (uint32_t c = 0; c < clusters.size(); ++c)
+	{
+		const std::vector<uint32_t>& nodes = hierarchy.cluster_nodes[clusters[c]];
+		for (uint32_t i = 0; i < nodes.size(); ++i)
+		{
+			reseed(nodes[i]);
+		}
+	}
+
+	RelaxField(hierarchy, field, open);
+}
+
+bool IsLegStale(const NavHierarchy& hierarchy, const RouteLeg& leg)
+{
+	return leg.cluster_version != hierarchy.cluster_version[leg.cluster];
+}
+
+// Refines one hop of an abstract path into cell centres.
+static void RefineLeg(const NavGrid& grid, const NavHierarchy& hierarchy, RouteLeg& leg)
+{
+	leg.cluster = ClusterOfCell(grid, hierarchy, leg.from);
+	leg.cluster_version = hierarchy.cluster_version[leg.cluster];
+	leg.points.clear();
+
+	// Transitions and zero length legs step straight onto the destination.
+	if (leg.from == leg.to || ClusterOfCell(grid, hierarchy, leg.to) != leg.cluster)
+	{
+		leg.points.push_back(CellCenter(grid, leg.to));
+		return;
+	}
+
+	LocalSearch& search = GetLocalSearch(grid, hierarchy, leg.cluster);
+	SearchCluster(grid, search, leg.from, leg.to);
+
+	const ClusterRect& rect = search.rect;
+	uint32_t local = LocalIndex(rect, leg.to % grid.width, leg.to / grid.width);
+	const uint32_t source_local = LocalIndex(rect, leg.from % grid.width, leg.from / grid.width);
+	if (search.dist[local] >= INFINITE_COST)
+	{
+		leg.points.push_back(CellCenter(grid, leg.to));
+		return;
+	}
+
+	while (local != source_local)
+	{
+		const uint32_t cell = (rect.min_y + local / NAV_CLUSTER_SIZE) * grid.width + rect.min_x + local % NAV_CLUSTER_SIZE;
+		leg.points.push_back(CellCenter(grid, cell));
+		local = search.parent[local];
+	}
+	std::reverse(leg.points.begin(), leg.points.end());
+}
+
+static uint32_t GetLeg(const NavGrid& grid, const NavHierarchy& hierarchy, PathCache& cache, uint32_t from, uint32_t to)
+{
+	const uint64_t key = ((uint64_t)from << 32) | to;
+	auto it = cache.leg_lookup.find(key);
+	if (it != cache.leg_lookup.end())
+	{
+		RouteLeg& leg = cache.legs[it->second];
+		if (IsLegStale(hierarchy, leg))
+		{
+			RefineLeg(grid, hierarchy, leg);
+		}
+		return it->second;
+	}
+
+	if (cache.legs.size() >= NAV_MAX_CACHED_LEGS)
+	{
+		// Monsters holding a leg from the old epoch will notice and replan.
+		cache.legs.clear();
+		cache.leg_lookup.clear();
+		++cache.epoch;
+	}
+
+	RouteLeg leg;
+	leg.from = from;
+	leg.to = to;
+	RefineLeg(grid, hierarchy, leg);
+
+	const uint32_t index = (uint32_t)cache.legs.size();
+	cache.legs.push_back(leg);
+	cache.leg_lookup[key] = index;
+	return index;
+}
+
+uint32_t PlanRoute(const NavGrid& grid, const NavHierarchy& hierarchy, PathCache& cache, uint32_t start_cell, uint32_t goal_cell)
+{
+	AbstractField& field = cache.fields[goal_cell];
+	if (field.version != hierarchy.version)
+	{
+		// Only fields too old for the change log (or never built) are searched again whole.
+		if (field.version >= hierarchy.changes_from && field.version < hierarchy.version)
+		{
+			RepairField(grid, hierarchy, field, goal_cell);
+		}
+		else
+		{
+			BuildField(grid, hierarchy, field, goal_cell);
+		}
+	}
+
+	if (start_cell == goal_cell)
+	{
+		return GetLeg(grid, hierarchy, cache, start_cell, goal_cell);
+	}
+
+	// Standing on a node, the shared field already knows where to go.
+	auto entry = field.entries.find(start_cell);
+	if (entry != field.entries.end())
+	{
+		return GetLeg(grid, hierarchy, cache, start_cell, entry->second.next);
+	}
+
+	// Otherwise connect the start cell to the nodes of its cluster, this is shared between every
+	// Monster that starts from the same cell (e.g. the spawn Waypoint).
+	auto hop = field.first_hop.find(start_cell);
+	if (hop == field.first_hop.end())
+	{
+		const uint32_t start_cluster = ClusterOfCell(grid, hierarchy, start_cell);
+		LocalSearch& search = GetLocalSearch(grid, hierarchy, start_cluster);
+		SearchCluster(grid, search, start_cell, INVALID_CELL);
+
+		uint32_t best_cell = INVALID_CELL;
+		float best_cost = INFINITE_COST;
+		if (ClusterOfCell(grid, hierarchy, goal_cell) == start_cluster)
+		{
+			best_cost = LocalDistance(grid, search, goal_cell);
+			best_cell = best_cost < INFINITE_COST ? goal_cell : INVALID_CELL;
+		}
+
+		const std::vector<uint32_t>& start_nodes = hierarchy.cluster_nodes[start_cluster];
+		for (uint32_t i = 0; i < start_nodes.size(); ++i)
+		{
+			auto node_entry = field.entries.find(start_nodes[i]);
+			if (node_entry == field.entries.end())
+			{
+				continue;
+			}
+
+			const float cost = LocalDistance(grid, search, start_nodes[i]) + node_entry->second.cost;
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_cell = start_nodes[i];
+			}
+		}
+
+		hop = field.first_hop.insert(std::make_pair(start_cell, best_cell)).first;
+	}
+
+	if (hop->second == INVALID_CELL)
+	{
+		return INVALID_LEG;
+	}
+
+	return GetLeg(grid, hierarchy, cache, start_cell, hop->second);
+}
+
+Position NextRoutePoint(Monster& monster, Position goal, GridMap& grid_map)
+{
+	const NavGrid& grid = grid_map.grid;
+	const NavHierarchy& hierarchy = grid_map.hierarchy;
+	PathCache& cache = grid_map.cache;
+	const uint32_t goal_cell = CellAt(grid, goal);
+
+	for (;;)
+	{
+		// Replan from where we stand if we have no route or the map changed underneath it.
+		if (monster.route_leg == INVALID_LEG || monster.route_epoch != cache.epoch || IsLegStale(hierarchy, cache.legs[monster.route_leg]))
+		{
+			monster.route_leg = PlanRoute(grid, hierarchy, cache, CellAt(grid, monster.position), goal_cell);
+			monster.route_step = 0;
+			monster.route_epoch = cache.epoch;
+			if (monster.route_leg == INVALID_LEG)
+			{
+				return goal;
+			}
+		}
+
+		const RouteLeg& leg = cache.legs[monster.route_leg];
+		if (monster.route_step < leg.points.size())
+		{
+			const Position point = leg.points[monster.route_step];
+			const float dx = point.x - monster.position.x;
+			const float dy = point.y - monster.position.y;
+			if (sqrtf(dx * dx + dy * dy) > 2.0f)
+			{
+				return point;
+			}
+			++monster.route_step;
+			continue;
+		}
+
+		// Finished this leg, the goal cell is unobstructed so head straight for the exact goal position.
+		const uint32_t leg_end = leg.to;
+		if (leg_end == goal_cell)
+		{
+			return goal;
+		}
+
+		monster.route_leg = PlanRoute(grid, hierarchy, cache, leg_end, goal_cell);
+		monster.route_step = 0;
+		monster.route_epoch = cache.epoch;
+		if (monster.route_leg == INVALID_LEG)
+		{
+			return goal;
+		}
+	}
+}
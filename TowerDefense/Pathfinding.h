@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Components.h"
+
+#include <vector>
+#include <unordered_map>
+
+//
+// Grid map mode and hierarchical pathfinding (HPA*).
+//
+// The world is divided into a NavGrid of square cells which are either open or blocked.
+// Searching the full resolution grid every time a Tower is placed is far too slow for
+// large maps, so the grid is further divided into square clusters. Where two neighbouring
+// clusters share an open border we place entrance nodes, and inside each cluster we precompute
+// the cost between every pair of its entrance nodes. This small abstract graph is all that
+// path queries and replans need to search; only the cluster being walked through is ever
+// searched at full resolution (local refinement).
+//
+// Monsters that share a destination share a single AbstractField, which is a Dijkstra tree
+// over the abstract graph rooted at the destination, so a whole wave heading for the same
+// Waypoint costs one abstract search no matter how many Monsters are in it.
+//
+// Placing or removing a Tower doesn't rebuild the fields. The hierarchy logs which clusters
+// each change rebuilt, and a field is repaired from that log: only the nodes in those clusters
+// and the nodes whose path to the goal ran through them are searched again.
+//
+
+const uint32_t INVALID_CELL = 0xFFFFFFFF;
+const uint32_t INVALID_LEG = 0xFFFFFFFF;
+
+// Sizes are in pixels.
+const float NAV_CELL_SIZE = 32.0f;
+
+// Sizes are in cells.
+const uint32_t NAV_CLUSTER_SIZE = 8;
+
+// Border runs longer than this get an entrance at each end instead of a single one in the middle.
+const uint32_t NAV_MAX_ENTRANCE_WIDTH = 6;
+
+// Once this many legs are cached the cache is flushed and every Monster replans.
+const uint32_t NAV_MAX_CACHED_LEGS = 65536;
+
+// Once this many rebuilt clusters are logged the oldest half is dropped, fields older than what's left are rebuilt whole.
+const uint32_t NAV_MAX_LOGGED_CHANGES = 4096;
+
+struct NavGrid
+{
+	uint32_t width;					// Size in cells.
+	uint32_t height;
+	float cell_size;				// Size of a cell in pixels.
+	std::vector<uint8_t> blocked;	// Number of Towers blocking each cell, 0 means open.
+};
+
+struct AbstractEdge
+{
+	uint32_t to_cell;
+	float cost;
+};
+
+// Entrance node on a cluster border, keyed by the cell it sits on.
+struct AbstractNode
+{
+	std::vector<AbstractEdge> intra;	// Nodes in the same cluster, cost precomputed at full resolution.
+	std::vector<uint32_t> inter;		// Nodes across a cluster border, always 1 cell away.
+};
+
+// A cluster rebuilt by the change that bumped NavHierarchy::version to version.
+struct NavChange
+{
+	uint32_t version;
+	uint32_t cluster;
+};
+
+struct NavHierarchy
+{
+	uint32_t clusters_x;
+	uint32_t clusters_y;
+	std::unordered_map<uint32_t, AbstractNode> nodes;
+	std::vector<std::vector<uint32_t>> cluster_nodes;	// Node cells in each cluster.
+	std::vector<uint32_t> cluster_version;				// Bumped every time a cluster is rebuilt.
+	uint32_t version;									// Bumped every time any cluster is rebuilt.
+	std::vector<NavChange> changes;						// Clusters rebuilt since version changes_from, oldest first.
+	uint32_t changes_from;								// Fields built at this version or later can be repaired from changes.
+};
+
+struct FieldEntry
+{
+	float cost;			// Cost from this node to the goal.
+	uint32_t next;		// Next cell to head for, either another node or the goal itself.
+};
+
+// Shared abstract path for every Monster heading to the same goal cell.
+struct AbstractField
+{
+	uint32_t version;									// NavHierarchy version this field was built or last repaired from.
+	std::unordered_map<uint32_t, FieldEntry> entries;	// Keyed by node cell.
+	std::unordered_map<uint32_t, uint32_t> first_hop;	// Start cell -> first cell to head for.
+};
+
+// Refined full resolution path between two cells, never leaves a single cluster
+// (or steps across one cluster border).
+struct RouteLeg
+{
+	uint32_t from;
+	uint32_t to;
+	uint32_t cluster;
+	uint32_t cluster_version;		// Leg is stale once its cluster has been rebuilt.
+	std::vector<Position> points;	// Cell centres to walk through, ending on the centre of cell 'to'.
+};
+
+struct PathCache
+{
+	std::unordered_map<uint32_t, AbstractField> fields;		// Keyed by goal cell.
+	std::unordered_map<uint64_t, uint32_t> leg_lookup;		// (from << 32 | to) -> index into legs.
+	std::vector<RouteLeg> legs;
+	uint16_t epoch;											// Bumped every time legs are flushed.
+};
+
+// Everything grid map mode needs, owned by main().
+struct GridMap
+{
+	NavGrid grid;
+	NavHierarchy hierarchy;
+	PathCache cache;
+};
+
+void InitNavGrid(NavGrid& grid, NavHierarchy& hierarchy, float world_width, float world_height, float cell_size);
+
+// Builds every cluster from scratch, for after many cells of grid.blocked were written at once (e.g. loading a level).
+void BuildNavHierarchy(const NavGrid& grid, NavHierarchy& hierarchy);
+
+uint32_t CellAt(const NavGrid& grid, Position position);
+Position CellCenter(const NavGrid& grid, uint32_t cell);
+
+// Adds or removes one blocker (e.g. a Tower) on the cell containing position and
+// rebuilds only the cluster it is in and the entrances of its neighbours.
+void AddBlocker(NavGrid& grid, NavHierarchy& hierarchy, Position position);
+void RemoveBlocker(NavGrid& grid, NavHierarchy& hierarchy, Position position);
+
+// Returns the leg a Monster standing in start_cell should walk next to reach goal_cell,
+// or INVALID_LEG if the goal is unreachable.
+uint32_t PlanRoute(const NavGrid& grid, const NavHierarchy& hierarchy, PathCache& cache, uint32_t start_cell, uint32_t goal_cell);
+
+bool IsLegStale(const NavHierarchy& hierarchy, const RouteLeg& leg);
+
+// Returns the point the Monster should walk towards this frame on its way to goal,
+// planning or advancing its route as needed. Falls back to goal itself if it is unreachable.
+Position NextRoutePoint(Monster& monster, Position goal, GridMap& grid_map);
@@ -0,0 +1,814 @@
+#include "Replay.h"
+#include "Varint.h"
+
+#include <iostream>
+#include <cmath>
+
+// Ids and Tower indices a reader accepts, far above anything real, so a corrupt file can't make it allocate without bound.
+const uint64_t REPLAY_MAX_ID = 1 << 26;
+
+// Bits in the id gap of an update, saying which fields follow.
+const uint32_t REPLAY_MOVED = 1;
+const uint32_t REPLAY_DAMAGED = 2;
+
+static int32_t Quantize(float value)
+{
+	return (int32_t)lrintf(value * REPLAY_POSITION_SCALE);
+}
+
+static Position QuantizedPosition(Position position)
+{
+	return Position({ Quantize(position.x) / REPLAY_POSITION_SCALE, Quantize(position.y) / REPLAY_POSITION_SCALE });
+}
+
+static ReplayMonster RecordMonster(const ReplayCapturedMonster& monster)
+{
+	return ReplayMonster({ monster.archetype, Quantize(monster.position.x), Quantize(monster.position.y), monster.health });
+}
+
+static void ResetFrame(ReplayFrame& frame, uint32_t tower_archetypes)
+{
+	frame.tick = 0;
+	frame.monsters_killed = 0;
+	frame.player_health = 0;
+	frame.monster_count = 0;
+	frame.monsters.clear();
+	frame.towers.assign(tower_archetypes, std::vector<Position>());
+}
+
+//
+// Encoding.
+//
+
+static void AppendRecord(std::vector<uint8_t>& out, ReplayRecordType type, uint64_t tick, const std::vector<uint8_t>& payload)
+{
+	out.push_back(type);
+	PutVarint(out, tick);
+	PutVarint(out, payload.size());
+	out.insert(out.end(), payload.begin(), payload.end());
+}
+
+static void AppendBytes(std::vector<uint8_t>& out, const std::vector<uint8_t>& bytes)
+{
+	out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+// Keyframe payload, everything in frame.
+static void EncodeFrame(const ReplayFrame& frame, std::vector<uint8_t>& out)
+{
+	out.clear();
+	PutVarint(out, frame.monsters_killed);
+	PutVarint(out, frame.player_health);
+
+	// Monsters in id order, each id as the gap from the one after the previous.
+	PutVarint(out, frame.monster_count);
+	uint32_t next_id = 0;
+	for (uint32_t id = 0; id < frame.monsters.size(); ++id)
+	{
+		const ReplayMonster& monster = frame.monsters[id];
+		if (monster.archetype == INVALID_ARCHETYPE)
+		{
+			continue;
+		}
+		PutVarint(out, id - next_id);
+		PutVarint(out, monster.archetype);
+		PutSignedVarint(out, monster.x);
+		PutSignedVarint(out, monster.y);
+		PutVarint(out, monster.health.value);
+		next_id = id + 1;
+	}
+
+	// Frame positions are already quantized, quantizing them again gives the same numbers back.
+	for (uint32_t b = 0; b < frame.towers.size(); ++b)
+	{
+		PutVarint(out, frame.towers[b].size());
+		for (uint32_t i = 0; i < frame.towers[b].size(); ++i)
+		{
+			PutSignedVarint(out, Quantize(frame.towers[b][i].x));
+			PutSignedVarint(out, Quantize(frame.towers[b][i].y));
+		}
+	}
+}
+
+static void EncodeKeyframe(ReplayEncoder& encoder, const ReplayCapture& capture)
+{
+	ReplayFrame& frame = encoder.frame;
+	frame.monsters_killed = capture.monsters_killed;
+	frame.player_health = capture.player_health;
+
+	const std::vector<uint32_t>& index_of = capture.index_of;
+	frame.monsters.assign(index_of.size(), ReplayMonster({ INVALID_ARCHETYPE, 0, 0, { 0 } }));
+	frame.monster_count = (uint32_t)capture.monsters.size();
+	for (uint32_t id = 0; id < index_of.size(); ++id)
+	{
+		if (index_of[id] != INVALID_INDEX)
+		{
+			frame.monsters[id] = RecordMonster(capture.monsters[index_of[id]]);
+		}
+	}
+
+	// Every Tower is in the keyframe, placed ones included.
+	for (uint32_t b = 0; b < capture.towers.size(); ++b)
+	{
+		frame.towers[b].resize(capture.towers[b].size());
+		for (uint32_t i = 0; i < capture.towers[b].size(); ++i)
+		{
+			frame.towers[b][i] = QuantizedPosition(capture.towers[b][i]);
+		}
+	}
+
+	EncodeFrame(frame, encoder.payload);
+}
+
+static void EncodeDelta(ReplayEncoder& encoder, const ReplayCapture& capture)
+{
+	ReplayFrame& frame = encoder.frame;
+	std::vector<uint8_t>& out = encoder.payload;
+	out.clear();
+
+	PutSignedVarint(out, (int64_t)capture.monsters_killed - frame.monsters_killed);
+	PutSignedVarint(out, (int64_t)capture.player_health - frame.player_health);
+	frame.monsters_killed = capture.monsters_killed;
+	frame.player_health = capture.player_health;
+
+	// One pass over every id, recorded or current, sorting Monsters into spawned, changed and removed.
+	// An id recycled between two recorded ticks for a Monster of the same archetype is recorded as the old one moving.
+	const std::vector<uint32_t>& index_of = capture.index_of;
+	if (frame.monsters.size() < index_of.size())
+	{
+		frame.monsters.resize(index_of.size(), ReplayMonster({ INVALID_ARCHETYPE, 0, 0, { 0 } }));
+	}
+
+	encoder.spawns.clear();
+	encoder.updates.clear();
+	encoder.removals.clear();
+	uint32_t spawn_count = 0;
+	uint32_t update_count = 0;
+	uint32_t removal_count = 0;
+	uint32_t next_spawn = 0;
+	uint32_t next_update = 0;
+	uint32_t next_removal = 0;
+	for (uint32_t id = 0; id < frame.monsters.size(); ++id)
+	{
+		ReplayMonster& recorded = frame.monsters[id];
+		const uint32_t index = id < index_of.size() ? index_of[id] : INVALID_INDEX;
+		if (index == INVALID_INDEX)
+		{
+			if (recorded.archetype != INVALID_ARCHETYPE)
+			{
+				PutVarint(encoder.removals, id - next_removal);
+				next_removal = id + 1;
+				++removal_count;
+				recorded.archetype = INVALID_ARCHETYPE;
+			}
+			continue;
+		}
+
+		const ReplayMonster current = RecordMonster(capture.monsters[index]);
+		if (recorded.archetype != current.archetype)
+		{
+			PutVarint(encoder.spawns, id - next_spawn);
+			PutVarint(encoder.spawns, current.archetype);
+			PutSignedVarint(encoder.spawns, current.x);
+			PutSignedVarint(encoder.spawns, current.y);
+			PutVarint(encoder.spawns, current.health.value);
+			next_spawn = id + 1;
+			++spawn_count;
+		}
+		else
+		{
+			const uint32_t changed = (current.x != recorded.x || current.y != recorded.y ? REPLAY_MOVED : 0) |
+									 (current.health.value != recorded.health.value ? REPLAY_DAMAGED : 0);
+			if (changed == 0)
+			{
+				continue;
+			}
+			PutVarint(encoder.updates, ((uint64_t)(id - next_update) << 2) | changed);
+			if (changed & REPLAY_MOVED)
+			{
+				PutSignedVarint(encoder.updates, (int64_t)current.x - recorded.x);
+				PutSignedVarint(encoder.updates, (int64_t)current.y - recorded.y);
+			}
+			if (changed & REPLAY_DAMAGED)
+			{
+				PutSignedVarint(encoder.updates, (int64_t)current.health.value - recorded.health.value);
+			}
+			next_update = id + 1;
+			++update_count;
+		}
+		recorded = current;
+	}
+	frame.monster_count = (uint32_t)capture.monsters.size();
+
+	for (uint32_t b = 0; b < capture.towers.size(); ++b)
+	{
+		frame.towers[b].resize(capture.towers[b].size());
+	}
+	encoder.placed.clear();
+	for (const ReplayPlacedTower& tower : capture.placed)
+	{
+		const Position position = capture.towers[tower.block][tower.index];
+		PutVarint(encoder.placed, tower.block);
+		PutVarint(encoder.placed, tower.index);
+		PutSignedVarint(encoder.placed, Quantize(position.x));
+		PutSignedVarint(encoder.placed, Quantize(position.y));
+		frame.towers[tower.block][tower.index] = QuantizedPosition(position);
+	}
+	const uint32_t placed_count = (uint32_t)capture.placed.size();
+
+	PutVarint(out, spawn_count);
+	AppendBytes(out, encoder.spawns);
+	PutVarint(out, update_count);
+	AppendBytes(out, encoder.updates);
+	PutVarint(out, removal_count);
+	AppendBytes(out, encoder.removals);
+	PutVarint(out, placed_count);
+	AppendBytes(out, encoder.placed);
+}
+
+void InitReplayEncoder(ReplayEncoder& encoder, uint32_t tower_archetypes, ChangeConsumer consumer)
+{
+	encoder.consumer = consumer;
+	ResetFrame(encoder.frame, tower_archetypes);
+}
+
+void CaptureReplayTick(const ReplayEncoder& encoder, Simulation& sim, ReplayCapture& capture)
+{
+	capture.tick = sim.tick;
+	capture.monsters_killed = sim.monsters_killed;
+	capture.player_health = sim.player_health;
+	capture.index_of = sim.monster_ids.index_of;
+	capture.monsters.resize(sim.monsters.size());
+	for (size_t i = 0; i < sim.monsters.size(); ++i)
+	{
+		const Monster& monster = sim.monsters[i];
+		capture.monsters[i] = ReplayCapturedMonster({ monster.archetype, monster.position, monster.health });
+	}
+
+	// Towers never move, so a changed Tower is a newly placed one.
+	capture.towers.resize(sim.tower_blocks.size());
+	capture.placed.clear();
+	for (uint32_t b = 0; b < sim.tower_blocks.size(); ++b)
+	{
+		TowerBlock& block = sim.tower_blocks[b];
+		capture.towers[b].resize(block.towers.size());
+		for (uint32_t i = 0; i < block.towers.size(); ++i)
+		{
+			capture.towers[b][i] = block.towers[i].position;
+		}
+		ConsumeChanges(block.changes, encoder.consumer, [&](uint32_t index) { capture.placed.push_back(ReplayPlacedTower({ b, index })); });
+	}
+}
+
+ReplayRecordType EncodeReplayCapture(ReplayEncoder& encoder, const ReplayCapture& capture, bool keyframe, std::vector<uint8_t>& out)
+{
+	// Towers only ever disappear when a snapshot is loaded, deltas can only add them.
+	for (uint32_t b = 0; !keyframe && b < capture.towers.size(); ++b)
+	{
+		keyframe = capture.towers[b].size() < encoder.frame.towers[b].size();
+	}
+
+	if (keyframe)
+	{
+		EncodeKeyframe(encoder, capture);
+	}
+	else
+	{
+		EncodeDelta(encoder, capture);
+	}
+	encoder.frame.tick = capture.tick;
+
+	const ReplayRecordType type = keyframe ? REPLAY_KEYFRAME : REPLAY_DELTA;
+	AppendRecord(out, type, capture.tick, encoder.payload);
+	return type;
+}
+
+ReplayRecordType EncodeReplayRecord(ReplayEncoder& encoder, Simulation& sim, bool keyframe, std::vector<uint8_t>& out)
+{
+	CaptureReplayTick(encoder, sim, encoder.capture);
+	return EncodeReplayCapture(encoder, encoder.capture, keyframe, out);
+}
+
+void EncodeReplayFrame(ReplayEncoder& encoder, std::vector<uint8_t>& out)
+{
+	EncodeFrame(encoder.frame, encoder.payload);
+	AppendRecord(out, REPLAY_KEYFRAME, encoder.frame.tick, encoder.payload);
+}
+
+//
+// Writer thread.
+//
+
+static void FlushReplay(ReplayWriter& writer)
+{
+	writer.file.write((const char*)writer.buffer.data(), (std::streamsize)writer.buffer.size());
+	writer.file_offset += writer.buffer.size();
+	writer.buffer.clear();
+}
+
+static void WriteCapture(ReplayWriter& writer, const ReplayCapture& capture)
+{
+	const uint64_t offset = writer.file_offset + writer.buffer.size();
+	const bool keyframe_due = writer.keyframes.empty() || writer.ticks_since_keyframe >= REPLAY_KEYFRAME_INTERVAL;
+	if (EncodeReplayCapture(writer.encoder, capture, keyframe_due, writer.buffer) == REPLAY_KEYFRAME)
+	{
+		writer.keyframes.push_back(ReplayKeyframe({ capture.tick, offset }));
+		writer.ticks_since_keyframe = 0;
+	}
+	++writer.ticks_since_keyframe;
+	++writer.ticks_recorded;
+
+	if (writer.buffer.size() >= REPLAY_FLUSH_SIZE)
+	{
+		FlushReplay(writer);
+	}
+}
+
+static void WriterLoop(ReplayWriter& writer)
+{
+	std::unique_lock<std::mutex> lock(writer.mutex);
+	for (;;)
+	{
+		writer.capture_ready.wait(lock, [&]() { return writer.stopping || writer.queued > 0; });
+		if (writer.queued == 0)
+		{
+			// Only reached when stopping, queued captures are always written first.
+			break;
+		}
+
+		// The simulation thread never touches a queued slot, so it is safe to use unlocked.
+		const ReplayCapture& capture = writer.queue[writer.head];
+		lock.unlock();
+		WriteCapture(writer, capture);
+		lock.lock();
+
+		writer.head = (writer.head + 1) % REPLAY_QUEUE_SIZE;
+		--writer.queued;
+	}
+}
+
+//
+// Simulation thread.
+//
+
+bool OpenReplayWriter(const std::string& path, const Archetypes& archetypes, const Simulation& sim, ReplayWriter& writer)
+{
+	writer.file.open(path, std::ios::binary | std::ios::trunc);
+	if (!writer.file)
+	{
+		std::cerr << "Could not create " << path << std::endl;
+		return false;
+	}
+
+	ReplayHeader header;
+	header.magic = REPLAY_MAGIC;
+	header.version = REPLAY_VERSION;
+	header.world_width = sim.world_width;
+	header.world_height = sim.world_height;
+	header.monster_archetypes = (uint32_t)archetypes.monsters.name.size();
+	header.tower_archetypes = (uint32_t)archetypes.towers.name.size();
+	writer.file.write((const char*)&header, sizeof(header));
+
+	if (!writer.file)
+	{
+		return false;
+	}
+
+	writer.queue.resize(REPLAY_QUEUE_SIZE);
+	writer.head = 0;
+	writer.queued = 0;
+	writer.stopping = false;
+	writer.ticks_dropped = 0;
+	writer.file_offset = sizeof(header);
+	writer.ticks_recorded = 0;
+	writer.buffer.clear();
+	writer.keyframes.clear();
+	writer.ticks_since_keyframe = 0;
+	InitReplayEncoder(writer.encoder, header.tower_archetypes, CONSUMER_NETWORK);
+
+	writer.thread = std::thread(WriterLoop, std::ref(writer));
+	return true;
+}
+
+void RecordReplayTick(ReplayWriter& writer, Simulation& sim)
+{
+	uint32_t slot;
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		slot = writer.queued == REPLAY_QUEUE_SIZE ? REPLAY_QUEUE_SIZE : (writer.head + writer.queued) % REPLAY_QUEUE_SIZE;
+	}
+
+	// Tower changes stay unconsumed, the next capture picks them up.
+	if (slot == REPLAY_QUEUE_SIZE)
+	{
+		++writer.ticks_dropped;
+		return;
+	}
+
+	// Not queued yet, so the writer thread won't look at it until it is.
+	CaptureReplayTick(writer.encoder, sim, writer.queue[slot]);
+
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		++writer.queued;
+	}
+	writer.capture_ready.notify_one();
+}
+
+bool CloseReplayWriter(ReplayWriter& writer)
+{
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		writer.stopping = true;
+	}
+	writer.capture_ready.notify_one();
+	writer.thread.join();
+
+	FlushReplay(writer);
+
+	ReplayFooter footer;
+	footer.index_offset = writer.file_offset;
+	footer.keyframe_count = (uint32_t)writer.keyframes.size();
+	footer.magic = REPLAY_FOOTER_MAGIC;
+	writer.file.write((const char*)writer.keyframes.data(), (std::streamsize)(writer.keyframes.size() * sizeof(ReplayKeyframe)));
+	writer.file.write((const char*)&footer, sizeof(footer));
+	writer.file.close();
+
+	return !writer.file.fail();
+}
+
+//
+// Reading.
+//
+
+static bool ReadStreamVarint(std::istream& stream, uint64_t& value)
+{
+	value = 0;
+	for (uint32_t shift = 0; shift < 64; shift += 7)
+	{
+		const int byte = stream.get();
+		if (byte == EOF)
+		{
+			return false;
+		}
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (byte < 0x80)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Reads a Monster's archetype, position and health (as written for spawns and keyframes).
+static bool DecodeMonster(const uint8_t*& p, const uint8_t* end, uint32_t monster_archetypes, ReplayMonster& monster)
+{
+	uint64_t archetype;
+	int64_t x;
+	int64_t y;
+	uint64_t health;
+	if (!GetVarint(p, end, archetype) || !GetSignedVarint(p, end, x) || !GetSignedVarint(p, end, y) || !GetVarint(p, end, health) ||
+		archetype >= monster_archetypes)
+	{
+		return false;
+	}
+	monster = ReplayMonster({ (uint32_t)archetype, (int32_t)x, (int32_t)y, { (uint32_t)health } });
+	return true;
+}
+
+// Returns the id after skipping gap past next_id, or REPLAY_MAX_ID if that is out of range.
+static uint64_t NextId(uint64_t next_id, uint64_t gap)
+{
+	return gap < REPLAY_MAX_ID && next_id + gap < REPLAY_MAX_ID ? next_id + gap : REPLAY_MAX_ID;
+}
+
+static ReplayMonster* MonsterSlot(ReplayFrame& frame, uint64_t id)
+{
+	if (id >= REPLAY_MAX_ID)
+	{
+		return nullptr;
+	}
+	if (id >= frame.monsters.size())
+	{
+		frame.monsters.resize(id + 1, ReplayMonster({ INVALID_ARCHETYPE, 0, 0, { 0 } }));
+	}
+	return &frame.monsters[id];
+}
+
+static bool DecodeKeyframe(const uint8_t* p, const uint8_t* end, uint32_t monster_archetypes, ReplayFrame& frame)
+{
+	uint64_t kills;
+	uint64_t health;
+	uint64_t count;
+	if (!GetVarint(p, end, kills) || !GetVarint(p, end, health) || !GetVarint(p, end, count))
+	{
+		return false;
+	}
+	frame.monsters_killed = (uint32_t)kills;
+	frame.player_health = (uint32_t)health;
+	frame.monsters.clear();
+	frame.monster_count = 0;
+
+	uint64_t next_id = 0;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t gap;
+		ReplayMonster monster;
+		if (!GetVarint(p, end, gap) || !DecodeMonster(p, end, monster_archetypes, monster))
+		{
+			return false;
+		}
+		const uint64_t id = NextId(next_id, gap);
+		ReplayMonster* slot = MonsterSlot(frame, id);
+		if (!slot)
+		{
+			return false;
+		}
+		*slot = monster;
+		++frame.monster_count;
+		next_id = id + 1;
+	}
+
+	for (uint32_t b = 0; b < frame.towers.size(); ++b)
+	{
+		uint64_t tower_count;
+		if (!GetVarint(p, end, tower_count) || tower_count > REPLAY_MAX_ID)
+		{
+			return false;
+		}
+		frame.towers[b].resize((size_t)tower_count);
+		for (uint64_t i = 0; i < tower_count; ++i)
+		{
+			int64_t x;
+			int64_t y;
+			if (!GetSignedVarint(p, end, x) || !GetSignedVarint(p, end, y))
+			{
+				return false;
+			}
+			frame.towers[b][i] = Position({ x / REPLAY_POSITION_SCALE, y / REPLAY_POSITION_SCALE });
+		}
+	}
+
+	return p == end;
+}
+
+static bool DecodeDelta(const uint8_t* p, const uint8_t* end, uint32_t monster_archetypes, ReplayFrame& frame)
+{
+	int64_t kills;
+	int64_t health;
+	if (!GetSignedVarint(p, end, kills) || !GetSignedVarint(p, end, health))
+	{
+		return false;
+	}
+	frame.monsters_killed = (uint32_t)(frame.monsters_killed + kills);
+	frame.player_health = (uint32_t)(frame.player_health + health);
+
+	uint64_t count;
+	uint64_t next_id = 0;
+	if (!GetVarint(p, end, count))
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t gap;
+		ReplayMonster monster;
+		if (!GetVarint(p, end, gap) || !DecodeMonster(p, end, monster_archetypes, monster))
+		{
+			return false;
+		}
+		const uint64_t id = NextId(next_id, gap);
+		ReplayMonster* slot = MonsterSlot(frame, id);
+		if (!slot)
+		{
+			return false;
+		}
+		frame.monster_count += slot->archetype == INVALID_ARCHETYPE ? 1 : 0;
+		*slot = monster;
+		next_id = id + 1;
+	}
+
+	next_id = 0;
+	if (!GetVarint(p, end, count))
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t gap_and_changes;
+		if (!GetVarint(p, end, gap_and_changes))
+		{
+			return false;
+		}
+		const uint64_t id = NextId(next_id, gap_and_changes >> 2);
+		if (id >= frame.monsters.size() || frame.monsters[id].archetype == INVALID_ARCHETYPE)
+		{
+			return false;
+		}
+		ReplayMonster& monster = frame.monsters[id];
+		if (gap_and_changes & REPLAY_MOVED)
+		{
+			int64_t dx;
+			int64_t dy;
+			if (!GetSignedVarint(p, end, dx) || !GetSignedVarint(p, end, dy))
+			{
+				return false;
+			}
+			monster.x = (int32_t)(monster.x + dx);
+			monster.y = (int32_t)(monster.y + dy);
+		}
+		if (gap_and_changes & REPLAY_DAMAGED)
+		{
+			int64_t damage;
+			if (!GetSignedVarint(p, end, damage))
+			{
+				return false;
+			}
+			monster.health.value = (uint32_t)(monster.health.value + damage);
+		}
+		next_id = id + 1;
+	}
+
+	next_id = 0;
+	if (!GetVarint(p, end, count))
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t gap;
+		if (!GetVarint(p, end, gap))
+		{
+			return false;
+		}
+		const uint64_t id = NextId(next_id, gap);
+		if (id >= frame.monsters.size() || frame.monsters[id].archetype == INVALID_ARCHETYPE)
+		{
+			return false;
+		}
+		frame.monsters[id].archetype = INVALID_ARCHETYPE;
+		--frame.monster_count;
+		next_id = id + 1;
+	}
+
+	if (!GetVarint(p, end, count))
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint64_t block;
+		uint64_t index;
+		int64_t x;
+		int64_t y;
+		if (!GetVarint(p, end, block) || !GetVarint(p, end, index) || !GetSignedVarint(p, end, x) || !GetSignedVarint(p, end, y) ||
+			block >= frame.towers.size() || index >= REPLAY_MAX_ID)
+		{
+			return false;
+		}
+		std::vector<Position>& towers = frame.towers[block];
+		if (index >= towers.size())
+		{
+			towers.resize((size_t)index + 1);
+		}
+		towers[index] = Position({ x / REPLAY_POSITION_SCALE, y / REPLAY_POSITION_SCALE });
+	}
+
+	return p == end;
+}
+
+static bool DecodePayload(uint32_t type, uint64_t tick, const uint8_t* p, const uint8_t* end, uint32_t monster_archetypes, ReplayFrame& frame)
+{
+	const bool valid = type == REPLAY_KEYFRAME ? DecodeKeyframe(p, end, monster_archetypes, frame)
+											   : type == REPLAY_DELTA && DecodeDelta(p, end, monster_archetypes, frame);
+	frame.tick = tick;
+	return valid;
+}
+
+void InitReplayFrame(ReplayFrame& frame, uint32_t tower_archetypes)
+{
+	ResetFrame(frame, tower_archetypes);
+}
+
+bool PeekReplayRecord(const uint8_t* data, const uint8_t* end, size_t& size)
+{
+	const uint8_t* p = data + 1;
+	uint64_t tick;
+	uint64_t payload_size;
+	if (data >= end || !GetVarint(p, end, tick) || !GetVarint(p, end, payload_size) || payload_size > (uint64_t)(end - p))
+	{
+		return false;
+	}
+	size = (size_t)(p - data) + (size_t)payload_size;
+	return true;
+}
+
+bool DecodeReplayRecord(const uint8_t*& data, const uint8_t* end, uint32_t monster_archetypes, ReplayFrame& frame)
+{
+	size_t size;
+	if (!PeekReplayRecord(data, end, size))
+	{
+		return false;
+	}
+	const uint8_t* p = data + 1;
+	uint64_t tick;
+	uint64_t payload_size;
+	GetVarint(p, end, tick);
+	GetVarint(p, end, payload_size);
+	const bool valid = DecodePayload(data[0], tick, p, data + size, monster_archetypes, frame);
+	data += size;
+	return valid;
+}
+
+bool OpenReplay(const std::string& path, ReplayReader& reader)
+{
+	reader.file.open(path, std::ios::binary);
+	if (!reader.file)
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+
+	reader.file.seekg(0, std::ios::end);
+	reader.file_size = (uint64_t)reader.file.tellg();
+	reader.file.seekg(0);
+	if (reader.file_size < sizeof(ReplayHeader) || !reader.file.read((char*)&reader.header, sizeof(reader.header)) ||
+		reader.header.magic != REPLAY_MAGIC || reader.header.version != REPLAY_VERSION)
+	{
+		std::cerr << path << ": not a version " << REPLAY_VERSION << " replay" << std::endl;
+		return false;
+	}
+
+	// Use the keyframe index if the replay was closed properly, otherwise records run to the end of the file.
+	reader.records_end = reader.file_size;
+	reader.keyframes.clear();
+	ReplayFooter footer;
+	if (reader.file_size >= sizeof(ReplayHeader) + sizeof(ReplayFooter))
+	{
+		reader.file.seekg((std::streamoff)(reader.file_size - sizeof(ReplayFooter)));
+		if (reader.file.read((char*)&footer, sizeof(footer)) && footer.magic == REPLAY_FOOTER_MAGIC && footer.index_offset >= sizeof(ReplayHeader) &&
+			footer.index_offset + (uint64_t)footer.keyframe_count * sizeof(ReplayKeyframe) + sizeof(ReplayFooter) == reader.file_size)
+		{
+			reader.keyframes.resize(footer.keyframe_count);
+			reader.file.seekg((std::streamoff)footer.index_offset);
+			reader.file.read((char*)reader.keyframes.data(), (std::streamsize)(footer.keyframe_count * sizeof(ReplayKeyframe)));
+			reader.records_end = footer.index_offset;
+		}
+	}
+
+	reader.file.clear();
+	reader.file.seekg(sizeof(ReplayHeader));
+	ResetFrame(reader.frame, reader.header.tower_archetypes);
+	return (bool)reader.file;
+}
+
+bool ReadReplayRecord(ReplayReader& reader)
+{
+	const uint64_t offset = (uint64_t)reader.file.tellg();
+	if (!reader.file || offset >= reader.records_end)
+	{
+		return false;
+	}
+
+	const int type = reader.file.get();
+	uint64_t tick;
+	uint64_t size;
+	if (type == EOF || !ReadStreamVarint(reader.file, tick) || !ReadStreamVarint(reader.file, size) ||
+		(uint64_t)reader.file.tellg() + size > reader.records_end)
+	{
+		return false;
+	}
+
+	reader.payload.resize((size_t)size);
+	if (!reader.file.read((char*)reader.payload.data(), (std::streamsize)size))
+	{
+		return false;
+	}
+
+	return DecodePayload((uint32_t)type, tick, reader.payload.data(), reader.payload.data() + size, reader.header.monster_archetypes, reader.frame);
+}
+
+bool SeekReplay(ReplayReader& reader, uint64_t tick)
+{
+	// Without an index, carry on from here if that is still before tick, otherwise start over.
+	uint64_t offset = sizeof(ReplayHeader);
+	for (uint32_t i = 0; i < reader.keyframes.size() && reader.keyframes[i].tick <= tick; ++i)
+	{
+		offset = reader.keyframes[i].offset;
+	}
+	if (!reader.keyframes.empty() || reader.frame.tick > tick)
+	{
+		reader.file.clear();
+		reader.file.seekg((std::streamoff)offset);
+	}
+
+	do
+	{
+		if (!ReadReplayRecord(reader))
+		{
+			return false;
+		}
+	} while (reader.frame.tick < tick);
+
+	return true;
+}
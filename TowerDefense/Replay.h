@@ -0,0 +1,234 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//
+// Replay stream, what the simulation looked like every tick in a compact file.
+//
+// Recorded ticks are a sequence of records. A keyframe holds the whole visible state
+// (every Monster, every Tower, kills and player health), every other record is a delta holding
+// only what changed since the tick before it: Monsters spawned, moved, damaged or removed,
+// Towers placed and counter changes. Keyframes are written every REPLAY_KEYFRAME_INTERVAL
+// ticks so playback can start near any tick without decoding the whole file.
+//
+// Positions are quantized to 1 / REPLAY_POSITION_SCALE pixel and every number is a varint
+// (see Varint.h), Monsters are visited in id order so ids are written as the gap from the
+// previous one. A Monster walking at normal speed costs about 4 bytes per tick.
+//
+// Only what a viewer needs is recorded, Bullets, lightning arcs and status effects are not.
+// It is not a snapshot (see Snapshot.h), a replay can't be resumed from.
+//
+// Like telemetry (see Telemetry.h) the simulation thread only copies the tick into a free slot
+// of a small ring of reusable captures, diffing, encoding and writing happen on a writer
+// thread. The simulation never waits on the writer, a tick that finds every slot full is not
+// recorded and the next recorded delta covers both. Playback then holds the previous tick.
+//
+// File layout:
+//   ReplayHeader
+//   records: u8 type, varint tick, varint payload size, payload
+//   keyframe index: ReplayKeyframe per keyframe, then ReplayFooter, written when the replay is closed.
+// A replay that was never closed (e.g. the game crashed) has no index but can still be read
+// sequentially, record by record.
+//
+
+const uint32_t REPLAY_MAGIC = 0x50524454;		// "TDRP"
+const uint32_t REPLAY_FOOTER_MAGIC = 0x58494454;	// "TDIX"
+const uint32_t REPLAY_VERSION = 1;
+
+const uint32_t REPLAY_KEYFRAME_INTERVAL = 300;
+
+// Quantized positions are pixels * REPLAY_POSITION_SCALE, rounded.
+const float REPLAY_POSITION_SCALE = 8.0f;
+
+// Records are written to the file once this many bytes are buffered.
+const uint32_t REPLAY_FLUSH_SIZE = 1 << 20;
+
+// Captured ticks waiting for the writer thread before new ones are skipped.
+const uint32_t REPLAY_QUEUE_SIZE = 4;
+
+enum ReplayRecordType : uint8_t
+{
+	REPLAY_KEYFRAME = 0,
+	REPLAY_DELTA = 1,
+};
+
+// 4 byte aligned, 24 byte size.
+struct ReplayHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	float world_width;
+	float world_height;
+	uint32_t monster_archetypes;
+	uint32_t tower_archetypes;
+};
+
+// 8 byte aligned, 16 byte size.
+struct ReplayKeyframe
+{
+	uint64_t tick;
+	uint64_t offset;		// Of the keyframe record, from the start of the file.
+};
+
+// 8 byte aligned, 16 byte size.
+struct ReplayFooter
+{
+	uint64_t index_offset;	// Of the first ReplayKeyframe.
+	uint32_t keyframe_count;
+	uint32_t magic;
+};
+
+// A Monster as recorded, quantized.
+struct ReplayMonster
+{
+	uint32_t archetype;		// INVALID_ARCHETYPE if no Monster has this id.
+	int32_t x;
+	int32_t y;
+	Health health;
+};
+
+// Everything a replay records at one tick. The encoder keeps the last frame it wrote to diff
+// against, the reader rebuilds the same frame as it reads.
+struct ReplayFrame
+{
+	uint64_t tick;
+	uint32_t monsters_killed;
+	uint32_t player_health;
+	uint32_t monster_count;							// Live entries in monsters.
+	std::vector<ReplayMonster> monsters;			// Indexed by Monster id.
+	std::vector<std::vector<Position>> towers;		// Tower positions of each Tower archetype.
+};
+
+// A Monster as captured, before quantizing.
+struct ReplayCapturedMonster
+{
+	uint32_t archetype;
+	Position position;
+	Health health;
+};
+
+// A Tower placed since the encoder's last capture.
+struct ReplayPlacedTower
+{
+	uint32_t block;
+	uint32_t index;
+};
+
+// What the simulation thread copies of a tick for encoding elsewhere. Monsters are in the
+// simulation's order so the copy is one sequential pass, index_of finds them by id.
+struct ReplayCapture
+{
+	uint64_t tick;
+	uint32_t monsters_killed;
+	uint32_t player_health;
+	std::vector<uint32_t> index_of;					// Copy of the simulation's Monster ids.
+	std::vector<ReplayCapturedMonster> monsters;
+	std::vector<std::vector<Position>> towers;		// Tower positions of each Tower archetype.
+	std::vector<ReplayPlacedTower> placed;
+};
+
+// Turns a simulation into records, each delta against the frame of the record before it.
+// Used by ReplayWriter, and by anything else streaming records (e.g. SpectatorServer.h).
+struct ReplayEncoder
+{
+	ChangeConsumer consumer;			// Whose Tower changes it consumes, one encoder per consumer.
+	ReplayFrame frame;					// As of the last record.
+	ReplayCapture capture;				// Scratch for EncodeReplayRecord.
+	std::vector<uint8_t> payload;		// Scratch, reused every record.
+	std::vector<uint8_t> spawns;
+	std::vector<uint8_t> updates;
+	std::vector<uint8_t> removals;
+	std::vector<uint8_t> placed;
+};
+
+struct ReplayWriter
+{
+	std::ofstream file;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable capture_ready;
+	std::vector<ReplayCapture> queue;	// Ring of REPLAY_QUEUE_SIZE captures, reused.
+	uint32_t head;						// Oldest queued capture.
+	uint32_t queued;
+	bool stopping;
+
+	// Simulation thread only.
+	uint64_t ticks_dropped;				// Skipped because the queue was full.
+
+	// Writer thread only, read them after CloseReplayWriter.
+	uint64_t file_offset;				// Bytes written to file so far.
+	uint64_t ticks_recorded;
+	std::vector<uint8_t> buffer;		// Records not yet written to file.
+	std::vector<ReplayKeyframe> keyframes;
+	ReplayEncoder encoder;
+	uint32_t ticks_since_keyframe;
+};
+
+struct ReplayReader
+{
+	std::ifstream file;
+	ReplayHeader header;
+	uint64_t file_size;
+	uint64_t records_end;				// Where records stop, the index or the end of the file.
+	std::vector<ReplayKeyframe> keyframes;	// Empty if the replay was never closed.
+	ReplayFrame frame;					// As of the last record read.
+	std::vector<uint8_t> payload;		// Scratch.
+};
+
+void InitReplayEncoder(ReplayEncoder& encoder, uint32_t tower_archetypes, ChangeConsumer consumer);
+
+// Copies what the next record of sim needs into capture. Consumes the encoder's Tower changes,
+// so every capture must be encoded, in order.
+void CaptureReplayTick(const ReplayEncoder& encoder, Simulation& sim, ReplayCapture& capture);
+
+// Appends a record of capture to out. It is a keyframe if keyframe is true or if a delta can't
+// describe what changed (Towers went away, e.g. because a snapshot was loaded).
+ReplayRecordType EncodeReplayCapture(ReplayEncoder& encoder, const ReplayCapture& capture, bool keyframe, std::vector<uint8_t>& out);
+
+// Both of the above in one go, for encoding on the simulation thread.
+ReplayRecordType EncodeReplayRecord(ReplayEncoder& encoder, Simulation& sim, bool keyframe, std::vector<uint8_t>& out);
+
+// Appends a keyframe of the encoder's last record to out, for someone starting from there.
+void EncodeReplayFrame(ReplayEncoder& encoder, std::vector<uint8_t>& out);
+
+// Starts the writer thread.
+bool OpenReplayWriter(const std::string& path, const Archetypes& archetypes, const Simulation& sim, ReplayWriter& writer);
+
+// Captures sim as it is now for the writer thread, call once per tick. Never blocks on the
+// writer thread. Consumes the CONSUMER_NETWORK changes of every TowerBlock, nothing else may
+// consume them while recording.
+void RecordReplayTick(ReplayWriter& writer, Simulation& sim);
+
+// Encodes every queued capture, joins the writer thread, then writes what is still buffered
+// and the keyframe index.
+bool CloseReplayWriter(ReplayWriter& writer);
+
+// Decoding records from memory instead of a file, e.g. as they arrive over a socket.
+void InitReplayFrame(ReplayFrame& frame, uint32_t tower_archetypes);
+
+// Returns true once all of the record at data is between data and end, and its size.
+bool PeekReplayRecord(const uint8_t* data, const uint8_t* end, size_t& size);
+
+// Applies the record at data to frame and moves data past it. Returns false if it is incomplete or corrupt.
+bool DecodeReplayRecord(const uint8_t*& data, const uint8_t* end, uint32_t monster_archetypes, ReplayFrame& frame);
+
+bool OpenReplay(const std::string& path, ReplayReader& reader);
+
+// Reads the next record into reader.frame, returns false at the end of the replay or if it is corrupt.
+bool ReadReplayRecord(ReplayReader& reader);
+
+// Reads forward from the last keyframe at or before tick until reader.frame is at tick
+// (or the first recorded tick after it). Returns false if tick is past the end.
+bool SeekReplay(ReplayReader& reader, uint64_t tick);
+
+inline Position ReplayPosition(const ReplayMonster& monster)
+{
+	return Position({ monster.x / REPLAY_POSITION_SCALE, monster.y / REPLAY_POSITION_SCALE });
+}
@@ -0,0 +1,248 @@
+#include "Results.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+
+static int64_t LiveAllocations()
+{
+	return (int64_t)(AllocationCount() - DeallocationCount());
+}
+
+static uint32_t HistogramBucket(float seconds)
+{
+	const float microseconds = seconds * 1e6f;
+	if (microseconds <= 1.0f)
+	{
+		return 0;
+	}
+	const uint32_t bucket = (uint32_t)(log2f(microseconds) * RESULTS_BUCKETS_PER_DOUBLING);
+	return bucket < RESULTS_HISTOGRAM_BUCKETS ? bucket : RESULTS_HISTOGRAM_BUCKETS - 1;
+}
+
+// Upper bound of a bucket, in seconds.
+static float HistogramSeconds(uint32_t bucket)
+{
+	return exp2f((float)(bucket + 1) / RESULTS_BUCKETS_PER_DOUBLING) * 1e-6f;
+}
+
+static float HistogramPercentile(const std::vector<uint64_t>& histogram, uint64_t count, float percentile)
+{
+	const uint64_t rank = (uint64_t)ceil(percentile * count);
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < histogram.size(); ++i)
+	{
+		seen += histogram[i];
+		if (seen >= rank && seen > 0)
+		{
+			return HistogramSeconds(i);
+		}
+	}
+	return 0.0f;
+}
+
+// Nearest rank percentile of an unsorted interval, partially sorting scratch.
+static float IntervalPercentile(std::vector<float>& scratch, float percentile)
+{
+	const size_t rank = (size_t)ceil(percentile * scratch.size());
+	const size_t index = rank > 0 ? rank - 1 : 0;
+	std::nth_element(scratch.begin(), scratch.begin() + index, scratch.end());
+	return scratch[index];
+}
+
+static void StartInterval(ResultsReporter& results, uint32_t kills)
+{
+	results.tick_seconds.clear();
+	results.peak_monsters = 0;
+	results.peak_bullets = 0;
+	results.start_allocations = AllocationCount();
+	results.start_kills = kills;
+}
+
+static void EndInterval(ResultsReporter& results)
+{
+	if (results.tick_seconds.empty())
+	{
+		return;
+	}
+
+	double seconds = 0.0;
+	float longest = 0.0f;
+	for (uint32_t i = 0; i < results.tick_seconds.size(); ++i)
+	{
+		seconds += results.tick_seconds[i];
+		longest = std::max(longest, results.tick_seconds[i]);
+	}
+	results.sorted = results.tick_seconds;
+
+	results.end_tick.push_back(results.last_tick);
+	results.ticks.push_back((uint32_t)results.tick_seconds.size());
+	results.ticks_per_second.push_back(seconds > 0.0 ? results.tick_seconds.size() / seconds : 0.0);
+	results.p50_ms.push_back(IntervalPercentile(results.sorted, 0.5f) * 1000.0f);
+	results.p99_ms.push_back(IntervalPercentile(results.sorted, 0.99f) * 1000.0f);
+	results.max_ms.push_back(longest * 1000.0f);
+	results.row_peak_monsters.push_back(results.peak_monsters);
+	results.row_peak_bullets.push_back(results.peak_bullets);
+	results.allocations.push_back(AllocationCount() - results.start_allocations);
+	results.live_allocations.push_back(LiveAllocations());
+	results.kills.push_back(results.last_kills - results.start_kills);
+
+	// Written as soon as it's known, so a run that's stopped keeps it.
+	const size_t row = results.end_tick.size() - 1;
+	results.csv << results.mode << ',' << results.end_tick[row] << ',' << results.ticks[row] << ',' << results.ticks_per_second[row] << ','
+				<< results.p50_ms[row] << ',' << results.p99_ms[row] << ',' << results.max_ms[row] << ',' << results.row_peak_monsters[row]
+				<< ',' << results.row_peak_bullets[row] << ',' << results.allocations[row] << ',' << results.live_allocations[row] << ','
+				<< results.kills[row] << '\n';
+	results.csv.flush();
+
+	StartInterval(results, results.last_kills);
+}
+
+template <typename T>
+static void WriteColumn(std::ofstream& json, const char* name, const std::vector<T>& column, bool last)
+{
+	json << "    \"" << name << "\": [";
+	for (size_t i = 0; i < column.size(); ++i)
+	{
+		json << (i > 0 ? ", " : "") << column[i];
+	}
+	json << (last ? "]\n" : "],\n");
+}
+
+bool OpenResults(const std::string& prefix, const std::string& mode, uint32_t interval, ResultsReporter& results)
+{
+	results.open = false;
+	if (prefix.empty())
+	{
+		return true;
+	}
+
+	results.csv.open(prefix + ".csv", std::ios::trunc);
+	if (!results.csv)
+	{
+		std::cerr << "Could not create " << prefix << ".csv" << std::endl;
+		return false;
+	}
+	results.csv << std::setprecision(6);
+	results.csv << "mode,end_tick,ticks,ticks_per_second,p50_ms,p99_ms,max_ms,peak_monsters,peak_bullets,allocations,live_allocations,kills\n";
+
+	results.open = true;
+	results.mode = mode;
+	results.json_path = prefix + ".json";
+	results.interval = interval > 0 ? interval : RESULTS_DEFAULT_INTERVAL;
+	results.run_ticks = 0;
+	results.run_seconds = 0.0;
+	results.run_max = 0.0f;
+	results.run_peak_monsters = 0;
+	results.run_peak_bullets = 0;
+	results.run_start_allocations = AllocationCount();
+	results.run_start_live = LiveAllocations();
+	results.last_tick = 0;
+	results.last_kills = 0;
+	results.histogram.assign(RESULTS_HISTOGRAM_BUCKETS, 0);
+	results.tick_seconds.reserve(results.interval);
+	StartInterval(results, 0);
+	return true;
+}
+
+void RecordResultsTick(ResultsReporter& results, const Simulation& sim, float seconds)
+{
+	if (!results.open)
+	{
+		return;
+	}
+	// Kills are counted from the end of the first tick, the run's start state isn't known here.
+	if (results.run_ticks == 0)
+	{
+		results.start_kills = sim.monsters_killed;
+	}
+	results.last_tick = sim.tick;
+	results.last_kills = sim.monsters_killed;
+
+	const uint32_t monsters = (uint32_t)sim.monsters.size();
+	const uint32_t bullets = (uint32_t)BulletCount(sim);
+	results.tick_seconds.push_back(seconds);
+	results.peak_monsters = std::max(results.peak_monsters, monsters);
+	results.peak_bullets = std::max(results.peak_bullets, bullets);
+
+	++results.run_ticks;
+	results.run_seconds += seconds;
+	results.run_max = std::max(results.run_max, seconds);
+	results.run_peak_monsters = std::max(results.run_peak_monsters, monsters);
+	results.run_peak_bullets = std::max(results.run_peak_bullets, bullets);
+	++results.histogram[HistogramBucket(seconds)];
+
+	if (results.tick_seconds.size() >= results.interval)
+	{
+		EndInterval(results);
+	}
+}
+
+void AddResult(ResultsReporter& results, const std::string& name, double value)
+{
+	if (!results.open)
+	{
+		return;
+	}
+	results.summary_names.push_back(name);
+	results.summary_values.push_back(value);
+}
+
+bool CloseResults(ResultsReporter& results)
+{
+	if (!results.open)
+	{
+		return true;
+	}
+	results.open = false;
+
+	// The last interval is usually shorter.
+	EndInterval(results);
+	results.csv.close();
+	const bool csv_written = !results.csv.fail();
+
+	std::vector<std::string> names;
+	std::vector<double> values;
+	if (results.run_ticks > 0)
+	{
+		names = { "ticks", "seconds", "ticks_per_second", "p50_ms", "p99_ms", "max_ms", "peak_monsters", "peak_bullets", "allocations",
+				  "live_allocation_growth" };
+		values = { (double)results.run_ticks, results.run_seconds, results.run_seconds > 0.0 ? results.run_ticks / results.run_seconds : 0.0,
+				   HistogramPercentile(results.histogram, results.run_ticks, 0.5f) * 1000.0, HistogramPercentile(results.histogram, results.run_ticks, 0.99f) * 1000.0,
+				   results.run_max * 1000.0, (double)results.run_peak_monsters, (double)results.run_peak_bullets,
+				   (double)(AllocationCount() - results.run_start_allocations), (double)(LiveAllocations() - results.run_start_live) };
+	}
+	names.insert(names.end(), results.summary_names.begin(), results.summary_names.end());
+	values.insert(values.end(), results.summary_values.begin(), results.summary_values.end());
+
+	std::ofstream json(results.json_path, std::ios::trunc);
+	json << std::setprecision(9);
+	json << "{\n  \"mode\": \"" << results.mode << "\",\n  \"summary\": {\n";
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		json << "    \"" << names[i] << "\": " << (std::isfinite(values[i]) ? values[i] : 0.0) << (i + 1 < names.size() ? ",\n" : "\n");
+	}
+	json << "  },\n  \"intervals\": {\n";
+	WriteColumn(json, "end_tick", results.end_tick, false);
+	WriteColumn(json, "ticks", results.ticks, false);
+	WriteColumn(json, "ticks_per_second", results.ticks_per_second, false);
+	WriteColumn(json, "p50_ms", results.p50_ms, false);
+	WriteColumn(json, "p99_ms", results.p99_ms, false);
+	WriteColumn(json, "max_ms", results.max_ms, false);
+	WriteColumn(json, "peak_monsters", results.row_peak_monsters, false);
+	WriteColumn(json, "peak_bullets", results.row_peak_bullets, false);
+	WriteColumn(json, "allocations", results.allocations, false);
+	WriteColumn(json, "live_allocations", results.live_allocations, false);
+	WriteColumn(json, "kills", results.kills, true);
+	json << "  }\n}\n";
+	json.close();
+
+	if (!csv_written || !json)
+	{
+		std::cerr << "Could not write results " << results.json_path << std::endl;
+		return false;
+	}
+	return true;
+}
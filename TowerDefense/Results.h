@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+//
+// Machine readable results of the headless modes (--simulate, --forecast, --benchmark), one
+// schema for all of them so dashboards read every run the same way.
+//
+// A run has a mode, summary values (named numbers, in the order they were added) and, for
+// modes that step a simulation, a row per interval of ticks: tick rate, tick time percentiles,
+// peak entity counts, allocations and kills. Rows are kept in columns, one vector per field,
+// and each is also appended to the CSV file as soon as its interval ends, so a long run that
+// is stopped early still leaves every finished interval behind. Closing writes the JSON file:
+// the summary and every row, column by column.
+//
+//   <prefix>.csv    mode,end_tick,ticks,ticks_per_second,p50_ms,p99_ms,max_ms,peak_monsters,
+//                   peak_bullets,allocations,live_allocations,kills
+//   <prefix>.json   { "mode": ..., "summary": { name: value, ... },
+//                     "intervals": { "end_tick": [ ... ], "ticks": [ ... ], ... } }
+//
+// live_allocations is operator new calls minus operator delete calls (see Metrics.h), if it
+// keeps growing from one interval to the next something is leaking. Run percentiles come from
+// a log scale histogram (about 2% wide buckets), interval percentiles are exact.
+//
+
+const uint32_t RESULTS_DEFAULT_INTERVAL = 600;
+
+// Run tick time histogram buckets per doubling, and buckets in all (1 us to over an hour).
+const uint32_t RESULTS_BUCKETS_PER_DOUBLING = 32;
+const uint32_t RESULTS_HISTOGRAM_BUCKETS = 32 * RESULTS_BUCKETS_PER_DOUBLING;
+
+struct ResultsReporter
+{
+	bool open;							// False if no results were asked for, every function does nothing.
+	std::string mode;
+	std::string json_path;
+	std::ofstream csv;
+	uint32_t interval;					// Ticks per row.
+
+	// The interval being measured.
+	std::vector<float> tick_seconds;
+	std::vector<float> sorted;			// Scratch.
+	uint32_t peak_monsters;
+	uint32_t peak_bullets;
+	uint64_t start_allocations;
+	uint32_t start_kills;
+	uint64_t last_tick;					// As of the last tick recorded.
+	uint32_t last_kills;
+
+	// Rows, one entry per interval.
+	std::vector<uint64_t> end_tick;
+	std::vector<uint32_t> ticks;
+	std::vector<double> ticks_per_second;
+	std::vector<float> p50_ms;
+	std::vector<float> p99_ms;
+	std::vector<float> max_ms;
+	std::vector<uint32_t> row_peak_monsters;
+	std::vector<uint32_t> row_peak_bullets;
+	std::vector<uint64_t> allocations;
+	std::vector<int64_t> live_allocations;
+	std::vector<uint32_t> kills;
+
+	// The whole run.
+	uint64_t run_ticks;
+	double run_seconds;
+	float run_max;
+	uint32_t run_peak_monsters;
+	uint32_t run_peak_bullets;
+	uint64_t run_start_allocations;
+	int64_t run_start_live;
+	std::vector<uint64_t> histogram;
+	std::vector<std::string> summary_names;
+	std::vector<double> summary_values;
+};
+
+// An empty prefix opens nothing and succeeds. Returns false if the CSV file can't be created.
+bool OpenResults(const std::string& prefix, const std::string& mode, uint32_t interval, ResultsReporter& results);
+
+// Call after every tick with how long it took.
+void RecordResultsTick(ResultsReporter& results, const Simulation& sim, float seconds);
+
+void AddResult(ResultsReporter& results, const std::string& name, double value);
+
+// Ends the last partial interval, adds the run's tick summary if any ticks were recorded and
+// writes the JSON file. Returns false if a file couldn't be written.
+bool CloseResults(ResultsReporter& results);
@@ -0,0 +1,136 @@
+#include "Separation.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SEPARATION_USE_SSE2 1
+#else
+#define SEPARATION_USE_SSE2 0
+#endif
+
+// Offset given to unused neighbour slots, far enough that they contribute no force.
+const float UNUSED_OFFSET = 1.0e6f;
+
+// Sums the push from every neighbour offset (Monster position - neighbour position).
+// Each neighbour pushes with weight (1 / d - 1 / r), clamped to 0, so the push along the
+// offset is (1 - d / r): full strength when overlapping exactly, none at the radius.
+// Offsets must not be zero, coincident Monsters are given a small offset before calling this.
+static void SeparationKernel(const float* offset_x, const float* offset_y, float& force_x, float& force_y)
+{
+#if SEPARATION_USE_SSE2
+	const __m128 inv_radius = _mm_set1_ps(1.0f / SEPARATION_RADIUS);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 sum_x = zero;
+	__m128 sum_y = zero;
+	for (uint32_t k = 0; k < SEPARATION_MAX_NEIGHBOURS; k += 4)
+	{
+		const __m128 x = _mm_loadu_ps(offset_x + k);
+		const __m128 y = _mm_loadu_ps(offset_y + k);
+		const __m128 d2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+		const __m128 weight = _mm_max_ps(_mm_sub_ps(_mm_rsqrt_ps(d2), inv_radius), zero);
+		sum_x = _mm_add_ps(sum_x, _mm_mul_ps(x, weight));
+		sum_y = _mm_add_ps(sum_y, _mm_mul_ps(y, weight));
+	}
+
+	// Horizontal add of the 4 lanes.
+	float lanes_x[4];
+	float lanes_y[4];
+	_mm_storeu_ps(lanes_x, sum_x);
+	_mm_storeu_ps(lanes_y, sum_y);
+	force_x = (lanes_x[0] + lanes_x[1]) + (lanes_x[2] + lanes_x[3]);
+	force_y = (lanes_y[0] + lanes_y[1]) + (lanes_y[2] + lanes_y[3]);
+#else
+	const float inv_radius = 1.0f / SEPARATION_RADIUS;
+	force_x = 0.0f;
+	force_y = 0.0f;
+	for (uint32_t k = 0; k < SEPARATION_MAX_NEIGHBOURS; ++k)
+	{
+		const float d2 = offset_x[k] * offset_x[k] + offset_y[k] * offset_y[k];
+		const float weight = fmaxf(1.0f / sqrtf(d2) - inv_radius, 0.0f);
+		force_x += offset_x[k] * weight;
+		force_y += offset_y[k] * weight;
+	}
+#endif
+}
+
+void UpdateSeparation(const SpatialGrid& grid, std::vector<Monster>& monsters)
+{
+	const float radius_squared = SEPARATION_RADIUS * SEPARATION_RADIUS;
+
+	float offset_x[SEPARATION_MAX_NEIGHBOURS];
+	float offset_y[SEPARATION_MAX_NEIGHBOURS];
+
+	// Walk Monsters in grid order so neighbouring cells stay in cache between Monsters.
+	for (uint32_t slot = 0; slot < grid.entity.size(); ++slot)
+	{
+		const uint32_t cell = grid.entity_cell[grid.entity[slot]];
+		const uint32_t cell_x = cell % grid.width;
+		const uint32_t cell_y = cell / grid.width;
+		const uint32_t min_x = cell_x > 0 ? cell_x - 1 : 0;
+		const uint32_t max_x = cell_x + 1 < grid.width ? cell_x + 1 : cell_x;
+		const uint32_t min_y = cell_y > 0 ? cell_y - 1 : 0;
+		const uint32_t max_y = cell_y + 1 < grid.height ? cell_y + 1 : cell_y;
+
+		const uint32_t self = grid.entity[slot];
+		const float x = grid.x[slot];
+		const float y = grid.y[slot];
+
+		// Gather up to SEPARATION_MAX_NEIGHBOURS overlapping Monsters.
+		uint32_t count = 0;
+		for (uint32_t ny = min_y; ny <= max_y && count < SEPARATION_MAX_NEIGHBOURS; ++ny)
+		{
+			for (uint32_t nx = min_x; nx <= max_x && count < SEPARATION_MAX_NEIGHBOURS; ++nx)
+			{
+				const uint32_t neighbour_cell = ny * grid.width + nx;
+				for (uint32_t other = grid.cell_start[neighbour_cell]; other < grid.cell_start[neighbour_cell + 1] && count < SEPARATION_MAX_NEIGHBOURS; ++other)
+				{
+					if (other == slot)
+					{
+						continue;
+					}
+
+					float ox = x - grid.x[other];
+					float oy = y - grid.y[other];
+					const float d2 = ox * ox + oy * oy;
+					if (d2 >= radius_squared)
+					{
+						continue;
+					}
+
+					if (d2 < 1e-6f)
+					{
+						// Exactly on top of each other (e.g. both just spawned), pick a direction from the
+						// pair of indices. Swapping the pair flips the direction so they push apart.
+						const uint32_t low = self < grid.entity[other] ? self : grid.entity[other];
+						const uint32_t high = self < grid.entity[other] ? grid.entity[other] : self;
+						const float angle = (float)((low * 2654435761u) ^ (high * 40503u)) * (6.2831853f / 4294967296.0f);
+						const float sign = self < grid.entity[other] ? 1.0f : -1.0f;
+						ox = sign * cosf(angle) * 0.01f;
+						oy = sign * sinf(angle) * 0.01f;
+					}
+
+					offset_x[count] = ox;
+					offset_y[count] = oy;
+					++count;
+				}
+			}
+		}
+
+		for (uint32_t k = count; k < SEPARATION_MAX_NEIGHBOURS; ++k)
+		{
+			offset_x[k] = UNUSED_OFFSET;
+			offset_y[k] = UNUSED_OFFSET;
+		}
+
+		float force_x;
+		float force_y;
+		SeparationKernel(offset_x, offset_y, force_x, force_y);
+
+		// Never push harder than SEPARATION_STRENGTH however crowded it gets.
+		const float magnitude = sqrtf(force_x * force_x + force_y * force_y);
+		const float scale = magnitude > 1.0f ? SEPARATION_STRENGTH / magnitude : SEPARATION_STRENGTH;
+		monsters[self].velocity.x = force_x * scale;
+		monsters[self].velocity.y = force_y * scale;
+	}
+}
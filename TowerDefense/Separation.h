@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Components.h"
+#include "SpatialGrid.h"
+
+#include <vector>
+
+//
+// Local crowd separation (the separation rule from boids).
+//
+// Each Monster is pushed away from the Monsters overlapping it so a wave spreads out
+// instead of every Monster walking the exact same line. Neighbours come from the
+// SpatialGrid and are capped at SEPARATION_MAX_NEIGHBOURS per Monster, so the cost
+// is linear in the number of Monsters however tightly they are packed.
+//
+
+// Sizes are in pixels. Must not be larger than the SpatialGrid cell size
+// as only the 3x3 block of cells around each Monster is searched.
+const float SEPARATION_RADIUS = 32.0f;
+
+// Speed is pixels per second.
+const float SEPARATION_STRENGTH = 60.0f;
+
+// Multiple of 4 so the force kernel runs on whole SSE registers.
+const uint32_t SEPARATION_MAX_NEIGHBOURS = 16;
+
+// Writes each Monster's separation push into its Velocity component.
+// The grid must have been built from the same monsters vector.
+void UpdateSeparation(const SpatialGrid& grid, std::vector<Monster>& monsters);
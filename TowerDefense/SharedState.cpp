@@ -0,0 +1,263 @@
+#include "SharedState.h"
+
+#include <iostream>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Buffers start on their own cache lines, so publishing one doesn't disturb readers of another.
+const uint32_t SHARED_STATE_ALIGNMENT = 64;
+
+static bool ValidRegion(const SharedRegion& region)
+{
+	const SharedStateHeader* header = SharedHeader(region);
+	return region.size >= sizeof(SharedStateHeader) && header->magic == SHARED_STATE_MAGIC && header->version == SHARED_STATE_VERSION &&
+		   header->region_size == region.size && header->buffer_stride >= sizeof(SharedStateBuffer) + (uint64_t)header->capacity * sizeof(SharedMonster) &&
+		   sizeof(SharedStateHeader) + (uint64_t)header->buffer_stride * SHARED_STATE_BUFFERS <= region.size;
+}
+
+static void InitRegion(SharedRegion& region, uint32_t capacity, uint32_t stride)
+{
+	memset(region.data, 0, region.size);
+	SharedStateHeader* header = (SharedStateHeader*)region.data;
+	header->capacity = capacity;
+	header->buffer_stride = stride;
+	header->region_size = region.size;
+	header->latest.store(0, std::memory_order_relaxed);
+	header->version = SHARED_STATE_VERSION;
+
+	// Last, readers treat a region without it as not created yet.
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHARED_STATE_MAGIC;
+}
+
+#ifdef _WIN32
+
+static std::string MappingName(const std::string& name)
+{
+	return "Local\\" + name;
+}
+
+bool CreateSharedRegion(const std::string& name, uint32_t capacity, SharedRegion& region)
+{
+	const uint32_t stride = (sizeof(SharedStateBuffer) + capacity * sizeof(SharedMonster) + SHARED_STATE_ALIGNMENT - 1) & ~(SHARED_STATE_ALIGNMENT - 1);
+	const uint64_t size = sizeof(SharedStateHeader) + (uint64_t)stride * SHARED_STATE_BUFFERS;
+
+	region.data = nullptr;
+	region.size = (size_t)size;
+	region.name = name;
+	region.owner = true;
+	region.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, MappingName(name).c_str());
+	if (region.mapping)
+	{
+		region.data = (uint8_t*)MapViewOfFile(region.mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	}
+	if (!region.data)
+	{
+		std::cerr << "Could not create shared memory " << name << std::endl;
+		CloseSharedRegion(region);
+		return false;
+	}
+
+	InitRegion(region, capacity, stride);
+	return true;
+}
+
+bool OpenSharedRegion(const std::string& name, SharedRegion& region)
+{
+	region.data = nullptr;
+	region.size = 0;
+	region.name = name;
+	region.owner = false;
+	region.mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, MappingName(name).c_str());
+	if (region.mapping)
+	{
+		region.data = (uint8_t*)MapViewOfFile(region.mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	MEMORY_BASIC_INFORMATION info;
+	if (region.data && VirtualQuery(region.data, &info, sizeof(info)) != 0)
+	{
+		// Rounded up to whole pages, ValidRegion only needs it to cover region_size.
+		region.size = (size_t)info.RegionSize;
+	}
+	if (!region.data || region.size < sizeof(SharedStateHeader) || SharedHeader(region)->region_size > region.size)
+	{
+		std::cerr << "Could not open shared memory " << name << std::endl;
+		CloseSharedRegion(region);
+		return false;
+	}
+	region.size = (size_t)SharedHeader(region)->region_size;
+
+	if (!ValidRegion(region))
+	{
+		std::cerr << name << ": not version " << SHARED_STATE_VERSION << " shared state" << std::endl;
+		CloseSharedRegion(region);
+		return false;
+	}
+	return true;
+}
+
+void CloseSharedRegion(SharedRegion& region)
+{
+	// The mapping goes away with its last handle, nothing to remove.
+	if (region.data)
+	{
+		UnmapViewOfFile(region.data);
+	}
+	if (region.mapping)
+	{
+		CloseHandle(region.mapping);
+	}
+	region.data = nullptr;
+	region.size = 0;
+	region.mapping = nullptr;
+}
+
+#else
+
+static std::string ObjectName(const std::string& name)
+{
+	return "/" + name;
+}
+
+bool CreateSharedRegion(const std::string& name, uint32_t capacity, SharedRegion& region)
+{
+	const uint32_t stride = (sizeof(SharedStateBuffer) + capacity * sizeof(SharedMonster) + SHARED_STATE_ALIGNMENT - 1) & ~(SHARED_STATE_ALIGNMENT - 1);
+	const uint64_t size = sizeof(SharedStateHeader) + (uint64_t)stride * SHARED_STATE_BUFFERS;
+
+	region.data = nullptr;
+	region.size = (size_t)size;
+	region.name = name;
+	region.owner = true;
+
+	// A region left behind by a game that crashed is replaced, readers still mapping it keep the old one.
+	shm_unlink(ObjectName(name).c_str());
+	const int file = shm_open(ObjectName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (file >= 0 && ftruncate(file, (off_t)size) == 0)
+	{
+		void* data = mmap(nullptr, region.size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		region.data = data != MAP_FAILED ? (uint8_t*)data : nullptr;
+	}
+	if (file >= 0)
+	{
+		close(file);
+	}
+	if (!region.data)
+	{
+		std::cerr << "Could not create shared memory " << name << std::endl;
+		CloseSharedRegion(region);
+		return false;
+	}
+
+	InitRegion(region, capacity, stride);
+	return true;
+}
+
+bool OpenSharedRegion(const std::string& name, SharedRegion& region)
+{
+	region.data = nullptr;
+	region.size = 0;
+	region.name = name;
+	region.owner = false;
+
+	const int file = shm_open(ObjectName(name).c_str(), O_RDONLY, 0);
+	struct stat status;
+	if (file >= 0 && fstat(file, &status) == 0 && (size_t)status.st_size >= sizeof(SharedStateHeader))
+	{
+		region.size = (size_t)status.st_size;
+		void* data = mmap(nullptr, region.size, PROT_READ, MAP_SHARED, file, 0);
+		region.data = data != MAP_FAILED ? (uint8_t*)data : nullptr;
+	}
+	if (file >= 0)
+	{
+		close(file);
+	}
+	if (!region.data)
+	{
+		std::cerr << "Could not open shared memory " << name << std::endl;
+		CloseSharedRegion(region);
+		return false;
+	}
+
+	if (!ValidRegion(region))
+	{
+		std::cerr << name << ": not version " << SHARED_STATE_VERSION << " shared state" << std::endl;
+		CloseSharedRegion(region);
+		return false;
+	}
+	return true;
+}
+
+void CloseSharedRegion(SharedRegion& region)
+{
+	if (region.data)
+	{
+		munmap(region.data, region.size);
+	}
+	if (region.owner)
+	{
+		shm_unlink(ObjectName(region.name).c_str());
+	}
+	region.data = nullptr;
+	region.size = 0;
+	region.owner = false;
+}
+
+#endif
+
+const SharedStateBuffer* BeginSharedRead(const SharedRegion& region, uint32_t& sequence)
+{
+	const uint32_t latest = SharedHeader(region)->latest.load(std::memory_order_acquire);
+	const SharedStateBuffer* buffer = SharedBuffer(region, latest % SHARED_STATE_BUFFERS);
+	sequence = buffer->sequence.load(std::memory_order_acquire);
+	return sequence % 2 == 0 ? buffer : nullptr;
+}
+
+bool EndSharedRead(const SharedStateBuffer* buffer, uint32_t sequence)
+{
+	// Keeps the reads before it from moving past the second look at the sequence.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return buffer->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+bool CopySharedState(const SharedRegion& region, SharedStateBuffer& buffer, SharedMonster* monsters, uint32_t attempts)
+{
+	const uint32_t capacity = SharedHeader(region)->capacity;
+	for (uint32_t attempt = 0; attempt < attempts; ++attempt)
+	{
+		uint32_t sequence;
+		const SharedStateBuffer* shared = BeginSharedRead(region, sequence);
+		if (!shared)
+		{
+			continue;
+		}
+
+		// A torn read can see any monster_count, clamp it before using it and let EndSharedRead reject it.
+		const uint32_t count = shared->monster_count < capacity ? shared->monster_count : capacity;
+		buffer.monster_count = count;
+		buffer.tick = shared->tick;
+		buffer.monster_total = shared->monster_total;
+		buffer.monsters_killed = shared->monsters_killed;
+		buffer.player_health = shared->player_health;
+		buffer.tower_count = shared->tower_count;
+		buffer.world_width = shared->world_width;
+		buffer.world_height = shared->world_height;
+		memcpy(monsters, SharedMonsters(shared), count * sizeof(SharedMonster));
+
+		if (EndSharedRead(shared, sequence))
+		{
+			buffer.sequence.store(sequence, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Latest simulation state in named shared memory, for viewers and monitors in other processes.
+//
+// The game publishes (see StatePublisher.h), any number of readers map the same region read
+// only and look at it in place. Nothing here depends on the rest of the game, a tool only needs
+// this header and SharedState.cpp.
+//
+// The region holds SHARED_STATE_BUFFERS state buffers. The publisher writes each new state into
+// the buffer after the latest one, then makes it the latest, so the buffer a reader is looking
+// at is only overwritten two publishes later. Each buffer is also a seqlock: its sequence is odd
+// while it is being written and goes up by 2 every time it is, a reader that sees the same even
+// sequence before and after reading knows what it read was not torn. The publisher never waits
+// for readers, a reader that was too slow just reads again.
+//
+// Region layout:
+//   SharedStateHeader
+//   SHARED_STATE_BUFFERS times: SharedStateBuffer, capacity SharedMonsters, padded to buffer_stride
+//
+
+const uint32_t SHARED_STATE_MAGIC = 0x4D534454;		// "TDSM"
+const uint32_t SHARED_STATE_VERSION = 1;
+const uint32_t SHARED_STATE_BUFFERS = 3;
+
+const char* const SHARED_STATE_DEFAULT_NAME = "tower_defense_state";
+
+// Monsters each buffer has room for, any more are left out (see SharedStateBuffer::monster_total).
+const uint32_t SHARED_STATE_DEFAULT_CAPACITY = 1 << 17;
+
+// Both ends of the region have to agree on these being plain memory, not a lock.
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "shared state atomics must be lock free");
+
+// 8 byte aligned, 64 byte size.
+struct SharedStateHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;					// SharedMonsters per buffer.
+	uint32_t buffer_stride;				// Bytes from one SharedStateBuffer to the next.
+	uint64_t region_size;
+	std::atomic<uint32_t> latest;		// Buffer most recently published.
+	uint32_t reserved[9];
+};
+
+// 8 byte aligned, 48 byte size.
+struct SharedStateBuffer
+{
+	std::atomic<uint32_t> sequence;		// Odd while being written.
+	uint32_t monster_count;				// SharedMonsters following this buffer.
+	uint64_t tick;
+	uint32_t monster_total;				// Monsters alive, more than monster_count if they didn't fit.
+	uint32_t monsters_killed;
+	uint32_t player_health;
+	uint32_t tower_count;
+	float world_width;
+	float world_height;
+	uint32_t reserved[2];
+};
+
+// 4 byte aligned, 20 byte size.
+struct SharedMonster
+{
+	uint32_t id;
+	uint32_t archetype;
+	float x;
+	float y;
+	uint32_t health;
+};
+
+// A mapped region, as created by the publisher or opened by a reader.
+struct SharedRegion
+{
+	uint8_t* data;
+	size_t size;
+	std::string name;
+	bool owner;			// Created it, removes the name again when closed.
+#ifdef _WIN32
+	void* mapping;		// HANDLE
+#endif
+};
+
+// Creates (or replaces) a region big enough for capacity Monsters per buffer, with no state published yet.
+bool CreateSharedRegion(const std::string& name, uint32_t capacity, SharedRegion& region);
+
+// Maps an existing region read only.
+bool OpenSharedRegion(const std::string& name, SharedRegion& region);
+
+void CloseSharedRegion(SharedRegion& region);
+
+inline const SharedStateHeader* SharedHeader(const SharedRegion& region)
+{
+	return (const SharedStateHeader*)region.data;
+}
+
+inline SharedStateBuffer* SharedBuffer(const SharedRegion& region, uint32_t buffer)
+{
+	return (SharedStateBuffer*)(region.data + sizeof(SharedStateHeader) + (size_t)buffer * SharedHeader(region)->buffer_stride);
+}
+
+inline const SharedMonster* SharedMonsters(const SharedStateBuffer* buffer)
+{
+	return (const SharedMonster*)(buffer + 1);
+}
+
+// Reading in place: BeginSharedRead returns the latest buffer (nullptr if it is being written
+// right now), read what is needed from it and then call EndSharedRead, which returns false if
+// the buffer was overwritten in the meantime and what was read has to be thrown away.
+const SharedStateBuffer* BeginSharedRead(const SharedRegion& region, uint32_t& sequence);
+bool EndSharedRead(const SharedStateBuffer* buffer, uint32_t sequence);
+
+// Copies the latest state into buffer and monsters (room for the region's capacity), trying
+// up to attempts times. Returns false if the publisher kept overwriting it.
+bool CopySharedState(const SharedRegion& region, SharedStateBuffer& buffer, SharedMonster* monsters, uint32_t attempts);
@@ -0,0 +1,341 @@
+#include "Simulation.h"
+#include "Separation.h"
+#include "View.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+//
+// Systems (functions that act on entities and components).
+//
+
+static float Distance(Position pos1, Position pos2)
+{
+	return sqrtf((pos2.x - pos1.x) * (pos2.x - pos1.x) + (pos2.y - pos1.y) * (pos2.y - pos1.y));
+}
+
+static float Magnitude(float x, float y)
+{
+	return sqrtf(x * x + y * y);
+}
+
+static Velocity Normalize(float x, float y)
+{
+	Velocity result;
+	const float magnitude = Magnitude(x, y);
+	result.x = x / magnitude;
+	result.y = y / magnitude;
+
+	return result;
+}
+
+// Returns false if Monster is dead.
+// grid_map is only passed in grid map mode, otherwise Monsters walk in a straight line between Waypoints.
+static bool UpdateMonster(Monster& monster, float DeltaTime, const std::vector<Waypoint>& waypoints, const MonsterArchetypes& archetypes,
+						  uint32_t& player_health, GridMap* grid_map)
+{
+	// Are we dead?
+	if (monster.health.value <= 0)
+	{
+		return false;
+	}
+
+	// Can only occur at game start, need at least 2 waypoints for Monsters to function.
+	if (waypoints.size() == 1)
+	{
+		return false;
+	}
+
+	// Are we on the targeted Waypoint?
+	if (Distance(monster.position, waypoints[monster.waypoint_index].position) <= 2.0f)
+	{
+		// Have we reached last Waypoint?
+		if (waypoints.size() - 1 == monster.waypoint_index)
+		{
+			// Deal damage to player then die, health stops at 0 so the game over checks see it.
+			const uint32_t damage = archetypes.damage[monster.archetype].value;
+			player_health = player_health > damage ? player_health - damage : 0;
+			return false;
+		}
+
+		// Target next Waypoint.
+		++monster.waypoint_index;
+		monster.route_leg = INVALID_LEG;
+	}
+
+	Position target = waypoints[monster.waypoint_index].position;
+	if (grid_map)
+	{
+		// Walk around anything blocking the grid instead.
+		target = NextRoutePoint(monster, target, *grid_map);
+	}
+
+	const float xdir = target.x - monster.position.x;
+	const float ydir = target.y - monster.position.y;
+	const Velocity normalized_dir = Normalize(xdir, ydir);
+
+	// Slows only ever touch the SpeedMultiplier, so every Monster moves the same way here.
+	const float speed = archetypes.speed[monster.archetype] * monster.speed.value;
+	monster.position.x += (normalized_dir.x * speed + monster.velocity.x) * DeltaTime;
+	monster.position.y += (normalized_dir.y * speed + monster.velocity.y) * DeltaTime;
+
+	return true;
+}
+
+// Swaps the last Monster into the hole and pops, keeping ids and sparse components in sync.
+static void RemoveMonster(std::vector<Monster>& monsters, uint32_t index, EntityIds& ids, StatusEffects& effects)
+{
+	ClearStatusEffects(effects, monsters[index].id);
+	DestroyId(ids, monsters[index].id);
+
+	const uint32_t last = (uint32_t)monsters.size() - 1;
+	if (index != last)
+	{
+		monsters[index] = monsters[last];
+		MoveId(ids, monsters[index].id, index);
+	}
+	monsters.pop_back();
+}
+
+void InitSimulation(Simulation& sim, const TowerArchetypes& archetypes, float world_width, float world_height, float cell_size)
+{
+	sim.monsters.clear();
+	sim.waypoints.clear();
+	InitTowerBlocks(archetypes, sim.tower_blocks);
+	sim.lightning_arcs.clear();
+	sim.monster_ids = EntityIds();
+	sim.status_effects = StatusEffects();
+	sim.status_effects.now = 0.0f;
+
+	InitNavGrid(sim.grid_map.grid, sim.grid_map.hierarchy, world_width, world_height, cell_size);
+	sim.grid_map.cache = PathCache();
+	sim.grid_map.cache.epoch = 0;
+
+	sim.waves.clear();
+	InitWaves(sim.wave_state, sim.waves);
+
+	sim.world_width = world_width;
+	sim.world_height = world_height;
+	sim.tick = 0;
+	sim.monsters_killed = 0;
+	sim.player_health = 100;
+	sim.grid_map_mode = false;
+	sim.separation_mode = false;
+
+	InitSpatialGrid(sim.spatial_grid, world_width, world_height, SEPARATION_RADIUS);
+	std::fill(sim.system_seconds, sim.system_seconds + SYSTEM_COUNT, 0.0f);
+}
+
+void StartLevel(Simulation& sim, const LevelView& level)
+{
+	sim.waypoints.assign(level.waypoints, level.waypoints + LevelCount(level, LEVEL_WAYPOINTS));
+	sim.waves.assign(level.waves, level.waves + LevelCount(level, LEVEL_WAVES));
+	InitWaves(sim.wave_state, sim.waves);
+
+	// Write the whole grid, then build the hierarchy once rather than once per Tower.
+	NavGrid& grid = sim.grid_map.grid;
+	std::copy(level.blocked, level.blocked + LevelCount(level, LEVEL_BLOCKED), grid.blocked.begin());
+	for (uint32_t i = 0; i < LevelCount(level, LEVEL_TOWERS); ++i)
+	{
+		AddTower(sim.tower_blocks[level.towers[i].archetype], level.towers[i].position);
+		uint8_t& blocked = grid.blocked[CellAt(grid, level.towers[i].position)];
+		blocked = (uint8_t)std::min(blocked + 1, 255);
+	}
+	BuildNavHierarchy(grid, sim.grid_map.hierarchy);
+}
+
+void SpawnMonster(Simulation& sim, const MonsterArchetypes& archetypes, uint32_t archetype)
+{
+	sim.monsters.emplace_back(Monster({ CreateId(sim.monster_ids, (uint32_t)sim.monsters.size()),	// Id
+										archetypes.max_health[archetype],							// Health
+										sim.waypoints[0].position,									// Position
+										0.0f, 0.0f,													// Velocity
+										0,															// Waypoint Index
+										archetype,													// Archetype
+										INVALID_LEG, 0, 0,											// Route
+										1.0f }));													// Speed Multiplier
+}
+
+void PlaceTower(Simulation& sim, uint32_t archetype, Position position)
+{
+	AddTower(sim.tower_blocks[archetype], position);
+	AddBlocker(sim.grid_map.grid, sim.grid_map.hierarchy, position);
+}
+
+void SetSeparation(Simulation& sim, bool enabled)
+{
+	sim.separation_mode = enabled;
+	if (!enabled)
+	{
+		view<Velocity>(sim.monsters).each([](Velocity& velocity) { velocity = Velocity({ 0.0f, 0.0f }); });
+	}
+}
+
+typedef std::chrono::steady_clock SystemClock;
+
+// Charges the time since start to system and starts timing the next one.
+static void EndSystem(Simulation& sim, SimulationSystem system, SystemClock::time_point& start)
+{
+	const SystemClock::time_point end = SystemClock::now();
+	sim.system_seconds[system] = std::chrono::duration<float>(end - start).count();
+	start = end;
+}
+
+void StepSimulation(Simulation& sim, const Archetypes& archetypes, const KernelRegistry& kernels, float DeltaTime)
+{
+	SystemClock::time_point start = SystemClock::now();
+	++sim.tick;
+
+	// Spawn this tick's share of the level's waves.
+	sim.wave_spawns.clear();
+	UpdateWaves(sim.waves, sim.wave_state, DeltaTime, sim.wave_spawns);
+	for (uint32_t i = 0; i < sim.wave_spawns.size(); ++i)
+	{
+		SpawnMonster(sim, archetypes.monsters, sim.wave_spawns[i]);
+	}
+	EndSystem(sim, SYSTEM_WAVES, start);
+
+	// Update monsters.
+	std::vector<Monster>& monsters = sim.monsters;
+	for (uint32_t i = 0; i < monsters.size(); ++i)
+	{
+		if (!UpdateMonster(monsters[i], DeltaTime, sim.waypoints, archetypes.monsters, sim.player_health, sim.grid_map_mode ? &sim.grid_map : nullptr))
+		{
+			// We are dead, remove Monster from vector.
+			RemoveMonster(monsters, i, sim.monster_ids, sim.status_effects);
+
+			// Increment monsters_killed.
+			++sim.monsters_killed;
+
+			// Reduce i by 1 so we don't skip this copied monster.
+			--i;
+		}
+	}
+	EndSystem(sim, SYSTEM_MONSTERS, start);
+
+	// Bucket the surviving Monsters, everything below queries this grid by Monster index.
+	BuildSpatialGrid(sim.spatial_grid, monsters);
+	EndSystem(sim, SYSTEM_SPATIAL_GRID, start);
+
+	// Push overlapping Monsters apart, applied when they move next tick.
+	if (sim.separation_mode)
+	{
+		UpdateSeparation(sim.spatial_grid, monsters);
+	}
+	EndSystem(sim, SYSTEM_SEPARATION, start);
+
+	// Fade out old lightning arcs.
+	std::vector<LightningArc>& lightning_arcs = sim.lightning_arcs;
+	for (uint32_t i = 0; i < lightning_arcs.size(); ++i)
+	{
+		lightning_arcs[i].timer.value -= DeltaTime;
+		if (lightning_arcs[i].timer.value <= 0.0f)
+		{
+			lightning_arcs[i] = lightning_arcs.back();
+			lightning_arcs.pop_back();
+			--i;
+		}
+	}
+
+	HitQueue& hits = sim.hits;
+	ClearHits(hits);
+
+	// Expire status effects and queue burn and poison damage.
+	UpdateStatusEffects(sim.status_effects, DeltaTime, monsters, sim.monster_ids, hits.damage);
+	EndSystem(sim, SYSTEM_STATUS_EFFECTS, start);
+
+	// Update towers and bullets, one kernel call per archetype.
+	UpdateTowerBlocks(kernels, sim.tower_blocks, archetypes.towers, DeltaTime, monsters, sim.spatial_grid, hits, lightning_arcs);
+	EndSystem(sim, SYSTEM_TOWERS, start);
+	UpdateBulletBlocks(kernels, sim.tower_blocks, archetypes.towers, DeltaTime, monsters, sim.spatial_grid, hits);
+	EndSystem(sim, SYSTEM_BULLETS, start);
+
+	// Resolve every splash impact in one batch, then apply all of this tick's damage and effects.
+	ResolveSplash(sim.spatial_grid, hits);
+	ApplyDamage(hits.damage, view<Health>(monsters));
+	for (uint32_t i = 0; i < hits.effects.size(); ++i)
+	{
+		ApplyStatusEffect(sim.status_effects, monsters, hits.effects[i].monster_index, hits.effects[i].effect);
+	}
+	EndSystem(sim, SYSTEM_DAMAGE, start);
+}
+
+void ForkSimulation(const Simulation& source, Simulation& fork)
+{
+	fork.monsters = source.monsters;
+	fork.waypoints = source.waypoints;
+	fork.tower_blocks = source.tower_blocks;
+	fork.lightning_arcs = source.lightning_arcs;
+	fork.monster_ids = source.monster_ids;
+	fork.status_effects = source.status_effects;
+	fork.grid_map.grid = source.grid_map.grid;
+	fork.grid_map.hierarchy = source.grid_map.hierarchy;
+	fork.waves = source.waves;
+	fork.wave_state = source.wave_state;
+	fork.world_width = source.world_width;
+	fork.world_height = source.world_height;
+	fork.tick = source.tick;
+	fork.monsters_killed = source.monsters_killed;
+	fork.player_health = source.player_health;
+	fork.grid_map_mode = source.grid_map_mode;
+	fork.separation_mode = source.separation_mode;
+
+	// Every route held by a Monster is from an older epoch than the emptied cache.
+	PathCache& cache = fork.grid_map.cache;
+	cache.fields.clear();
+	cache.leg_lookup.clear();
+	cache.legs.clear();
+	cache.epoch = (uint16_t)(source.grid_map.cache.epoch + 1);
+
+	// Scratch is rebuilt every tick, only the spatial grid's size has to match.
+	if (fork.spatial_grid.cell_start.size() != source.spatial_grid.cell_start.size())
+	{
+		InitSpatialGrid(fork.spatial_grid, source.world_width, source.world_height, source.spatial_grid.cell_size);
+	}
+}
+
+bool IsQuiescent(const Simulation& sim)
+{
+	return sim.monsters.empty() && sim.lightning_arcs.empty() && BulletCount(sim) == 0;
+}
+
+void SkipQuiescentTime(Simulation& sim, float seconds)
+{
+	sim.wave_state.time += seconds;
+	sim.status_effects.now += seconds;
+	for (uint32_t b = 0; b < sim.tower_blocks.size(); ++b)
+	{
+		std::vector<Tower>& towers = sim.tower_blocks[b].towers;
+		for (uint32_t i = 0; i < towers.size(); ++i)
+		{
+			towers[i].timer.value += seconds;
+		}
+	}
+}
+
+size_t TowerCount(const Simulation& sim)
+{
+	size_t count = 0;
+	for (uint32_t i = 0; i < sim.tower_blocks.size(); ++i)
+	{
+		count += sim.tower_blocks[i].towers.size();
+	}
+	return count;
+}
+
+size_t BulletCount(const Simulation& sim)
+{
+	size_t count = 0;
+	for (uint32_t i = 0; i < sim.tower_blocks.size(); ++i)
+	{
+		count += sim.tower_blocks[i].bullets.size();
+	}
+	return count;
+}
+
+const char* SystemName(SimulationSystem system)
+{
+	static const char* const names[SYSTEM_COUNT] = { "waves", "monsters", "spatial_grid", "separation", "status_effects", "towers", "bullets", "damage" };
+	return system < SYSTEM_COUNT ? names[system] : "unknown";
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Components.h"
+#include "Archetypes.h"
+#include "Combat.h"
+#include "Pathfinding.h"
+#include "SpatialGrid.h"
+#include "EntityIds.h"
+#include "StatusEffects.h"
+#include "Waves.h"
+#include "Level.h"
+
+#include <vector>
+
+//
+// The game simulation, every entity and counter a tick reads and writes.
+//
+// Everything the simulation owns lives in one Simulation so it can be stepped without a
+// window (headless modes) and saved and restored as a whole (see Snapshot.h). Input and
+// rendering stay in main(), they only call the functions below and read the state.
+//
+// Archetype tables and the KernelRegistry are not part of the state, they're loaded once
+// and passed in, so many Simulations can share them.
+//
+// The simulation has no randomness, stepping the same state with the same DeltaTimes
+// always gives the same result.
+//
+
+// The systems StepSimulation times, in the order it runs them.
+enum SimulationSystem : uint32_t
+{
+	SYSTEM_WAVES = 0,
+	SYSTEM_MONSTERS = 1,
+	SYSTEM_SPATIAL_GRID = 2,
+	SYSTEM_SEPARATION = 3,
+	SYSTEM_STATUS_EFFECTS = 4,
+	SYSTEM_TOWERS = 5,
+	SYSTEM_BULLETS = 6,
+	SYSTEM_DAMAGE = 7,
+	SYSTEM_COUNT = 8,
+};
+
+struct Simulation
+{
+	std::vector<Monster> monsters;
+	std::vector<Waypoint> waypoints;
+	std::vector<TowerBlock> tower_blocks;		// One per Tower archetype, see Combat.h.
+	std::vector<LightningArc> lightning_arcs;
+	EntityIds monster_ids;
+	StatusEffects status_effects;
+	GridMap grid_map;							// Towers always block the grid so grid map mode can be toggled at any time.
+	std::vector<Wave> waves;
+	WaveState wave_state;
+	float world_width;							// Pixels.
+	float world_height;
+	uint64_t tick;								// Number of StepSimulation() calls so far.
+	uint32_t monsters_killed;
+	uint32_t player_health;
+	bool grid_map_mode;
+	bool separation_mode;
+
+	// Rebuilt or cleared every tick, not part of the state.
+	SpatialGrid spatial_grid;
+	HitQueue hits;
+	std::vector<uint32_t> wave_spawns;
+	float system_seconds[SYSTEM_COUNT];			// How long each system took last tick.
+};
+
+// Empty world with no Waypoints, Towers or waves.
+void InitSimulation(Simulation& sim, const TowerArchetypes& archetypes, float world_width, float world_height, float cell_size);
+
+// Copies a level's Waypoints, waves, blocked cells and Towers into a freshly initialized Simulation.
+// The level's world and grid size must be the ones sim was initialized with.
+void StartLevel(Simulation& sim, const LevelView& level);
+
+// Spawns on the first Waypoint.
+void SpawnMonster(Simulation& sim, const MonsterArchetypes& archetypes, uint32_t archetype);
+
+// Places a Tower and blocks its grid cell.
+void PlaceTower(Simulation& sim, uint32_t archetype, Position position);
+
+// Turning separation off also clears every Monster's separation push.
+void SetSeparation(Simulation& sim, bool enabled);
+
+void StepSimulation(Simulation& sim, const Archetypes& archetypes, const KernelRegistry& kernels, float DeltaTime);
+
+// Makes fork an independent copy of source that can be stepped on another thread.
+// Every entity and component vector is copied whole (one memcpy each) into fork's existing
+// storage, so forking into the same Simulation again doesn't allocate once it has grown.
+// The nav hierarchy is copied per entrance node, never per entity. The path cache is not
+// copied, fork starts with an empty one and its Monsters replan in grid map mode.
+void ForkSimulation(const Simulation& source, Simulation& fork);
+
+// Nothing moves or changes until a Monster spawns: no Monsters, Bullets or lightning arcs.
+bool IsQuiescent(const Simulation& sim);
+
+// Advances a quiescent sim's clocks (waves, status effects, Tower timers) by seconds as stepping
+// it would, without stepping it. Spawns still wait for the next StepSimulation().
+void SkipQuiescentTime(Simulation& sim, float seconds);
+
+size_t TowerCount(const Simulation& sim);
+size_t BulletCount(const Simulation& sim);
+
+// Lower case, e.g. "spatial_grid".
+const char* SystemName(SimulationSystem system);
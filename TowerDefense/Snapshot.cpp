@@ -0,0 +1,523 @@
+#include "Snapshot.h"
+#include "MappedFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#endif
+
+// Record size of each section, in SnapshotSectionId order.
+static const uint32_t SECTION_STRIDE[SNAPSHOT_SECTION_COUNT] = {
+	sizeof(Monster), sizeof(Waypoint), sizeof(uint32_t), sizeof(Tower), sizeof(uint32_t), sizeof(Bullet),
+	sizeof(LightningArc), sizeof(Wave), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint8_t),
+	sizeof(uint32_t), sizeof(uint32_t), sizeof(float), sizeof(float), sizeof(float), sizeof(ExpiryEntry) };
+
+// A buffer to be written as is, the file is the concatenation of every chunk.
+struct WriteChunk
+{
+	const void* data;
+	size_t size;
+};
+
+struct SnapshotWriter
+{
+	SnapshotHeader header;
+	std::vector<WriteChunk> chunks;
+	uint64_t offset;
+};
+
+static void BeginSection(SnapshotWriter& writer, SnapshotSectionId section)
+{
+	static const uint8_t padding[8] = {};
+	const uint64_t aligned = (writer.offset + 7) & ~7ull;
+	if (aligned != writer.offset)
+	{
+		writer.chunks.push_back(WriteChunk({ padding, (size_t)(aligned - writer.offset) }));
+		writer.offset = aligned;
+	}
+	writer.header.sections[section].offset = aligned;
+	writer.header.sections[section].count = 0;
+	writer.header.sections[section].stride = SECTION_STRIDE[section];
+}
+
+// Appends count records to the section begun last, written straight from data.
+static void AppendSection(SnapshotWriter& writer, SnapshotSectionId section, const void* data, size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	const size_t size = count * SECTION_STRIDE[section];
+	writer.chunks.push_back(WriteChunk({ data, size }));
+	writer.header.sections[section].count += (uint32_t)count;
+	writer.offset += size;
+}
+
+template <typename T>
+static void WriteSection(SnapshotWriter& writer, SnapshotSectionId section, const std::vector<T>& records)
+{
+	BeginSection(writer, section);
+	AppendSection(writer, section, records.data(), records.size());
+}
+
+#ifdef _WIN32
+
+static bool WriteChunks(const std::string& path, const std::vector<WriteChunk>& chunks)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	// WriteFileGather() only takes page sized, page aligned buffers, so write each array with its own call.
+	bool success = true;
+	for (uint32_t i = 0; success && i < chunks.size(); ++i)
+	{
+		const uint8_t* data = (const uint8_t*)chunks[i].data;
+		size_t remaining = chunks[i].size;
+		while (success && remaining > 0)
+		{
+			DWORD written = 0;
+			const DWORD size = (DWORD)std::min<size_t>(remaining, 1u << 30);
+			success = WriteFile(file, data, size, &written, nullptr) && written > 0;
+			data += written;
+			remaining -= written;
+		}
+	}
+
+	return CloseHandle(file) && success;
+}
+
+#else
+
+static bool WriteChunks(const std::string& path, const std::vector<WriteChunk>& chunks)
+{
+	const int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	std::vector<iovec> buffers(chunks.size());
+	for (uint32_t i = 0; i < chunks.size(); ++i)
+	{
+		buffers[i].iov_base = (void*)chunks[i].data;
+		buffers[i].iov_len = chunks[i].size;
+	}
+
+	// One writev per IOV_MAX buffers. A short write leaves the rest of a buffer for the next call.
+	size_t first = 0;
+	bool success = true;
+	while (success && first < buffers.size())
+	{
+		const int batch = (int)std::min<size_t>(buffers.size() - first, IOV_MAX);
+		const ssize_t written = writev(file, &buffers[first], batch);
+		if (written < 0)
+		{
+			success = errno == EINTR;
+			continue;
+		}
+
+		size_t remaining = (size_t)written;
+		while (first < buffers.size() && remaining >= buffers[first].iov_len)
+		{
+			remaining -= buffers[first].iov_len;
+			++first;
+		}
+		if (remaining > 0)
+		{
+			buffers[first].iov_base = (uint8_t*)buffers[first].iov_base + remaining;
+			buffers[first].iov_len -= remaining;
+		}
+	}
+
+	return close(file) == 0 && success;
+}
+
+#endif
+
+bool SaveSnapshot(const std::string& path, const Archetypes& archetypes, const Simulation& sim)
+{
+	SnapshotWriter writer;
+	SnapshotHeader& header = writer.header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.tick = sim.tick;
+	header.world_width = sim.world_width;
+	header.world_height = sim.world_height;
+	header.cell_size = sim.grid_map.grid.cell_size;
+	header.grid_width = sim.grid_map.grid.width;
+	header.grid_height = sim.grid_map.grid.height;
+	header.monster_archetypes = (uint32_t)archetypes.monsters.name.size();
+	header.tower_archetypes = (uint32_t)archetypes.towers.name.size();
+	header.monsters_killed = sim.monsters_killed;
+	header.player_health = sim.player_health;
+	header.path_epoch = sim.grid_map.cache.epoch;
+	header.effects_now = sim.status_effects.now;
+	header.wave_time = sim.wave_state.time;
+	header.flags = (sim.grid_map_mode ? SNAPSHOT_GRID_MAP_MODE : 0) | (sim.separation_mode ? SNAPSHOT_SEPARATION_MODE : 0);
+
+	// The header is filled in as sections are added, it is only read when the chunks are written.
+	writer.chunks.push_back(WriteChunk({ &header, sizeof(header) }));
+	writer.offset = sizeof(header);
+
+	std::vector<uint32_t> tower_counts(sim.tower_blocks.size());
+	std::vector<uint32_t> bullet_counts(sim.tower_blocks.size());
+	for (uint32_t b = 0; b < sim.tower_blocks.size(); ++b)
+	{
+		tower_counts[b] = (uint32_t)sim.tower_blocks[b].towers.size();
+		bullet_counts[b] = (uint32_t)sim.tower_blocks[b].bullets.size();
+	}
+
+	WriteSection(writer, SNAPSHOT_MONSTERS, sim.monsters);
+	WriteSection(writer, SNAPSHOT_WAYPOINTS, sim.waypoints);
+	WriteSection(writer, SNAPSHOT_TOWER_COUNTS, tower_counts);
+	BeginSection(writer, SNAPSHOT_TOWERS);
+	for (uint32_t b = 0; b < sim.tower_blocks.size(); ++b)
+	{
+		AppendSection(writer, SNAPSHOT_TOWERS, sim.tower_blocks[b].towers.data(), sim.tower_blocks[b].towers.size());
+	}
+	WriteSection(writer, SNAPSHOT_BULLET_COUNTS, bullet_counts);
+	BeginSection(writer, SNAPSHOT_BULLETS);
+	for (uint32_t b = 0; b < sim.tower_blocks.size(); ++b)
+	{
+		AppendSection(writer, SNAPSHOT_BULLETS, sim.tower_blocks[b].bullets.data(), sim.tower_blocks[b].bullets.size());
+	}
+	WriteSection(writer, SNAPSHOT_LIGHTNING_ARCS, sim.lightning_arcs);
+	WriteSection(writer, SNAPSHOT_WAVES, sim.waves);
+	WriteSection(writer, SNAPSHOT_WAVES_SPAWNED, sim.wave_state.spawned);
+	WriteSection(writer, SNAPSHOT_ID_INDEX, sim.monster_ids.index_of);
+	WriteSection(writer, SNAPSHOT_FREE_IDS, sim.monster_ids.free_ids);
+	WriteSection(writer, SNAPSHOT_BLOCKED, sim.grid_map.grid.blocked);
+
+	std::vector<uint32_t> effect_counts(STATUS_EFFECT_COUNT);
+	for (uint32_t t = 0; t < STATUS_EFFECT_COUNT; ++t)
+	{
+		effect_counts[t] = (uint32_t)sim.status_effects.sets[t].owner.size();
+	}
+	WriteSection(writer, SNAPSHOT_EFFECT_COUNTS, effect_counts);
+	BeginSection(writer, SNAPSHOT_EFFECT_OWNERS);
+	for (uint32_t t = 0; t < STATUS_EFFECT_COUNT; ++t)
+	{
+		AppendSection(writer, SNAPSHOT_EFFECT_OWNERS, sim.status_effects.sets[t].owner.data(), effect_counts[t]);
+	}
+	BeginSection(writer, SNAPSHOT_EFFECT_MAGNITUDES);
+	for (uint32_t t = 0; t < STATUS_EFFECT_COUNT; ++t)
+	{
+		AppendSection(writer, SNAPSHOT_EFFECT_MAGNITUDES, sim.status_effects.sets[t].magnitude.data(), effect_counts[t]);
+	}
+	BeginSection(writer, SNAPSHOT_EFFECT_EXPIRIES);
+	for (uint32_t t = 0; t < STATUS_EFFECT_COUNT; ++t)
+	{
+		AppendSection(writer, SNAPSHOT_EFFECT_EXPIRIES, sim.status_effects.sets[t].expires_at.data(), effect_counts[t]);
+	}
+	BeginSection(writer, SNAPSHOT_EFFECT_PENDING);
+	for (uint32_t t = 0; t < STATUS_EFFECT_COUNT; ++t)
+	{
+		AppendSection(writer, SNAPSHOT_EFFECT_PENDING, sim.status_effects.sets[t].pending_damage.data(), effect_counts[t]);
+	}
+	WriteSection(writer, SNAPSHOT_EXPIRY_HEAP, sim.status_effects.expiry_heap);
+
+	header.file_size = writer.offset;
+
+	if (!WriteChunks(path, writer.chunks))
+	{
+		std::cerr << "Could not write " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+static const T* SectionData(const uint8_t* data, const SnapshotHeader& header, SnapshotSectionId section)
+{
+	return (const T*)(data + header.sections[section].offset);
+}
+
+template <typename T>
+static void CopySection(const uint8_t* data, const SnapshotHeader& header, SnapshotSectionId section, uint32_t first, uint32_t count, std::vector<T>& records)
+{
+	const T* source = SectionData<T>(data, header, section) + first;
+	records.assign(source, source + count);
+}
+
+template <typename T>
+static void CopySection(const uint8_t* data, const SnapshotHeader& header, SnapshotSectionId section, std::vector<T>& records)
+{
+	CopySection(data, header, section, 0, header.sections[section].count, records);
+}
+
+template <typename T>
+static uint32_t SumSection(const uint8_t* data, const SnapshotHeader& header, SnapshotSectionId section)
+{
+	uint64_t sum = 0;
+	const T* values = SectionData<T>(data, header, section);
+	for (uint32_t i = 0; i < header.sections[section].count; ++i)
+	{
+		sum += values[i];
+	}
+	return sum > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)sum;
+}
+
+// Checks the header, every section fits the file, and every index the simulation uses unchecked is in range.
+static bool ValidateSnapshot(const uint8_t* data, size_t size, const Archetypes& archetypes)
+{
+	const SnapshotHeader& header = *(const SnapshotHeader*)data;
+	if (size < sizeof(SnapshotHeader) || header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+		header.file_size != size || !(header.cell_size > 0.0f))
+	{
+		return false;
+	}
+
+	for (uint32_t s = 0; s < SNAPSHOT_SECTION_COUNT; ++s)
+	{
+		const SnapshotSection& section = header.sections[s];
+		if (section.stride != SECTION_STRIDE[s] || section.offset % 8 != 0 || section.offset < sizeof(SnapshotHeader) ||
+			section.offset > size || (uint64_t)section.count * section.stride > size - section.offset)
+		{
+			return false;
+		}
+	}
+
+	const uint32_t monster_archetypes = (uint32_t)archetypes.monsters.name.size();
+	const uint32_t tower_archetypes = (uint32_t)archetypes.towers.name.size();
+	const SnapshotSection* sections = header.sections;
+	const uint32_t effect_entries = sections[SNAPSHOT_EFFECT_OWNERS].count;
+	if (header.monster_archetypes != monster_archetypes || header.tower_archetypes != tower_archetypes ||
+		sections[SNAPSHOT_TOWER_COUNTS].count != tower_archetypes || sections[SNAPSHOT_BULLET_COUNTS].count != tower_archetypes ||
+		SumSection<uint32_t>(data, header, SNAPSHOT_TOWER_COUNTS) != sections[SNAPSHOT_TOWERS].count ||
+		SumSection<uint32_t>(data, header, SNAPSHOT_BULLET_COUNTS) != sections[SNAPSHOT_BULLETS].count ||
+		sections[SNAPSHOT_WAYPOINTS].count == 0 || sections[SNAPSHOT_WAVES_SPAWNED].count != sections[SNAPSHOT_WAVES].count ||
+		sections[SNAPSHOT_BLOCKED].count != (uint64_t)header.grid_width * header.grid_height ||
+		sections[SNAPSHOT_EFFECT_COUNTS].count != STATUS_EFFECT_COUNT ||
+		SumSection<uint32_t>(data, header, SNAPSHOT_EFFECT_COUNTS) != effect_entries ||
+		sections[SNAPSHOT_EFFECT_MAGNITUDES].count != effect_entries || sections[SNAPSHOT_EFFECT_EXPIRIES].count != effect_entries ||
+		sections[SNAPSHOT_EFFECT_PENDING].count != effect_entries)
+	{
+		return false;
+	}
+
+	const uint32_t monster_count = sections[SNAPSHOT_MONSTERS].count;
+	const uint32_t id_count = sections[SNAPSHOT_ID_INDEX].count;
+	const uint32_t* index_of = SectionData<uint32_t>(data, header, SNAPSHOT_ID_INDEX);
+	const Monster* monsters = SectionData<Monster>(data, header, SNAPSHOT_MONSTERS);
+	for (uint32_t i = 0; i < monster_count; ++i)
+	{
+		if (monsters[i].archetype >= monster_archetypes || monsters[i].waypoint_index >= sections[SNAPSHOT_WAYPOINTS].count ||
+			monsters[i].id >= id_count || index_of[monsters[i].id] != i)
+		{
+			return false;
+		}
+	}
+
+	const uint32_t* free_ids = SectionData<uint32_t>(data, header, SNAPSHOT_FREE_IDS);
+	for (uint32_t i = 0; i < sections[SNAPSHOT_FREE_IDS].count; ++i)
+	{
+		if (free_ids[i] >= id_count || index_of[free_ids[i]] != INVALID_INDEX)
+		{
+			return false;
+		}
+	}
+
+	// Every Tower and Bullet of a block must be of the block's archetype.
+	const uint32_t* tower_counts = SectionData<uint32_t>(data, header, SNAPSHOT_TOWER_COUNTS);
+	const uint32_t* bullet_counts = SectionData<uint32_t>(data, header, SNAPSHOT_BULLET_COUNTS);
+	const Tower* towers = SectionData<Tower>(data, header, SNAPSHOT_TOWERS);
+	const Bullet* bullets = SectionData<Bullet>(data, header, SNAPSHOT_BULLETS);
+	for (uint32_t b = 0; b < tower_archetypes; ++b)
+	{
+		for (uint32_t i = 0; i < tower_counts[b]; ++i, ++towers)
+		{
+			if (towers->archetype != b)
+			{
+				return false;
+			}
+		}
+		for (uint32_t i = 0; i < bullet_counts[b]; ++i, ++bullets)
+		{
+			if (bullets->archetype != b)
+			{
+				return false;
+			}
+		}
+	}
+
+	const Wave* waves = SectionData<Wave>(data, header, SNAPSHOT_WAVES);
+	const uint32_t* spawned = SectionData<uint32_t>(data, header, SNAPSHOT_WAVES_SPAWNED);
+	for (uint32_t i = 0; i < sections[SNAPSHOT_WAVES].count; ++i)
+	{
+		if (waves[i].archetype >= monster_archetypes || spawned[i] > waves[i].count)
+		{
+			return false;
+		}
+	}
+
+	const uint32_t* owners = SectionData<uint32_t>(data, header, SNAPSHOT_EFFECT_OWNERS);
+	for (uint32_t i = 0; i < effect_entries; ++i)
+	{
+		if (owners[i] >= id_count)
+		{
+			return false;
+		}
+	}
+
+	const ExpiryEntry* expiries = SectionData<ExpiryEntry>(data, header, SNAPSHOT_EXPIRY_HEAP);
+	for (uint32_t i = 0; i < sections[SNAPSHOT_EXPIRY_HEAP].count; ++i)
+	{
+		if (expiries[i].type >= STATUS_EFFECT_COUNT)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Returns false if the world size doesn't give the saved grid size.
+static bool ReadSnapshot(const uint8_t* data, const Archetypes& archetypes, Simulation& sim)
+{
+	const SnapshotHeader& header = *(const SnapshotHeader*)data;
+
+	InitSimulation(sim, archetypes.towers, header.world_width, header.world_height, header.cell_size);
+	if (sim.grid_map.grid.width != header.grid_width || sim.grid_map.grid.height != header.grid_height)
+	{
+		return false;
+	}
+	sim.tick = header.tick;
+	sim.monsters_killed = header.monsters_killed;
+	sim.player_health = header.player_health;
+	sim.grid_map_mode = (header.flags & SNAPSHOT_GRID_MAP_MODE) != 0;
+	sim.separation_mode = (header.flags & SNAPSHOT_SEPARATION_MODE) != 0;
+
+	CopySection(data, header, SNAPSHOT_MONSTERS, sim.monsters);
+	CopySection(data, header, SNAPSHOT_WAYPOINTS, sim.waypoints);
+	CopySection(data, header, SNAPSHOT_LIGHTNING_ARCS, sim.lightning_arcs);
+	CopySection(data, header, SNAPSHOT_WAVES, sim.waves);
+	CopySection(data, header, SNAPSHOT_WAVES_SPAWNED, sim.wave_state.spawned);
+	sim.wave_state.time = header.wave_time;
+	CopySection(data, header, SNAPSHOT_ID_INDEX, sim.monster_ids.index_of);
+	CopySection(data, header, SNAPSHOT_FREE_IDS, sim.monster_ids.free_ids);
+
+	// Blocks start out empty, growing their ChangeTrackers marks every Tower changed so meshes are rebuilt.
+	const uint32_t* tower_counts = SectionData<uint32_t>(data, header, SNAPSHOT_TOWER_COUNTS);
+	const uint32_t* bullet_counts = SectionData<uint32_t>(data, header, SNAPSHOT_BULLET_COUNTS);
+	uint32_t first_tower = 0;
+	uint32_t first_bullet = 0;
+	for (uint32_t b = 0; b < sim.tower_blocks.size(); ++b)
+	{
+		TowerBlock& block = sim.tower_blocks[b];
+		CopySection(data, header, SNAPSHOT_TOWERS, first_tower, tower_counts[b], block.towers);
+		CopySection(data, header, SNAPSHOT_BULLETS, first_bullet, bullet_counts[b], block.bullets);
+		ResizeChangeTracker(block.changes, tower_counts[b]);
+		first_tower += tower_counts[b];
+		first_bullet += bullet_counts[b];
+	}
+
+	// The grid is copied whole, then the hierarchy built once. Every saved route is from an older
+	// epoch than the new empty cache, so Monsters in grid map mode replan on their next tick.
+	CopySection(data, header, SNAPSHOT_BLOCKED, sim.grid_map.grid.blocked);
+	BuildNavHierarchy(sim.grid_map.grid, sim.grid_map.hierarchy);
+	sim.grid_map.cache.epoch = (uint16_t)(header.path_epoch + 1);
+
+	StatusEffects& effects = sim.status_effects;
+	effects.now = header.effects_now;
+	const uint32_t* effect_counts = SectionData<uint32_t>(data, header, SNAPSHOT_EFFECT_COUNTS);
+	uint32_t first_effect = 0;
+	for (uint32_t t = 0; t < STATUS_EFFECT_COUNT; ++t)
+	{
+		StatusEffectSet& set = effects.sets[t];
+		CopySection(data, header, SNAPSHOT_EFFECT_OWNERS, first_effect, effect_counts[t], set.owner);
+		CopySection(data, header, SNAPSHOT_EFFECT_MAGNITUDES, first_effect, effect_counts[t], set.magnitude);
+		CopySection(data, header, SNAPSHOT_EFFECT_EXPIRIES, first_effect, effect_counts[t], set.expires_at);
+		CopySection(data, header, SNAPSHOT_EFFECT_PENDING, first_effect, effect_counts[t], set.pending_damage);
+		first_effect += effect_counts[t];
+
+		set.sparse.assign(sim.monster_ids.index_of.size(), INVALID_INDEX);
+		for (uint32_t slot = 0; slot < set.owner.size(); ++slot)
+		{
+			set.sparse[set.owner[slot]] = slot;
+		}
+	}
+	CopySection(data, header, SNAPSHOT_EXPIRY_HEAP, effects.expiry_heap);
+
+	return true;
+}
+
+bool LoadSnapshot(const std::string& path, const Archetypes& archetypes, Simulation& sim, bool map_file)
+{
+	// Both ways end with the whole file in memory at data, 8 byte aligned like the sections expect.
+	MappedFile mapped;
+	std::vector<uint64_t> buffer;
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	if (map_file)
+	{
+		if (!OpenMappedFile(path, mapped))
+		{
+			std::cerr << "Could not open " << path << std::endl;
+			return false;
+		}
+		data = mapped.data;
+		size = mapped.size;
+	}
+	else
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			std::cerr << "Could not open " << path << std::endl;
+			return false;
+		}
+		size = (size_t)file.tellg();
+		buffer.resize((size + 7) / 8);
+		file.seekg(0);
+		if (!file.read((char*)buffer.data(), (std::streamsize)size))
+		{
+			std::cerr << "Could not read " << path << std::endl;
+			return false;
+		}
+		data = (const uint8_t*)buffer.data();
+	}
+
+	// Load into a fresh Simulation so sim is untouched if anything is wrong.
+	bool loaded = false;
+	if (!ValidateSnapshot(data, size, archetypes))
+	{
+		std::cerr << path << ": not a version " << SNAPSHOT_VERSION << " snapshot saved with these archetypes" << std::endl;
+	}
+	else
+	{
+		Simulation snapshot;
+		loaded = ReadSnapshot(data, archetypes, snapshot);
+		if (loaded)
+		{
+			sim = std::move(snapshot);
+		}
+		else
+		{
+			std::cerr << path << ": grid doesn't match the world size" << std::endl;
+		}
+	}
+
+	if (map_file)
+	{
+		CloseMappedFile(mapped);
+	}
+
+	return loaded;
+}
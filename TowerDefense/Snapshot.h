@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <string>
+
+//
+// Snapshots, the complete state of a Simulation saved to a single binary file.
+//
+// Used to resume long soak runs, reproduce a problem from the tick it happened on, and start
+// headless runs (--simulate) from a heavy state instead of playing minutes of waves first.
+//
+// Like levels (see Level.h) the file is a header followed by 8 byte aligned sections of fixed
+// size records laid out exactly as in memory. Saving never copies or converts an entity: the
+// file is written straight from the component vectors in a single gathered write (one buffer
+// per array, with writev where available). Loading copies each section into its vector in one
+// go, reading the file either with one plain read or by memory mapping it.
+//
+// Towers and Bullets of every TowerBlock are stored back to back, with per block counts, so
+// each block is still one contiguous copy. Things that can be rebuilt from the saved state are
+// not saved: the NavHierarchy is rebuilt from the blocked grid, the path cache starts empty
+// (Monsters in grid map mode replan on their next tick) and status effect sparse tables are
+// rebuilt from the dense owners.
+//
+// Snapshots hold archetype indices, not archetypes. They can only be loaded with the same
+// archetype tables (e.g. the same level) they were saved with, which is checked by count.
+//
+
+const uint32_t SNAPSHOT_MAGIC = 0x53534454;		// "TDSS"
+const uint32_t SNAPSHOT_VERSION = 1;
+
+enum SnapshotSectionId : uint32_t
+{
+	SNAPSHOT_MONSTERS = 0,				// Monster
+	SNAPSHOT_WAYPOINTS = 1,				// Waypoint
+	SNAPSHOT_TOWER_COUNTS = 2,			// uint32_t, Towers in each TowerBlock.
+	SNAPSHOT_TOWERS = 3,				// Tower, every block's in block order.
+	SNAPSHOT_BULLET_COUNTS = 4,			// uint32_t, Bullets in each TowerBlock.
+	SNAPSHOT_BULLETS = 5,				// Bullet, every block's in block order.
+	SNAPSHOT_LIGHTNING_ARCS = 6,		// LightningArc
+	SNAPSHOT_WAVES = 7,					// Wave
+	SNAPSHOT_WAVES_SPAWNED = 8,			// uint32_t, WaveState::spawned.
+	SNAPSHOT_ID_INDEX = 9,				// uint32_t, EntityIds::index_of.
+	SNAPSHOT_FREE_IDS = 10,				// uint32_t, EntityIds::free_ids.
+	SNAPSHOT_BLOCKED = 11,				// uint8_t, NavGrid::blocked.
+	SNAPSHOT_EFFECT_COUNTS = 12,		// uint32_t, entries in each StatusEffectSet.
+	SNAPSHOT_EFFECT_OWNERS = 13,		// uint32_t, every set's in StatusEffectType order.
+	SNAPSHOT_EFFECT_MAGNITUDES = 14,	// float
+	SNAPSHOT_EFFECT_EXPIRIES = 15,		// float
+	SNAPSHOT_EFFECT_PENDING = 16,		// float
+	SNAPSHOT_EXPIRY_HEAP = 17,			// ExpiryEntry
+	SNAPSHOT_SECTION_COUNT = 18,
+};
+
+// 8 byte aligned, 16 byte size.
+struct SnapshotSection
+{
+	uint64_t offset;		// From the start of the file, multiple of 8.
+	uint32_t count;
+	uint32_t stride;		// Size of one record, checked against the struct it is read as.
+};
+
+// Set in SnapshotHeader::flags.
+const uint32_t SNAPSHOT_GRID_MAP_MODE = 1;
+const uint32_t SNAPSHOT_SEPARATION_MODE = 2;
+
+// 8 byte aligned, 368 byte size.
+struct SnapshotHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;
+	uint64_t tick;
+	float world_width;
+	float world_height;
+	float cell_size;
+	uint32_t grid_width;
+	uint32_t grid_height;
+	uint32_t monster_archetypes;	// Number of archetypes the snapshot was saved with.
+	uint32_t tower_archetypes;
+	uint32_t monsters_killed;
+	uint32_t player_health;
+	uint32_t path_epoch;			// PathCache epoch, the cache is flushed on load by moving past it.
+	float effects_now;				// StatusEffects::now
+	float wave_time;				// WaveState::time
+	uint32_t flags;
+	uint32_t reserved;
+	SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+};
+
+// Returns false (after printing why to std::cerr) if the file can't be written.
+bool SaveSnapshot(const std::string& path, const Archetypes& archetypes, const Simulation& sim);
+
+// Replaces all of sim with the snapshot. With map_file the file is memory mapped and copied
+// out of the mapping, otherwise it is read into memory with a single read first.
+// Returns false (after printing why to std::cerr) and leaves sim untouched if the file isn't
+// a valid snapshot or was saved with different archetypes.
+bool LoadSnapshot(const std::string& path, const Archetypes& archetypes, Simulation& sim, bool map_file);
@@ -0,0 +1,151 @@
+#include "Sockets.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef _WIN32
+
+const int SEND_FLAGS = 0;
+
+bool StartSockets()
+{
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+}
+
+void StopSockets()
+{
+	WSACleanup();
+}
+
+void CloseSocket(SocketHandle socket)
+{
+	closesocket((SOCKET)socket);
+}
+
+bool SetNonBlocking(SocketHandle socket)
+{
+	u_long on = 1;
+	return ioctlsocket((SOCKET)socket, FIONBIO, &on) == 0;
+}
+
+bool WaitReadable(SocketHandle socket, int milliseconds)
+{
+	WSAPOLLFD readable = { (SOCKET)socket, POLLRDNORM, 0 };
+	return WSAPoll(&readable, 1, milliseconds) > 0;
+}
+
+bool WouldBlock()
+{
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+#else
+
+const int SEND_FLAGS = MSG_NOSIGNAL;
+
+bool StartSockets()
+{
+	return true;
+}
+
+void StopSockets()
+{
+}
+
+void CloseSocket(SocketHandle socket)
+{
+	close(socket);
+}
+
+bool SetNonBlocking(SocketHandle socket)
+{
+	return fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK) == 0;
+}
+
+bool WaitReadable(SocketHandle socket, int milliseconds)
+{
+	pollfd readable = { socket, POLLIN, 0 };
+	return poll(&readable, 1, milliseconds) > 0;
+}
+
+bool WouldBlock()
+{
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+#endif
+
+static sockaddr_in LoopbackAddress(uint16_t port)
+{
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return address;
+}
+
+SocketHandle ListenLoopback(uint16_t port)
+{
+	const sockaddr_in address = LoopbackAddress(port);
+	const int on = 1;
+	const SocketHandle listener = (SocketHandle)socket(AF_INET, SOCK_STREAM, 0);
+	bool listening = listener != NO_SOCKET;
+	listening = listening && setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on)) == 0;
+	listening = listening && bind(listener, (const sockaddr*)&address, sizeof(address)) == 0;
+	listening = listening && listen(listener, SOMAXCONN) == 0;
+	if (!listening && listener != NO_SOCKET)
+	{
+		CloseSocket(listener);
+	}
+	return listening ? listener : NO_SOCKET;
+}
+
+SocketHandle ConnectLoopback(uint16_t port)
+{
+	const sockaddr_in address = LoopbackAddress(port);
+	const SocketHandle connection = (SocketHandle)socket(AF_INET, SOCK_STREAM, 0);
+	if (connection != NO_SOCKET && connect(connection, (const sockaddr*)&address, sizeof(address)) != 0)
+	{
+		CloseSocket(connection);
+		return NO_SOCKET;
+	}
+	return connection;
+}
+
+SocketHandle AcceptSocket(SocketHandle listener)
+{
+	return (SocketHandle)accept(listener, nullptr, nullptr);
+}
+
+void DisableNagle(SocketHandle socket)
+{
+	const int on = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+int SendSocket(SocketHandle socket, const void* data, size_t size)
+{
+	return (int)send(socket, (const char*)data, (int)size, SEND_FLAGS);
+}
+
+int ReceiveSocket(SocketHandle socket, void* data, size_t size)
+{
+	return (int)recv(socket, (char*)data, (int)size, 0);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// TCP sockets on the loopback interface, the little of Winsock and BSD sockets the local
+// servers need (see SpectatorServer.h, Metrics.h).
+//
+// Every Start/StopSockets pair is counted by Winsock, each user calls them around its own
+// sockets. Send and receive return the bytes moved, 0 when the other end has hung up and
+// a negative number on errors, WouldBlock() tells the ones a non blocking socket can retry.
+//
+
+#ifdef _WIN32
+typedef uintptr_t SocketHandle;		// SOCKET
+const SocketHandle NO_SOCKET = ~(SocketHandle)0;
+#else
+typedef int SocketHandle;
+const SocketHandle NO_SOCKET = -1;
+#endif
+
+bool StartSockets();
+void StopSockets();
+
+// Returns NO_SOCKET if 127.0.0.1:port can't be listened on.
+SocketHandle ListenLoopback(uint16_t port);
+
+// Blocks until connected. Returns NO_SOCKET if nothing listens on 127.0.0.1:port.
+SocketHandle ConnectLoopback(uint16_t port);
+
+// Returns NO_SOCKET if no connection is waiting on a non blocking listener.
+SocketHandle AcceptSocket(SocketHandle listener);
+
+void CloseSocket(SocketHandle socket);
+bool SetNonBlocking(SocketHandle socket);
+
+// Sends small writes right away, for when latency matters more than packet count.
+void DisableNagle(SocketHandle socket);
+
+// Waits up to milliseconds for the socket to have something to read (or a connection to accept).
+bool WaitReadable(SocketHandle socket, int milliseconds);
+
+// Never raises SIGPIPE, a closed connection is an error like any other.
+int SendSocket(SocketHandle socket, const void* data, size_t size);
+int ReceiveSocket(SocketHandle socket, void* data, size_t size);
+
+// Whether the last failed call would have succeeded later.
+bool WouldBlock();
@@ -0,0 +1,347 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+void InitSpatialGrid(SpatialGrid& grid, float world_width, float world_height, float cell_size)
+{
+	grid.cell_size = cell_size;
+	grid.inv_cell_size = 1.0f / cell_size;
+	grid.width = std::max(1u, (uint32_t)ceilf(world_width / cell_size));
+	grid.height = std::max(1u, (uint32_t)ceilf(world_height / cell_size));
+	grid.cell_start.assign(grid.width * grid.height + 1, 0);
+	grid.entity.clear();
+	grid.x.clear();
+	grid.y.clear();
+	grid.entity_cell.clear();
+}
+
+uint32_t SpatialCellX(const SpatialGrid& grid, float x)
+{
+	const int cell = (int)(x * grid.inv_cell_size);
+	return (uint32_t)std::max(0, std::min(cell, (int)grid.width - 1));
+}
+
+uint32_t SpatialCellY(const SpatialGrid& grid, float y)
+{
+	const int cell = (int)(y * grid.inv_cell_size);
+	return (uint32_t)std::max(0, std::min(cell, (int)grid.height - 1));
+}
+
+// Shared by every entity type with a Position.
+template <typename Entity>
+static void BuildGrid(SpatialGrid& grid, const std::vector<Entity>& entities)
+{
+	const uint32_t count = (uint32_t)entities.size();
+	const uint32_t cell_count = grid.width * grid.height;
+
+	grid.entity.resize(count);
+	grid.x.resize(count);
+	grid.y.resize(count);
+	grid.entity_cell.resize(count);
+	std::fill(grid.cell_start.begin(), grid.cell_start.end(), 0);
+
+	// Count entities per cell.
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t cell = SpatialCellY(grid, entities[i].position.y) * grid.width + SpatialCellX(grid, entities[i].position.x);
+		grid.entity_cell[i] = cell;
+		++grid.cell_start[cell + 1];
+	}
+
+	// Prefix sum turns counts into start offsets.
+	for (uint32_t cell = 0; cell < cell_count; ++cell)
+	{
+		grid.cell_start[cell + 1] += grid.cell_start[cell];
+	}
+
+	// Scatter, using cell_start as a write cursor which leaves it shifted one cell forward.
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t slot = grid.cell_start[grid.entity_cell[i]]++;
+		grid.entity[slot] = i;
+		grid.x[slot] = entities[i].position.x;
+		grid.y[slot] = entities[i].position.y;
+	}
+
+	// Shift the cursors back so cell_start[cell] is the start of cell again.
+	for (uint32_t cell = cell_count; cell > 0; --cell)
+	{
+		grid.cell_start[cell] = grid.cell_start[cell - 1];
+	}
+	grid.cell_start[0] = 0;
+}
+
+void BuildSpatialGrid(SpatialGrid& grid, const std::vector<Monster>& monsters)
+{
+	BuildGrid(grid, monsters);
+}
+
+void BuildSpatialGrid(SpatialGrid& grid, const std::vector<Tower>& towers)
+{
+	BuildGrid(grid, towers);
+}
+
+void BuildSpatialGrid(SpatialGrid& grid, const std::vector<Bullet>& bullets)
+{
+	BuildGrid(grid, bullets);
+}
+
+uint32_t InsertSpatialGrid(SpatialGrid& grid, uint32_t entity, Position position)
+{
+	const uint32_t cell = SpatialCellY(grid, position.y) * grid.width + SpatialCellX(grid, position.x);
+	const uint32_t slot = grid.cell_start[cell + 1];
+
+	grid.entity.insert(grid.entity.begin() + slot, entity);
+	grid.x.insert(grid.x.begin() + slot, position.x);
+	grid.y.insert(grid.y.begin() + slot, position.y);
+	for (uint32_t c = cell + 1; c < grid.cell_start.size(); ++c)
+	{
+		++grid.cell_start[c];
+	}
+
+	return slot;
+}
+
+void QueryRadiusBatch(const SpatialGrid& grid, const std::vector<RadiusQuery>& queries, std::vector<RadiusHit>& hits)
+{
+	for (uint32_t q = 0; q < queries.size(); ++q)
+	{
+		const float center_x = queries[q].center.x;
+		const float center_y = queries[q].center.y;
+		const float radius_squared = queries[q].radius * queries[q].radius;
+
+		const uint32_t min_x = SpatialCellX(grid, center_x - queries[q].radius);
+		const uint32_t max_x = SpatialCellX(grid, center_x + queries[q].radius);
+		const uint32_t min_y = SpatialCellY(grid, center_y - queries[q].radius);
+		const uint32_t max_y = SpatialCellY(grid, center_y + queries[q].radius);
+
+		for (uint32_t cell_y = min_y; cell_y <= max_y; ++cell_y)
+		{
+			// Cells in a row are contiguous, so the whole row is one run of slots.
+			const uint32_t first = grid.cell_start[cell_y * grid.width + min_x];
+			const uint32_t last = grid.cell_start[cell_y * grid.width + max_x + 1];
+			for (uint32_t slot = first; slot < last; ++slot)
+			{
+				const float dx = grid.x[slot] - center_x;
+				const float dy = grid.y[slot] - center_y;
+				if (dx * dx + dy * dy <= radius_squared)
+				{
+					hits.push_back(RadiusHit({ q, grid.entity[slot] }));
+				}
+			}
+		}
+	}
+}
+
+// Keeps result sorted nearest first, dropping the farthest entry when full.
+static void InsertNearest(KnnResult& result, uint32_t k, uint32_t monster, float distance_squared)
+{
+	if (result.count == k && distance_squared >= result.distance_squared[k - 1])
+	{
+		return;
+	}
+
+	uint32_t i = result.count < k ? result.count++ : k - 1;
+	while (i > 0 && result.distance_squared[i - 1] > distance_squared)
+	{
+		result.monster[i] = result.monster[i - 1];
+		result.distance_squared[i] = result.distance_squared[i - 1];
+		--i;
+	}
+	result.monster[i] = monster;
+	result.distance_squared[i] = distance_squared;
+}
+
+void QueryNearest(const SpatialGrid& grid, Position center, float max_radius, uint32_t k,
+				  const uint32_t* exclude, uint32_t exclude_count, KnnResult& result)
+{
+	result.count = 0;
+	k = std::min(k, KNN_MAX_RESULTS);
+	if (k == 0)
+	{
+		return;
+	}
+
+	const int center_x = (int)SpatialCellX(grid, center.x);
+	const int center_y = (int)SpatialCellY(grid, center.y);
+	const float max_radius_squared = max_radius * max_radius;
+
+	// Distance from center to the nearest edge of its own cell, every ring adds a cell to that.
+	const float inner_x = std::min(center.x - center_x * grid.cell_size, (center_x + 1) * grid.cell_size - center.x);
+	const float inner_y = std::min(center.y - center_y * grid.cell_size, (center_y + 1) * grid.cell_size - center.y);
+	const float inner = std::max(0.0f, std::min(inner_x, inner_y));
+	const int max_ring = (int)std::max(grid.width, grid.height);
+
+	for (int ring = 0; ring <= max_ring; ++ring)
+	{
+		// Nothing in this ring or beyond can be closer than this.
+		if (ring > 0)
+		{
+			const float ring_distance = inner + (ring - 1) * grid.cell_size;
+			const float ring_distance_squared = ring_distance * ring_distance;
+			if (ring_distance_squared > max_radius_squared)
+			{
+				return;
+			}
+			if (result.count == k && ring_distance_squared >= result.distance_squared[k - 1])
+			{
+				return;
+			}
+		}
+
+		const int min_y = std::max(center_y - ring, 0);
+		const int max_y = std::min(center_y + ring, (int)grid.height - 1);
+		for (int cell_y = min_y; cell_y <= max_y; ++cell_y)
+		{
+			// Rows on the top and bottom of the ring are searched fully, the rest only at both ends.
+			const bool full_row = (cell_y == center_y - ring) || (cell_y == center_y + ring);
+			const int step = full_row || ring == 0 ? 1 : 2 * ring;
+			for (int cell_x = center_x - ring; cell_x <= center_x + ring; cell_x += step)
+			{
+				if (cell_x < 0 || cell_x >= (int)grid.width)
+				{
+					continue;
+				}
+
+				const uint32_t cell = cell_y * grid.width + cell_x;
+				for (uint32_t slot = grid.cell_start[cell]; slot < grid.cell_start[cell + 1]; ++slot)
+				{
+					const float dx = grid.x[slot] - center.x;
+					const float dy = grid.y[slot] - center.y;
+					const float distance_squared = dx * dx + dy * dy;
+					if (distance_squared > max_radius_squared)
+					{
+						continue;
+					}
+
+					const uint32_t monster = grid.entity[slot];
+					if (std::find(exclude, exclude + exclude_count, monster) != exclude + exclude_count)
+					{
+						continue;
+					}
+
+					InsertNearest(result, k, monster, distance_squared);
+				}
+			}
+		}
+	}
+}
+
+void QuerySegment(const SpatialGrid& grid, Position from, Position to, float radius, std::vector<uint32_t>& hits)
+{
+	// Reused between queries so segments never allocate once warmed up, one per thread.
+	static thread_local std::vector<uint32_t> cells;
+	cells.clear();
+
+	const float dir_x = to.x - from.x;
+	const float dir_y = to.y - from.y;
+	const float length_squared = dir_x * dir_x + dir_y * dir_y;
+	if (length_squared <= 0.0f)
+	{
+		return;
+	}
+
+	// DDA (Amanatides & Woo), step into whichever cell boundary the segment crosses first.
+	// Cells are not clamped here, segments may run just outside the world and still touch Monsters inside it.
+	int cell_x = (int)floorf(from.x * grid.inv_cell_size);
+	int cell_y = (int)floorf(from.y * grid.inv_cell_size);
+	const int end_x = (int)floorf(to.x * grid.inv_cell_size);
+	const int end_y = (int)floorf(to.y * grid.inv_cell_size);
+	const int step_x = dir_x > 0.0f ? 1 : -1;
+	const int step_y = dir_y > 0.0f ? 1 : -1;
+	const float t_delta_x = dir_x != 0.0f ? grid.cell_size / fabsf(dir_x) : 1e30f;
+	const float t_delta_y = dir_y != 0.0f ? grid.cell_size / fabsf(dir_y) : 1e30f;
+	float t_max_x = dir_x != 0.0f ? ((cell_x + (step_x > 0 ? 1 : 0)) * grid.cell_size - from.x) / dir_x : 1e30f;
+	float t_max_y = dir_y != 0.0f ? ((cell_y + (step_y > 0 ? 1 : 0)) * grid.cell_size - from.y) / dir_y : 1e30f;
+
+	for (;;)
+	{
+		// Widen by one cell, Monsters overlapping the segment can sit in a neighbouring cell.
+		for (int ny = std::max(cell_y - 1, 0); ny <= std::min(cell_y + 1, (int)grid.height - 1); ++ny)
+		{
+			for (int nx = std::max(cell_x - 1, 0); nx <= std::min(cell_x + 1, (int)grid.width - 1); ++nx)
+			{
+				cells.push_back(ny * grid.width + nx);
+			}
+		}
+
+		if ((cell_x == end_x && cell_y == end_y) || (t_max_x > 1.0f && t_max_y > 1.0f))
+		{
+			break;
+		}
+		if (t_max_x < t_max_y)
+		{
+			cell_x += step_x;
+			t_max_x += t_delta_x;
+		}
+		else
+		{
+			cell_y += step_y;
+			t_max_y += t_delta_y;
+		}
+	}
+
+	// Neighbouring traversed cells share most of their widened blocks.
+	std::sort(cells.begin(), cells.end());
+	cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+	const float radius_squared = radius * radius;
+	const float inv_length_squared = 1.0f / length_squared;
+	for (uint32_t i = 0; i < cells.size(); ++i)
+	{
+		for (uint32_t slot = grid.cell_start[cells[i]]; slot < grid.cell_start[cells[i] + 1]; ++slot)
+		{
+			const float offset_x = grid.x[slot] - from.x;
+			const float offset_y = grid.y[slot] - from.y;
+			const float t = (offset_x * dir_x + offset_y * dir_y) * inv_length_squared;
+			if (t < 0.0f || t >= 1.0f)
+			{
+				continue;
+			}
+
+			const float dx = offset_x - dir_x * t;
+			const float dy = offset_y - dir_y * t;
+			if (dx * dx + dy * dy <= radius_squared)
+			{
+				hits.push_back(grid.entity[slot]);
+			}
+		}
+	}
+}
+
+void QueryRect(const SpatialGrid& grid, Position min, Position max, std::vector<uint32_t>& hits)
+{
+	const uint32_t min_x = SpatialCellX(grid, min.x);
+	const uint32_t max_x = SpatialCellX(grid, max.x);
+	const uint32_t min_y = SpatialCellY(grid, min.y);
+	const uint32_t max_y = SpatialCellY(grid, max.y);
+
+	for (uint32_t cell_y = min_y; cell_y <= max_y; ++cell_y)
+	{
+		const uint32_t first = grid.cell_start[cell_y * grid.width + min_x];
+		const uint32_t last = grid.cell_start[cell_y * grid.width + max_x + 1];
+		for (uint32_t slot = first; slot < last; ++slot)
+		{
+			if (grid.x[slot] >= min.x && grid.x[slot] <= max.x && grid.y[slot] >= min.y && grid.y[slot] <= max.y)
+			{
+				hits.push_back(grid.entity[slot]);
+			}
+		}
+	}
+}
+
+uint32_t CountRect(const SpatialGrid& grid, Position min, Position max)
+{
+	const uint32_t min_x = SpatialCellX(grid, min.x);
+	const uint32_t max_x = SpatialCellX(grid, max.x);
+	const uint32_t min_y = SpatialCellY(grid, min.y);
+	const uint32_t max_y = SpatialCellY(grid, max.y);
+
+	uint32_t count = 0;
+	for (uint32_t cell_y = min_y; cell_y <= max_y; ++cell_y)
+	{
+		count += grid.cell_start[cell_y * grid.width + max_x + 1] - grid.cell_start[cell_y * grid.width + min_x];
+	}
+	return count;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Components.h"
+
+#include <vector>
+
+//
+// Uniform grid of Monster positions, rebuilt once per tick.
+//
+// Monsters are bucketed with a counting sort so the whole build is O(Monsters + cells)
+// and each cell's Monsters end up contiguous in memory. Positions are copied into the
+// sorted order as well (x and y arrays) so queries walk tightly packed floats
+// instead of chasing indices back into the monsters vector.
+//
+// Any system that needs to know which Monsters are near a point should query this
+// grid rather than looping over every Monster.
+//
+
+struct SpatialGrid
+{
+	float cell_size;					// Size of a cell in pixels.
+	float inv_cell_size;
+	uint32_t width;						// Size in cells.
+	uint32_t height;
+	std::vector<uint32_t> cell_start;	// Index of each cell's first entry, cell_start[cell + 1] is one past its last.
+	std::vector<uint32_t> entity;		// Monster indices sorted by cell.
+	std::vector<float> x;				// Monster positions sorted by cell.
+	std::vector<float> y;
+	std::vector<uint32_t> entity_cell;	// Scratch, cell of each Monster in monsters order.
+};
+
+// Capacity of KnnResult, the most neighbours a single nearest query can return.
+const uint32_t KNN_MAX_RESULTS = 16;
+
+// Fixed capacity so nearest queries never allocate, callers keep one around and reuse it.
+struct KnnResult
+{
+	uint32_t count;
+	uint32_t monster[KNN_MAX_RESULTS];			// Index into monsters vector, nearest first.
+	float distance_squared[KNN_MAX_RESULTS];
+};
+
+struct RadiusQuery
+{
+	Position center;
+	float radius;
+};
+
+struct RadiusHit
+{
+	uint32_t query;		// Index into the batch of queries.
+	uint32_t monster;	// Index into monsters vector.
+};
+
+void InitSpatialGrid(SpatialGrid& grid, float world_width, float world_height, float cell_size);
+
+// Positions outside the world are clamped into the border cells.
+uint32_t SpatialCellX(const SpatialGrid& grid, float x);
+uint32_t SpatialCellY(const SpatialGrid& grid, float y);
+
+void BuildSpatialGrid(SpatialGrid& grid, const std::vector<Monster>& monsters);
+
+// The same bucketing for other entities, entity holds indices into towers or bullets instead.
+void BuildSpatialGrid(SpatialGrid& grid, const std::vector<Tower>& towers);
+void BuildSpatialGrid(SpatialGrid& grid, const std::vector<Bullet>& bullets);
+
+// Adds entity at the end of its cell without rebuilding and returns its slot. Every later slot moves
+// up one, so it costs O(entries + cells) and is only for grids that rarely grow (see TowerMesh.h).
+uint32_t InsertSpatialGrid(SpatialGrid& grid, uint32_t entity, Position position);
+
+// Appends a hit for every Monster within radius of each query's center.
+// Only the cells overlapping each query's bounding box are visited.
+void QueryRadiusBatch(const SpatialGrid& grid, const std::vector<RadiusQuery>& queries, std::vector<RadiusHit>& hits);
+
+// Finds the k (at most KNN_MAX_RESULTS) nearest Monsters within max_radius of center, nearest first,
+// skipping the exclude_count Monster indices in exclude. Cells are searched in square rings
+// outward from center, stopping as soon as the next ring cannot hold anything closer than what was found.
+void QueryNearest(const SpatialGrid& grid, Position center, float max_radius, uint32_t k,
+				  const uint32_t* exclude, uint32_t exclude_count, KnnResult& result);
+
+// Line counterpart to QueryRadiusBatch. Walks the cells the segment from -> to crosses
+// (a DDA traversal, widened by one cell so Monsters overlapping the segment from a
+// neighbouring cell are found) and appends every Monster within radius of the segment.
+// radius must not be larger than the cell size.
+// A Monster only counts if its closest point on the line falls in [from, to), so a projectile
+// calling this with consecutive segments each tick hits every Monster it passes through exactly once.
+void QuerySegment(const SpatialGrid& grid, Position from, Position to, float radius, std::vector<uint32_t>& hits);
+
+// Appends every Monster positioned inside the rectangle from min to max, inclusive. Only the cells
+// overlapping it are visited, so Monsters elsewhere in the world cost nothing.
+void QueryRect(const SpatialGrid& grid, Position min, Position max, std::vector<uint32_t>& hits);
+
+// Monsters in the cells overlapping the rectangle from min to max, counted from cell_start a row of
+// cells at a time, so it costs the same however many Monsters there are.
+uint32_t CountRect(const SpatialGrid& grid, Position min, Position max);
@@ -0,0 +1,528 @@
+#include "SpectatorServer.h"
+
+#include <iostream>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#else
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+// Stands for the listening socket in readiness events.
+const uint32_t SPECTATOR_LISTENER = 0xFFFFFFFF;
+
+// Readiness events handled per poll, the rest are still ready next tick.
+const uint32_t SPECTATOR_MAX_EVENTS = 64;
+
+// Bytes a viewer asks the socket for at a time.
+const uint32_t SPECTATOR_RECEIVE_SIZE = 64 << 10;
+
+const uint32_t SPECTATOR_ACK_SIZE = 8;
+
+struct SocketEvent
+{
+	uint32_t connection;		// Index into connections, or SPECTATOR_LISTENER.
+	bool readable;
+	bool writable;
+	bool failed;
+};
+
+//
+// Readiness, an epoll set on Linux and WSAPoll over every socket on Windows.
+//
+
+#ifdef _WIN32
+
+static bool CreatePoller(SpectatorServer&)
+{
+	return true;
+}
+
+static void DestroyPoller(SpectatorServer&)
+{
+}
+
+// WSAPoll is handed every socket each time, nothing to register.
+static bool WatchSocket(SpectatorServer&, SocketHandle, uint32_t, bool, bool)
+{
+	return true;
+}
+
+static uint32_t GatherEvents(SpectatorServer& server, SocketEvent* events)
+{
+	static thread_local std::vector<WSAPOLLFD> sockets;
+	static thread_local std::vector<uint32_t> owners;
+	sockets.clear();
+	owners.clear();
+	sockets.push_back(WSAPOLLFD({ (SOCKET)server.listener, POLLRDNORM, 0 }));
+	owners.push_back(SPECTATOR_LISTENER);
+	for (uint32_t i = 0; i < server.connections.size(); ++i)
+	{
+		const SpectatorConnection& connection = server.connections[i];
+		if (connection.open)
+		{
+			sockets.push_back(WSAPOLLFD({ (SOCKET)connection.socket, (SHORT)(POLLRDNORM | (connection.waiting_to_write ? POLLWRNORM : 0)), 0 }));
+			owners.push_back(i);
+		}
+	}
+
+	if (WSAPoll(sockets.data(), (ULONG)sockets.size(), 0) <= 0)
+	{
+		return 0;
+	}
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < sockets.size() && count < SPECTATOR_MAX_EVENTS; ++i)
+	{
+		const SHORT ready = sockets[i].revents;
+		if (ready != 0)
+		{
+			events[count++] = SocketEvent({ owners[i], (ready & (POLLRDNORM | POLLHUP)) != 0, (ready & POLLWRNORM) != 0, (ready & (POLLERR | POLLNVAL)) != 0 });
+		}
+	}
+	return count;
+}
+
+#else
+
+static bool CreatePoller(SpectatorServer& server)
+{
+	server.epoll = epoll_create1(0);
+	return server.epoll >= 0;
+}
+
+static void DestroyPoller(SpectatorServer& server)
+{
+	if (server.epoll >= 0)
+	{
+		close(server.epoll);
+	}
+	server.epoll = -1;
+}
+
+// Sockets leave the set by themselves when they are closed.
+static bool WatchSocket(SpectatorServer& server, SocketHandle socket, uint32_t connection, bool write, bool watched)
+{
+	epoll_event event;
+	event.events = EPOLLIN | (write ? (uint32_t)EPOLLOUT : 0u);
+	event.data.u32 = connection;
+	return epoll_ctl(server.epoll, watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, socket, &event) == 0;
+}
+
+static uint32_t GatherEvents(SpectatorServer& server, SocketEvent* events)
+{
+	epoll_event ready[SPECTATOR_MAX_EVENTS];
+	const int count = epoll_wait(server.epoll, ready, SPECTATOR_MAX_EVENTS, 0);
+	for (int i = 0; i < count; ++i)
+	{
+		events[i] = SocketEvent({ ready[i].data.u32, (ready[i].events & EPOLLIN) != 0, (ready[i].events & EPOLLOUT) != 0,
+								  (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0 });
+	}
+	return count > 0 ? (uint32_t)count : 0;
+}
+
+#endif
+
+//
+// Server.
+//
+
+static void CloseConnection(SpectatorConnection& connection)
+{
+	CloseSocket(connection.socket);
+	connection.socket = NO_SOCKET;
+	connection.open = false;
+	connection.output.clear();
+	connection.output_sent = 0;
+}
+
+static void SendOutput(SpectatorServer& server, uint32_t index)
+{
+	SpectatorConnection& connection = server.connections[index];
+	while (connection.output_sent < connection.output.size())
+	{
+		const int sent = SendSocket(connection.socket, connection.output.data() + connection.output_sent, connection.output.size() - connection.output_sent);
+		if (sent < 0 && WouldBlock())
+		{
+			if (!connection.waiting_to_write)
+			{
+				connection.waiting_to_write = true;
+				WatchSocket(server, connection.socket, index, true, true);
+			}
+			return;
+		}
+		if (sent <= 0)
+		{
+			CloseConnection(connection);
+			return;
+		}
+		connection.output_sent += sent;
+		server.bytes_sent += sent;
+	}
+
+	connection.output.clear();
+	connection.output_sent = 0;
+	if (connection.waiting_to_write)
+	{
+		connection.waiting_to_write = false;
+		WatchSocket(server, connection.socket, index, false, true);
+	}
+}
+
+// Queues a keyframe of the state after the last record, encoding it if nobody needed one since that record.
+static void QueueKeyframe(SpectatorServer& server, SpectatorConnection& connection)
+{
+	if (server.keyframe_record != server.record_count)
+	{
+		server.keyframe.clear();
+		EncodeReplayFrame(server.encoder, server.keyframe);
+		server.keyframe_record = server.record_count;
+		server.bytes_encoded += server.keyframe.size();
+		++server.keyframes_encoded;
+	}
+	connection.output.insert(connection.output.end(), server.keyframe.begin(), server.keyframe.end());
+	connection.next_record = server.record_count;
+	connection.sent_tick = server.encoder.frame.tick;
+}
+
+static void QueueRecords(SpectatorServer& server, SpectatorConnection& connection)
+{
+	if (connection.sent_tick >= connection.acked_tick + (uint64_t)SPECTATOR_ACK_WINDOW * server.interval)
+	{
+		return;
+	}
+
+	if (connection.next_record + SPECTATOR_HISTORY < server.record_count)
+	{
+		QueueKeyframe(server, connection);
+		return;
+	}
+
+	for (uint64_t record = connection.next_record; record < server.record_count; ++record)
+	{
+		const std::vector<uint8_t>& bytes = server.history[record % SPECTATOR_HISTORY];
+		connection.output.insert(connection.output.end(), bytes.begin(), bytes.end());
+	}
+	connection.next_record = server.record_count;
+	connection.sent_tick = server.encoder.frame.tick;
+}
+
+// Encoded once, then copied to every viewer that needs it.
+static void EncodeRecord(SpectatorServer& server, Simulation& sim)
+{
+	std::vector<uint8_t>& record = server.history[server.record_count % SPECTATOR_HISTORY];
+	record.clear();
+	EncodeReplayRecord(server.encoder, sim, server.record_count == 0, record);
+	server.bytes_encoded += record.size();
+	++server.record_count;
+	server.next_tick = sim.tick + server.interval;
+}
+
+static void AcceptConnections(SpectatorServer& server, Simulation& sim)
+{
+	for (;;)
+	{
+		const SocketHandle socket = AcceptSocket(server.listener);
+		if (socket == NO_SOCKET)
+		{
+			return;
+		}
+		DisableNagle(socket);
+
+		uint32_t index = 0;
+		while (index < server.connections.size() && server.connections[index].open)
+		{
+			++index;
+		}
+		if (index == server.connections.size())
+		{
+			server.connections.emplace_back();
+		}
+		if (!SetNonBlocking(socket) || !WatchSocket(server, socket, index, false, false))
+		{
+			CloseSocket(socket);
+			continue;
+		}
+
+		SpectatorConnection& connection = server.connections[index];
+		connection.socket = socket;
+		connection.open = true;
+		connection.waiting_to_write = false;
+		connection.next_record = 0;
+		connection.sent_tick = 0;
+		connection.ack_size = 0;
+		connection.output.clear();
+		connection.output_sent = 0;
+
+		const uint8_t* header = (const uint8_t*)&server.header;
+		connection.output.insert(connection.output.end(), header, header + sizeof(server.header));
+		if (server.idle)
+		{
+			// Catch the encoder up, so the keyframe is of now rather than of the last viewer's time.
+			EncodeRecord(server, sim);
+			server.idle = false;
+		}
+		QueueKeyframe(server, connection);
+		// It has nothing to acknowledge yet, count the keyframe as acknowledged.
+		connection.acked_tick = connection.sent_tick;
+		SendOutput(server, index);
+	}
+}
+
+static void ReceiveAcks(SpectatorConnection& connection)
+{
+	uint8_t received[256];
+	for (;;)
+	{
+		const int size = ReceiveSocket(connection.socket, received, sizeof(received));
+		if (size < 0 && WouldBlock())
+		{
+			return;
+		}
+		if (size <= 0)
+		{
+			CloseConnection(connection);
+			return;
+		}
+
+		for (int i = 0; i < size; ++i)
+		{
+			connection.ack[connection.ack_size++] = received[i];
+			if (connection.ack_size == SPECTATOR_ACK_SIZE)
+			{
+				uint64_t tick = 0;
+				for (uint32_t b = 0; b < SPECTATOR_ACK_SIZE; ++b)
+				{
+					tick |= (uint64_t)connection.ack[b] << (b * 8);
+				}
+				connection.acked_tick = tick > connection.acked_tick ? tick : connection.acked_tick;
+				connection.ack_size = 0;
+			}
+		}
+	}
+}
+
+bool OpenSpectatorServer(uint16_t port, uint32_t interval, const Archetypes& archetypes, const Simulation& sim, SpectatorServer& server)
+{
+	server.listener = NO_SOCKET;
+#ifndef _WIN32
+	server.epoll = -1;
+#endif
+	if (!StartSockets())
+	{
+		std::cerr << "Could not start sockets" << std::endl;
+		return false;
+	}
+
+	server.listener = ListenLoopback(port);
+	bool listening = server.listener != NO_SOCKET && SetNonBlocking(server.listener);
+	listening = listening && CreatePoller(server) && WatchSocket(server, server.listener, SPECTATOR_LISTENER, false, false);
+	if (!listening)
+	{
+		std::cerr << "Could not listen on port " << port << std::endl;
+		CloseSpectatorServer(server);
+		return false;
+	}
+
+	server.interval = interval > 0 ? interval : 1;
+	server.next_tick = 0;
+	server.header.magic = REPLAY_MAGIC;
+	server.header.version = REPLAY_VERSION;
+	server.header.world_width = sim.world_width;
+	server.header.world_height = sim.world_height;
+	server.header.monster_archetypes = (uint32_t)archetypes.monsters.name.size();
+	server.header.tower_archetypes = (uint32_t)archetypes.towers.name.size();
+	InitReplayEncoder(server.encoder, server.header.tower_archetypes, CONSUMER_SPECTATORS);
+	server.record_count = 0;
+	server.keyframe_record = 0;
+	server.idle = true;
+	server.bytes_encoded = 0;
+	server.bytes_sent = 0;
+	server.keyframes_encoded = 0;
+	return true;
+}
+
+void PollSpectatorServer(SpectatorServer& server, Simulation& sim)
+{
+	SocketEvent events[SPECTATOR_MAX_EVENTS];
+	const uint32_t event_count = GatherEvents(server, events);
+	for (uint32_t e = 0; e < event_count; ++e)
+	{
+		const SocketEvent& event = events[e];
+		if (event.connection == SPECTATOR_LISTENER)
+		{
+			AcceptConnections(server, sim);
+			continue;
+		}
+
+		SpectatorConnection& connection = server.connections[event.connection];
+		if (connection.open && event.failed)
+		{
+			CloseConnection(connection);
+		}
+		if (connection.open && event.readable)
+		{
+			ReceiveAcks(connection);
+		}
+		if (connection.open && event.writable)
+		{
+			SendOutput(server, event.connection);
+		}
+	}
+
+	if (SpectatorCount(server) == 0)
+	{
+		server.idle = true;
+		return;
+	}
+	if (sim.tick < server.next_tick)
+	{
+		return;
+	}
+
+	EncodeRecord(server, sim);
+
+	for (uint32_t i = 0; i < server.connections.size(); ++i)
+	{
+		if (server.connections[i].open)
+		{
+			QueueRecords(server, server.connections[i]);
+			SendOutput(server, i);
+		}
+	}
+}
+
+void CloseSpectatorServer(SpectatorServer& server)
+{
+	for (uint32_t i = 0; i < server.connections.size(); ++i)
+	{
+		if (server.connections[i].open)
+		{
+			CloseConnection(server.connections[i]);
+		}
+	}
+	server.connections.clear();
+	if (server.listener != NO_SOCKET)
+	{
+		CloseSocket(server.listener);
+		server.listener = NO_SOCKET;
+	}
+	DestroyPoller(server);
+	StopSockets();
+}
+
+uint32_t SpectatorCount(const SpectatorServer& server)
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < server.connections.size(); ++i)
+	{
+		count += server.connections[i].open ? 1 : 0;
+	}
+	return count;
+}
+
+//
+// Viewer.
+//
+
+bool ConnectSpectatorViewer(uint16_t port, SpectatorViewer& viewer)
+{
+	viewer.socket = NO_SOCKET;
+	if (!StartSockets())
+	{
+		std::cerr << "Could not start sockets" << std::endl;
+		return false;
+	}
+
+	viewer.socket = ConnectLoopback(port);
+	if (viewer.socket == NO_SOCKET || !SetNonBlocking(viewer.socket))
+	{
+		std::cerr << "Could not connect to port " << port << std::endl;
+		CloseSpectatorViewer(viewer);
+		return false;
+	}
+	DisableNagle(viewer.socket);
+
+	viewer.has_header = false;
+	viewer.input.clear();
+	viewer.records = 0;
+	viewer.bytes_received = 0;
+	return true;
+}
+
+bool PollSpectatorViewer(SpectatorViewer& viewer)
+{
+	for (;;)
+	{
+		const size_t size = viewer.input.size();
+		viewer.input.resize(size + SPECTATOR_RECEIVE_SIZE);
+		const int received = ReceiveSocket(viewer.socket, viewer.input.data() + size, SPECTATOR_RECEIVE_SIZE);
+		viewer.input.resize(size + (received > 0 ? received : 0));
+		if (received < 0 && WouldBlock())
+		{
+			break;
+		}
+		if (received <= 0)
+		{
+			return false;
+		}
+		viewer.bytes_received += received;
+	}
+
+	const uint8_t* p = viewer.input.data();
+	const uint8_t* end = p + viewer.input.size();
+	if (!viewer.has_header && (size_t)(end - p) >= sizeof(ReplayHeader))
+	{
+		memcpy(&viewer.header, p, sizeof(viewer.header));
+		p += sizeof(viewer.header);
+		if (viewer.header.magic != REPLAY_MAGIC || viewer.header.version != REPLAY_VERSION)
+		{
+			return false;
+		}
+		InitReplayFrame(viewer.frame, viewer.header.tower_archetypes);
+		viewer.has_header = true;
+	}
+
+	bool applied = false;
+	size_t record_size;
+	while (viewer.has_header && PeekReplayRecord(p, end, record_size))
+	{
+		if (!DecodeReplayRecord(p, end, viewer.header.monster_archetypes, viewer.frame))
+		{
+			return false;
+		}
+		++viewer.records;
+		applied = true;
+	}
+	viewer.input.erase(viewer.input.begin(), viewer.input.begin() + (p - viewer.input.data()));
+
+	// One ack for everything applied. 8 bytes fit any socket buffer that isn't full of unread acks.
+	if (applied)
+	{
+		uint8_t ack[SPECTATOR_ACK_SIZE];
+		for (uint32_t b = 0; b < SPECTATOR_ACK_SIZE; ++b)
+		{
+			ack[b] = (uint8_t)(viewer.frame.tick >> (b * 8));
+		}
+		const int sent = SendSocket(viewer.socket, ack, sizeof(ack));
+		if (sent != (int)sizeof(ack) && !(sent < 0 && WouldBlock()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void CloseSpectatorViewer(SpectatorViewer& viewer)
+{
+	if (viewer.socket != NO_SOCKET)
+	{
+		CloseSocket(viewer.socket);
+		viewer.socket = NO_SOCKET;
+	}
+	StopSockets();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Replay.h"
+#include "Sockets.h"
+
+#include <vector>
+#include <cstdint>
+
+//
+// Spectator server, streams the game to any number of viewers over TCP on the loopback interface.
+//
+// A viewer connects and is sent the ReplayHeader, a keyframe record of the last state sent and
+// from then on a record every interval ticks, each a delta from the one before (see Replay.h).
+// It answers with the tick of every record it has applied, 8 bytes little endian, its acks.
+//
+// Each record is encoded once, however many viewers there are, and kept in a short history;
+// a viewer is sent copies of the records after the last one it was sent. A viewer that gets more
+// than SPECTATOR_ACK_WINDOW records ahead of its acks is sent nothing more until it catches up.
+// If by then the record it needs next has left the history, it gets a keyframe of the current
+// state instead, which is also encoded at most once per record however many viewers need it.
+//
+// Nothing is encoded while nobody is watching. The first viewer to connect after that has a
+// record of the current state encoded on the spot and then starts from a keyframe of it, like
+// any viewer joining a running stream.
+//
+// Everything happens on the simulation thread in PollSpectatorServer, sockets are non blocking and
+// readiness is polled without waiting (epoll, WSAPoll on Windows), so the game never stalls on a
+// viewer.
+//
+
+const uint16_t SPECTATOR_DEFAULT_PORT = 7777;
+
+// Ticks between records unless --serve-interval says otherwise, 20 per second at 60 ticks per second.
+const uint32_t SPECTATOR_DEFAULT_INTERVAL = 3;
+
+// Records kept for viewers that are behind.
+const uint32_t SPECTATOR_HISTORY = 64;
+
+// Records a viewer may be sent before it has to acknowledge them.
+const uint32_t SPECTATOR_ACK_WINDOW = 16;
+
+// One connected viewer.
+struct SpectatorConnection
+{
+	SocketHandle socket;
+	bool open;
+	bool waiting_to_write;			// The socket wouldn't take all of output, watching for it to become writable.
+	uint64_t next_record;			// Number of the next record to send.
+	uint64_t sent_tick;				// Tick of the last record sent.
+	uint64_t acked_tick;			// Latest tick the viewer acknowledged.
+	uint8_t ack[8];					// A partly received ack.
+	uint32_t ack_size;
+	std::vector<uint8_t> output;	// Queued for the socket.
+	size_t output_sent;
+};
+
+struct SpectatorServer
+{
+	SocketHandle listener;
+#ifndef _WIN32
+	int epoll;
+#endif
+	uint32_t interval;
+	uint64_t next_tick;						// Next tick a record is due.
+	ReplayHeader header;
+	ReplayEncoder encoder;
+	std::vector<uint8_t> history[SPECTATOR_HISTORY];	// Record n is history[n % SPECTATOR_HISTORY].
+	uint64_t record_count;
+	std::vector<uint8_t> keyframe;			// Keyframe of the state after the last record, if keyframe_record == record_count.
+	uint64_t keyframe_record;
+	bool idle;								// Records were skipped with nobody watching, the encoder is behind.
+	std::vector<SpectatorConnection> connections;	// Closed ones are reused.
+
+	uint64_t bytes_encoded;
+	uint64_t bytes_sent;
+	uint64_t keyframes_encoded;
+};
+
+// Listens on 127.0.0.1:port. Consumes the CONSUMER_SPECTATORS changes of every TowerBlock from now on.
+bool OpenSpectatorServer(uint16_t port, uint32_t interval, const Archetypes& archetypes, const Simulation& sim, SpectatorServer& server);
+
+// Call once per tick: accepts viewers, reads acks, encodes a record if one is due and sends
+// whatever the sockets will take. Never blocks.
+void PollSpectatorServer(SpectatorServer& server, Simulation& sim);
+
+void CloseSpectatorServer(SpectatorServer& server);
+
+uint32_t SpectatorCount(const SpectatorServer& server);
+
+// The viewer end, rebuilding the streamed state into a ReplayFrame.
+struct SpectatorViewer
+{
+	SocketHandle socket;
+	ReplayHeader header;
+	bool has_header;
+	ReplayFrame frame;
+	std::vector<uint8_t> input;		// Received, not yet decoded.
+	uint64_t records;
+	uint64_t bytes_received;
+};
+
+// Connects to a server on 127.0.0.1:port.
+bool ConnectSpectatorViewer(uint16_t port, SpectatorViewer& viewer);
+
+// Decodes everything received so far and acknowledges it. Never blocks. Returns false once the
+// server has gone away or sent something that doesn't decode.
+bool PollSpectatorViewer(SpectatorViewer& viewer);
+
+void CloseSpectatorViewer(SpectatorViewer& viewer);
@@ -0,0 +1,47 @@
+#include "StatePublisher.h"
+
+bool OpenStatePublisher(const std::string& name, uint32_t capacity, StatePublisher& publisher)
+{
+	publisher.publishes = 0;
+	publisher.truncated = 0;
+	return CreateSharedRegion(name, capacity, publisher.region);
+}
+
+void PublishState(StatePublisher& publisher, const Simulation& sim)
+{
+	SharedStateHeader* header = (SharedStateHeader*)publisher.region.data;
+	const uint32_t next = (header->latest.load(std::memory_order_relaxed) + 1) % SHARED_STATE_BUFFERS;
+	SharedStateBuffer* buffer = SharedBuffer(publisher.region, next);
+	SharedMonster* monsters = (SharedMonster*)(buffer + 1);
+
+	// Odd while writing. The release fence keeps the writes below from becoming visible before it.
+	const uint32_t sequence = buffer->sequence.load(std::memory_order_relaxed);
+	buffer->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const uint32_t count = sim.monsters.size() < header->capacity ? (uint32_t)sim.monsters.size() : header->capacity;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const Monster& monster = sim.monsters[i];
+		monsters[i] = SharedMonster({ monster.id, monster.archetype, monster.position.x, monster.position.y, monster.health.value });
+	}
+	buffer->monster_count = count;
+	buffer->tick = sim.tick;
+	buffer->monster_total = (uint32_t)sim.monsters.size();
+	buffer->monsters_killed = sim.monsters_killed;
+	buffer->player_health = sim.player_health;
+	buffer->tower_count = (uint32_t)TowerCount(sim);
+	buffer->world_width = sim.world_width;
+	buffer->world_height = sim.world_height;
+
+	buffer->sequence.store(sequence + 2, std::memory_order_release);
+	header->latest.store(next, std::memory_order_release);
+
+	++publisher.publishes;
+	publisher.truncated += count < sim.monsters.size() ? 1 : 0;
+}
+
+void CloseStatePublisher(StatePublisher& publisher)
+{
+	CloseSharedRegion(publisher.region);
+}
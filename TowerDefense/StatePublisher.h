@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Simulation.h"
+#include "SharedState.h"
+
+//
+// Publishes the simulation's latest state into a shared memory region, see SharedState.h.
+//
+
+struct StatePublisher
+{
+	SharedRegion region;
+	uint64_t publishes;
+	uint64_t truncated;		// Publishes that left Monsters out for lack of room.
+};
+
+bool OpenStatePublisher(const std::string& name, uint32_t capacity, StatePublisher& publisher);
+
+// Copies sim into the next buffer and makes it the latest. Never waits for readers.
+void PublishState(StatePublisher& publisher, const Simulation& sim);
+
+// Removes the region's name, readers that still have it mapped keep reading the last state.
+void CloseStatePublisher(StatePublisher& publisher);
@@ -0,0 +1,136 @@
+#include "StatusEffects.h"
+
+#include <algorithm>
+
+static bool LaterExpiry(const ExpiryEntry& a, const ExpiryEntry& b)
+{
+	return a.time > b.time;
+}
+
+static uint32_t FindSlot(const StatusEffectSet& set, uint32_t monster_id)
+{
+	return monster_id < set.sparse.size() ? set.sparse[monster_id] : INVALID_INDEX;
+}
+
+static void RemoveSlot(StatusEffectSet& set, uint32_t slot)
+{
+	const uint32_t last = (uint32_t)set.owner.size() - 1;
+	set.sparse[set.owner[slot]] = INVALID_INDEX;
+	if (slot != last)
+	{
+		set.owner[slot] = set.owner[last];
+		set.magnitude[slot] = set.magnitude[last];
+		set.expires_at[slot] = set.expires_at[last];
+		set.pending_damage[slot] = set.pending_damage[last];
+		set.sparse[set.owner[slot]] = slot;
+	}
+	set.owner.pop_back();
+	set.magnitude.pop_back();
+	set.expires_at.pop_back();
+	set.pending_damage.pop_back();
+}
+
+void ApplyStatusEffect(StatusEffects& effects, std::vector<Monster>& monsters, uint32_t monster_index, const OnHitEffect& effect)
+{
+	if (effect.type >= STATUS_EFFECT_COUNT)
+	{
+		return;
+	}
+
+	StatusEffectSet& set = effects.sets[effect.type];
+	const uint32_t monster_id = monsters[monster_index].id;
+	const float expires_at = effects.now + effect.duration;
+
+	uint32_t slot = FindSlot(set, monster_id);
+	if (slot == INVALID_INDEX)
+	{
+		if (monster_id >= set.sparse.size())
+		{
+			set.sparse.resize(monster_id + 1, INVALID_INDEX);
+		}
+		slot = (uint32_t)set.owner.size();
+		set.sparse[monster_id] = slot;
+		set.owner.push_back(monster_id);
+		set.magnitude.push_back(effect.magnitude);
+		set.expires_at.push_back(expires_at);
+		set.pending_damage.push_back(0.0f);
+	}
+	else
+	{
+		if (effect.type == STATUS_POISON)
+		{
+			set.magnitude[slot] += effect.magnitude;
+		}
+		else
+		{
+			set.magnitude[slot] = std::max(set.magnitude[slot], effect.magnitude);
+		}
+		set.expires_at[slot] = std::max(set.expires_at[slot], expires_at);
+	}
+
+	effects.expiry_heap.push_back(ExpiryEntry({ expires_at, monster_id, effect.type }));
+	std::push_heap(effects.expiry_heap.begin(), effects.expiry_heap.end(), LaterExpiry);
+
+	if (effect.type == STATUS_SLOW)
+	{
+		set.magnitude[slot] = std::min(set.magnitude[slot], 1.0f);
+		monsters[monster_index].speed.value = 1.0f - set.magnitude[slot];
+	}
+}
+
+void ClearStatusEffects(StatusEffects& effects, uint32_t monster_id)
+{
+	// Heap entries for the Monster are left behind, they will find no slot when popped.
+	for (uint32_t type = 0; type < STATUS_EFFECT_COUNT; ++type)
+	{
+		const uint32_t slot = FindSlot(effects.sets[type], monster_id);
+		if (slot != INVALID_INDEX)
+		{
+			RemoveSlot(effects.sets[type], slot);
+		}
+	}
+}
+
+void UpdateStatusEffects(StatusEffects& effects, float DeltaTime, std::vector<Monster>& monsters, const EntityIds& ids, std::vector<DamageEvent>& damage_events)
+{
+	effects.now += DeltaTime;
+
+	// Pop only what has expired.
+	while (!effects.expiry_heap.empty() && effects.expiry_heap.front().time <= effects.now)
+	{
+		const ExpiryEntry entry = effects.expiry_heap.front();
+		std::pop_heap(effects.expiry_heap.begin(), effects.expiry_heap.end(), LaterExpiry);
+		effects.expiry_heap.pop_back();
+
+		StatusEffectSet& set = effects.sets[entry.type];
+		const uint32_t slot = FindSlot(set, entry.monster_id);
+
+		// Stale entry, the effect was refreshed (or the Monster died) since this was pushed.
+		if (slot == INVALID_INDEX || set.expires_at[slot] > effects.now)
+		{
+			continue;
+		}
+
+		RemoveSlot(set, slot);
+		if (entry.type == STATUS_SLOW)
+		{
+			monsters[IndexOf(ids, entry.monster_id)].speed.value = 1.0f;
+		}
+	}
+
+	// Damage over time, only affected Monsters are visited.
+	for (uint32_t type = STATUS_BURN; type <= STATUS_POISON; ++type)
+	{
+		StatusEffectSet& set = effects.sets[type];
+		for (uint32_t slot = 0; slot < set.owner.size(); ++slot)
+		{
+			set.pending_damage[slot] += set.magnitude[slot] * DeltaTime;
+			if (set.pending_damage[slot] >= 1.0f)
+			{
+				const uint32_t damage = (uint32_t)set.pending_damage[slot];
+				set.pending_damage[slot] -= (float)damage;
+				damage_events.emplace_back(DamageEvent({ IndexOf(ids, set.owner[slot]), Damage({ damage }) }));
+			}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Components.h"
+#include "EntityIds.h"
+
+#include <vector>
+
+//
+// Status effects (slow, burn, poison) as sparse components.
+//
+// Most Monsters are never affected, so rather than giving every Monster room for every
+// effect each effect type is a sparse set: a dense array of entries for only the affected
+// Monsters, plus a sparse table from Monster id to dense slot. Ticking burn and poison
+// walks only the dense arrays.
+//
+// Expiry times go into a min-heap, so each frame only pops the effects that actually expired
+// instead of checking every entry. Refreshing an effect pushes a new heap entry and leaves the
+// old one behind, which is recognised as stale and skipped when it is popped.
+//
+// Slows are applied to the Monster's SpeedMultiplier so movement just multiplies by it
+// every frame without checking for effects.
+//
+
+struct StatusEffectSet
+{
+	std::vector<uint32_t> sparse;		// Monster id -> dense slot, INVALID_INDEX if not affected.
+	std::vector<uint32_t> owner;		// Dense, Monster id.
+	std::vector<float> magnitude;		// Dense.
+	std::vector<float> expires_at;		// Dense, in StatusEffects::now time.
+	std::vector<float> pending_damage;	// Dense, fractional damage over time not yet dealt.
+};
+
+struct ExpiryEntry
+{
+	float time;
+	uint32_t monster_id;
+	StatusEffectType type;
+};
+
+struct StatusEffects
+{
+	StatusEffectSet sets[STATUS_EFFECT_COUNT];
+	std::vector<ExpiryEntry> expiry_heap;
+	float now;							// Seconds of simulation time.
+};
+
+void ApplyStatusEffect(StatusEffects& effects, std::vector<Monster>& monsters, uint32_t monster_index, const OnHitEffect& effect);
+
+// Drops every effect on a Monster, must be called before its id is recycled.
+void ClearStatusEffects(StatusEffects& effects, uint32_t monster_id);
+
+// Advances time, expires effects (restoring speed when slows end) and queues burn and poison damage.
+void UpdateStatusEffects(StatusEffects& effects, float DeltaTime, std::vector<Monster>& monsters, const EntityIds& ids, std::vector<DamageEvent>& damage_events);
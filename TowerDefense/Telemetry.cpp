@@ -0,0 +1,312 @@
+#include "Telemetry.h"
+#include "Compression.h"
+#include "MappedFile.h"
+
+#include <iostream>
+#include <cstring>
+
+//
+// Writer thread.
+//
+
+static void FlushTelemetry(TelemetryWriter& writer)
+{
+	writer.file.write((const char*)writer.output.data(), (std::streamsize)writer.output.size());
+	writer.write_failed = writer.write_failed || writer.file.fail();
+	writer.file_bytes += writer.output.size();
+	writer.output.clear();
+}
+
+static void PutColumn(uint8_t*& out, const void* column, size_t rows)
+{
+	memcpy(out, column, rows * 4);
+	out += rows * 4;
+}
+
+static void WriteSample(TelemetryWriter& writer, TelemetrySample& sample)
+{
+	const size_t rows = sample.id.size();
+
+	// Ids become gaps in place, the slot is refilled from scratch next time anyway.
+	uint32_t next_id = 0;
+	for (size_t i = 0; i < rows; ++i)
+	{
+		const uint32_t id = sample.id[i];
+		sample.id[i] = id - next_id;
+		next_id = id + 1;
+	}
+
+	writer.packed.resize(rows * TELEMETRY_COLUMNS * 4);
+	uint8_t* out = writer.packed.data();
+	PutColumn(out, sample.id.data(), rows);
+	PutColumn(out, sample.archetype.data(), rows);
+	PutColumn(out, sample.x.data(), rows);
+	PutColumn(out, sample.y.data(), rows);
+	PutColumn(out, sample.health.data(), rows);
+
+	writer.shuffled.resize(writer.packed.size());
+	ShuffleBytes(writer.packed.data(), rows * TELEMETRY_COLUMNS, writer.shuffled.data());
+
+	const size_t block_start = writer.output.size();
+	writer.output.resize(block_start + sizeof(TelemetryBlockHeader));
+	TelemetryBlockHeader header;
+	header.tick = sample.tick;
+	header.row_count = (uint32_t)rows;
+	header.compressed_size = (uint32_t)CompressBlock(writer.shuffled.data(), writer.shuffled.size(), writer.output);
+	memcpy(writer.output.data() + block_start, &header, sizeof(header));
+
+	++writer.samples_written;
+	writer.raw_bytes += writer.packed.size();
+	if (writer.output.size() >= TELEMETRY_WRITE_SIZE)
+	{
+		FlushTelemetry(writer);
+	}
+}
+
+static void WriterLoop(TelemetryWriter& writer)
+{
+	std::unique_lock<std::mutex> lock(writer.mutex);
+	for (;;)
+	{
+		writer.sample_ready.wait(lock, [&]() { return writer.stopping || writer.queued > 0; });
+		if (writer.queued == 0)
+		{
+			// Only reached when stopping, queued samples are always written first.
+			break;
+		}
+
+		// The simulation thread never touches a queued slot, so it is safe to use unlocked.
+		TelemetrySample& sample = writer.queue[writer.head];
+		lock.unlock();
+		WriteSample(writer, sample);
+		lock.lock();
+
+		writer.head = (writer.head + 1) % TELEMETRY_QUEUE_SIZE;
+		--writer.queued;
+	}
+	lock.unlock();
+
+	FlushTelemetry(writer);
+}
+
+//
+// Simulation thread.
+//
+
+bool OpenTelemetryWriter(const std::string& path, const Archetypes& archetypes, uint32_t interval, TelemetryPolicy policy, TelemetryWriter& writer)
+{
+	writer.file.open(path, std::ios::binary | std::ios::trunc);
+	if (!writer.file)
+	{
+		std::cerr << "Could not create " << path << std::endl;
+		return false;
+	}
+
+	TelemetryHeader header;
+	header.magic = TELEMETRY_MAGIC;
+	header.version = TELEMETRY_VERSION;
+	header.interval = interval > 0 ? interval : 1;
+	header.monster_archetypes = (uint32_t)archetypes.monsters.name.size();
+	writer.file.write((const char*)&header, sizeof(header));
+
+	writer.queue.resize(TELEMETRY_QUEUE_SIZE);
+	writer.head = 0;
+	writer.queued = 0;
+	writer.stopping = false;
+	writer.policy = policy;
+	writer.interval = header.interval;
+	writer.current_interval = header.interval;
+	writer.next_tick = 0;
+	writer.samples_dropped = 0;
+	writer.samples_written = 0;
+	writer.raw_bytes = 0;
+	writer.file_bytes = sizeof(header);
+	writer.write_failed = false;
+	writer.output.reserve(TELEMETRY_WRITE_SIZE);
+
+	writer.thread = std::thread(WriterLoop, std::ref(writer));
+	return true;
+}
+
+void CaptureTelemetry(TelemetryWriter& writer, const Simulation& sim)
+{
+	if (sim.tick < writer.next_tick)
+	{
+		return;
+	}
+
+	uint32_t slot;
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		if (writer.queued == TELEMETRY_QUEUE_SIZE)
+		{
+			slot = TELEMETRY_QUEUE_SIZE;
+		}
+		else
+		{
+			slot = (writer.head + writer.queued) % TELEMETRY_QUEUE_SIZE;
+			if (writer.queued == 0 && writer.current_interval > writer.interval)
+			{
+				// Caught up, sample faster again.
+				writer.current_interval /= 2;
+			}
+		}
+	}
+
+	if (slot == TELEMETRY_QUEUE_SIZE)
+	{
+		++writer.samples_dropped;
+		if (writer.policy == TELEMETRY_THROTTLE && writer.current_interval < writer.interval * TELEMETRY_MAX_THROTTLE)
+		{
+			writer.current_interval *= 2;
+		}
+		writer.next_tick = sim.tick + writer.current_interval;
+		return;
+	}
+
+	// Not queued yet, so the writer thread won't look at it until it is.
+	TelemetrySample& sample = writer.queue[slot];
+	const size_t rows = sim.monsters.size();
+	sample.tick = sim.tick;
+	sample.id.resize(rows);
+	sample.archetype.resize(rows);
+	sample.x.resize(rows);
+	sample.y.resize(rows);
+	sample.health.resize(rows);
+	const std::vector<uint32_t>& index_of = sim.monster_ids.index_of;
+	uint32_t row = 0;
+	for (uint32_t id = 0; id < index_of.size(); ++id)
+	{
+		if (index_of[id] == INVALID_INDEX)
+		{
+			continue;
+		}
+		const Monster& monster = sim.monsters[index_of[id]];
+		sample.id[row] = id;
+		sample.archetype[row] = monster.archetype;
+		sample.x[row] = monster.position.x;
+		sample.y[row] = monster.position.y;
+		sample.health[row] = monster.health.value;
+		++row;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		++writer.queued;
+	}
+	writer.sample_ready.notify_one();
+	writer.next_tick = sim.tick + writer.current_interval;
+}
+
+bool CloseTelemetryWriter(TelemetryWriter& writer)
+{
+	{
+		std::lock_guard<std::mutex> lock(writer.mutex);
+		writer.stopping = true;
+	}
+	writer.sample_ready.notify_one();
+	writer.thread.join();
+
+	writer.file.close();
+	return !writer.write_failed && !writer.file.fail();
+}
+
+//
+// Reader.
+//
+
+static void GetColumn(const uint8_t*& in, size_t rows, void* column)
+{
+	memcpy(column, in, rows * 4);
+	in += rows * 4;
+}
+
+bool LoadTelemetry(const std::string& path, TelemetryColumns& columns)
+{
+	MappedFile file;
+	if (!OpenMappedFile(path, file))
+	{
+		std::cerr << "Could not open " << path << std::endl;
+		return false;
+	}
+
+	const uint8_t* p = file.data;
+	const uint8_t* end = file.data + file.size;
+	bool valid = file.size >= sizeof(TelemetryHeader);
+	if (valid)
+	{
+		memcpy(&columns.header, p, sizeof(columns.header));
+		p += sizeof(columns.header);
+		valid = columns.header.magic == TELEMETRY_MAGIC && columns.header.version == TELEMETRY_VERSION;
+	}
+
+	columns.tick.clear();
+	columns.first_row.assign(1, 0);
+	columns.id.clear();
+	columns.archetype.clear();
+	columns.x.clear();
+	columns.y.clear();
+	columns.health.clear();
+
+	std::vector<uint8_t> shuffled;
+	std::vector<uint8_t> packed;
+	while (valid && p < end)
+	{
+		TelemetryBlockHeader block;
+		valid = (size_t)(end - p) >= sizeof(block);
+		if (!valid)
+		{
+			break;
+		}
+		memcpy(&block, p, sizeof(block));
+		p += sizeof(block);
+
+		const size_t rows = block.row_count;
+		const size_t raw_size = rows * TELEMETRY_COLUMNS * 4;
+		// A compressed byte never expands to more than 255, so a corrupt row count can't make this allocate without bound.
+		valid = block.compressed_size <= (size_t)(end - p) && raw_size <= (size_t)block.compressed_size * 255;
+		if (!valid)
+		{
+			break;
+		}
+		shuffled.resize(raw_size);
+		packed.resize(raw_size);
+		valid = DecompressBlock(p, block.compressed_size, shuffled.data(), raw_size);
+		if (!valid)
+		{
+			break;
+		}
+		p += block.compressed_size;
+		UnshuffleBytes(shuffled.data(), rows * TELEMETRY_COLUMNS, packed.data());
+
+		const size_t first = columns.id.size();
+		columns.id.resize(first + rows);
+		columns.archetype.resize(first + rows);
+		columns.x.resize(first + rows);
+		columns.y.resize(first + rows);
+		columns.health.resize(first + rows);
+		const uint8_t* in = packed.data();
+		GetColumn(in, rows, columns.id.data() + first);
+		GetColumn(in, rows, columns.archetype.data() + first);
+		GetColumn(in, rows, columns.x.data() + first);
+		GetColumn(in, rows, columns.y.data() + first);
+		GetColumn(in, rows, columns.health.data() + first);
+
+		uint32_t next_id = 0;
+		for (size_t i = first; i < first + rows; ++i)
+		{
+			columns.id[i] += next_id;
+			next_id = columns.id[i] + 1;
+		}
+
+		columns.tick.push_back(block.tick);
+		columns.first_row.push_back((uint32_t)columns.id.size());
+	}
+
+	CloseMappedFile(file);
+	if (!valid)
+	{
+		std::cerr << path << ": not a version " << TELEMETRY_VERSION << " telemetry file" << std::endl;
+	}
+	return valid;
+}
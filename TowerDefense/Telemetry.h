@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//
+// Telemetry export, every Monster's position and health every few ticks for offline analysis.
+//
+// The simulation thread only copies a sample into a free slot of a small ring of reusable
+// samples, everything else happens on a writer thread: packing the sample into columns,
+// compressing it (see Compression.h) and buffering it until a large sequential write is worth
+// doing. The simulation never waits on the writer. If every slot is full when a sample is due
+// the sample is skipped, TELEMETRY_DROP keeps sampling at the same rate and counts what it
+// lost, TELEMETRY_THROTTLE doubles the interval until the writer catches up, so samples stay
+// evenly spaced but coarser.
+//
+// File layout:
+//   TelemetryHeader
+//   per sample: TelemetryBlockHeader, compressed block
+// A block decompresses to the sample's columns one after the other (id gaps, archetype, x, y,
+// health, 4 bytes per row each) with their bytes shuffled. Rows are Monsters in id order and
+// ids are stored as the gap from the one after the previous row, which is almost always 0.
+//
+// Towers don't move and are not exported, see Replay.h for a full visual record.
+//
+
+const uint32_t TELEMETRY_MAGIC = 0x4D544454;		// "TDTM"
+const uint32_t TELEMETRY_VERSION = 1;
+
+// Columns in a block, each 4 bytes per row.
+const uint32_t TELEMETRY_COLUMNS = 5;
+
+// Samples waiting for the writer thread before new ones are skipped.
+const uint32_t TELEMETRY_QUEUE_SIZE = 8;
+
+// Compressed blocks are written to the file once this many bytes are buffered.
+const uint32_t TELEMETRY_WRITE_SIZE = 4 << 20;
+
+// TELEMETRY_THROTTLE never samples less often than this many intervals.
+const uint32_t TELEMETRY_MAX_THROTTLE = 64;
+
+enum TelemetryPolicy : uint32_t
+{
+	TELEMETRY_DROP = 0,
+	TELEMETRY_THROTTLE = 1,
+};
+
+// 4 byte aligned, 16 byte size.
+struct TelemetryHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t interval;				// Ticks between samples as requested, throttling may have made some gaps longer.
+	uint32_t monster_archetypes;
+};
+
+// 8 byte aligned, 16 byte size.
+struct TelemetryBlockHeader
+{
+	uint64_t tick;
+	uint32_t row_count;
+	uint32_t compressed_size;
+};
+
+// One sample as captured, one row per Monster in id order.
+struct TelemetrySample
+{
+	uint64_t tick;
+	std::vector<uint32_t> id;
+	std::vector<uint32_t> archetype;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<uint32_t> health;
+};
+
+struct TelemetryWriter
+{
+	std::ofstream file;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable sample_ready;
+	std::vector<TelemetrySample> queue;		// Ring of TELEMETRY_QUEUE_SIZE samples, reused.
+	uint32_t head;							// Oldest queued sample.
+	uint32_t queued;
+	bool stopping;
+
+	// Simulation thread only.
+	TelemetryPolicy policy;
+	uint32_t interval;
+	uint32_t current_interval;				// interval, or longer while throttled.
+	uint64_t next_tick;
+	uint64_t samples_dropped;				// Skipped because the queue was full.
+
+	// Writer thread only, read them after CloseTelemetryWriter.
+	uint64_t samples_written;
+	uint64_t raw_bytes;
+	uint64_t file_bytes;
+	bool write_failed;
+	std::vector<uint8_t> packed;			// Scratch.
+	std::vector<uint8_t> shuffled;
+	std::vector<uint8_t> output;			// Blocks not yet written to file.
+};
+
+// Every column of every sample in a file, samples one after the other.
+struct TelemetryColumns
+{
+	TelemetryHeader header;
+	std::vector<uint64_t> tick;				// Per sample.
+	std::vector<uint32_t> first_row;		// Per sample, plus one past the last row.
+	std::vector<uint32_t> id;				// Per row from here on.
+	std::vector<uint32_t> archetype;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<uint32_t> health;
+};
+
+// Starts the writer thread. Samples are taken every interval ticks.
+bool OpenTelemetryWriter(const std::string& path, const Archetypes& archetypes, uint32_t interval, TelemetryPolicy policy, TelemetryWriter& writer);
+
+// Call once per tick, takes a sample if one is due. Never blocks on the writer thread.
+void CaptureTelemetry(TelemetryWriter& writer, const Simulation& sim);
+
+// Writes every queued sample, then joins the writer thread.
+bool CloseTelemetryWriter(TelemetryWriter& writer);
+
+bool LoadTelemetry(const std::string& path, TelemetryColumns& columns);
+
+inline uint32_t TelemetrySampleCount(const TelemetryColumns& columns)
+{
+	return (uint32_t)columns.tick.size();
+}
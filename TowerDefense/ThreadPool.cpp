@@ -0,0 +1,76 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+static void WorkerLoop(ThreadPool& pool)
+{
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	for (;;)
+	{
+		pool.job_ready.wait(lock, [&]() { return pool.stopping || !pool.jobs.empty(); });
+		if (pool.jobs.empty())
+		{
+			// Only reached when stopping, queued jobs are always finished first.
+			return;
+		}
+
+		std::function<void()> job = std::move(pool.jobs.front());
+		pool.jobs.pop_front();
+		++pool.running;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		--pool.running;
+		if (pool.running == 0 && pool.jobs.empty())
+		{
+			pool.all_done.notify_all();
+		}
+	}
+}
+
+void InitThreadPool(ThreadPool& pool, uint32_t thread_count)
+{
+	if (thread_count == 0)
+	{
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	pool.running = 0;
+	pool.stopping = false;
+	for (uint32_t i = 0; i < thread_count; ++i)
+	{
+		pool.workers.emplace_back(WorkerLoop, std::ref(pool));
+	}
+}
+
+void ShutdownThreadPool(ThreadPool& pool)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.stopping = true;
+	}
+	pool.job_ready.notify_all();
+
+	for (uint32_t i = 0; i < pool.workers.size(); ++i)
+	{
+		pool.workers[i].join();
+	}
+	pool.workers.clear();
+}
+
+void SubmitJob(ThreadPool& pool, std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.jobs.push_back(std::move(job));
+	}
+	pool.job_ready.notify_one();
+}
+
+void WaitForJobs(ThreadPool& pool)
+{
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.all_done.wait(lock, [&]() { return pool.running == 0 && pool.jobs.empty(); });
+}
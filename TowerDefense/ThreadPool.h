@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+//
+// Fixed set of worker threads running queued jobs.
+//
+// Jobs are whole units of work (e.g. stepping one Simulation for many ticks), not per entity
+// tasks, so a single mutex protected queue is plenty. Anything a job touches that another
+// running job might also touch is the caller's problem, the pool only runs them.
+//
+
+struct ThreadPool
+{
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable job_ready;
+	std::condition_variable all_done;
+	std::deque<std::function<void()>> jobs;
+	uint32_t running;		// Jobs taken off the queue but not finished yet.
+	bool stopping;
+};
+
+// thread_count 0 uses one thread per hardware thread.
+void InitThreadPool(ThreadPool& pool, uint32_t thread_count);
+
+// Finishes every queued job, then joins the workers.
+void ShutdownThreadPool(ThreadPool& pool);
+
+void SubmitJob(ThreadPool& pool, std::function<void()> job);
+
+// Blocks until the queue is empty and no job is running.
+void WaitForJobs(ThreadPool& pool);
+
+inline uint32_t ThreadCount(const ThreadPool& pool)
+{
+	return (uint32_t)pool.workers.size();
+}
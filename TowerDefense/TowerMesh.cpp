@@ -0,0 +1,152 @@
+#include "TowerMesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Unit circle, shared by every Tower.
+static const sf::Vector2f* CirclePoints()
+{
+	static sf::Vector2f points[TOWER_MESH_SEGMENTS + 1];
+	static bool initialized = false;
+	if (!initialized)
+	{
+		for (uint32_t i = 0; i <= TOWER_MESH_SEGMENTS; ++i)
+		{
+			const float angle = i * 6.28318531f / TOWER_MESH_SEGMENTS;
+			points[i] = sf::Vector2f(cosf(angle), sinf(angle));
+		}
+		initialized = true;
+	}
+	return points;
+}
+
+static void WriteTower(TowerMesh& mesh, uint32_t slot, Position position, float range)
+{
+	const sf::Vector2f* circle = CirclePoints();
+	const sf::Vector2f center(position.x, position.y);
+
+	const uint32_t body = slot * TOWER_MESH_SEGMENTS * 3;
+	const uint32_t ring = slot * TOWER_MESH_SEGMENTS * 2;
+	for (uint32_t s = 0; s < TOWER_MESH_SEGMENTS; ++s)
+	{
+		mesh.bodies[body + s * 3] = sf::Vertex(center, sf::Color::Green);
+		mesh.bodies[body + s * 3 + 1] = sf::Vertex(center + circle[s] * TOWER_RADIUS, sf::Color::Green);
+		mesh.bodies[body + s * 3 + 2] = sf::Vertex(center + circle[s + 1] * TOWER_RADIUS, sf::Color::Green);
+
+		mesh.ranges[ring + s * 2] = sf::Vertex(center + circle[s] * range, sf::Color::Black);
+		mesh.ranges[ring + s * 2 + 1] = sf::Vertex(center + circle[s + 1] * range, sf::Color::Black);
+	}
+}
+
+static void ResizeTowerMesh(TowerMesh& mesh, uint32_t tower_count)
+{
+	mesh.bodies.resize(tower_count * TOWER_MESH_SEGMENTS * 3);
+	mesh.ranges.resize(tower_count * TOWER_MESH_SEGMENTS * 2);
+}
+
+// Moves the vertices of the slots from slot up one slot (vertices_per_tower each), count slots were in use.
+static void ShiftSlots(sf::VertexArray& vertices, uint32_t vertices_per_tower, uint32_t slot, uint32_t count)
+{
+	sf::Vertex* data = &vertices[0];
+	std::copy_backward(data + slot * vertices_per_tower, data + count * vertices_per_tower, data + (count + 1) * vertices_per_tower);
+}
+
+// Adds a placed Tower at the end of its cell's range.
+static void InsertTower(TowerMesh& mesh, uint32_t index, Position position, float range)
+{
+	const uint32_t count = (uint32_t)mesh.cells.entity.size();
+	const uint32_t slot = InsertSpatialGrid(mesh.cells, index, position);
+	ResizeTowerMesh(mesh, count + 1);
+	ShiftSlots(mesh.bodies, TOWER_MESH_SEGMENTS * 3, slot, count);
+	ShiftSlots(mesh.ranges, TOWER_MESH_SEGMENTS * 2, slot, count);
+	WriteTower(mesh, slot, position, range);
+}
+
+// Draws the Towers in the cells a circle of radius around them could reach bounds from, one call
+// per run of contiguous rows (rows whose ranges follow on from each other are merged).
+static void DrawCells(const SpatialGrid& cells, const sf::VertexArray& vertices, uint32_t vertices_per_tower, float radius,
+					  const sf::FloatRect& bounds, sf::RenderTarget& target)
+{
+	if (cells.entity.empty())
+	{
+		return;
+	}
+
+	const uint32_t min_x = SpatialCellX(cells, bounds.left - radius);
+	const uint32_t max_x = SpatialCellX(cells, bounds.left + bounds.width + radius);
+	const uint32_t min_y = SpatialCellY(cells, bounds.top - radius);
+	const uint32_t max_y = SpatialCellY(cells, bounds.top + bounds.height + radius);
+
+	const sf::PrimitiveType type = vertices.getPrimitiveType();
+	uint32_t run_first = cells.cell_start[min_y * cells.width + min_x];
+	uint32_t run_end = run_first;
+	for (uint32_t cell_y = min_y; cell_y <= max_y; ++cell_y)
+	{
+		const uint32_t first = cells.cell_start[cell_y * cells.width + min_x];
+		if (first != run_end)
+		{
+			if (run_end > run_first)
+			{
+				target.draw(&vertices[run_first * vertices_per_tower], (run_end - run_first) * vertices_per_tower, type);
+			}
+			run_first = first;
+		}
+		run_end = cells.cell_start[cell_y * cells.width + max_x + 1];
+	}
+	if (run_end > run_first)
+	{
+		target.draw(&vertices[run_first * vertices_per_tower], (run_end - run_first) * vertices_per_tower, type);
+	}
+}
+
+void InitTowerMesh(TowerMesh& mesh, float world_width, float world_height)
+{
+	mesh.bodies.setPrimitiveType(sf::Triangles);
+	mesh.bodies.clear();
+	mesh.ranges.setPrimitiveType(sf::Lines);
+	mesh.ranges.clear();
+	InitSpatialGrid(mesh.cells, world_width, world_height, TOWER_MESH_CELL_SIZE);
+}
+
+void UpdateTowerMesh(TowerMesh& mesh, TowerBlock& block, const TowerArchetypes& archetypes)
+{
+	const uint32_t count = (uint32_t)block.towers.size();
+	const uint32_t meshed = (uint32_t)mesh.cells.entity.size();
+
+	// Towers are only ever appended when placed, so a change to one already meshed
+	// (or fewer Towers than meshed) means the block was replaced.
+	bool rebuild = count < meshed || count - meshed > TOWER_MESH_MAX_INSERTS;
+	ConsumeChanges(block.changes, CONSUMER_RENDER, [&](uint32_t index)
+	{
+		rebuild = rebuild || index < meshed;
+	});
+
+	if (rebuild)
+	{
+		RebuildTowerMesh(mesh, block, archetypes);
+		return;
+	}
+
+	const float range = archetypes.range[block.archetype].value;
+	for (uint32_t i = meshed; i < count; ++i)
+	{
+		InsertTower(mesh, i, block.towers[i].position, range);
+	}
+}
+
+void RebuildTowerMesh(TowerMesh& mesh, const TowerBlock& block, const TowerArchetypes& archetypes)
+{
+	const float range = archetypes.range[block.archetype].value;
+	BuildSpatialGrid(mesh.cells, block.towers);
+	ResizeTowerMesh(mesh, (uint32_t)block.towers.size());
+	for (uint32_t slot = 0; slot < mesh.cells.entity.size(); ++slot)
+	{
+		WriteTower(mesh, slot, block.towers[mesh.cells.entity[slot]].position, range);
+	}
+}
+
+void DrawTowerMesh(const TowerMesh& mesh, const TowerBlock& block, const TowerArchetypes& archetypes, const sf::FloatRect& bounds, sf::RenderTarget& target)
+{
+	DrawCells(mesh.cells, mesh.bodies, TOWER_MESH_SEGMENTS * 3, TOWER_RADIUS, bounds, target);
+	DrawCells(mesh.cells, mesh.ranges, TOWER_MESH_SEGMENTS * 2, archetypes.range[block.archetype].value, bounds, target);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "Combat.h"
+#include "Archetypes.h"
+#include "SpatialGrid.h"
+
+//
+// Cached vertices for drawing Towers.
+//
+// Drawing a CircleShape per Tower (plus another for its range) costs two draw calls and a
+// shape rebuild per Tower every frame, although Towers never move once placed. Instead each
+// TowerBlock keeps its Towers' vertices in two vertex arrays and only the Towers its
+// ChangeTracker reports as changed for CONSUMER_RENDER are written.
+//
+// The vertices are ordered by a SpatialGrid of the block's Towers, bucketed once as they are
+// placed, so each cell's Towers are one contiguous range. Drawing walks the rows of cells in
+// view and draws each row's range with one call, Towers in cells out of view cost nothing.
+//
+
+// Sizes are in pixels.
+const float TOWER_RADIUS = 16.0f;
+
+// Points on each circle.
+const uint32_t TOWER_MESH_SEGMENTS = 24;
+
+// Size of the cells Towers are bucketed by, in pixels.
+const float TOWER_MESH_CELL_SIZE = 256.0f;
+
+// Towers placed since the last update past which the mesh is rebuilt instead of inserting each.
+const uint32_t TOWER_MESH_MAX_INSERTS = 4;
+
+struct TowerMesh
+{
+	sf::VertexArray bodies;		// Triangles, TOWER_MESH_SEGMENTS * 3 vertices per Tower, in cells order.
+	sf::VertexArray ranges;		// Lines, TOWER_MESH_SEGMENTS * 2 vertices per Tower, in cells order.
+	SpatialGrid cells;			// Slot of each Tower's vertices, entity is the index into the block's towers.
+};
+
+void InitTowerMesh(TowerMesh& mesh, float world_width, float world_height);
+
+// Writes the Towers changed since the last update. Placed Towers are inserted at the end
+// of their cell, anything else (a block replaced by loading a snapshot) rebuilds the mesh.
+void UpdateTowerMesh(TowerMesh& mesh, TowerBlock& block, const TowerArchetypes& archetypes);
+
+// Rebuckets and rewrites every Tower, what UpdateTowerMesh() saves (see Benchmark.h).
+void RebuildTowerMesh(TowerMesh& mesh, const TowerBlock& block, const TowerArchetypes& archetypes);
+
+// Draws the Towers in the cells whose body or range could overlap bounds. The mesh must be up to date with block.
+void DrawTowerMesh(const TowerMesh& mesh, const TowerBlock& block, const TowerArchetypes& archetypes, const sf::FloatRect& bounds, sf::RenderTarget& target);
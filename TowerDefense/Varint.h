@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//
+// Variable length integers (LEB128), 7 bits per byte, low bits first, top bit set on every
+// byte but the last. Small values take one byte, which is what the delta encodings are built
+// on: most per tick changes are a few units of a quantized position.
+//
+// Signed values are zigzag mapped first (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) so small
+// negative numbers are small too.
+//
+
+inline uint64_t ZigZag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+inline void PutSignedVarint(std::vector<uint8_t>& out, int64_t value)
+{
+	PutVarint(out, ZigZag(value));
+}
+
+// Returns false, leaving data where it was, if the varint runs past end or is longer than 64 bits.
+inline bool GetVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	const uint8_t* p = data;
+	for (uint32_t shift = 0; p < end && shift < 64; shift += 7)
+	{
+		const uint8_t byte = *p++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (byte < 0x80)
+		{
+			data = p;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool GetSignedVarint(const uint8_t*& data, const uint8_t* end, int64_t& value)
+{
+	uint64_t raw;
+	if (!GetVarint(data, end, raw))
+	{
+		return false;
+	}
+	value = UnZigZag(raw);
+	return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Components.h"
+
+#include <vector>
+#include <type_traits>
+
+//
+// Component views, the query API systems use instead of taking whole entity vectors.
+//
+//   view<Position, const Health>(monsters).each([](Position& position, const Health& health) { ... });
+//
+// A view names only the components a system touches and how: a const component can only
+// be read, anything else is writable. Asking for a component the entity type doesn't have,
+// writing through a const component, or asking for a writable component from a const vector
+// fails to compile.
+//
+// Entities are still stored as structs (see the ECS note in main.cpp), so each component is
+// a span over the entity vector with the entity's size as its stride rather than its own array.
+// Component locations are member pointers known at compile time, so each() and get() inline
+// down to the same loads and stores as a hand written loop over the vector.
+//
+// Every view type also carries compile time read and write masks, so a scheduler running
+// systems in parallel can check two views for conflicts with ViewsConflict() without running them.
+//
+
+// Bit of each component type in the access masks.
+template <typename Component> struct ComponentId;
+template <> struct ComponentId<Health> { static constexpr uint32_t value = 0; };
+template <> struct ComponentId<Position> { static constexpr uint32_t value = 1; };
+template <> struct ComponentId<Velocity> { static constexpr uint32_t value = 2; };
+template <> struct ComponentId<Timer> { static constexpr uint32_t value = 3; };
+template <> struct ComponentId<SpeedMultiplier> { static constexpr uint32_t value = 4; };
+
+// Where each component lives in each entity type. Entity types without a specialization
+// for a component don't have it.
+template <typename Entity, typename Component> struct ComponentOf;
+template <> struct ComponentOf<Monster, Health> { static constexpr Health Monster::* member = &Monster::health; };
+template <> struct ComponentOf<Monster, Position> { static constexpr Position Monster::* member = &Monster::position; };
+template <> struct ComponentOf<Monster, Velocity> { static constexpr Velocity Monster::* member = &Monster::velocity; };
+template <> struct ComponentOf<Monster, SpeedMultiplier> { static constexpr SpeedMultiplier Monster::* member = &Monster::speed; };
+template <> struct ComponentOf<Waypoint, Position> { static constexpr Position Waypoint::* member = &Waypoint::position; };
+template <> struct ComponentOf<Tower, Position> { static constexpr Position Tower::* member = &Tower::position; };
+template <> struct ComponentOf<Tower, Timer> { static constexpr Timer Tower::* member = &Tower::timer; };
+template <> struct ComponentOf<Bullet, Position> { static constexpr Position Bullet::* member = &Bullet::position; };
+template <> struct ComponentOf<Bullet, Velocity> { static constexpr Velocity Bullet::* member = &Bullet::velocity; };
+template <> struct ComponentOf<Bullet, Timer> { static constexpr Timer Bullet::* member = &Bullet::lifetime; };
+template <> struct ComponentOf<LightningArc, Timer> { static constexpr Timer LightningArc::* member = &LightningArc::timer; };
+
+template <typename... Components> struct AccessMask;
+
+template <>
+struct AccessMask<>
+{
+	static constexpr uint32_t reads = 0;
+	static constexpr uint32_t writes = 0;
+	static constexpr bool all_const = true;
+};
+
+template <typename Component, typename... Rest>
+struct AccessMask<Component, Rest...>
+{
+	static constexpr uint32_t bit = 1u << ComponentId<typename std::remove_const<Component>::type>::value;
+	static_assert((bit & AccessMask<Rest...>::reads) == 0, "Component listed twice in one view");
+
+	// Writing a component implies reading it, anything that conflicts with a read conflicts with a write.
+	static constexpr uint32_t reads = bit | AccessMask<Rest...>::reads;
+	static constexpr uint32_t writes = (std::is_const<Component>::value ? 0 : bit) | AccessMask<Rest...>::writes;
+	static constexpr bool all_const = std::is_const<Component>::value && AccessMask<Rest...>::all_const;
+};
+
+// Fails to compile (incomplete ComponentOf) if Entity lacks any of the Components.
+template <typename Entity, typename... Components> struct HasComponents;
+
+template <typename Entity>
+struct HasComponents<Entity>
+{
+	static constexpr bool value = true;
+};
+
+template <typename Entity, typename Component, typename... Rest>
+struct HasComponents<Entity, Component, Rest...>
+{
+	static constexpr bool value = sizeof(ComponentOf<Entity, typename std::remove_const<Component>::type>) > 0 && HasComponents<Entity, Rest...>::value;
+};
+
+template <typename Entity, typename... Components>
+struct View
+{
+	typedef typename std::remove_const<Entity>::type entity_type;
+	static constexpr uint32_t reads = AccessMask<Components...>::reads;
+	static constexpr uint32_t writes = AccessMask<Components...>::writes;
+	static_assert(HasComponents<entity_type, Components...>::value && reads != 0, "A view needs at least one Component");
+
+	Entity* entities;
+	uint32_t count;
+
+	uint32_t size() const
+	{
+		return count;
+	}
+
+	// Component must be one of the view's Components, const exactly when it is const there.
+	template <typename Component>
+	Component& get(uint32_t index) const
+	{
+		static_assert(AccessMask<Components...>::reads & AccessMask<typename std::remove_const<Component>::type>::reads,
+					  "Component is not part of this view");
+		static_assert(std::is_const<Component>::value || (AccessMask<Components...>::writes & AccessMask<Component>::writes),
+					  "Component is read only in this view");
+		return entities[index].*ComponentOf<entity_type, typename std::remove_const<Component>::type>::member;
+	}
+
+	// Calls fn with a reference to each of the view's Components, for every entity in order.
+	template <typename Function>
+	void each(Function fn) const
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			fn(static_cast<Components&>(entities[i].*ComponentOf<entity_type, typename std::remove_const<Components>::type>::member)...);
+		}
+	}
+};
+
+template <typename... Components, typename Entity>
+View<Entity, Components...> view(std::vector<Entity>& entities)
+{
+	return View<Entity, Components...>({ entities.data(), (uint32_t)entities.size() });
+}
+
+template <typename... Components, typename Entity>
+View<const Entity, Components...> view(const std::vector<Entity>& entities)
+{
+	static_assert(AccessMask<Components...>::all_const, "Only const Components can be viewed from a const vector");
+	return View<const Entity, Components...>({ entities.data(), (uint32_t)entities.size() });
+}
+
+// True if the systems using views A and B can't safely run at the same time,
+// i.e. both touch the same entity type and one writes a component the other reads.
+template <typename ViewA, typename ViewB>
+constexpr bool ViewsConflict()
+{
+	return std::is_same<typename ViewA::entity_type, typename ViewB::entity_type>::value &&
+		   ((ViewA::writes & ViewB::reads) != 0 || (ViewB::writes & ViewA::reads) != 0);
+}
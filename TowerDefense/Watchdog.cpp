@@ -0,0 +1,155 @@
+#include "Watchdog.h"
+#include "Snapshot.h"
+#include "Metrics.h"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+static float SecondsSince(WatchdogClock::time_point start, WatchdogClock::time_point end)
+{
+	return std::chrono::duration<float>(end - start).count();
+}
+
+// False while captures are rate limited, see WATCHDOG_COOLDOWN_SECONDS and WATCHDOG_MAX_CAPTURES.
+static bool CanCapture(const HitchWatchdog& watchdog, WatchdogClock::time_point now)
+{
+	return watchdog.captures < WATCHDOG_MAX_CAPTURES && SecondsSince(watchdog.last_capture, now) >= WATCHDOG_COOLDOWN_SECONDS;
+}
+
+static bool WriteReport(const std::string& path, const std::string& snapshot_path, const HitchWatchdog& watchdog, float seconds,
+						const Simulation& sim)
+{
+	std::ofstream report(path);
+	report << std::fixed << std::setprecision(3);
+	report << "Hitch at tick " << sim.tick << ": " << seconds * 1000.0f << " ms, budget " << watchdog.budget * 1000.0f << " ms, hitch "
+		   << watchdog.hitches << " of " << watchdog.frames << " frames" << std::endl;
+
+	report << "Zones:" << std::endl;
+	float zoned = 0.0f;
+	for (uint32_t i = 0; i < watchdog.zone_count; ++i)
+	{
+		const TraceZone& zone = watchdog.zones[i];
+		report << "  " << std::left << std::setw(20) << zone.name << std::right << std::setw(10) << zone.seconds * 1000.0f << " ms at "
+			   << zone.start * 1000.0f << " ms" << std::endl;
+		zoned += zone.seconds;
+	}
+	report << "  " << std::left << std::setw(20) << "(not in a zone)" << std::right << std::setw(10) << (seconds - zoned) * 1000.0f << " ms"
+		   << std::endl;
+
+	report << "Simulation systems, last tick:" << std::endl;
+	for (uint32_t i = 0; i < SYSTEM_COUNT; ++i)
+	{
+		report << "  " << std::left << std::setw(20) << SystemName((SimulationSystem)i) << std::right << std::setw(10)
+			   << sim.system_seconds[i] * 1000.0f << " ms" << std::endl;
+	}
+
+	uint32_t status_effects = 0;
+	for (uint32_t i = 0; i < STATUS_EFFECT_COUNT; ++i)
+	{
+		status_effects += (uint32_t)sim.status_effects.sets[i].owner.size();
+	}
+	report << "Entities: " << sim.monsters.size() << " Monsters, " << TowerCount(sim) << " Towers, " << BulletCount(sim) << " Bullets, "
+		   << sim.lightning_arcs.size() << " lightning arcs, " << sim.waypoints.size() << " Waypoints, " << status_effects
+		   << " status effects" << std::endl;
+	report << "Player: " << sim.player_health << " health, " << sim.monsters_killed << " kills" << std::endl;
+	report << "Allocations so far: " << AllocationCount() << std::endl;
+	report << "Snapshot: " << snapshot_path << ", tick " << watchdog.baseline.tick << ", " << watchdog.frame_start_tick - watchdog.baseline.tick
+		   << " ticks before the frame began at tick " << watchdog.frame_start_tick << std::endl;
+
+	report.close();
+	if (!report)
+	{
+		std::cerr << "Could not write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void InitWatchdog(HitchWatchdog& watchdog, float budget)
+{
+	watchdog.budget = budget;
+	watchdog.zone_count = 0;
+	watchdog.frames = 0;
+	watchdog.hitches = 0;
+	watchdog.captures = 0;
+	watchdog.worst = 0.0f;
+	watchdog.frame_start_tick = 0;
+	watchdog.has_baseline = false;
+	watchdog.frame_start = WatchdogClock::now();
+	watchdog.zone_start = watchdog.frame_start;
+	// The first hitch is captured whenever it happens.
+	watchdog.last_capture = watchdog.frame_start - std::chrono::duration_cast<WatchdogClock::duration>(std::chrono::duration<float>(WATCHDOG_COOLDOWN_SECONDS));
+}
+
+void BeginWatchdogFrame(HitchWatchdog& watchdog, const Simulation& sim)
+{
+	if (watchdog.budget <= 0.0f)
+	{
+		return;
+	}
+
+	// Forked before the frame is timed, so keeping the state doesn't count towards the budget.
+	// A tick going backwards means a snapshot was loaded, the old baseline is of another game.
+	const bool baseline_due = !watchdog.has_baseline || sim.tick < watchdog.baseline.tick ||
+							  sim.tick - watchdog.baseline.tick >= WATCHDOG_BASELINE_TICKS;
+	if (baseline_due && watchdog.captures < WATCHDOG_MAX_CAPTURES)
+	{
+		ForkSimulation(sim, watchdog.baseline);
+		watchdog.has_baseline = true;
+	}
+	watchdog.frame_start_tick = sim.tick;
+
+	watchdog.frame_start = WatchdogClock::now();
+	watchdog.zone_start = watchdog.frame_start;
+	watchdog.zone_count = 0;
+}
+
+void EndWatchdogZone(HitchWatchdog& watchdog, const char* name)
+{
+	if (watchdog.budget <= 0.0f)
+	{
+		return;
+	}
+	const WatchdogClock::time_point now = WatchdogClock::now();
+	const float seconds = SecondsSince(watchdog.zone_start, now);
+	if (watchdog.zone_count < WATCHDOG_MAX_ZONES)
+	{
+		watchdog.zones[watchdog.zone_count++] = TraceZone({ name, SecondsSince(watchdog.frame_start, watchdog.zone_start), seconds });
+	}
+	else
+	{
+		watchdog.zones[WATCHDOG_MAX_ZONES - 1].seconds += seconds;
+	}
+	watchdog.zone_start = now;
+}
+
+bool EndWatchdogFrame(HitchWatchdog& watchdog, const Archetypes& archetypes, const Simulation& sim)
+{
+	if (watchdog.budget <= 0.0f)
+	{
+		return true;
+	}
+	const WatchdogClock::time_point now = WatchdogClock::now();
+	const float seconds = SecondsSince(watchdog.frame_start, now);
+	++watchdog.frames;
+	watchdog.worst = seconds > watchdog.worst ? seconds : watchdog.worst;
+	if (seconds <= watchdog.budget)
+	{
+		return true;
+	}
+
+	++watchdog.hitches;
+	if (!watchdog.has_baseline || !CanCapture(watchdog, now))
+	{
+		return true;
+	}
+	watchdog.last_capture = now;
+	++watchdog.captures;
+
+	const std::string path = WATCHDOG_CAPTURE_PREFIX + std::to_string(sim.tick);
+	const bool saved = SaveSnapshot(path + ".snapshot", archetypes, watchdog.baseline);
+	const bool reported = WriteReport(path + ".txt", path + ".snapshot", watchdog, seconds, sim);
+	std::cout << "Hitch at tick " << sim.tick << " took " << seconds * 1000.0f << " ms, captured to " << path << ".txt" << std::endl;
+	return saved && reported;
+}
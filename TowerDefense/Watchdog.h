@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <string>
+#include <chrono>
+
+//
+// Hitch watchdog, captures what a frame was doing when it takes longer than its budget.
+//
+// The frame loop marks where each of its zones (events, simulation, recording, drawing...)
+// ends. When a frame comes in over budget the watchdog writes a report of its zones, with the
+// simulation's own systems broken out (see Simulation::system_seconds), and the entity counts,
+// plus a snapshot that can be resumed with --resume (see Snapshot.h), both named after the tick.
+//
+// The snapshot is a baseline from before the frame that hitched, so resuming it steps up to
+// and through the hitching ticks again. Every WATCHDOG_BASELINE_TICKS ticks the watchdog forks
+// the simulation into a Simulation it keeps (see ForkSimulation()), which doesn't allocate once
+// it has grown. Forking costs about as much as a tick at 75k Monsters, so doing it every frame
+// would double the cost of watching; once every WATCHDOG_BASELINE_TICKS it's lost in the noise.
+// The fork happens before the frame is timed, it never counts towards the budget, and stops
+// after the last capture. The report says how many ticks the baseline is from the frame that
+// hitched. The input handled since the baseline isn't kept, only the state it started from.
+//
+// Capturing costs a snapshot save, so it's rate limited: at most one capture per cooldown and
+// WATCHDOG_MAX_CAPTURES per run, later hitches are only counted. The capture happens after the
+// frame's time is taken and the next frame starts timing after it, so a capture doesn't make
+// the following frame look like a hitch too.
+//
+// Every function does nothing on a watchdog initialized with a budget of 0, so the frame loop
+// can mark zones unconditionally.
+//
+
+// 2x a 60 Hz frame unless --watchdog says otherwise.
+const float WATCHDOG_DEFAULT_BUDGET = 2.0f / 60.0f;
+
+const float WATCHDOG_COOLDOWN_SECONDS = 60.0f;
+
+// Ticks between baseline forks, 5 seconds at 60 Hz.
+const uint64_t WATCHDOG_BASELINE_TICKS = 300;
+const uint32_t WATCHDOG_MAX_CAPTURES = 10;
+
+// Captures are written to <prefix><tick>.txt and <prefix><tick>.snapshot.
+const char* const WATCHDOG_CAPTURE_PREFIX = "hitch_";
+
+// Zones a frame can be split into, more are folded into the last one.
+const uint32_t WATCHDOG_MAX_ZONES = 16;
+
+struct TraceZone
+{
+	const char* name;		// Static string.
+	float start;			// Seconds since the frame began.
+	float seconds;
+};
+
+typedef std::chrono::steady_clock WatchdogClock;
+
+struct HitchWatchdog
+{
+	float budget;						// Seconds, 0 disables the watchdog.
+	WatchdogClock::time_point frame_start;
+	WatchdogClock::time_point zone_start;
+	TraceZone zones[WATCHDOG_MAX_ZONES];
+	uint32_t zone_count;
+	WatchdogClock::time_point last_capture;
+
+	uint64_t frames;
+	uint64_t hitches;
+	uint32_t captures;
+	float worst;						// Longest frame so far, seconds.
+
+	uint64_t frame_start_tick;			// Simulation tick when the frame began.
+	Simulation baseline;				// Forked every WATCHDOG_BASELINE_TICKS, what a capture saves.
+	bool has_baseline;
+};
+
+void InitWatchdog(HitchWatchdog& watchdog, float budget);
+
+// Call before the frame changes sim, forks a new baseline if one is due.
+void BeginWatchdogFrame(HitchWatchdog& watchdog, const Simulation& sim);
+
+// Ends the zone that began where the last one (or the frame) ended.
+void EndWatchdogZone(HitchWatchdog& watchdog, const char* name);
+
+// Captures the frame if it went over budget and captures aren't rate limited. Returns false
+// only if a capture couldn't be written.
+bool EndWatchdogFrame(HitchWatchdog& watchdog, const Archetypes& archetypes, const Simulation& sim);
@@ -0,0 +1,50 @@
+#include "Waves.h"
+
+#include <algorithm>
+#include <limits>
+
+void InitWaves(WaveState& state, const std::vector<Wave>& waves)
+{
+	state.time = 0.0f;
+	state.spawned.assign(waves.size(), 0);
+}
+
+void UpdateWaves(const std::vector<Wave>& waves, WaveState& state, float DeltaTime, std::vector<uint32_t>& spawns)
+{
+	state.time += DeltaTime;
+	for (uint32_t w = 0; w < waves.size(); ++w)
+	{
+		const Wave& wave = waves[w];
+		if (state.time < wave.start_time || state.spawned[w] == wave.count)
+		{
+			continue;
+		}
+
+		// The first Monster spawns at start_time, every one after that interval seconds later.
+		uint32_t due = wave.count;
+		if (wave.interval > 0.0f)
+		{
+			const float elapsed = (state.time - wave.start_time) / wave.interval;
+			due = elapsed + 1.0f >= (float)wave.count ? wave.count : (uint32_t)elapsed + 1;
+		}
+
+		for (; state.spawned[w] < due; ++state.spawned[w])
+		{
+			spawns.push_back(wave.archetype);
+		}
+	}
+}
+
+float SecondsToNextSpawn(const std::vector<Wave>& waves, const WaveState& state)
+{
+	float next = std::numeric_limits<float>::infinity();
+	for (uint32_t w = 0; w < waves.size(); ++w)
+	{
+		const Wave& wave = waves[w];
+		if (state.spawned[w] < wave.count)
+		{
+			next = std::min(next, wave.start_time + state.spawned[w] * wave.interval - state.time);
+		}
+	}
+	return std::max(next, 0.0f);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//
+// Wave schedule, which Monsters spawn and when.
+//
+// Each Wave spawns count Monsters of one archetype, one every interval seconds from
+// start_time on. Waves may overlap. The schedule itself is plain data (it is stored as is
+// in level files), the only state is how many of each Wave have spawned so far.
+//
+
+// 4 byte aligned, 16 byte size.
+struct Wave
+{
+	float start_time;		// Seconds since the level started.
+	uint32_t archetype;		// Index into MonsterArchetypes.
+	uint32_t count;
+	float interval;			// Seconds between spawns.
+};
+
+struct WaveState
+{
+	float time;							// Seconds since the level started.
+	std::vector<uint32_t> spawned;		// Monsters spawned so far by each Wave.
+};
+
+void InitWaves(WaveState& state, const std::vector<Wave>& waves);
+
+// Appends the archetype of every Monster due to spawn this frame.
+void UpdateWaves(const std::vector<Wave>& waves, WaveState& state, float DeltaTime, std::vector<uint32_t>& spawns);
+
+// 0 if a spawn is already due, infinity once every Wave has spawned.
+float SecondsToNextSpawn(const std::vector<Wave>& waves, const WaveState& state);
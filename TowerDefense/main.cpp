@@ -1,24 +1,115 @@
 #include <SFML/Graphics.hpp>
 
+#include "Components.h"
+#include "Pathfinding.h"
+#include "Archetypes.h"
+#include "Combat.h"
+#include "Benchmark.h"
+#include "View.h"
+#include "TowerMesh.h"
+#include "Level.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "Forecast.h"
+#include "Replay.h"
+#include "Telemetry.h"
+#include "StatePublisher.h"
+#include "SpectatorServer.h"
+#include "Metrics.h"
+#include "Watchdog.h"
+#include "Results.h"
+#include "FramePacing.h"
+#include "FastForward.h"
+#include "Camera.h"
+#include "DensityMap.h"
+
 #include <vector>
 #include <unordered_map>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
 
 const int WIDTH = 1600;
 const int HEIGHT = 900;
 
-// Sizes are in pixels.
-const float MONSTER_SIZE = 32.0f;
+// Sizes are in pixels, Monster and Bullet sizes are in Combat.h, Tower size in TowerMesh.h.
 const float WAYPOINT_RADIUS = 16.0f;
-const float TOWER_RADIUS = 16.0f;
-const float BULLET_RADIUS = 8.0f;
 
-// Speed is pixels per second.
-const float MONSTER_SPEED = 100.0f;
-const float BULLET_SPEED = 150.0f;
+// How far above a Monster's center its health bar reaches.
+const float MONSTER_DRAWN_EXTENT = MONSTER_SIZE / 2.0f + 8.0f;
+
+// Size of the cells Bullets are bucketed by each frame to find those in view.
+const float BULLET_GRID_CELL_SIZE = 128.0f;
+
+// Seconds simulated per tick by --simulate (60 ticks per second).
+const float HEADLESS_DELTA_TIME = 1.0f / 60.0f;
+
+// --forecast tries each Tower archetype on every open cell this many cells apart.
+const uint32_t FORECAST_CANDIDATE_SPACING = 4;
+
+// Number of placements --forecast prints, best first.
+const uint32_t FORECAST_SHOWN = 10;
+
+// Saved to by F5 and loaded by F9.
+const char* const QUICKSAVE_PATH = "quicksave.snapshot";
+
+// Ticks between --telemetry samples unless --telemetry-interval says otherwise.
+const uint32_t TELEMETRY_DEFAULT_INTERVAL = 10;
+
+// Times --watch reads the shared state per second.
+const uint32_t WATCH_READS_PER_SECOND = 2;
+
+// --watch stops once the shared state hasn't changed for this long.
+const float WATCH_IDLE_SECONDS = 5.0f;
+
+// How often an idle game looks for input while it also has to wake for something else.
+const float IDLE_POLL_SECONDS = 0.01f;
+
+// --spectate polls the server this often and prints once per this many polls.
+const float SPECTATE_POLL_SECONDS = 0.005f;
+const uint32_t SPECTATE_POLLS_PER_PRINT = 200;
+
+// What to record or publish while the simulation runs, headless or not. Empty paths and names do nothing.
+struct RecordOptions
+{
+	std::string replay_path;
+	std::string telemetry_path;
+	uint32_t telemetry_interval;
+	TelemetryPolicy telemetry_policy;
+	std::string share_name;
+	uint16_t serve_port;		// 0 serves nothing.
+	uint32_t serve_interval;
+	uint16_t metrics_port;		// 0 serves no metrics.
+	float watchdog_budget;		// Seconds, 0 watches nothing.
+};
+
+// Cells a level blocks, built once as the level never changes them. Quads are in row order so
+// the rows in view are one contiguous range.
+struct BlockedCells
+{
+	sf::VertexArray quads;
+	std::vector<uint32_t> row_start;	// First vertex of each grid row, row_start[row + 1] is one past its last.
+	float cell_size;
+};
 
-const uint32_t MONSTER_MAX_HEALTH = 100;
+// Everything RecordOptions asked for, open.
+struct Recorders
+{
+	ReplayWriter replay;
+	TelemetryWriter telemetry;
+	StatePublisher publisher;
+	bool recording;
+	bool exporting;
+	SpectatorServer server;
+	MetricsRegistry metrics;
+	MetricsServer metrics_server;
+	HitchWatchdog watchdog;
+	bool sharing;
+	bool serving;
+	bool metering;
+};
 
 //
 // This is a simple Tower Defense style game.
@@ -45,121 +136,26 @@ const uint32_t MONSTER_MAX_HEALTH = 100;
 // Then every time a Tower was "created", new data would be emplaced_back() into
 // each of these arrays.
 //
-
-//
-// Base Components.
+// Components and Entity types live in Components.h so other systems can share them.
+// Stats shared by every entity of a kind live in archetype tables (Archetypes.h) loaded
+// from archetypes.txt, entities only store the index of their archetype.
+// Systems that only touch a few components should take a View of them (View.h) rather than whole entity vectors.
+// Every entity and the systems updating them live in a Simulation (Simulation.h), main() only handles input and drawing.
 //
 
-// Alignment values assume x64.
-// 4 byte aligned, 4 byte size.
-struct Health
-{
-	uint32_t value;
-};
-
-// 4 byte aligned, 8 byte size.
-struct Position
-{
-	float x;
-	float y;
-};
-
-// 4 byte aligned, 8 byte size.
-struct Velocity
-{
-	float x;
-	float y;
-};
-
-// 4 byte aligned, 4 byte size.
-struct Damage
-{
-	uint32_t value;
-};
-
-// 4 byte aligned, 4 byte size.
-struct AttackRange
-{
-	float value;
-};
-
-// 4 byte aligned, 4 byte size.
-// The number of seconds between each shot.
-struct AttackRate
-{
-	float value;
-};
-
-// 4 byte aligned, 4 byte size.
-struct Timer
-{
-	float value;
-};
-
-//
-// Entity types (comprised of base components).
-//
-
-// 4 byte aligned, 28 byte size.
-struct Monster
-{
-	Health health;
-	Position position;
-	Velocity velocity;
-	uint32_t waypoint_index;	// Index into waypoints vector, this is the currently targeted waypoint.
-	Damage damage;
-};
-
-// 4 byte aligned, 8 byte size.
-struct Waypoint
-{
-	Position position;
-};
-
-// 4 byte aligned, 20 byte size.
-struct Tower
-{
-	Position position;
-	AttackRange range;
-	AttackRate attackRate;
-	Timer timer;
-};
-
-// 4 byte aligned, 24 byte size.
-struct Bullet
-{
-	Position position;
-	Velocity velocity;
-	Damage damage;
-	uint32_t target_index;		// Index into monsters vector, this is the current target.
-								// This enables the bullets to track their target and home in.
-};
-
 //
 // Systems (functions that act on entities and components).
+// The simulation's systems are in Simulation.cpp, these only draw.
 //
 
-float Distance(Position pos1, Position pos2)
-{
-	return sqrtf((pos2.x - pos1.x) * (pos2.x - pos1.x) + (pos2.y - pos1.y) * (pos2.y - pos1.y));
-}
-
-float Magnitude(float x, float y)
-{
-	return sqrtf(x * x + y * y);
-}
-
-sf::Vector2f Normalize(float x, float y)
+// True if a point within margin of (x, y) is in bounds.
+bool InView(float x, float y, float margin, const sf::FloatRect& bounds)
 {
-	sf::Vector2f result;
-	const float magnitude = Magnitude(x, y);
-	result.x = x / magnitude;
-	result.y = y / magnitude;
-
-	return result;
+	return x + margin >= bounds.left && x - margin <= bounds.left + bounds.width && y + margin >= bounds.top && y - margin <= bounds.top + bounds.height;
 }
 
-void DrawMonsters(const std::vector<Monster>& monsters, sf::RenderTarget& target)
+// Draws the Monsters in visible, indices into monsters (see QueryRect()).
+void DrawMonsters(const std::vector<Monster>& monsters, const std::vector<uint32_t>& visible, const MonsterArchetypes& archetypes, sf::RenderTarget& target)
 {
 	sf::RectangleShape shape;
 	shape.setFillColor(sf::Color::Red);
@@ -180,179 +176,876 @@ void DrawMonsters(const std::vector<Monster>& monsters, sf::RenderTarget& target
 	health.setSize(sf::Vector2f(MONSTER_SIZE, bar_height));
 	health.setOrigin(MONSTER_SIZE / 2.0f, bar_height / 2.0f);
 
-	for (uint32_t i = 0; i < monsters.size(); ++i)
+	for (uint32_t v = 0; v < visible.size(); ++v)
 	{
-		shape.setPosition(monsters[i].position.x, monsters[i].position.y);
+		const Monster& monster = monsters[visible[v]];
+
+		// Slowed Monsters are tinted blue.
+		shape.setFillColor(monster.speed.value < 1.0f ? sf::Color(120, 60, 200) : sf::Color::Red);
+		shape.setPosition(monster.position.x, monster.position.y);
 		target.draw(shape);
 
-		healthBar.setPosition(monsters[i].position.x, monsters[i].position.y - (MONSTER_SIZE / 2.0f) - 5.0f);
+		healthBar.setPosition(monster.position.x, monster.position.y - (MONSTER_SIZE / 2.0f) - 5.0f);
 		target.draw(healthBar);
 
-		health.setSize(sf::Vector2f(MONSTER_SIZE * (monsters[i].health.value / (float)MONSTER_MAX_HEALTH), bar_height));
-		health.setPosition(monsters[i].position.x, monsters[i].position.y - (MONSTER_SIZE / 2.0f) - 5.0f);
+		health.setSize(sf::Vector2f(MONSTER_SIZE * (monster.health.value / (float)archetypes.max_health[monster.archetype].value), bar_height));
+		health.setPosition(monster.position.x, monster.position.y - (MONSTER_SIZE / 2.0f) - 5.0f);
 		target.draw(health);
 	}
 }
 
-void DrawWaypoints(const std::vector<Waypoint>& waypoints, sf::RenderTarget& target)
+void DrawWaypoints(const std::vector<Waypoint>& waypoints, const sf::FloatRect& bounds, sf::RenderTarget& target)
 {
 	sf::CircleShape shape;
 	shape.setFillColor(sf::Color::Blue);
 	shape.setRadius(WAYPOINT_RADIUS);
 	shape.setOrigin(WAYPOINT_RADIUS, WAYPOINT_RADIUS); // Set origin to center of shape instead of top-left corner.
-	for (uint32_t i = 0; i < waypoints.size(); ++i)
+	view<const Position>(waypoints).each([&](const Position& position)
+	{
+		if (InView(position.x, position.y, WAYPOINT_RADIUS, bounds))
+		{
+			shape.setPosition(position.x, position.y);
+			target.draw(shape);
+		}
+	});
+}
+
+// Bullets move every tick, so they are bucketed into grid once per drawn frame and only those in the cells in view are drawn.
+void DrawBullets(const std::vector<Bullet>& bullets, const TowerArchetypes& archetypes, const sf::FloatRect& bounds, SpatialGrid& grid,
+				 std::vector<uint32_t>& visible, sf::RenderTarget& target)
+{
+	if (bullets.empty())
+	{
+		return;
+	}
+	BuildSpatialGrid(grid, bullets);
+	visible.clear();
+	QueryRect(grid, Position({ bounds.left - BULLET_RADIUS, bounds.top - BULLET_RADIUS }),
+			  Position({ bounds.left + bounds.width + BULLET_RADIUS, bounds.top + bounds.height + BULLET_RADIUS }), visible);
+
+	sf::CircleShape shape;
+	shape.setFillColor(sf::Color::Cyan);
+	shape.setRadius(BULLET_RADIUS);
+	shape.setOrigin(BULLET_RADIUS, BULLET_RADIUS); // Set origin to center of shape instead of top-left corner.
+	for (uint32_t v = 0; v < visible.size(); ++v)
 	{
-		shape.setPosition(waypoints[i].position.x, waypoints[i].position.y);
+		const Bullet& bullet = bullets[visible[v]];
+		shape.setFillColor(bullet.type == PROJECTILE_PIERCING ? sf::Color::Magenta : archetypes.splash[bullet.archetype].value > 0.0f ? sf::Color::Yellow : sf::Color::Cyan);
+		shape.setPosition(bullet.position.x, bullet.position.y);
 		target.draw(shape);
 	}
 }
 
-void DrawTowers(const std::vector<Tower>& towers, sf::RenderTarget& target)
+void DrawLightningArcs(const std::vector<LightningArc>& arcs, const sf::FloatRect& bounds, sf::RenderTarget& target)
 {
-	// Tower.
-	sf::CircleShape shape;
-	shape.setFillColor(sf::Color::Green);
-	shape.setRadius(TOWER_RADIUS);
-	shape.setOrigin(TOWER_RADIUS, TOWER_RADIUS); // Set origin to center of shape instead of top-left corner.
+	sf::VertexArray lines(sf::Lines);
+	for (uint32_t i = 0; i < arcs.size(); ++i)
+	{
+		// Culled by the arc's bounding box.
+		const float half_width = fabsf(arcs[i].to.x - arcs[i].from.x) / 2.0f;
+		const float half_height = fabsf(arcs[i].to.y - arcs[i].from.y) / 2.0f;
+		const float center_x = (arcs[i].from.x + arcs[i].to.x) / 2.0f;
+		const float center_y = (arcs[i].from.y + arcs[i].to.y) / 2.0f;
+		if (center_x + half_width >= bounds.left && center_x - half_width <= bounds.left + bounds.width && center_y + half_height >= bounds.top &&
+			center_y - half_height <= bounds.top + bounds.height)
+		{
+			lines.append(sf::Vertex(sf::Vector2f(arcs[i].from.x, arcs[i].from.y), sf::Color::White));
+			lines.append(sf::Vertex(sf::Vector2f(arcs[i].to.x, arcs[i].to.y), sf::Color::White));
+		}
+	}
+	target.draw(lines);
+}
 
-	// AttackRange circle.
-	sf::CircleShape attackRange;
-	attackRange.setFillColor(sf::Color::Transparent);
-	attackRange.setOutlineColor(sf::Color::Black);
-	attackRange.setOutlineThickness(1.0f);
+void BuildBlockedCells(const NavGrid& grid, const uint8_t* blocked, BlockedCells& cells)
+{
+	cells.quads.setPrimitiveType(sf::Quads);
+	cells.quads.clear();
+	cells.row_start.assign(grid.height + 1, 0);
+	cells.cell_size = grid.cell_size;
+	const sf::Color color(70, 70, 70);
+	for (uint32_t cell = 0; cell < grid.width * grid.height; ++cell)
+	{
+		if (blocked[cell])
+		{
+			const float x = (cell % grid.width) * grid.cell_size;
+			const float y = (cell / grid.width) * grid.cell_size;
+			cells.quads.append(sf::Vertex(sf::Vector2f(x, y), color));
+			cells.quads.append(sf::Vertex(sf::Vector2f(x + grid.cell_size, y), color));
+			cells.quads.append(sf::Vertex(sf::Vector2f(x + grid.cell_size, y + grid.cell_size), color));
+			cells.quads.append(sf::Vertex(sf::Vector2f(x, y + grid.cell_size), color));
+		}
+		if ((cell + 1) % grid.width == 0)
+		{
+			cells.row_start[cell / grid.width + 1] = (uint32_t)cells.quads.getVertexCount();
+		}
+	}
+}
 
-	for (uint32_t i = 0; i < towers.size(); ++i)
+// Draws the rows of blocked cells in bounds, whole, as one range of quads.
+void DrawBlockedCells(const BlockedCells& cells, const sf::FloatRect& bounds, sf::RenderTarget& target)
+{
+	if (cells.row_start.size() < 2)
 	{
-		// Draw tower.
-		shape.setPosition(towers[i].position.x, towers[i].position.y);
-		target.draw(shape);
+		return;
+	}
+	const int last_row = (int)cells.row_start.size() - 2;
+	const int min_row = std::max(0, std::min((int)(bounds.top / cells.cell_size), last_row));
+	const int max_row = std::max(0, std::min((int)((bounds.top + bounds.height) / cells.cell_size), last_row));
+	const uint32_t first = cells.row_start[min_row];
+	const uint32_t end = cells.row_start[max_row + 1];
+	if (end > first)
+	{
+		target.draw(&cells.quads[first], end - first, sf::Quads);
+	}
+}
 
-		// Draw attack range circle.
-		attackRange.setRadius(towers[i].range.value);
-		attackRange.setOrigin(towers[i].range.value, towers[i].range.value);
-		attackRange.setPosition(towers[i].position.x, towers[i].position.y);
-		target.draw(attackRange);
+// Returns false if a file couldn't be written.
+bool CloseRecorders(const RecordOptions& options, Recorders& recorders)
+{
+	bool written = true;
+	if (recorders.recording && !CloseReplayWriter(recorders.replay))
+	{
+		std::cerr << "Could not write " << options.replay_path << std::endl;
+		written = false;
+	}
+	if (recorders.exporting && !CloseTelemetryWriter(recorders.telemetry))
+	{
+		std::cerr << "Could not write " << options.telemetry_path << std::endl;
+		written = false;
+	}
+	if (recorders.sharing)
+	{
+		CloseStatePublisher(recorders.publisher);
 	}
+	if (recorders.serving)
+	{
+		CloseSpectatorServer(recorders.server);
+	}
+	if (recorders.metering)
+	{
+		CloseMetricsServer(recorders.metrics_server);
+	}
+	recorders.recording = false;
+	recorders.exporting = false;
+	recorders.sharing = false;
+	recorders.serving = false;
+	recorders.metering = false;
+	return written;
 }
 
-void DrawBullets(const std::vector<Bullet>& bullets, sf::RenderTarget& target)
+// Returns false if anything RecordOptions asked for can't be opened, leaving nothing open.
+bool OpenRecorders(const RecordOptions& options, const Archetypes& archetypes, const Simulation& sim, Recorders& recorders)
 {
-	sf::CircleShape shape;
-	shape.setFillColor(sf::Color::Cyan);
-	shape.setRadius(BULLET_RADIUS);
-	shape.setOrigin(BULLET_RADIUS, BULLET_RADIUS); // Set origin to center of shape instead of top-left corner.
-	for (uint32_t i = 0; i < bullets.size(); ++i)
+	recorders.recording = false;
+	recorders.exporting = false;
+	recorders.sharing = false;
+	recorders.serving = false;
+	recorders.metering = false;
+	InitWatchdog(recorders.watchdog, options.watchdog_budget);
+	if (!options.share_name.empty())
 	{
-		shape.setPosition(bullets[i].position.x, bullets[i].position.y);
-		target.draw(shape);
+		if (!OpenStatePublisher(options.share_name, SHARED_STATE_DEFAULT_CAPACITY, recorders.publisher))
+		{
+			return false;
+		}
+		recorders.sharing = true;
+	}
+	if (!options.replay_path.empty())
+	{
+		if (!OpenReplayWriter(options.replay_path, archetypes, sim, recorders.replay))
+		{
+			CloseRecorders(options, recorders);
+			return false;
+		}
+		recorders.recording = true;
+	}
+	if (options.serve_port != 0)
+	{
+		if (!OpenSpectatorServer(options.serve_port, options.serve_interval, archetypes, sim, recorders.server))
+		{
+			CloseRecorders(options, recorders);
+			return false;
+		}
+		recorders.serving = true;
+	}
+	// Last, they start threads that have to be joined.
+	InitMetrics(recorders.metrics);
+	if (options.metrics_port != 0)
+	{
+		if (!OpenMetricsServer(options.metrics_port, recorders.metrics, recorders.metrics_server))
+		{
+			CloseRecorders(options, recorders);
+			return false;
+		}
+		recorders.metering = true;
 	}
+	if (!options.telemetry_path.empty())
+	{
+		if (!OpenTelemetryWriter(options.telemetry_path, archetypes, options.telemetry_interval, options.telemetry_policy, recorders.telemetry))
+		{
+			CloseRecorders(options, recorders);
+			return false;
+		}
+		recorders.exporting = true;
+	}
+	return true;
 }
 
-// Returns false if Monster is dead.
-bool UpdateMonster(Monster& monster, float DeltaTime, const std::vector<Waypoint>& waypoints, uint32_t& player_health)
+// Call after every tick.
+void RecordTick(Recorders& recorders, Simulation& sim)
 {
-	// Are we dead?
-	if (monster.health.value <= 0)
+	if (recorders.metering)
+	{
+		RecordSimulationMetrics(recorders.metrics, sim);
+	}
+	if (recorders.recording)
+	{
+		RecordReplayTick(recorders.replay, sim);
+	}
+	if (recorders.exporting)
+	{
+		CaptureTelemetry(recorders.telemetry, sim);
+	}
+	if (recorders.sharing)
+	{
+		PublishState(recorders.publisher, sim);
+	}
+	if (recorders.serving)
+	{
+		PollSpectatorServer(recorders.server, sim);
+	}
+}
+
+// Call once per frame (headless, per tick) with how long it took.
+void RecordFrame(Recorders& recorders, float frame_seconds)
+{
+	if (recorders.metering)
+	{
+		ObserveFrame(recorders.metrics, frame_seconds);
+	}
+}
+
+// Steps sim without a window at a fixed DeltaTime, optionally recording it, then optionally saves it.
+// Returns 1 if the player died before the last tick.
+int RunHeadless(Simulation& sim, const Archetypes& archetypes, const KernelRegistry& kernels, uint32_t ticks, const std::string& save_path,
+				const RecordOptions& record, ResultsReporter& report)
+{
+	Recorders recorders;
+	if (!OpenRecorders(record, archetypes, sim, recorders))
+	{
+		return -1;
+	}
+	const bool recording = recorders.recording || recorders.exporting || recorders.sharing || recorders.serving || recorders.metering;
+
+	sf::Clock clock;
+	float record_seconds = 0.0f;
+	uint32_t tick = 0;
+	for (; tick < ticks && sim.player_health > 0; ++tick)
+	{
+		BeginWatchdogFrame(recorders.watchdog, sim);
+		const float start = clock.getElapsedTime().asSeconds();
+		StepSimulation(sim, archetypes, kernels, HEADLESS_DELTA_TIME);
+		EndWatchdogZone(recorders.watchdog, "simulation");
+		const float before = clock.getElapsedTime().asSeconds();
+		RecordTick(recorders, sim);
+		RecordFrame(recorders, before - start);
+		RecordResultsTick(report, sim, before - start);
+		record_seconds += clock.getElapsedTime().asSeconds() - before;
+		EndWatchdogZone(recorders.watchdog, "recording");
+		EndWatchdogFrame(recorders.watchdog, archetypes, sim);
+	}
+	const float seconds = clock.getElapsedTime().asSeconds();
+
+	std::cout << "Simulated " << tick << " ticks in " << seconds * 1000.0f << " ms (" << seconds * 1000.0f / std::max(tick, 1u)
+			  << " ms/tick), now at tick " << sim.tick << ": " << sim.monsters.size() << " Monsters, " << TowerCount(sim)
+			  << " Towers, " << sim.monsters_killed << " kills, " << sim.player_health << " health" << std::endl;
+	if (recording)
+	{
+		std::cout << "Recording took " << record_seconds * 1000.0f / std::max(tick, 1u) << " ms/tick on the simulation thread" << std::endl;
+	}
+	AddResult(report, "wall_seconds", seconds);
+	AddResult(report, "record_ms_per_tick", record_seconds * 1000.0f / std::max(tick, 1u));
+	AddResult(report, "end_tick", (double)sim.tick);
+	AddResult(report, "monsters", (double)sim.monsters.size());
+	AddResult(report, "towers", (double)TowerCount(sim));
+	AddResult(report, "kills", sim.monsters_killed);
+	AddResult(report, "player_health", sim.player_health);
+
+	if (recorders.serving)
 	{
-		return false;
+		const SpectatorServer& server = recorders.server;
+		std::cout << "Served " << SpectatorCount(server) << " spectators: " << server.record_count << " records, "
+				  << server.bytes_encoded << " bytes encoded (" << server.keyframes_encoded << " catch up keyframes), " << server.bytes_sent
+				  << " bytes sent" << std::endl;
+	}
+	if (recorders.metering)
+	{
+		std::cout << "Served metrics to " << recorders.metrics_server.scrapes.load() << " scrapes" << std::endl;
+	}
+	if (record.watchdog_budget > 0.0f)
+	{
+		const HitchWatchdog& watchdog = recorders.watchdog;
+		std::cout << "Watchdog: " << watchdog.hitches << " ticks over " << watchdog.budget * 1000.0f << " ms, " << watchdog.captures
+				  << " captured, worst " << watchdog.worst * 1000.0f << " ms" << std::endl;
 	}
 
-	// Can only occur at game start, need at least 2 waypoints for Monsters to function.
-	if (waypoints.size() == 1)
+	// Stats are final once closed, the replay and telemetry writer threads have finished.
+	const bool recorded_replay = recorders.recording;
+	const bool exported = recorders.exporting;
+	if (!CloseRecorders(record, recorders))
+	{
+		return -1;
+	}
+	if (recorded_replay)
 	{
-		return false;
+		const ReplayWriter& replay = recorders.replay;
+		std::cout << "Replay recorded to " << record.replay_path << ": " << replay.ticks_recorded << " ticks (" << replay.ticks_dropped
+				  << " dropped), " << replay.file_offset << " bytes, " << replay.file_offset / std::max<uint64_t>(replay.ticks_recorded, 1)
+				  << " bytes/tick, " << replay.keyframes.size() << " keyframes" << std::endl;
+	}
+	if (exported)
+	{
+		const TelemetryWriter& telemetry = recorders.telemetry;
+		std::cout << "Telemetry exported to " << record.telemetry_path << ": " << telemetry.samples_written << " samples ("
+				  << telemetry.samples_dropped << " dropped), " << telemetry.raw_bytes << " bytes compressed to " << telemetry.file_bytes
+				  << std::endl;
 	}
 
-	// Are we on the targeted Waypoint?
-	if (Distance(monster.position, waypoints[monster.waypoint_index].position) <= 2.0f)
+	if (!save_path.empty())
 	{
-		// Have we reached last Waypoint?
-		if (waypoints.size() - 1 == monster.waypoint_index)
+		clock.restart();
+		if (!SaveSnapshot(save_path, archetypes, sim))
 		{
-			// Deal damage to player then die.
-			player_health -= monster.damage.value;
-			return false;
+			return -1;
 		}
+		std::cout << "Snapshot saved to " << save_path << " in " << clock.getElapsedTime().asSeconds() * 1000.0f << " ms" << std::endl;
+	}
+
+	return sim.player_health > 0 ? 0 : 1;
+}
+
+// Forecasts placing every Tower archetype across the map from sim, on every hardware thread.
+int RunForecast(const Simulation& sim, const Archetypes& archetypes, const KernelRegistry& kernels, uint32_t ticks, ResultsReporter& report)
+{
+	std::vector<PlacementCandidate> candidates;
+	for (uint32_t archetype = 0; archetype < archetypes.towers.name.size(); ++archetype)
+	{
+		FindPlacementCandidates(sim, archetype, FORECAST_CANDIDATE_SPACING, candidates);
+	}
+
+	Forecaster forecaster;
+	InitForecaster(forecaster, 0);
 
-		// Target next Waypoint.
-		++monster.waypoint_index;
+	// Time forking alone, into storage already grown by a first fork as it is when forecasting.
+	const uint32_t fork_repeats = 100;
+	ForkSimulation(sim, forecaster.forks[0]);
+	sf::Clock clock;
+	for (uint32_t i = 0; i < fork_repeats; ++i)
+	{
+		ForkSimulation(sim, forecaster.forks[0]);
 	}
+	const float fork_ms = clock.getElapsedTime().asSeconds() * 1000.0f / fork_repeats;
+
+	clock.restart();
+	std::vector<PlacementForecast> results;
+	ForecastPlacements(forecaster, sim, archetypes, kernels, candidates, ticks, HEADLESS_DELTA_TIME, results);
+	const float forecast_ms = clock.getElapsedTime().asSeconds() * 1000.0f;
 
-	const float xdir = waypoints[monster.waypoint_index].position.x - monster.position.x;
-	const float ydir = waypoints[monster.waypoint_index].position.y - monster.position.y;
-	const sf::Vector2f normalized_dir = Normalize(xdir, ydir);
+	std::cout << "Forecast " << candidates.size() << " placements " << ticks << " ticks ahead on " << ThreadCount(forecaster.pool)
+			  << " threads in " << forecast_ms << " ms, " << fork_ms << " ms per fork of " << sim.monsters.size() << " Monsters and "
+			  << TowerCount(sim) << " Towers" << std::endl;
+	for (uint32_t i = 0; i < results.size() && i < FORECAST_SHOWN; ++i)
+	{
+		const PlacementForecast& result = results[i];
+		std::cout << "  " << archetypes.towers.name[result.candidate.archetype] << " at " << result.candidate.position.x << ", "
+				  << result.candidate.position.y << ": " << result.player_health << " health, " << result.monsters_left
+				  << " Monsters left with " << result.monster_health_left << " health" << std::endl;
+	}
 
-	monster.position.x += (normalized_dir.x * MONSTER_SPEED * DeltaTime);
-	monster.position.y += (normalized_dir.y * MONSTER_SPEED * DeltaTime);
+	AddResult(report, "candidates", (double)candidates.size());
+	AddResult(report, "forecast_ticks", ticks);
+	AddResult(report, "threads", ThreadCount(forecaster.pool));
+	AddResult(report, "forecast_ms", forecast_ms);
+	AddResult(report, "fork_ms", fork_ms);
+	AddResult(report, "monsters", (double)sim.monsters.size());
+	AddResult(report, "best_player_health", results.empty() ? 0.0 : results[0].player_health);
 
-	return true;
+	ShutdownForecaster(forecaster);
+	return 0;
 }
 
-void UpdateTower(Tower& tower, float DeltaTime, const std::vector<Monster>& monsters, std::vector<Bullet>& bullets)
+// Reads a replay end to end, then seeks back to the middle of it.
+int RunReplayInfo(const std::string& path)
 {
-	tower.timer.value += DeltaTime;
-	for (uint32_t i = 0; i < monsters.size(); ++i)
+	ReplayReader replay;
+	if (!OpenReplay(path, replay))
 	{
-		// Check if Monster is in range of Tower.
-		if (Distance(tower.position, monsters[i].position) <= tower.range.value)
-		{
-			// Check if enough time has passed for us to fire again.
-			if (tower.timer.value >= tower.attackRate.value)
-			{
-				// Don't worry about bullet velocity, as UpdateBullet() will handle that.
-				bullets.emplace_back(Bullet({ tower.position.x, tower.position.y,	// Position
-											  0.0f, 0.0f,							// Velocity
-											  50,									// Damage
-											  i }));								// Target Index
+		return -1;
+	}
+
+	sf::Clock clock;
+	uint64_t records = 0;
+	uint64_t first_tick = 0;
+	while (ReadReplayRecord(replay))
+	{
+		first_tick = records++ == 0 ? replay.frame.tick : first_tick;
+	}
+	const float read_ms = clock.getElapsedTime().asSeconds() * 1000.0f;
+	const uint64_t last_tick = replay.frame.tick;
+
+	std::cout << path << ": " << records << " ticks (" << first_tick << " to " << last_tick << "), " << replay.file_size << " bytes, "
+			  << replay.file_size / std::max(records, (uint64_t)1) << " bytes/tick, " << replay.keyframes.size() << " keyframes"
+			  << (replay.keyframes.empty() ? " (not closed, no index)" : "") << ", read in " << read_ms << " ms" << std::endl;
+	std::cout << "Last tick: " << replay.frame.monster_count << " Monsters, " << replay.frame.monsters_killed << " kills, "
+			  << replay.frame.player_health << " health" << std::endl;
+
+	const uint64_t middle = first_tick + (last_tick - first_tick) / 2;
+	clock.restart();
+	if (records == 0 || !SeekReplay(replay, middle))
+	{
+		std::cerr << path << ": could not seek to tick " << middle << std::endl;
+		return -1;
+	}
+	std::cout << "Seeked to tick " << replay.frame.tick << " in " << clock.getElapsedTime().asSeconds() * 1000.0f << " ms: "
+			  << replay.frame.monster_count << " Monsters" << std::endl;
 
-				// Reset timer to 0.0f as we just fired.
-				tower.timer.value = 0.0f;
+	return 0;
+}
 
-				return;
-			}
+// Loads a telemetry file into columns and summarizes it.
+int RunTelemetryInfo(const std::string& path)
+{
+	sf::Clock clock;
+	TelemetryColumns columns;
+	if (!LoadTelemetry(path, columns))
+	{
+		return -1;
+	}
+	const float load_ms = clock.getElapsedTime().asSeconds() * 1000.0f;
+
+	const uint32_t samples = TelemetrySampleCount(columns);
+	std::cout << path << ": " << samples << " samples every " << columns.header.interval << " ticks, " << columns.id.size()
+			  << " rows, loaded in " << load_ms << " ms" << std::endl;
+	if (samples == 0)
+	{
+		return 0;
+	}
+
+	// Total Monster health at the first, middle and last sample.
+	const uint32_t shown[] = { 0, samples / 2, samples - 1 };
+	for (uint32_t sample : shown)
+	{
+		uint64_t health = 0;
+		for (uint32_t row = columns.first_row[sample]; row < columns.first_row[sample + 1]; ++row)
+		{
+			health += columns.health[row];
 		}
+		std::cout << "  tick " << columns.tick[sample] << ": " << columns.first_row[sample + 1] - columns.first_row[sample]
+				  << " Monsters with " << health << " health" << std::endl;
 	}
+
+	return 0;
 }
 
-// Returns false if Bullet hit a Monster, or there are no Monsters left.
-bool UpdateBullet(Bullet& bullet, float DeltaTime, std::vector<Monster>& monsters)
+// Sample shared state reader, run next to a game started with --share. Prints what it publishes,
+// reading in place, until it stops changing.
+int RunWatch(const std::string& name)
 {
-	// No more monsters left, destroy bullet.
-	if (monsters.size() == 0)
+	SharedRegion region;
+	if (!OpenSharedRegion(name, region))
+	{
+		return -1;
+	}
+
+	uint64_t last_tick = 0;
+	uint32_t torn_reads = 0;
+	sf::Clock idle;
+	while (idle.getElapsedTime().asSeconds() < WATCH_IDLE_SECONDS)
 	{
-		return false;
+		sf::sleep(sf::seconds(1.0f / WATCH_READS_PER_SECOND));
+
+		uint32_t sequence;
+		const SharedStateBuffer* state = BeginSharedRead(region, sequence);
+		if (!state)
+		{
+			++torn_reads;
+			continue;
+		}
+		const uint64_t tick = state->tick;
+		const uint32_t count = std::min(state->monster_count, SharedHeader(region)->capacity);
+		const uint32_t monsters_killed = state->monsters_killed;
+		const uint32_t player_health = state->player_health;
+		const SharedMonster* monsters = SharedMonsters(state);
+		Position center = { 0.0f, 0.0f };
+		uint64_t monster_health = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			center.x += monsters[i].x / count;
+			center.y += monsters[i].y / count;
+			monster_health += monsters[i].health;
+		}
+		if (!EndSharedRead(state, sequence))
+		{
+			++torn_reads;
+			continue;
+		}
+
+		if (tick != last_tick)
+		{
+			std::cout << "Tick " << tick << ": " << count << " Monsters with " << monster_health << " health around " << center.x << ", "
+					  << center.y << ", " << monsters_killed << " kills, " << player_health << " health" << std::endl;
+			last_tick = tick;
+			idle.restart();
+		}
 	}
 
-	// If we were targetting the last Monster in monsters and they died, target the new last Monster.
-	if (bullet.target_index >= monsters.size() && monsters.size() != 0)
+	std::cout << name << " stopped changing, " << torn_reads << " reads overlapped a publish and were retried" << std::endl;
+	CloseSharedRegion(region);
+	return 0;
+}
+
+// Sample spectator, run next to a game started with --serve. Rebuilds what it streams and prints
+// it about once a second until the game goes away.
+int RunSpectate(uint16_t port)
+{
+	SpectatorViewer viewer;
+	if (!ConnectSpectatorViewer(port, viewer))
 	{
-		bullet.target_index = (uint32_t)monsters.size() - 1;
+		return -1;
 	}
 
-	// Get direction vectors to targeted Monster.
-	const float xdir = monsters[bullet.target_index].position.x - bullet.position.x;
-	const float ydir = monsters[bullet.target_index].position.y - bullet.position.y;
+	uint32_t polls = 0;
+	uint64_t last_tick = 0;
+	while (PollSpectatorViewer(viewer))
+	{
+		sf::sleep(sf::seconds(SPECTATE_POLL_SECONDS));
+		if (++polls % SPECTATE_POLLS_PER_PRINT != 0 || viewer.records == 0 || viewer.frame.tick == last_tick)
+		{
+			continue;
+		}
 
-	const sf::Vector2f normalized_dir = Normalize(xdir, ydir);
+		const ReplayFrame& frame = viewer.frame;
+		uint64_t monster_health = 0;
+		for (const ReplayMonster& monster : frame.monsters)
+		{
+			monster_health += monster.archetype != INVALID_ARCHETYPE ? monster.health.value : 0;
+		}
+		std::cout << "Tick " << frame.tick << ": " << frame.monster_count << " Monsters with " << monster_health << " health, "
+				  << frame.monsters_killed << " kills, " << frame.player_health << " health, " << viewer.bytes_received << " bytes received"
+				  << std::endl;
+		last_tick = frame.tick;
+	}
 
-	bullet.position.x += (normalized_dir.x * BULLET_SPEED * DeltaTime);
-	bullet.position.y += (normalized_dir.y * BULLET_SPEED * DeltaTime);
+	std::cout << "Disconnected after " << viewer.records << " records, " << viewer.bytes_received << " bytes" << std::endl;
+	CloseSpectatorViewer(viewer);
+	return 0;
+}
 
-	// Have we hit a monster?
-	if (Distance(bullet.position, monsters[bullet.target_index].position) <= BULLET_RADIUS)
+// Waits until a window event comes in, returning it, or the next wave spawn is due. Blocks in
+// waitEvent if nothing else can wake the game, otherwise polls for events every IDLE_POLL_SECONDS
+// (and keeps a spectator server accepting viewers).
+bool WaitWhileIdle(sf::RenderWindow& window, Simulation& sim, Recorders& recorders, sf::Event& event)
+{
+	const float until_spawn = SecondsToNextSpawn(sim.waves, sim.wave_state);
+	if (std::isinf(until_spawn) && !recorders.serving)
 	{
-		// Damage monster.
-		monsters[bullet.target_index].health.value -= bullet.damage.value;
+		return window.waitEvent(event);
+	}
 
-		return false;
+	sf::Clock waited;
+	for (float elapsed = 0.0f; elapsed < until_spawn; elapsed = waited.getElapsedTime().asSeconds())
+	{
+		if (window.pollEvent(event))
+		{
+			return true;
+		}
+		if (recorders.serving)
+		{
+			PollSpectatorServer(recorders.server, sim);
+		}
+		sf::sleep(sf::seconds(std::min(IDLE_POLL_SECONDS, until_spawn - elapsed)));
 	}
+	return false;
+}
 
-	return true;
+// Closes report after a headless mode, failing the run if the results couldn't be written.
+int FinishResults(ResultsReporter& report, int result)
+{
+	return CloseResults(report) ? result : -1;
 }
 
 int main(int argc, char** argv)
 {
+	const std::string usage = "Usage: --convert-level <level.txt> <level.lvl>\n"
+							  "       --replay-info <replay>\n"
+							  "       --telemetry-info <telemetry>\n"
+							  "       --watch\n"
+							  "       --spectate [<port>]\n"
+							  "       [--level <level.lvl>] [--resume <snapshot>] [--record <replay>]\n"
+							  "       [--telemetry <telemetry> [--telemetry-interval <ticks>] [--telemetry-drop]] [--share]\n"
+							  "       [--results <prefix> [--results-interval <ticks>]]\n"
+							  "       [--serve [<port>] [--serve-interval <ticks>]] [--metrics [<port>]] [--watchdog [<ms>]]\n"
+							  "       [--vsync | --fps <frames per second, 0 uncapped>] [--speed <1 | 2 | 4 | 16 | max>]\n"
+							  "       [--lod-density <Monsters per 100x100 pixels, 0 never>]\n"
+							  "       [--benchmark | --simulate <ticks> [--save <snapshot>] | --forecast <ticks>]";
+
+	// Headless modes, no window is opened.
+	if (argc > 1 && std::string(argv[1]) == "--convert-level")
+	{
+		LevelData level;
+		if (argc != 4 || !LoadLevelText(argv[2], (float)WIDTH, (float)HEIGHT, NAV_CELL_SIZE, level) || !WriteLevel(argv[3], level))
+		{
+			std::cerr << usage << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--replay-info")
+	{
+		if (argc != 3)
+		{
+			std::cerr << usage << std::endl;
+			return -1;
+		}
+		return RunReplayInfo(argv[2]);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--telemetry-info")
+	{
+		if (argc != 3)
+		{
+			std::cerr << usage << std::endl;
+			return -1;
+		}
+		return RunTelemetryInfo(argv[2]);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--watch")
+	{
+		if (argc != 2)
+		{
+			std::cerr << usage << std::endl;
+			return -1;
+		}
+		return RunWatch(SHARED_STATE_DEFAULT_NAME);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--spectate")
+	{
+		if (argc > 3)
+		{
+			std::cerr << usage << std::endl;
+			return -1;
+		}
+		return RunSpectate(argc == 3 ? (uint16_t)strtoul(argv[2], nullptr, 10) : SPECTATOR_DEFAULT_PORT);
+	}
+
+	std::string level_path;
+	std::string resume_path;
+	std::string save_path;
+	RecordOptions record = { "", "", TELEMETRY_DEFAULT_INTERVAL, TELEMETRY_THROTTLE, "", 0, SPECTATOR_DEFAULT_INTERVAL, 0, 0.0f };
+	std::string results_prefix;
+	uint32_t results_interval = RESULTS_DEFAULT_INTERVAL;
+	PacingMode pacing = PACING_CAP;
+	float fps = PACING_DEFAULT_FPS;
+	uint32_t speed = 1;
+	float lod_density = DENSITY_DEFAULT_THRESHOLD;
+	uint32_t simulate_ticks = 0;
+	uint32_t forecast_ticks = 0;
+	bool benchmark = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--level" && has_value)
+		{
+			level_path = argv[++i];
+		}
+		else if (arg == "--resume" && has_value)
+		{
+			resume_path = argv[++i];
+		}
+		else if (arg == "--save" && has_value)
+		{
+			save_path = argv[++i];
+		}
+		else if (arg == "--record" && has_value)
+		{
+			record.replay_path = argv[++i];
+		}
+		else if (arg == "--telemetry" && has_value)
+		{
+			record.telemetry_path = argv[++i];
+		}
+		else if (arg == "--telemetry-interval" && has_value)
+		{
+			record.telemetry_interval = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--telemetry-drop")
+		{
+			record.telemetry_policy = TELEMETRY_DROP;
+		}
+		else if (arg == "--share")
+		{
+			record.share_name = SHARED_STATE_DEFAULT_NAME;
+		}
+		else if (arg == "--serve")
+		{
+			// The port is optional, a following option isn't one.
+			const bool has_port = has_value && argv[i + 1][0] != '-';
+			record.serve_port = has_port ? (uint16_t)strtoul(argv[++i], nullptr, 10) : SPECTATOR_DEFAULT_PORT;
+		}
+		else if (arg == "--serve-interval" && has_value)
+		{
+			record.serve_interval = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--metrics")
+		{
+			const bool has_port = has_value && argv[i + 1][0] != '-';
+			record.metrics_port = has_port ? (uint16_t)strtoul(argv[++i], nullptr, 10) : METRICS_DEFAULT_PORT;
+		}
+		else if (arg == "--watchdog")
+		{
+			const bool has_budget = has_value && argv[i + 1][0] != '-';
+			record.watchdog_budget = has_budget ? (float)atof(argv[++i]) / 1000.0f : WATCHDOG_DEFAULT_BUDGET;
+		}
+		else if (arg == "--results" && has_value)
+		{
+			results_prefix = argv[++i];
+		}
+		else if (arg == "--results-interval" && has_value)
+		{
+			results_interval = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--vsync")
+		{
+			pacing = PACING_VSYNC;
+		}
+		else if (arg == "--fps" && has_value)
+		{
+			fps = (float)atof(argv[++i]);
+			pacing = fps > 0.0f ? PACING_CAP : PACING_UNCAPPED;
+		}
+		else if (arg == "--speed" && has_value)
+		{
+			const std::string value = argv[++i];
+			speed = value == "max" ? FAST_FORWARD_UNBOUNDED : (uint32_t)strtoul(value.c_str(), nullptr, 10);
+			if (value != "max" && std::find(FAST_FORWARD_SPEEDS, FAST_FORWARD_SPEEDS + FAST_FORWARD_SPEED_COUNT, speed) == FAST_FORWARD_SPEEDS + FAST_FORWARD_SPEED_COUNT)
+			{
+				std::cerr << usage << std::endl;
+				return -1;
+			}
+		}
+		else if (arg == "--lod-density" && has_value)
+		{
+			lod_density = (float)atof(argv[++i]);
+		}
+		else if (arg == "--simulate" && has_value)
+		{
+			simulate_ticks = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--forecast" && has_value)
+		{
+			forecast_ticks = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--benchmark")
+		{
+			benchmark = true;
+		}
+		else
+		{
+			std::cerr << usage << std::endl;
+			return -1;
+		}
+	}
+
+	// Results are for the headless modes, the game has no run to report on.
+	const char* const mode = benchmark ? "benchmark" : simulate_ticks > 0 ? "simulate" : forecast_ticks > 0 ? "forecast" : nullptr;
+	if (!results_prefix.empty() && !mode)
+	{
+		std::cerr << usage << std::endl;
+		return -1;
+	}
+
+	// Levels are used straight from the mapped file, only archetypes are converted.
+	MappedFile level_file;
+	LevelView level;
+	const bool has_level = !level_path.empty();
+	Archetypes archetypes;
+	sf::Clock load_clock;
+	if (has_level)
+	{
+		if (!OpenLevel(level_path, level_file, level))
+		{
+			return -1;
+		}
+		ReadLevelArchetypes(level, archetypes);
+	}
+	else if (!LoadArchetypes("archetypes.txt", archetypes))
+	{
+		return -1;
+	}
+
+	ResultsReporter report;
+	if (!OpenResults(results_prefix, mode ? mode : "", results_interval, report))
+	{
+		return -1;
+	}
+	if (benchmark)
+	{
+		return FinishResults(report, RunBenchmark(archetypes, report));
+	}
+
+	KernelRegistry kernels;
+	BuildKernelRegistry(archetypes.towers, kernels);
+
+	// Everything the game simulates, see Simulation.h.
+	Simulation sim;
+	BlockedCells blocked_cells;
+	if (has_level)
+	{
+		InitSimulation(sim, archetypes.towers, level.header->world_width, level.header->world_height, level.header->cell_size);
+		if (sim.grid_map.grid.width != level.header->grid_width || sim.grid_map.grid.height != level.header->grid_height)
+		{
+			std::cerr << level_path << ": grid doesn't match the world size" << std::endl;
+			return -1;
+		}
+		StartLevel(sim, level);
+		BuildBlockedCells(sim.grid_map.grid, level.blocked, blocked_cells);
+
+		CloseMappedFile(level_file);
+		std::cout << "Level loaded in " << load_clock.getElapsedTime().asSeconds() * 1000.0f << " ms" << std::endl;
+	}
+	else
+	{
+		InitSimulation(sim, archetypes.towers, (float)WIDTH, (float)HEIGHT, NAV_CELL_SIZE);
+
+		// Set starting waypoint to ensure we have atleast one so Monsters can spawn.
+		sim.waypoints.emplace_back(Waypoint({ 150.0f, 150.0f }));
+	}
+
+	if (!resume_path.empty())
+	{
+		load_clock.restart();
+		if (!LoadSnapshot(resume_path, archetypes, sim, true))
+		{
+			return -1;
+		}
+		std::cout << "Resumed from tick " << sim.tick << " in " << load_clock.getElapsedTime().asSeconds() * 1000.0f << " ms" << std::endl;
+	}
+
+	if (simulate_ticks > 0)
+	{
+		return FinishResults(report, RunHeadless(sim, archetypes, kernels, simulate_ticks, save_path, record, report));
+	}
+	if (forecast_ticks > 0)
+	{
+		return FinishResults(report, RunForecast(sim, archetypes, kernels, forecast_ticks, report));
+	}
+
 	sf::RenderWindow window(sf::VideoMode(WIDTH, HEIGHT, 32), "Tower Defense", sf::Style::Close);
+	window.setVerticalSyncEnabled(pacing == PACING_VSYNC);
+	FramePacer pacer;
+	InitFramePacer(pacer, pacing, fps);
+	FastForward fast_forward;
+	InitFastForward(fast_forward, speed);
 
 	sf::Font liberation_mono_font;
 	if (!liberation_mono_font.loadFromFile("liberation-mono.ttf"))
@@ -372,163 +1065,257 @@ int main(int argc, char** argv)
 	sf::Text player_health_text("Health: ", liberation_mono_font, font_size);
 	player_health_text.setPosition(WIDTH / 2.0f - 100.0f, 10.0f);
 
-	// Vectors containing all entities in the game.
-	std::vector<Monster> monsters;
-	std::vector<Waypoint> waypoints;
-	std::vector<Tower> towers;
-	std::vector<Bullet> bullets;
+	Camera camera;
+	InitCamera(camera, (float)WIDTH, (float)HEIGHT, sim.world_width, sim.world_height);
+	std::vector<uint32_t> visible_monsters;
+	DensityMap density_map;
+	InitDensityMap(density_map);
 
-	// Set starting waypoint to ensure we have atleast one so Monsters can spawn.
-	waypoints.emplace_back(Waypoint({ 150.0f, 150.0f }));
-
-	uint32_t monsters_killed = 0;
-	uint32_t player_health = 100;
-
-	float Elapsed = 0.0f;
-	float DeltaTime = 0.0f;
-	sf::Clock clock;
+	// Vertices of each block's Towers, only written for Towers placed since the last frame.
+	std::vector<TowerMesh> tower_meshes(sim.tower_blocks.size());
+	for (uint32_t i = 0; i < tower_meshes.size(); ++i)
+	{
+		InitTowerMesh(tower_meshes[i], sim.world_width, sim.world_height);
+	}
+	SpatialGrid bullet_grid;
+	InitSpatialGrid(bullet_grid, sim.world_width, sim.world_height, BULLET_GRID_CELL_SIZE);
+	std::vector<uint32_t> visible_bullets;
+
+	// Archetypes placed by right click and spawned by space. Number keys 1-9 select
+	// one of the first 9 Tower archetypes, M cycles through the Monster archetypes. F cycles
+	// the fast forward speed. The arrow keys and middle mouse drags pan, the wheel zooms (Camera.h).
+	uint32_t selected_tower = 0;
+	uint32_t selected_monster = 0;
+
+	Recorders recorders;
+	if (!OpenRecorders(record, archetypes, sim, recorders))
+	{
+		return -1;
+	}
 
-	while (window.isOpen())
+	// Every window event goes through here, whether it was polled or waited for while idle.
+	auto handle_event = [&](const sf::Event& event)
 	{
-		DeltaTime = clock.restart().asSeconds();
-		Elapsed += DeltaTime;
+		HandleCameraEvent(camera, event);
+		if (event.type == sf::Event::Closed)
+		{
+			window.close();
+		}
 
-		sf::Event event;
-		while (window.pollEvent(event))
+		if (event.type == sf::Event::KeyPressed)
 		{
-			if (event.type == sf::Event::Closed)
+			if (event.key.code == sf::Keyboard::Escape)
 			{
 				window.close();
 			}
-
-			if (event.type == sf::Event::KeyPressed)
+			else if (event.key.code == sf::Keyboard::Space)
 			{
-				if (event.key.code == sf::Keyboard::Escape)
-				{
-					window.close();
-				}
-				else if (event.key.code == sf::Keyboard::Space)
-				{
-					monsters.emplace_back(Monster({ 100,												// Health
-													waypoints[0].position.x, waypoints[0].position.y,	// Position
-													0.0f, 0.0f,											// Velocity
-													0,													// Waypoint Index
-													5 }));												// Damage
-				}
+				SpawnMonster(sim, archetypes.monsters, selected_monster);
 			}
-			else if (event.type == sf::Event::MouseButtonPressed)
+			else if (event.key.code >= sf::Keyboard::Num1 && event.key.code <= sf::Keyboard::Num9)
 			{
-				const sf::Vector2i click_position = sf::Mouse::getPosition(window);
-				if (event.mouseButton.button == sf::Mouse::Left)
-				{
-					waypoints.emplace_back(Waypoint({ (float)click_position.x, (float)click_position.y }));
-				}
-				else if (event.mouseButton.button == sf::Mouse::Right)
+				const uint32_t archetype = (uint32_t)(event.key.code - sf::Keyboard::Num1);
+				if (archetype < archetypes.towers.name.size())
 				{
-					towers.emplace_back(Tower({ (float)click_position.x, (float)click_position.y,		// Position
-												100.0f,													// AttackRange
-												1.5f,													// AttackRate
-												0.0f }));												// Timer
+					selected_tower = archetype;
 				}
 			}
+			else if (event.key.code == sf::Keyboard::M)
+			{
+				selected_monster = (selected_monster + 1) % (uint32_t)archetypes.monsters.name.size();
+			}
+			else if (event.key.code == sf::Keyboard::F)
+			{
+				CycleFastForward(fast_forward);
+			}
+			else if (event.key.code == sf::Keyboard::G)
+			{
+				sim.grid_map_mode = !sim.grid_map_mode;
+			}
+			else if (event.key.code == sf::Keyboard::S)
+			{
+				SetSeparation(sim, !sim.separation_mode);
+			}
+			else if (event.key.code == sf::Keyboard::F5)
+			{
+				SaveSnapshot(QUICKSAVE_PATH, archetypes, sim);
+			}
+			else if (event.key.code == sf::Keyboard::F9)
+			{
+				LoadSnapshot(QUICKSAVE_PATH, archetypes, sim, true);
+			}
+		}
+		else if (event.type == sf::Event::MouseButtonPressed)
+		{
+			const sf::Vector2f click_position = CameraToWorld(camera, sf::Vector2i(event.mouseButton.x, event.mouseButton.y));
+			if (event.mouseButton.button == sf::Mouse::Left)
+			{
+				sim.waypoints.emplace_back(Waypoint({ click_position.x, click_position.y }));
+			}
+			else if (event.mouseButton.button == sf::Mouse::Right)
+			{
+				PlaceTower(sim, selected_tower, Position({ click_position.x, click_position.y }));
+			}
 		}
+	};
+
+	float Elapsed = 0.0f;
+	float DeltaTime = 0.0f;
+	sf::Clock clock;
+	bool idle = false;
 
-		// Update monsters.
-		for (uint32_t i = 0; i < monsters.size(); ++i)
+	while (window.isOpen())
+	{
+		// Nothing moved last frame and nobody did anything, the frame on screen is still right. Wait
+		// for input or the next wave spawn instead of stepping and drawing it again.
+		bool had_input = false;
+		if (idle)
 		{
-			if (!UpdateMonster(monsters[i], DeltaTime, waypoints, player_health))
+			sf::Event event;
+			const bool woken = WaitWhileIdle(window, sim, recorders, event);
+			SkipQuiescentTime(sim, clock.restart().asSeconds());
+			RestartFramePacing(pacer);
+			if (woken)
 			{
-				// We are dead, remove Monster from vector.
-				const size_t last = monsters.size() - 1;
-				monsters[i].health.value = monsters[last].health.value;
-				monsters[i].position.x = monsters[last].position.x;
-				monsters[i].position.y = monsters[last].position.y;
-				monsters[i].velocity.x = monsters[last].velocity.x;
-				monsters[i].velocity.y = monsters[last].velocity.y;
-				monsters[i].waypoint_index = monsters[last].waypoint_index;
-				monsters[i].damage.value = monsters[last].damage.value;
-
-				monsters.pop_back();
-
-				// Increment monsters_killed.
-				++monsters_killed;
-
-				// Reduce i by 1 so we don't skip this copied monster.
-				--i;
+				handle_event(event);
+				had_input = true;
 			}
 		}
 
-		// Update towers.
-		for (uint32_t i = 0; i < towers.size(); ++i)
+		PaceFrame(pacer);
+		DeltaTime = clock.restart().asSeconds();
+		Elapsed += DeltaTime;
+		BeginWatchdogFrame(recorders.watchdog, sim);
+
+		sf::Event event;
+		while (window.pollEvent(event))
+		{
+			handle_event(event);
+			had_input = true;
+		}
+		if (window.hasFocus() && UpdateCamera(camera, DeltaTime))
 		{
-			UpdateTower(towers[i], DeltaTime, monsters, bullets);
+			had_input = true;
 		}
 
-		// Update bullets.
-		for (uint32_t i = 0; i < bullets.size(); ++i)
+		EndWatchdogZone(recorders.watchdog, "events");
+
+		// Once at 1x, fast forwarding as many ticks as are owed and there's time for. Only the last is drawn.
+		const uint32_t ticks = BeginFastForwardFrame(fast_forward, DeltaTime);
+		const float tick_seconds = FastForwardTickSeconds(fast_forward, DeltaTime);
+		for (uint32_t tick = 0; tick < ticks && sim.player_health > 0; ++tick)
 		{
-			if (!UpdateBullet(bullets[i], DeltaTime, monsters))
+			StepSimulation(sim, archetypes, kernels, tick_seconds);
+			RecordTick(recorders, sim);
+			if (!FastForwardTick(fast_forward))
 			{
-				// We hit a Monster, swap element with last element in bullets vector
-				// and call bullets.pop_back().
-				const size_t last = bullets.size() - 1;
-				bullets[i].position.x = bullets[last].position.x;
-				bullets[i].position.y = bullets[last].position.y;
-				bullets[i].damage.value = bullets[last].damage.value;
-				bullets[i].velocity.x = bullets[last].velocity.x;
-				bullets[i].velocity.y = bullets[last].velocity.y;
-				bullets[i].target_index = bullets[last].target_index;
-
-				bullets.pop_back();
-
-				// Reduce i by 1 so we don't skip this copied bullet.
-				--i;
+				break;
 			}
 		}
+		RecordFrame(recorders, DeltaTime);
+		EndWatchdogZone(recorders.watchdog, "simulation");
 
 		// If health == 0, game over!
-		if (player_health == 0)
+		if (sim.player_health == 0)
 		{
+			CloseRecorders(record, recorders);
 			// Just return with value 1 right now, game over screen can be implemented later.
 			return 1;
 		}
 
-		num_monsters_text.setString("Monsters: " + std::to_string(monsters.size()));
-		num_waypoints_text.setString("Waypoints: " + std::to_string(waypoints.size()));
-		num_towers_text.setString("Towers: " + std::to_string(towers.size()));
-		monsters_killed_text.setString("Kills: " + std::to_string(monsters_killed));
-		player_health_text.setString("Health: " + std::to_string(player_health));
+		num_monsters_text.setString("Monsters: " + std::to_string(sim.monsters.size()));
+		num_waypoints_text.setString("Waypoints: " + std::to_string(sim.waypoints.size()));
+		num_towers_text.setString("Towers: " + std::to_string(TowerCount(sim)));
+		monsters_killed_text.setString("Kills: " + std::to_string(sim.monsters_killed));
+		player_health_text.setString("Health: " + std::to_string(sim.player_health));
 
 		// Calculate ms/frame (16.67 = 60 FPS).
 		static uint32_t count = 0;
 		std::stringstream ss;
 		ss << "Tower Defense - FPS: " << 1000.0f / Elapsed << " - Frame Time: " << Elapsed;
+		if (fast_forward.speed != 1)
+		{
+			ss << " - Speed: " << FastForwardName(fast_forward.speed) << " - Ticks/s: " << (uint32_t)(fast_forward.frame_ticks / DeltaTime);
+		}
 		// Don't update title every frame, this is expensive.
 		// We have arbitrarily chosen to update once every 10 frames.
 		if (count++ % 10 == 0)
 		{
 			window.setTitle(ss.str());
 		}
+		EndWatchdogZone(recorders.watchdog, "hud");
 
 		// Clear screen to light grey.
 		window.clear(sf::Color(120, 120, 120, 255));
 
-		// Draw entities.
-		DrawWaypoints(waypoints, window);
-		DrawMonsters(monsters, window);		// Draw Monsters after Waypoints so Monsters appear on top of Waypoints.
-		DrawTowers(towers, window);
-		DrawBullets(bullets, window);
+		// Draw entities through the camera, only those it shows.
+		window.setView(camera.view);
+		const sf::FloatRect bounds = CameraBounds(camera);
+		DrawBlockedCells(blocked_cells, bounds, window);
+		DrawWaypoints(sim.waypoints, bounds, window);
 
-		// Draw text.
+		// Monsters in view come from the cells in view. Too dense to tell apart, they are drawn as a map
+		// of each cell's count instead. The grid is rebuilt every tick, a frame that stepped none may
+		// have had Monsters spawned or loaded since.
+		if (fast_forward.frame_ticks == 0)
+		{
+			BuildSpatialGrid(sim.spatial_grid, sim.monsters);
+		}
+		const bool dense = UseDensityMap(sim.spatial_grid, bounds, (float)(WIDTH * HEIGHT), lod_density);
+		if (!dense || !DrawDensityMap(density_map, sim.spatial_grid, bounds, window))
+		{
+			visible_monsters.clear();
+			QueryRect(sim.spatial_grid, Position({ bounds.left - MONSTER_DRAWN_EXTENT, bounds.top - MONSTER_DRAWN_EXTENT }),
+					  Position({ bounds.left + bounds.width + MONSTER_DRAWN_EXTENT, bounds.top + bounds.height + MONSTER_DRAWN_EXTENT }), visible_monsters);
+			DrawMonsters(sim.monsters, visible_monsters, archetypes.monsters, window);		// Draw Monsters after Waypoints so Monsters appear on top of Waypoints.
+		}
+
+		for (uint32_t i = 0; i < sim.tower_blocks.size(); ++i)
+		{
+			UpdateTowerMesh(tower_meshes[i], sim.tower_blocks[i], archetypes.towers);
+			DrawTowerMesh(tower_meshes[i], sim.tower_blocks[i], archetypes.towers, bounds, window);
+			DrawBullets(sim.tower_blocks[i].bullets, archetypes.towers, bounds, bullet_grid, visible_bullets, window);
+		}
+		DrawLightningArcs(sim.lightning_arcs, bounds, window);
+
+		// Draw text, fixed to the window.
+		window.setView(window.getDefaultView());
 		window.draw(num_monsters_text);
 		window.draw(num_waypoints_text);
 		window.draw(num_towers_text);
 		window.draw(monsters_killed_text);
 		window.draw(player_health_text);
+		EndWatchdogZone(recorders.watchdog, "draw");
 
 		// Swap backbuffer to front.
 		window.display();
+		EndWatchdogZone(recorders.watchdog, "display");
+		EndWatchdogFrame(recorders.watchdog, archetypes, sim);
+
+		// Drawn once more after the last change, so the screen shows it while idle. Fast forwarding
+		// runs straight on to the next spawn instead.
+		idle = !had_input && fast_forward.speed == 1 && IsQuiescent(sim);
+	}
+
+	if (pacer.frames > 0)
+	{
+		std::cout << "Frame pacing: " << pacer.frames << " frames, started " << pacer.error_total * 1e6 / pacer.frames << " us from their time on average, "
+				  << pacer.error_max * 1e6 << " us at worst, " << 100.0 * pacer.on_time / pacer.frames << "% within "
+				  << PACING_ON_TIME_SECONDS * 1e6f << " us; waited " << pacer.sleep_total << " s asleep and " << pacer.spin_total << " s spinning"
+				  << std::endl;
+	}
+
+	if (fast_forward.frames > 0)
+	{
+		std::cout << "Fast forward: " << fast_forward.ticks << " ticks in " << fast_forward.frames << " frames, "
+				  << (double)fast_forward.ticks / fast_forward.frames << " ticks a frame, " << fast_forward.dropped
+				  << " ticks dropped for lack of time" << std::endl;
+	}
+
+	if (!CloseRecorders(record, recorders))
+	{
+		return -1;
 	}
 
 	return 0;
-}
\ No newline at end of file
+}